@@ -20,5 +20,10 @@ var app = {
 		callback('/my/path/');
 	},
 
-	showInFileManager: function() {}
+	showInFileManager: function() {},
+
+	getResourceStats: function(callback)
+	{
+		callback([]);
+	}
 };
\ No newline at end of file
@@ -4,7 +4,7 @@ import os, sys
 
 
 base_id = 3000
-res_file_extensions = [ '.html', '.css', '.js', '.png', '.woff', '.ttf', '.svg', '.jpg', '.jpeg' ]
+res_file_extensions = [ '.html', '.css', '.js', '.png', '.woff', '.ttf', '.svg', '.jpg', '.jpeg', '.sha256' ]
 exclude_files = [ 'app\\js\\mock.app.js' ]
 
 
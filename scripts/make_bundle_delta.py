@@ -0,0 +1,119 @@
+# Create a delta which updates an app bundle (app.zip) to a new version
+#
+# Usage: make_bundle_delta.py <old app.zip> <new app.zip> <delta>
+#
+# The new bundle is described as ranges copied from the old one and literal
+# data: the old bundle is split into blocks, which are found in the new
+# bundle at any offset using a rolling checksum (as in rsync).
+# Stage the delta as "app.zip.delta" next to the installed bundle; it is
+# applied at the next start.
+
+import hashlib, struct, sys
+
+
+match_block_size = 2048
+verify_block_size = 1024 * 1024
+
+OP_COPY = 0
+OP_DATA = 1
+
+
+def weak_checksum(data):
+	a = sum(data) & 0xffff
+	b = sum((len(data) - i) * c for i, c in enumerate(data)) & 0xffff
+	return a, b
+
+
+def strong_checksum(data):
+	return hashlib.md5(data).digest()
+
+
+# ------------------------------------------------------------------------------
+# Find the blocks of the old bundle in the new bundle
+
+def compute_ops(old, new):
+	blocks = {}
+	for offset in range(0, len(old) - match_block_size + 1, match_block_size):
+		block = old[offset:offset + match_block_size]
+		a, b = weak_checksum(block)
+		blocks.setdefault((b << 16) | a, []).append(offset)
+
+	ops = []
+	literal_start = 0
+	pos = 0
+	n = match_block_size
+	a, b = weak_checksum(new[0:n]) if len(new) >= n else (0, 0)
+
+	while pos + n <= len(new):
+		match = None
+		candidates = blocks.get((b << 16) | a)
+		if candidates:
+			strong = strong_checksum(new[pos:pos + n])
+			for offset in candidates:
+				if strong_checksum(old[offset:offset + n]) == strong:
+					match = offset
+					break
+
+		if match is not None:
+			if literal_start < pos:
+				ops.append((OP_DATA, literal_start, pos - literal_start))
+
+			# merge with the previous copy if the ranges are adjacent
+			if ops and ops[-1][0] == OP_COPY and ops[-1][1] + ops[-1][2] == match:
+				ops[-1] = (OP_COPY, ops[-1][1], ops[-1][2] + n)
+			else:
+				ops.append((OP_COPY, match, n))
+
+			pos += n
+			literal_start = pos
+			if pos + n <= len(new):
+				a, b = weak_checksum(new[pos:pos + n])
+		else:
+			# roll the checksum by one byte
+			if pos + n < len(new):
+				out_byte = new[pos]
+				in_byte = new[pos + n]
+				a = (a - out_byte + in_byte) & 0xffff
+				b = (b - n * out_byte + a) & 0xffff
+			pos += 1
+
+	if literal_start < len(new):
+		ops.append((OP_DATA, literal_start, len(new) - literal_start))
+
+	return ops
+
+
+# ------------------------------------------------------------------------------
+# Write the delta
+
+def write_delta(old, new, ops, path):
+	out = open(path, 'wb')
+
+	num_blocks = (len(new) + verify_block_size - 1) // verify_block_size
+	out.write(b'ZDLT')
+	out.write(struct.pack('<IQQII', 1, len(old), len(new), verify_block_size, num_blocks))
+	for i in range(num_blocks):
+		out.write(hashlib.sha256(new[i * verify_block_size:(i + 1) * verify_block_size]).digest())
+
+	out.write(struct.pack('<I', len(ops)))
+	for op, offset, length in ops:
+		if op == OP_COPY:
+			out.write(struct.pack('<BQQ', OP_COPY, offset, length))
+		else:
+			out.write(struct.pack('<BQ', OP_DATA, length))
+			out.write(new[offset:offset + length])
+
+	out.close()
+
+
+if len(sys.argv) != 4:
+	print('Usage: make_bundle_delta.py <old app.zip> <new app.zip> <delta>')
+	sys.exit(1)
+
+old = open(sys.argv[1], 'rb').read()
+new = open(sys.argv[2], 'rb').read()
+ops = compute_ops(old, new)
+write_delta(old, new, ops, sys.argv[3])
+
+num_literal = sum(length for op, offset, length in ops if op == OP_DATA)
+print('%d operations, %d of %d bytes literal' % (len(ops), num_literal, len(new)))
@@ -0,0 +1,41 @@
+# Write the SHA-256 digests of all app resources to the integrity manifest
+#
+# Run this when building a release, after the last change to the app folder
+# (and before add_win_resources.py on Windows, so the manifest is compiled in).
+
+import hashlib, os
+
+
+manifest_name = 'integrity.sha256'
+app_dir = os.path.join('..', 'app')
+
+
+# ------------------------------------------------------------------------------
+# Hash the resource files
+
+lines = []
+for dirname, dirnames, filenames in os.walk(app_dir):
+	for filename in filenames:
+		path = os.path.join(dirname, filename)
+		name = os.path.relpath(path, app_dir).replace(os.sep, '/')
+		if name == manifest_name:
+			continue
+
+		sha = hashlib.sha256()
+		f = open(path, 'rb')
+		for chunk in iter(lambda: f.read(65536), b''):
+			sha.update(chunk)
+		f.close()
+
+		lines.append(sha.hexdigest() + '  ' + name + '\n')
+		print(name)
+
+lines.sort(key = lambda line: line[66:])
+
+
+# ------------------------------------------------------------------------------
+# Write the manifest (in the format of sha256sum)
+
+manifest = open(os.path.join(app_dir, manifest_name), 'w')
+manifest.writelines(lines)
+manifest.close()
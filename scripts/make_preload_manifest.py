@@ -0,0 +1,62 @@
+# Generate the preload manifest from the resources referenced by index.html
+
+import os, re, sys
+
+
+# the resources needed for the first page load are the ones referenced
+# statically by the start page
+start_page = 'index.html'
+preload_extensions = [ '.html', '.css', '.js', '.woff', '.ttf', '.svg' ]
+exclude_files = [ 'js/mock-app.js' ]
+
+app_dir = os.path.join('..', 'app')
+cpp_path = os.path.join('..', 'src', 'resource_preloader.cpp')
+
+
+# ------------------------------------------------------------------------------
+# Find the resources referenced by the start page
+
+html = open(os.path.join(app_dir, start_page), 'r').read()
+
+resfiles = [ start_page ]
+for match in re.finditer(r'<(?:script|link)\b[^>]*?\b(?:src|href)\s*=\s*["\']([^"\':?#]+)["\']', html, re.IGNORECASE):
+	path = match.group(1).lstrip('./')
+	if not os.path.splitext(path)[1] in preload_extensions:
+		continue
+	if path in exclude_files or path in resfiles:
+		continue
+	if not os.path.isfile(os.path.join(app_dir, path)):
+		continue
+
+	resfiles.append(path)
+	print(path)
+
+
+# ------------------------------------------------------------------------------
+# Write the manifest to the CPP file
+
+cppfile = open(cpp_path, 'r')
+cpplines = []
+adding_resources = False
+
+for line in cppfile:
+	# start adding lines after this marker again
+	if line.find('@PRELOAD_MANIFEST_END') >= 0:
+		adding_resources = False
+
+	if not adding_resources:
+		cpplines.append(line)
+
+	# add the resources; skip lines until marker
+	if line.find('@PRELOAD_MANIFEST_START') >= 0:
+		adding_resources = True
+
+		for resource in resfiles:
+			cpplines.append('    TEXT("' + resource + '"),\n')
+
+cppfile.close()
+
+# write it back
+cppfile = open(cpp_path, 'w')
+cppfile.writelines(cpplines)
+cppfile.close()
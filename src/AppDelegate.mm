@@ -25,6 +25,7 @@
 
 #import "GLMenuItem.h"
 
+#import "app.h"
 #import "native_extensions.h"
 
 
@@ -66,6 +67,12 @@ JSContextRef g_ctx = NULL;
     return NSTerminateNow;
 }
 
+- (void) applicationWillTerminate: (NSNotification*) aNotification
+{
+    // stop the background threads and complete pending writes
+    App::StopBackgroundThreads();
+}
+
 //
 // Don't quit the application when the window is closed.
 //
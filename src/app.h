@@ -87,6 +87,12 @@ void RemoveDemoMenuItems(WindowHandle wnd);
 //
 void Log(String msg);
 
+//
+// Stops the threads of the native extensions (completing pending writes) and
+// of the resource handling. Called when the application terminates.
+//
+void StopBackgroundThreads();
+
 //
 // Displays an error message.
 //
@@ -14,6 +14,9 @@
 
 #include "app.h"
 #include "client_handler.h"
+#include "bundle_update.h"
+#include "resource_integrity.h"
+#include "resource_preloader.h"
 #include "resource_util.h"
 #include "string_util.h"
 #include "extension_handler.h"
@@ -375,6 +378,18 @@ int main(int argc, char* argv[])
     // initialize the AutoRelease pool
     NSAutoreleasePool* autopool = [[NSAutoreleasePool alloc] init];
 
+    // declare the values substituted in HTML and CSS resources
+    RegisterResourcePlaceholders();
+
+    // update the app bundle before it is opened
+    BundleUpdate::ApplyPendingUpdate();
+
+    // start verifying the resources against the integrity manifest
+    ResourceIntegrity::Start();
+
+    // warm the critical resources while CEF is initializing
+    ResourcePreloader::Start();
+
     // initialize the ClientApplication instance
     [ClientApplication sharedApplication];
 
@@ -400,6 +415,7 @@ int main(int argc, char* argv[])
     g_isMessageLoopRunning = false;
 
     // shut down CEF
+    App::StopBackgroundThreads();
     if (g_handler != NULL)
         g_handler->ReleaseCefObjects();
     CefShutdown();
@@ -0,0 +1,73 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include "app.h"
+#include "directory_lister.h"
+#include "file_follower.h"
+#include "file_hasher.h"
+#include "file_search.h"
+#include "file_util.h"
+#include "file_watcher.h"
+#include "line_index.h"
+#include "native_extensions.h"
+#include "network_util.h"
+#include "read_stream.h"
+
+#ifndef USE_WEBVIEW
+#include "resource_integrity.h"
+#include "resource_preloader.h"
+#include "resource_stats.h"
+#endif
+
+
+namespace App {
+
+void StopBackgroundThreads()
+{
+    // close the streams and complete pending copies and writes first
+    ReadStream::CloseAll();
+    LineIndex::Stop();
+    FileUtil::StopCopier();
+    FileUtil::StopWriter();
+
+    DirectoryLister::Stop();
+    FileSearch::Stop();
+    FileHasher::Stop();
+    FileFollower::Stop();
+    FileWatcher::Stop();
+    ReleaseNativeExtensionCallbacks();
+
+    // the cache and the scheduler issue requests on the HTTP client
+    NetworkUtil::StopHttpCache();
+    NetworkUtil::StopScheduler();
+    NetworkUtil::StopHttpClient();
+
+#ifndef USE_WEBVIEW
+    ResourcePreloader::Stop();
+    ResourceIntegrity::Stop();
+    App::Log(TEXT("Resource requests: ") + ResourceStats::ToJSON());
+#endif
+}
+
+} // namespace App
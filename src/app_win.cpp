@@ -23,7 +23,10 @@
 #include "lib\Libcef\Include/cef_runnable.h"
 
 #include "app.h"
+#include "bundle_update.h"
 #include "client_handler.h"
+#include "resource_integrity.h"
+#include "resource_preloader.h"
 #include "resource_util.h"
 #include "extension_handler.h"
 #include "resource.h"
@@ -127,6 +130,18 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmd
 	if (exit_code >= 0)
 		return exit_code;
 
+	// declare the values substituted in HTML and CSS resources
+	RegisterResourcePlaceholders();
+
+	// update the app bundle before it is opened
+	BundleUpdate::ApplyPendingUpdate();
+
+	// start verifying the resources against the integrity manifest
+	ResourceIntegrity::Start();
+
+	// warm the critical resources while CEF is initializing
+	ResourcePreloader::Start();
+
 	// parse command line arguments
 	// the passed in values are ignored on Windows
 	App::InitCommandLine(0, NULL);
@@ -216,6 +231,7 @@ int CreateMainWindow()
 	}
 
 	g_isMessageLoopRunning = false;
+	App::StopBackgroundThreads();
 	g_handler->ReleaseCefObjects();
 	FreeResources();
 
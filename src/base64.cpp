@@ -21,7 +21,12 @@
 //     distribution.
 //
 
+//  Altered for Zephyros: SIMD (SSSE3, AVX2, NEON) encoding and decoding,
+//  and incremental encoders and decoders writing to caller-provided buffers.
+//
+
 #include <string.h>
+#include <algorithm>
 
 #include "types.h"
 
@@ -30,22 +35,24 @@
 #endif
 
 #include "base64.h"
+#include "simd_util.h"
 
 
 //
 // Mapping from 6 bit pattern to ASCII character.
 //
-static unsigned char base64EncodeLookup[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const unsigned char base64EncodeLookup[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 //
 // Definition for "masked-out" areas of the base64DecodeLookup mapping
+// (all values with the high bit set are invalid)
 //
-#define xx 65
+#define xx 0xFF
 
 //
 // Mapping from ASCII character to 6 bit pattern.
 //
-static unsigned char base64DecodeLookup[256] =
+static const unsigned char base64DecodeLookup[256] =
 {
     xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, 
     xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, xx, 
@@ -71,6 +78,546 @@ static unsigned char base64DecodeLookup[256] =
 #define BINARY_UNIT_SIZE 3
 #define BASE64_UNIT_SIZE 4
 
+
+//////////////////////////////////////////////////////////////////////////
+// Encoding and decoding kernels
+
+//
+// Each kernel encodes (or decodes) as many whole blocks as fit into "length"
+// and returns the number of input bytes processed; the rest is left for the
+// next kernel and finally for the scalar code. The encoders may read up to
+// "readable" bytes from src (which is at least "length"). The decoders stop at
+// the first block containing a character outside the base64 alphabet.
+//
+
+static void EncodeScalar(const uint8_t* src, size_t length, char* dst)
+{
+    for (size_t i = 0; i + BINARY_UNIT_SIZE <= length; i += BINARY_UNIT_SIZE)
+    {
+        uint32_t bits = ((uint32_t) src[i] << 16) | ((uint32_t) src[i + 1] << 8) | src[i + 2];
+        *dst++ = base64EncodeLookup[bits >> 18];
+        *dst++ = base64EncodeLookup[(bits >> 12) & 0x3F];
+        *dst++ = base64EncodeLookup[(bits >> 6) & 0x3F];
+        *dst++ = base64EncodeLookup[bits & 0x3F];
+    }
+}
+
+static size_t DecodeScalar(const uint8_t* src, size_t length, uint8_t* dst)
+{
+    size_t i = 0;
+    for ( ; i + BASE64_UNIT_SIZE <= length; i += BASE64_UNIT_SIZE)
+    {
+        uint32_t a = base64DecodeLookup[src[i]];
+        uint32_t b = base64DecodeLookup[src[i + 1]];
+        uint32_t c = base64DecodeLookup[src[i + 2]];
+        uint32_t d = base64DecodeLookup[src[i + 3]];
+        if ((a | b | c | d) & 0x80)
+            break;
+
+        uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+        *dst++ = (uint8_t) (bits >> 16);
+        *dst++ = (uint8_t) (bits >> 8);
+        *dst++ = (uint8_t) bits;
+    }
+
+    return i;
+}
+
+#ifdef SIMD_USE_SSSE3
+//
+// The SIMD algorithms are the ones described by Wojciech Muła and Daniel
+// Lemire in "Faster Base64 Encoding and Decoding using AVX2 Instructions".
+//
+
+//
+// Maps 12 bytes (in the low 12 bytes of "in") to 16 6-bit indices.
+//
+SIMD_TARGET_SSSE3 static inline __m128i EncodeIndicesSSSE3(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+//
+// Maps 6-bit indices to the characters of the base64 alphabet.
+//
+SIMD_TARGET_SSSE3 static inline __m128i EncodeCharsSSSE3(__m128i indices)
+{
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i offsetIndex = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    offsetIndex = _mm_or_si128(offsetIndex, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+    const __m128i offsets = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, offsetIndex));
+}
+
+SIMD_TARGET_SSSE3 static size_t EncodeSSSE3(const uint8_t* src, size_t length, size_t readable, char* dst)
+{
+    size_t i = 0;
+    for ( ; i + 12 <= length && i + 16 <= readable; i += 12, dst += 16)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i*) (src + i));
+        _mm_storeu_si128((__m128i*) dst, EncodeCharsSSSE3(EncodeIndicesSSSE3(in)));
+    }
+
+    return i;
+}
+
+//
+// Maps 16 characters to their 6-bit values and returns false if any of them
+// isn't part of the base64 alphabet.
+//
+SIMD_TARGET_SSSE3 static inline bool DecodeValuesSSSE3(__m128i& in)
+{
+    const __m128i lutLo = _mm_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2f);
+
+    __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+    __m128i lo = _mm_shuffle_epi8(lutLo, _mm_and_si128(in, mask2F));
+    __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+
+    // a character is invalid if its entries in both tables have a common bit
+    // (_mm_testz_si128 would need SSE4.1)
+    __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+    if (_mm_movemask_epi8(invalid) != 0xFFFF)
+        return false;
+
+    __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(in, mask2F), hiNibbles));
+    in = _mm_add_epi8(in, roll);
+    return true;
+}
+
+//
+// Packs 16 6-bit values into 12 bytes (in the low 12 bytes of the result).
+//
+SIMD_TARGET_SSSE3 static inline __m128i DecodePackSSSE3(__m128i values)
+{
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+SIMD_TARGET_SSSE3 static size_t DecodeSSSE3(const uint8_t* src, size_t length, uint8_t* dst)
+{
+    size_t i = 0;
+    for ( ; i + 16 <= length; i += 16, dst += 12)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i*) (src + i));
+        if (!DecodeValuesSSSE3(in))
+            break;
+
+        // store exactly 12 bytes
+        __m128i out = DecodePackSSSE3(in);
+        _mm_storel_epi64((__m128i*) dst, out);
+        uint32_t last = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+        memcpy(dst + 8, &last, 4);
+    }
+
+    return i;
+}
+#endif
+
+#ifdef SIMD_USE_AVX2
+SIMD_TARGET_AVX2 static size_t EncodeAVX2(const uint8_t* src, size_t length, size_t readable, char* dst)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    size_t i = 0;
+    for ( ; i + 24 <= length && i + 28 <= readable; i += 24, dst += 32)
+    {
+        // 12 bytes in each lane
+        __m256i in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (src + i))),
+            _mm_loadu_si128((const __m128i*) (src + i + 12)), 1);
+
+        in = _mm256_shuffle_epi8(in, shuffle);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t0, t1);
+
+        __m256i offsetIndex = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        offsetIndex = _mm256_or_si256(offsetIndex, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*) dst, _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, offsetIndex)));
+    }
+
+    return i;
+}
+
+SIMD_TARGET_AVX2 static size_t DecodeAVX2(const uint8_t* src, size_t length, uint8_t* dst)
+{
+    const __m256i lutLo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i shuffle = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i mask2F = _mm256_set1_epi8(0x2f);
+
+    size_t i = 0;
+    for ( ; i + 32 <= length; i += 32, dst += 24)
+    {
+        __m256i in = _mm256_loadu_si256((const __m256i*) (src + i));
+
+        __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask2F);
+        __m256i lo = _mm256_shuffle_epi8(lutLo, _mm256_and_si256(in, mask2F));
+        __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+
+        __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, mask2F), hiNibbles));
+        __m256i values = _mm256_add_epi8(in, roll);
+
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, shuffle);
+
+        // move the 12 bytes of each lane together and store exactly 24 bytes
+        __m256i out = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm_storeu_si128((__m128i*) dst, _mm256_castsi256_si128(out));
+        _mm_storel_epi64((__m128i*) (dst + 16), _mm256_extracti128_si256(out, 1));
+    }
+
+    return i;
+}
+#endif
+
+#ifdef SIMD_USE_NEON
+static size_t EncodeNEON(const uint8_t* src, size_t length, size_t readable, char* dst)
+{
+    uint8x16x4_t lut;
+    for (int k = 0; k < 4; k++)
+        lut.val[k] = vld1q_u8(base64EncodeLookup + 16 * k);
+    const uint8x16_t mask3F = vdupq_n_u8(0x3F);
+
+    size_t i = 0;
+    for ( ; i + 48 <= length; i += 48, dst += 64)
+    {
+        // load 16 groups of 3 bytes, de-interleaved
+        uint8x16x3_t in = vld3q_u8(src + i);
+
+        uint8x16x4_t out;
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshrq_n_u8(in.val[1], 4), vshlq_n_u8(in.val[0], 4)), mask3F);
+        out.val[2] = vandq_u8(vorrq_u8(vshrq_n_u8(in.val[2], 6), vshlq_n_u8(in.val[1], 2)), mask3F);
+        out.val[3] = vandq_u8(in.val[2], mask3F);
+        for (int k = 0; k < 4; k++)
+            out.val[k] = vqtbl4q_u8(lut, out.val[k]);
+
+        vst4q_u8((uint8_t*) dst, out);
+    }
+
+    return i;
+}
+
+static size_t DecodeNEON(const uint8_t* src, size_t length, uint8_t* dst)
+{
+    // the characters of the alphabet are all below 128
+    uint8x16x4_t lutLo, lutHi;
+    for (int k = 0; k < 4; k++)
+    {
+        lutLo.val[k] = vld1q_u8(base64DecodeLookup + 16 * k);
+        lutHi.val[k] = vld1q_u8(base64DecodeLookup + 64 + 16 * k);
+    }
+    const uint8x16_t offset = vdupq_n_u8(64);
+
+    size_t i = 0;
+    for ( ; i + 64 <= length; i += 64, dst += 48)
+    {
+        // load 16 groups of 4 characters, de-interleaved
+        uint8x16x4_t in = vld4q_u8(src + i);
+
+        // vqtbl4q_u8 yields 0 for characters >= 64, which vqtbx4q_u8 replaces
+        // for the characters from 64 to 127; characters >= 128 are detected
+        // by their high bit
+        uint8x16_t invalid = vdupq_n_u8(0);
+        uint8x16x4_t values;
+        for (int k = 0; k < 4; k++)
+        {
+            values.val[k] = vqtbx4q_u8(vqtbl4q_u8(lutLo, in.val[k]), lutHi, vsubq_u8(in.val[k], offset));
+            invalid = vorrq_u8(invalid, vorrq_u8(values.val[k], in.val[k]));
+        }
+        if (vmaxvq_u8(invalid) & 0x80)
+            break;
+
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(values.val[0], 2), vshrq_n_u8(values.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(values.val[1], 4), vshrq_n_u8(values.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(values.val[2], 6), values.val[3]);
+        vst3q_u8(dst, out);
+    }
+
+    return i;
+}
+#endif
+
+#ifdef SIMD_USE_SSSE3
+static const bool g_hasSSSE3 = HasSSSE3();
+#endif
+#ifdef SIMD_USE_AVX2
+static const bool g_hasAVX2 = HasAVX2();
+#endif
+
+//
+// Encodes "length" bytes (a multiple of BINARY_UNIT_SIZE) with the fastest
+// kernel the CPU supports.
+//
+static void EncodeBlocks(const uint8_t* src, size_t length, size_t readable, char* dst)
+{
+    size_t i = 0;
+
+#ifdef SIMD_USE_AVX2
+    if (g_hasAVX2)
+        i = EncodeAVX2(src, length, readable, dst);
+#endif
+#ifdef SIMD_USE_SSSE3
+    if (g_hasSSSE3)
+        i += EncodeSSSE3(src + i, length - i, readable - i, dst + i / BINARY_UNIT_SIZE * BASE64_UNIT_SIZE);
+#endif
+#ifdef SIMD_USE_NEON
+    i = EncodeNEON(src, length, readable, dst);
+#endif
+
+    EncodeScalar(src + i, length - i, dst + i / BINARY_UNIT_SIZE * BASE64_UNIT_SIZE);
+}
+
+//
+// Decodes characters up to the first invalid one (or the end) in blocks of
+// BASE64_UNIT_SIZE characters and returns the number of characters decoded.
+//
+static size_t DecodeBlocks(const uint8_t* src, size_t length, uint8_t* dst)
+{
+    size_t i = 0;
+
+#ifdef SIMD_USE_AVX2
+    if (g_hasAVX2)
+        i = DecodeAVX2(src, length, dst);
+#endif
+#ifdef SIMD_USE_SSSE3
+    if (g_hasSSSE3)
+        i += DecodeSSSE3(src + i, length - i, dst + i / BASE64_UNIT_SIZE * BINARY_UNIT_SIZE);
+#endif
+#ifdef SIMD_USE_NEON
+    i = DecodeNEON(src, length, dst);
+#endif
+
+    return i + DecodeScalar(src + i, length - i, dst + i / BASE64_UNIT_SIZE * BINARY_UNIT_SIZE);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Base64Encoder Implementation
+
+Base64Encoder::Base64Encoder(bool separateLines)
+    : m_separateLines(separateLines), m_lineLength(0), m_bufferLength(0)
+{
+}
+
+size_t Base64Encoder::GetMaxEncodedLength(size_t length) const
+{
+    size_t numChars = (m_bufferLength + length) / BINARY_UNIT_SIZE * BASE64_UNIT_SIZE;
+    if (m_separateLines)
+        numChars += (m_lineLength + numChars) / BASE64_LINE_LENGTH * 2;
+    return numChars;
+}
+
+size_t Base64Encoder::Update(const void* data, size_t length, char* output)
+{
+    const uint8_t* p = (const uint8_t*) data;
+    char* out = output;
+
+    // complete the group kept from the last call
+    if (m_bufferLength > 0)
+    {
+        while (m_bufferLength < BINARY_UNIT_SIZE && length > 0)
+        {
+            m_buffer[m_bufferLength++] = *p++;
+            length--;
+        }
+
+        if (m_bufferLength < BINARY_UNIT_SIZE)
+            return 0;
+
+        out = BreakLine(out, BASE64_UNIT_SIZE);
+        EncodeScalar(m_buffer, BINARY_UNIT_SIZE, out);
+        out += BASE64_UNIT_SIZE;
+        m_bufferLength = 0;
+    }
+
+    // encode the whole groups line by line
+    size_t numBytes = length - length % BINARY_UNIT_SIZE;
+    while (numBytes > 0)
+    {
+        size_t n = numBytes;
+        if (m_separateLines)
+        {
+            size_t lineLength = m_lineLength == BASE64_LINE_LENGTH ? 0 : m_lineLength;
+            n = (std::min)(n, (BASE64_LINE_LENGTH - lineLength) / BASE64_UNIT_SIZE * BINARY_UNIT_SIZE);
+        }
+
+        size_t numChars = n / BINARY_UNIT_SIZE * BASE64_UNIT_SIZE;
+        out = BreakLine(out, numChars);
+        EncodeBlocks(p, n, length, out);
+
+        p += n;
+        out += numChars;
+        length -= n;
+        numBytes -= n;
+    }
+
+    // keep the rest for the next call
+    memcpy(m_buffer, p, length);
+    m_bufferLength = length;
+
+    return out - output;
+}
+
+size_t Base64Encoder::Final(char* output)
+{
+    char* out = output;
+
+    if (m_bufferLength > 0)
+    {
+        out = BreakLine(out, BASE64_UNIT_SIZE);
+
+        uint8_t a = m_buffer[0];
+        uint8_t b = m_bufferLength > 1 ? m_buffer[1] : 0;
+        *out++ = base64EncodeLookup[a >> 2];
+        *out++ = base64EncodeLookup[((a & 0x03) << 4) | (b >> 4)];
+        *out++ = m_bufferLength > 1 ? base64EncodeLookup[(b & 0x0F) << 2] : '=';
+        *out++ = '=';
+    }
+
+    m_lineLength = 0;
+    m_bufferLength = 0;
+
+    return out - output;
+}
+
+//
+// Starts a new line (if lines are separated and the current one is full)
+// before numChars characters are written, and returns the new output position.
+//
+char* Base64Encoder::BreakLine(char* output, size_t numChars)
+{
+    if (m_separateLines)
+    {
+        if (m_lineLength == BASE64_LINE_LENGTH)
+        {
+            *output++ = '\r';
+            *output++ = '\n';
+            m_lineLength = 0;
+        }
+
+        m_lineLength += numChars;
+    }
+
+    return output;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Base64Decoder Implementation
+
+Base64Decoder::Base64Decoder()
+    : m_bits(0), m_numChars(0)
+{
+}
+
+size_t Base64Decoder::GetMaxDecodedLength(size_t length) const
+{
+    return (m_numChars + length) / BASE64_UNIT_SIZE * BINARY_UNIT_SIZE;
+}
+
+size_t Base64Decoder::Update(const char* data, size_t length, void* output)
+{
+    const uint8_t* p = (const uint8_t*) data;
+    const uint8_t* end = p + length;
+    uint8_t* out = (uint8_t*) output;
+
+    while (p < end)
+    {
+        // at the start of a group, decode the valid characters in blocks
+        if (m_numChars == 0)
+        {
+            size_t n = DecodeBlocks(p, end - p, out);
+            p += n;
+            out += n / BASE64_UNIT_SIZE * BINARY_UNIT_SIZE;
+
+            if (p == end)
+                break;
+        }
+
+        // skip everything which isn't part of the alphabet
+        uint8_t value = base64DecodeLookup[*p++];
+        if (value & 0x80)
+            continue;
+
+        m_bits = (m_bits << 6) | value;
+        if (++m_numChars == BASE64_UNIT_SIZE)
+        {
+            *out++ = (uint8_t) (m_bits >> 16);
+            *out++ = (uint8_t) (m_bits >> 8);
+            *out++ = (uint8_t) m_bits;
+            m_bits = 0;
+            m_numChars = 0;
+        }
+    }
+
+    return out - (uint8_t*) output;
+}
+
+size_t Base64Decoder::Final(void* output)
+{
+    uint8_t* out = (uint8_t*) output;
+
+    // 2 characters make 1 byte, 3 characters 2 bytes; a single character
+    // isn't enough for a byte
+    if (m_numChars == 2)
+        *out++ = (uint8_t) (m_bits >> 4);
+    else if (m_numChars == 3)
+    {
+        *out++ = (uint8_t) (m_bits >> 10);
+        *out++ = (uint8_t) (m_bits >> 2);
+    }
+
+    m_bits = 0;
+    m_numChars = 0;
+
+    return out - (uint8_t*) output;
+}
+
+
 //
 // NewBase64Decode
 //
@@ -97,45 +644,15 @@ void *NewBase64Decode(
 	size_t outputBufferSize =
 		((length+BASE64_UNIT_SIZE-1) / BASE64_UNIT_SIZE) * BINARY_UNIT_SIZE;
 	unsigned char *outputBuffer = (unsigned char *)malloc(outputBufferSize);
-	
-	size_t i = 0;
-	size_t j = 0;
-	while (i < length)
+	if (!outputBuffer)
 	{
-		//
-		// Accumulate 4 valid characters (ignore everything else)
-		//
-		unsigned char accumulated[BASE64_UNIT_SIZE];
-		size_t accumulateIndex = 0;
-		while (i < length)
-		{
-			unsigned char decode = base64DecodeLookup[(int) inputBuffer[i++]];
-			if (decode != xx)
-			{
-				accumulated[accumulateIndex] = decode;
-				accumulateIndex++;
-				
-				if (accumulateIndex == BASE64_UNIT_SIZE)
-				{
-					break;
-				}
-			}
-		}
-		
-		//
-		// Store the 6 bits from each of the 4 characters as 3 bytes
-		//
-		// (Uses improved bounds checking suggested by Alexandre Colucci)
-		//
-		if(accumulateIndex >= 2)  
-			outputBuffer[j] = (accumulated[0] << 2) | (accumulated[1] >> 4);  
-		if(accumulateIndex >= 3)  
-			outputBuffer[j + 1] = (accumulated[1] << 4) | (accumulated[2] >> 2);  
-		if(accumulateIndex >= 4)  
-			outputBuffer[j + 2] = (accumulated[2] << 6) | accumulated[3];
-		j += accumulateIndex - 1;
+		return NULL;
 	}
 	
+	Base64Decoder decoder;
+	size_t j = decoder.Update(inputBuffer, length, outputBuffer);
+	j += decoder.Final(outputBuffer + j);
+	
 	if (outputLength)
 	{
 		*outputLength = j;
@@ -165,11 +682,6 @@ char *NewBase64Encode(
 	bool separateLines,
 	size_t *outputLength)
 {
-	const unsigned char *inputBuffer = (const unsigned char *)buffer;
-	
-	#define MAX_NUM_PADDING_CHARS 2
-	#define OUTPUT_LINE_LENGTH 64
-	#define INPUT_LINE_LENGTH ((OUTPUT_LINE_LENGTH / BASE64_UNIT_SIZE) * BINARY_UNIT_SIZE)
 	#define CR_LF_SIZE 2
 	
 	//
@@ -182,7 +694,7 @@ char *NewBase64Encode(
 	if (separateLines)
 	{
 		outputBufferSize +=
-			(outputBufferSize / OUTPUT_LINE_LENGTH) * CR_LF_SIZE;
+			(outputBufferSize / BASE64_LINE_LENGTH) * CR_LF_SIZE;
 	}
 	
 	//
@@ -199,65 +711,9 @@ char *NewBase64Encode(
 		return NULL;
 	}
 
-	size_t i = 0;
-	size_t j = 0;
-	const size_t lineLength = separateLines ? INPUT_LINE_LENGTH : length;
-	size_t lineEnd = lineLength;
-	
-	while (true)
-	{
-		if (lineEnd > length)
-		{
-			lineEnd = length;
-		}
-
-		for (; i + BINARY_UNIT_SIZE - 1 < lineEnd; i += BINARY_UNIT_SIZE)
-		{
-			//
-			// Inner loop: turn 48 bytes into 64 base64 characters
-			//
-			outputBuffer[j++] = base64EncodeLookup[(inputBuffer[i] & 0xFC) >> 2];
-			outputBuffer[j++] = base64EncodeLookup[((inputBuffer[i] & 0x03) << 4)
-				| ((inputBuffer[i + 1] & 0xF0) >> 4)];
-			outputBuffer[j++] = base64EncodeLookup[((inputBuffer[i + 1] & 0x0F) << 2)
-				| ((inputBuffer[i + 2] & 0xC0) >> 6)];
-			outputBuffer[j++] = base64EncodeLookup[inputBuffer[i + 2] & 0x3F];
-		}
-		
-		if (lineEnd == length)
-		{
-			break;
-		}
-		
-		//
-		// Add the newline
-		//
-		outputBuffer[j++] = '\r';
-		outputBuffer[j++] = '\n';
-		lineEnd += lineLength;
-	}
-	
-	if (i + 1 < length)
-	{
-		//
-		// Handle the single '=' case
-		//
-		outputBuffer[j++] = base64EncodeLookup[(inputBuffer[i] & 0xFC) >> 2];
-		outputBuffer[j++] = base64EncodeLookup[((inputBuffer[i] & 0x03) << 4)
-			| ((inputBuffer[i + 1] & 0xF0) >> 4)];
-		outputBuffer[j++] = base64EncodeLookup[(inputBuffer[i + 1] & 0x0F) << 2];
-		outputBuffer[j++] =	'=';
-	}
-	else if (i < length)
-	{
-		//
-		// Handle the double '=' case
-		//
-		outputBuffer[j++] = base64EncodeLookup[(inputBuffer[i] & 0xFC) >> 2];
-		outputBuffer[j++] = base64EncodeLookup[(inputBuffer[i] & 0x03) << 4];
-		outputBuffer[j++] = '=';
-		outputBuffer[j++] = '=';
-	}
+	Base64Encoder encoder(separateLines);
+	size_t j = encoder.Update(buffer, length, outputBuffer);
+	j += encoder.Final(outputBuffer + j);
 	outputBuffer[j] = 0;
 	
 	//
@@ -21,5 +21,99 @@
 //     distribution.
 //
 
+//  Altered for Zephyros: SIMD (SSSE3, AVX2, NEON) encoding and decoding,
+//  and incremental encoders and decoders writing to caller-provided buffers.
+//
+
+#ifndef __base64_h
+#define __base64_h
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// The number of characters per line if lines are separated (by CR/LF)
+#define BASE64_LINE_LENGTH 64
+
+// The maximum number of characters Base64Encoder::Final writes
+#define BASE64_MAX_FINAL_ENCODED_LENGTH 6
+
+
 void* NewBase64Decode(const char* inputBuffer, size_t length, size_t* outputLength);
 char* NewBase64Encode(const void* inputBuffer, size_t length, bool separateLines, size_t* outputLength);
+
+//
+// Encodes data passed in pieces. If separateLines is set, a CR/LF pair is
+// inserted after every BASE64_LINE_LENGTH characters (but not at the end).
+//
+class Base64Encoder
+{
+public:
+    Base64Encoder(bool separateLines = false);
+
+    //
+    // Returns the maximum number of characters Update writes for "length"
+    // bytes.
+    //
+    size_t GetMaxEncodedLength(size_t length) const;
+
+    //
+    // Encodes the data (up to 2 bytes are kept for the next call) and returns
+    // the number of characters written to output.
+    //
+    size_t Update(const void* data, size_t length, char* output);
+
+    //
+    // Encodes the bytes kept from the last call with padding and returns the
+    // number of characters written to output (at most
+    // BASE64_MAX_FINAL_ENCODED_LENGTH). The encoder can be used for new data
+    // afterwards.
+    //
+    size_t Final(char* output);
+
+private:
+    char* BreakLine(char* output, size_t numChars);
+
+private:
+    bool m_separateLines;
+    size_t m_lineLength;
+    uint8_t m_buffer[3];
+    size_t m_bufferLength;
+};
+
+//
+// Decodes base64 text passed in pieces. Characters which aren't part of the
+// base64 alphabet (line breaks, white space and padding) are skipped.
+//
+class Base64Decoder
+{
+public:
+    Base64Decoder();
+
+    //
+    // Returns the maximum number of bytes Update writes for "length"
+    // characters.
+    //
+    size_t GetMaxDecodedLength(size_t length) const;
+
+    //
+    // Decodes the characters (up to 3 are kept for the next call) and returns
+    // the number of bytes written to output.
+    //
+    size_t Update(const char* data, size_t length, void* output);
+
+    //
+    // Decodes the characters kept from the last call and returns the number
+    // of bytes written to output (at most 2). The decoder can be used for new
+    // data afterwards.
+    //
+    size_t Final(void* output);
+
+private:
+    uint32_t m_bits;
+    size_t m_numChars;
+};
+
+
+#endif
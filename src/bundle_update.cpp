@@ -0,0 +1,351 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef OS_WIN
+#include <windows.h>
+#include <io.h>
+#include <tchar.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <vector>
+
+#include "bundle_update.h"
+#include "hash_util.h"
+#include "resource_util.h"
+#include "worker_pool.h"
+#include "app.h"
+
+
+#define DELTA_MAGIC "ZDLT"
+#define DELTA_VERSION 1
+
+#define DELTA_OP_COPY 0
+#define DELTA_OP_DATA 1
+
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+
+namespace BundleUpdate {
+
+static bool SeekFile(FILE* file, uint64_t offset)
+{
+#ifdef OS_WIN
+    return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+static bool GetFileSize(FILE* file, uint64_t& size)
+{
+#ifdef OS_WIN
+    if (_fseeki64(file, 0, SEEK_END) != 0)
+        return false;
+    size = (uint64_t) _ftelli64(file);
+#else
+    if (fseeko(file, 0, SEEK_END) != 0)
+        return false;
+    size = (uint64_t) ftello(file);
+#endif
+    return SeekFile(file, 0);
+}
+
+//
+// Flushes the file's data to the disk, so the rename can't be persisted
+// before the contents.
+//
+static bool SyncFile(FILE* file)
+{
+    if (fflush(file) != 0)
+        return false;
+#ifdef OS_WIN
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+//
+// Atomically replaces the file at path with the file at newPath.
+//
+static bool MoveIntoPlace(const String& newPath, const String& path)
+{
+#ifdef OS_WIN
+    return MoveFileEx(newPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(newPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+static bool ReadUInt8(FILE* file, uint8_t& value)
+{
+    return fread(&value, 1, 1, file) == 1;
+}
+
+static bool ReadUInt32(FILE* file, uint32_t& value)
+{
+    uint8_t buf[4];
+    if (fread(buf, 1, 4, file) != 4)
+        return false;
+    value = (uint32_t) buf[0] | ((uint32_t) buf[1] << 8) | ((uint32_t) buf[2] << 16) | ((uint32_t) buf[3] << 24);
+    return true;
+}
+
+static bool ReadUInt64(FILE* file, uint64_t& value)
+{
+    uint32_t lo, hi;
+    if (!ReadUInt32(file, lo) || !ReadUInt32(file, hi))
+        return false;
+    value = (uint64_t) lo | ((uint64_t) hi << 32);
+    return true;
+}
+
+//
+// Copies length bytes from src (at its current position) to dest.
+//
+static bool CopyBytes(FILE* src, FILE* dest, uint64_t length, std::vector<char>& buf)
+{
+    while (length > 0)
+    {
+        size_t len = length < buf.size() ? (size_t) length : buf.size();
+        if (fread(&buf[0], 1, len, src) != len || fwrite(&buf[0], 1, len, dest) != len)
+            return false;
+        length -= len;
+    }
+
+    return true;
+}
+
+//
+// Hashes the blocks of the file on a worker pool and compares them to the
+// expected hashes. Returns the number of blocks which don't match.
+//
+static int VerifyBlocks(const String& path, uint64_t size, uint32_t blockSize, const std::vector<uint8_t>& hashes)
+{
+    int numBlocks = (int) (hashes.size() / SHA256_DIGEST_SIZE);
+    std::atomic<int> numMismatches(0);
+
+    {
+        WorkerPool pool(numBlocks < (int) std::thread::hardware_concurrency() ? numBlocks : 0);
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            pool.Post([&path, &hashes, &numMismatches, size, blockSize, i]()
+            {
+                uint64_t offset = (uint64_t) i * blockSize;
+                uint64_t length = size - offset < blockSize ? size - offset : blockSize;
+
+                FILE* file = _tfopen(path.c_str(), TEXT("rb"));
+                if (!file)
+                {
+                    ++numMismatches;
+                    return;
+                }
+
+                HashUtil::Sha256 sha;
+                bool success = SeekFile(file, offset);
+
+                char buf[COPY_BUFFER_SIZE];
+                while (success && length > 0)
+                {
+                    size_t len = length < sizeof(buf) ? (size_t) length : sizeof(buf);
+                    success = fread(buf, 1, len, file) == len;
+                    sha.Update(buf, len);
+                    length -= len;
+                }
+
+                fclose(file);
+
+                uint8_t digest[SHA256_DIGEST_SIZE];
+                sha.Final(digest);
+                if (!success || memcmp(digest, &hashes[i * SHA256_DIGEST_SIZE], SHA256_DIGEST_SIZE) != 0)
+                    ++numMismatches;
+            });
+        }
+
+        pool.Wait();
+    }
+
+    return numMismatches;
+}
+
+//
+// Writes the target described by the delta to newPath.
+//
+static bool WriteTarget(FILE* delta, FILE* source, const String& newPath, uint64_t targetSize, String& error)
+{
+    FILE* target = _tfopen(newPath.c_str(), TEXT("wb"));
+    if (!target)
+    {
+        error = TEXT("Can't create ") + newPath;
+        return false;
+    }
+
+    uint32_t numOps = 0;
+    bool success = ReadUInt32(delta, numOps);
+    uint64_t numWritten = 0;
+    std::vector<char> buf(COPY_BUFFER_SIZE);
+
+    for (uint32_t i = 0; success && i < numOps; ++i)
+    {
+        uint8_t op;
+        uint64_t offset, length;
+
+        if (!ReadUInt8(delta, op))
+            success = false;
+        else if (op == DELTA_OP_COPY)
+        {
+            success = ReadUInt64(delta, offset) && ReadUInt64(delta, length) &&
+                SeekFile(source, offset) && CopyBytes(source, target, length, buf);
+        }
+        else if (op == DELTA_OP_DATA)
+            success = ReadUInt64(delta, length) && CopyBytes(delta, target, length, buf);
+        else
+            success = false;
+
+        if (success)
+            numWritten += length;
+    }
+
+    if (!success)
+        error = TEXT("The delta is corrupt or doesn't match the installed bundle");
+    else if (numWritten != targetSize)
+    {
+        error = TEXT("The size of the updated bundle doesn't match");
+        success = false;
+    }
+    else if (!SyncFile(target))
+    {
+        error = TEXT("Can't write ") + newPath;
+        success = false;
+    }
+
+    fclose(target);
+    return success;
+}
+
+
+bool ApplyDelta(const String& bundlePath, const String& deltaPath, String& error)
+{
+    FILE* delta = _tfopen(deltaPath.c_str(), TEXT("rb"));
+    if (!delta)
+    {
+        error = TEXT("Can't open ") + deltaPath;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0, blockSize = 0, numBlocks = 0;
+    uint64_t sourceSize = 0, targetSize = 0;
+    std::vector<uint8_t> hashes;
+
+    bool success = fread(magic, 1, 4, delta) == 4 && memcmp(magic, DELTA_MAGIC, 4) == 0 &&
+        ReadUInt32(delta, version) && version == DELTA_VERSION &&
+        ReadUInt64(delta, sourceSize) && ReadUInt64(delta, targetSize) &&
+        ReadUInt32(delta, blockSize) && ReadUInt32(delta, numBlocks) && blockSize > 0 &&
+        (uint64_t) numBlocks == (targetSize + blockSize - 1) / blockSize;
+
+    if (success)
+    {
+        hashes.resize((size_t) numBlocks * SHA256_DIGEST_SIZE);
+        success = hashes.empty() || fread(&hashes[0], 1, hashes.size(), delta) == hashes.size();
+    }
+
+    if (!success)
+    {
+        fclose(delta);
+        error = TEXT("Not a valid bundle delta: ") + deltaPath;
+        return false;
+    }
+
+    FILE* source = _tfopen(bundlePath.c_str(), TEXT("rb"));
+    uint64_t size = 0;
+    if (!source || !GetFileSize(source, size) || size != sourceSize)
+    {
+        if (source)
+            fclose(source);
+        fclose(delta);
+        error = TEXT("The delta doesn't apply to the installed bundle");
+        return false;
+    }
+
+    String newPath = bundlePath + BUNDLE_UPDATE_SUFFIX;
+    success = WriteTarget(delta, source, newPath, targetSize, error);
+
+    fclose(source);
+    fclose(delta);
+
+    if (success)
+    {
+        int numMismatches = VerifyBlocks(newPath, targetSize, blockSize, hashes);
+        if (numMismatches > 0)
+        {
+            StringStream ss;
+            ss << numMismatches << TEXT(" blocks of the updated bundle don't verify");
+            error = ss.str();
+            success = false;
+        }
+    }
+
+    if (success && !MoveIntoPlace(newPath, bundlePath))
+    {
+        error = TEXT("Can't replace ") + bundlePath;
+        success = false;
+    }
+
+    if (!success)
+        _tremove(newPath.c_str());
+
+    return success;
+}
+
+void ApplyPendingUpdate()
+{
+    String bundlePath;
+    if (!GetAppBundlePath(bundlePath))
+        return;
+
+    String deltaPath = bundlePath + BUNDLE_DELTA_SUFFIX;
+    FILE* file = _tfopen(deltaPath.c_str(), TEXT("rb"));
+    if (!file)
+        return;
+    fclose(file);
+
+    String error;
+    if (ApplyDelta(bundlePath, deltaPath, error))
+        App::Log(TEXT("Applied bundle update ") + deltaPath);
+    else
+        App::Log(TEXT("Failed to apply bundle update: ") + error);
+
+    // a delta which doesn't apply won't apply on the next start either
+    _tremove(deltaPath.c_str());
+}
+
+} // namespace BundleUpdate
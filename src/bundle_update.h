@@ -0,0 +1,81 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __bundle_update_h
+#define __bundle_update_h
+
+
+#include "types.h"
+
+
+// Suffix of a delta staged for the next start (e.g., "app.zip.delta")
+#define BUNDLE_DELTA_SUFFIX TEXT(".delta")
+
+// Suffix of the file the updated bundle is written to before it replaces the bundle
+#define BUNDLE_UPDATE_SUFFIX TEXT(".new")
+
+
+//
+// Block-level delta updates of the app's zip bundle.
+//
+// A delta, created by scripts/make_bundle_delta.py, describes the new bundle
+// as a sequence of ranges copied from the installed bundle and literal data
+// for the parts which have changed, so only the changed bytes have to be
+// downloaded. The new bundle is written next to the installed one, its
+// SHA-256 block hashes are verified in parallel, and it is moved into place
+// with a single atomic rename.
+//
+// Delta file format (all integers little endian):
+//
+//     "ZDLT"               magic
+//     uint32               version (1)
+//     uint64               size of the source bundle
+//     uint64               size of the target bundle
+//     uint32               block size used for the target hashes
+//     uint32               number of blocks
+//     uint8[32] * n        SHA-256 of each target block
+//     uint32               number of operations
+//     operations:
+//         uint8 0, uint64 offset, uint64 length    copy from the source
+//         uint8 1, uint64 length, data             literal data
+//
+namespace BundleUpdate {
+
+//
+// Applies the delta at deltaPath to the bundle at bundlePath, replacing
+// the bundle. The bundle is left untouched if the delta doesn't apply or
+// the result doesn't verify; error is set to the reason in this case.
+//
+bool ApplyDelta(const String& bundlePath, const String& deltaPath, String& error);
+
+//
+// Applies a delta staged next to the app's bundle, if any, and removes it.
+// Must be called at startup before the bundle is opened.
+//
+void ApplyPendingUpdate();
+
+} // namespace BundleUpdate
+
+
+#endif
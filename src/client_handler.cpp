@@ -38,11 +38,17 @@
 #include "lib\Libcef\Include/cef_runnable.h"
 #include "lib\Libcef\Include/cef_trace.h"
 #include "lib\Libcef\Include/cef_url.h"
+#include "lib\Libcef\Include/wrapper/cef_byte_read_handler.h"
 #include "lib\Libcef\Include/wrapper/cef_stream_resource_handler.h"
 
 #include "app.h"
 #include "client_handler.h"
 #include "extension_handler.h"
+#include "resource_cache.h"
+#include "resource_filter.h"
+#include "resource_integrity.h"
+#include "resource_preloader.h"
+#include "resource_stats.h"
 #include "resource_util.h"
 #include "string_util.h"
 #include "file_util.h"
@@ -51,6 +57,98 @@
 int ClientHandler::m_browserCount = 0;
 
 
+// Resources with a content hash in their file names (e.g., "js/app.3f9a2c71.js")
+// never change under the same URL and can be cached without revalidation.
+#define CACHE_CONTROL_IMMUTABLE TEXT("public, max-age=31536000, immutable")
+
+// All other resources may be cached, but have to be revalidated using their ETags.
+#define CACHE_CONTROL_REVALIDATE TEXT("no-cache")
+
+
+//
+// Tests whether the file name of the resource contains a content hash, i.e.,
+// whether it has the form "<name>.<hash>.<ext>" or "<name>-<hash>.<ext>",
+// where <hash> consists of at least 8 hexadecimal digits.
+//
+static bool IsContentHashedResource(const String& url)
+{
+    size_t posName = url.find_last_of(TEXT('/'));
+    String name = posName == String::npos ? url : url.substr(posName + 1);
+
+    size_t posExt = name.find_last_of(TEXT('.'));
+    if (posExt == String::npos)
+        return false;
+
+    size_t posHash = name.find_last_of(TEXT(".-"), posExt - 1);
+    if (posHash == String::npos || posExt - posHash - 1 < 8)
+        return false;
+
+    for (size_t i = posHash + 1; i < posExt; ++i)
+    {
+        TCHAR c = name.at(i);
+        if (!((c >= TEXT('0') && c <= TEXT('9')) || (c >= TEXT('a') && c <= TEXT('f')) || (c >= TEXT('A') && c <= TEXT('F'))))
+            return false;
+    }
+
+    return true;
+}
+
+//
+// Returns the value of the request header name (case-insensitive) or an empty
+// string if the request doesn't have such a header.
+//
+static String GetRequestHeader(CefRefPtr<CefRequest> request, String name)
+{
+    std::transform(name.begin(), name.end(), name.begin(), tolower);
+
+    CefRequest::HeaderMap headerMap;
+    request->GetHeaderMap(headerMap);
+    for (CefRequest::HeaderMap::iterator it = headerMap.begin(); it != headerMap.end(); ++it)
+    {
+        String key = it->first;
+        std::transform(key.begin(), key.end(), key.begin(), tolower);
+        if (key == name)
+            return it->second;
+    }
+
+    return String();
+}
+
+//
+// Tests whether the value of an If-None-Match header matches the entity tag etag.
+// Uses the weak comparison function (RFC 7232, 2.3.2).
+//
+static bool IsETagMatching(const String& ifNoneMatch, const String& etag)
+{
+    size_t pos = 0;
+    while (pos < ifNoneMatch.length())
+    {
+        size_t posEnd = ifNoneMatch.find(TEXT(','), pos);
+        if (posEnd == String::npos)
+            posEnd = ifNoneMatch.length();
+
+        // trim white space and strip the weakness indicator
+        size_t start = ifNoneMatch.find_first_not_of(TEXT(" \t"), pos);
+        size_t end = ifNoneMatch.find_last_not_of(TEXT(" \t"), posEnd - 1);
+        if (start != String::npos && start < posEnd && end >= start)
+        {
+            String tag = ifNoneMatch.substr(start, end - start + 1);
+            if (tag == TEXT("*"))
+                return true;
+            if (tag.compare(0, 2, TEXT("W/")) == 0)
+                tag = tag.substr(2);
+            if (tag == etag)
+                return true;
+        }
+
+        pos = posEnd + 1;
+    }
+
+    return false;
+}
+
+
+
 ClientHandler::ClientHandler()
   : m_mainHwnd(NULL),
     m_browserId(0),
@@ -240,6 +338,8 @@ void ClientHandler::OnRenderProcessTerminated(CefRefPtr<CefBrowser> browser, Ter
 
 CefRefPtr<CefResourceHandler> ClientHandler::GetResourceHandler(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefRequest> request)
 {
+    long long startTime = ResourceStats::GetTime();
+
     String url = request->GetURL();
     if (url == TEXT("http://index.html/"))
         url = TEXT("index.html");
@@ -253,28 +353,66 @@ CefRefPtr<CefResourceHandler> ClientHandler::GetResourceHandler(CefRefPtr<CefBro
         url.replace(startPos, from.length(), TEXT(""));
     }
 
-	String mimeType;
-    if (url.find(TEXT(".html")) != String::npos)
-        mimeType = TEXT("text/html");
-    else if (url.find(TEXT(".css")) != String::npos)
-        mimeType = TEXT("text/css");
-    else if (url.find(TEXT(".js")) != String::npos)
-        mimeType = TEXT("text/javascript");
-    else if (url.find(TEXT(".png")) != String::npos)
-        mimeType = TEXT("image/png");
-    else if (url.find(TEXT(".jpg")) != String::npos || url.find(TEXT(".jpeg")) != String::npos)
-        mimeType = TEXT("image/jpeg");
-    else if (url.find(TEXT(".woff")) != String::npos)
-        mimeType = TEXT("application/font-woff");
-    else if (url.find(TEXT(".ttf")) != String::npos)
-        mimeType = TEXT("application/x-font-ttf");
-	else if (url.find(TEXT(".svg")) != String::npos)
-		mimeType = TEXT("image/svg+xml");
-    
-    CefRefPtr<CefStreamReader> stream = GetBinaryResourceReader(url.c_str());
+    String mimeType = GetResourceMimeType(url);
+
+    // don't serve resources which have been tampered with
+    if (!ResourceIntegrity::VerifyResource(url))
+    {
+        ResourceStats::AddRecord(url, mimeType, ResourceStats::SourceBlocked, 403, startTime);
+        return NULL;
+    }
+
+    String etag;
+    if (!GetResourceETag(url.c_str(), etag))
+    {
+        String requestContents;
+        DumpRequestContents(request, requestContents);
+        App::Log(TEXT("Resource not found: ") + requestContents);
+
+        ResourceStats::AddRecord(url, mimeType, ResourceStats::SourceNotFound, 404, startTime);
+        return NULL;
+    }
+
+    // placeholders are substituted in filtered resources, so their entity tag also depends on the placeholder values
+    bool isFiltered = ResourceFilter::IsFilteredMimeType(mimeType);
+    if (isFiltered)
+        etag = ResourceFilter::GetETag(etag);
+
+    CefResponse::HeaderMap headerMap;
+    headerMap.insert(std::make_pair(TEXT("ETag"), etag));
+    headerMap.insert(std::make_pair(TEXT("Cache-Control"), IsContentHashedResource(url) ? CACHE_CONTROL_IMMUTABLE : CACHE_CONTROL_REVALIDATE));
+
+    // answer conditional requests for unchanged resources with "304 Not Modified" and no body
+    String ifNoneMatch = GetRequestHeader(request, TEXT("If-None-Match"));
+    if (ifNoneMatch.length() > 0 && IsETagMatching(ifNoneMatch, etag))
+    {
+        static char empty[1] = { 0 };
+        return ResourceStats::Instrument(
+            new CefStreamResourceHandler(304, mimeType, headerMap, CefStreamReader::CreateForHandler(new CefByteReadHandler((const unsigned char*) empty, 0, NULL))),
+            url, mimeType, ResourceStats::SourceNotModified, false, startTime);
+    }
+
+    CefRefPtr<CefStreamReader> stream = ResourceCache::GetReader(url);
+    bool isCacheHit = stream.get() != NULL;
+    ResourcePreloader::OnResourceServed(url, isCacheHit);
+
+    ResourceStats::Source source = ResourceStats::SourceMemoryCache;
+    if (!isCacheHit)
+    {
+        source = IsBundledResource(url.c_str()) ? ResourceStats::SourceZipBundle : ResourceStats::SourceResources;
+
+        // taken before the file is opened so a change while it's read invalidates the cached output
+        ResourceIdentity identity;
+        bool hasIdentity = GetResourceIdentity(url.c_str(), identity);
+        stream = GetBinaryResourceReader(url.c_str());
+        if (stream.get() && isFiltered)
+            stream = ResourceFilter::CreateReader(url, stream, hasIdentity ? &identity : NULL);
+    }
+
     if (stream.get())
-        return new CefStreamResourceHandler(mimeType, stream);
-        
+        return ResourceStats::Instrument(new CefStreamResourceHandler(200, mimeType, headerMap, stream), url, mimeType, source, isCacheHit, startTime);
+
+    ResourceStats::AddRecord(url, mimeType, ResourceStats::SourceNotFound, 404, startTime);
     return NULL;
 }
 
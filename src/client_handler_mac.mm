@@ -26,6 +26,7 @@
 #include "include/cef_frame.h"
 #include "app.h"
 #include "client_handler.h"
+#include "resource_preloader.h"
 
 extern bool g_isWindowLoaded;
 extern bool g_isWindowBeingLoaded;
@@ -45,6 +46,8 @@ void ClientHandler::OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame>
         
         g_isWindowLoaded = true;
         g_isWindowBeingLoaded = false;
+
+        ResourcePreloader::LogStartupTiming();
     }
 }
 
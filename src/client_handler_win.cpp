@@ -28,6 +28,7 @@
 #include "lib\Libcef\Include/cef_frame.h"
 
 #include "client_handler.h"
+#include "resource_preloader.h"
 #include "resource.h"
 
 
@@ -46,6 +47,8 @@ void ClientHandler::OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame>
 			ShowWindow(m_mainHwnd, g_nCmdShow);
 			UpdateWindow(m_mainHwnd);
 		}
+
+		ResourcePreloader::LogStartupTiming();
     }
 }
 
@@ -0,0 +1,276 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "directory_lister.h"
+#include "worker_pool.h"
+
+
+namespace DirectoryLister {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Listing
+{
+    String root;
+    bool recursive;
+    bool includeStats;
+    String filter;
+    ResultCallback onResults;
+
+    WorkerPool* pool;
+    std::atomic<int> numPendingTasks;
+
+    std::mutex mutex;
+    std::vector<FileUtil::FileInfo> batch;
+    Clock::time_point timeLastBatch;
+};
+
+typedef std::shared_ptr<Listing> ListingPtr;
+
+
+struct StatJob
+{
+    std::vector<String> paths;
+    std::vector<FileUtil::FileStatus> stats;
+    StatCallback onCompleted;
+    std::atomic<int> numPendingTasks;
+};
+
+typedef std::shared_ptr<StatJob> StatJobPtr;
+
+
+static std::mutex g_mutex;
+static WorkerPool* g_pool = NULL;
+static std::atomic<bool> g_isStopping(false);
+
+
+//
+// Returns the pool, creating it if necessary.
+//
+static WorkerPool* GetPool()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_pool == NULL)
+    {
+        g_isStopping = false;
+        g_pool = new WorkerPool(LIST_DIRECTORY_NUM_THREADS);
+    }
+
+    return g_pool;
+}
+
+
+static String GetPath(ListingPtr listing, const String& relativePath)
+{
+    return relativePath.length() == 0 ? listing->root : listing->root + FileUtil::GetPathSeparator() + relativePath;
+}
+
+//
+// Passes the batch on to the callback. The caller must hold the listing's lock.
+//
+static void PassBatch(ListingPtr listing, bool isDone)
+{
+    std::vector<FileUtil::FileInfo> entries;
+    entries.swap(listing->batch);
+    listing->timeLastBatch = Clock::now();
+
+    listing->onResults(entries, isDone);
+}
+
+static void AddResults(ListingPtr listing, std::vector<FileUtil::FileInfo>& entries)
+{
+    if (entries.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(listing->mutex);
+    listing->batch.insert(listing->batch.end(), entries.begin(), entries.end());
+
+    if (listing->batch.size() >= LIST_DIRECTORY_MAX_BATCH_SIZE ||
+        Clock::now() - listing->timeLastBatch >= std::chrono::milliseconds(LIST_DIRECTORY_BATCH_INTERVAL))
+    {
+        PassBatch(listing, false);
+    }
+}
+
+static void PostTask(ListingPtr listing, std::function<void()> task)
+{
+    ++listing->numPendingTasks;
+    listing->pool->Post([listing, task]() {
+        if (!g_isStopping)
+            task();
+
+        // the last task passes on the remaining entries
+        if (--listing->numPendingTasks == 0)
+        {
+            std::lock_guard<std::mutex> lock(listing->mutex);
+            PassBatch(listing, true);
+        }
+    });
+}
+
+static void StatTask(ListingPtr listing, String relativePath, std::shared_ptr<std::vector<FileUtil::FileInfo> > entries)
+{
+    String path = GetPath(listing, relativePath);
+    for (FileUtil::FileInfo& info : *entries)
+        FileUtil::GetFileStats(path + FileUtil::GetPathSeparator() + info.name, info);
+
+    // make the names relative to the root
+    if (relativePath.length() > 0)
+        for (FileUtil::FileInfo& info : *entries)
+            info.name = relativePath + FileUtil::GetPathSeparator() + info.name;
+
+    AddResults(listing, *entries);
+}
+
+static void ReadDirectoryTask(ListingPtr listing, String relativePath)
+{
+    std::vector<FileUtil::FileInfo> entries;
+    if (!FileUtil::ReadDirectory(GetPath(listing, relativePath), entries))
+        return;
+
+#ifdef OS_WIN
+    bool caseInsensitive = true;
+#else
+    bool caseInsensitive = false;
+#endif
+
+    std::vector<FileUtil::FileInfo> results;
+    for (FileUtil::FileInfo& info : entries)
+    {
+        // don't follow symbolic links to avoid cycles
+        if (listing->recursive && info.isDirectory && !info.isSymbolicLink)
+        {
+            String subdirectory = relativePath.length() == 0 ? info.name : relativePath + FileUtil::GetPathSeparator() + info.name;
+            PostTask(listing, [listing, subdirectory]() { ReadDirectoryTask(listing, subdirectory); });
+        }
+
+        if (listing->filter.length() == 0 || FileUtil::MatchGlob(info.name, listing->filter, caseInsensitive))
+            results.push_back(info);
+    }
+
+    if (listing->includeStats)
+    {
+        // retrieve the stats in parallel (unless they came with the entries)
+        std::vector<FileUtil::FileInfo> resultsWithStats;
+        for (size_t i = 0; i < results.size(); )
+        {
+            if (results[i].hasStats)
+            {
+                resultsWithStats.push_back(results[i++]);
+                continue;
+            }
+
+            std::shared_ptr<std::vector<FileUtil::FileInfo> > chunk(new std::vector<FileUtil::FileInfo>());
+            for ( ; i < results.size() && chunk->size() < LIST_DIRECTORY_STAT_CHUNK_SIZE; ++i)
+                chunk->push_back(results[i]);
+            PostTask(listing, [listing, relativePath, chunk]() { StatTask(listing, relativePath, chunk); });
+        }
+
+        results.swap(resultsWithStats);
+    }
+
+    if (relativePath.length() > 0)
+        for (FileUtil::FileInfo& info : results)
+            info.name = relativePath + FileUtil::GetPathSeparator() + info.name;
+
+    AddResults(listing, results);
+}
+
+bool List(const String& path, bool recursive, bool includeStats, const String& filter, ResultCallback onResults)
+{
+    FileUtil::FileInfo info;
+    if (!FileUtil::GetFileStats(path, info) || !info.isDirectory)
+        return false;
+
+    ListingPtr listing(new Listing());
+    listing->root = path;
+    listing->recursive = recursive;
+    listing->includeStats = includeStats;
+    listing->filter = filter;
+    listing->onResults = onResults;
+    listing->numPendingTasks = 0;
+
+    // pass the first entries on immediately
+    listing->timeLastBatch = Clock::now() - std::chrono::milliseconds(LIST_DIRECTORY_BATCH_INTERVAL);
+
+    listing->pool = GetPool();
+
+    PostTask(listing, [listing]() { ReadDirectoryTask(listing, String()); });
+    return true;
+}
+
+void StatMany(const std::vector<String>& paths, StatCallback onCompleted)
+{
+    StatJobPtr job(new StatJob());
+    job->paths = paths;
+    job->onCompleted = onCompleted;
+
+    FileUtil::FileStatus failed;
+    failed.size = 0;
+    failed.modified = 0;
+    failed.mode = 0;
+    failed.error = FileUtil::STAT_FAILED;
+    job->stats.resize(paths.size(), failed);
+
+    // there is at least one task, which passes on the (possibly empty) result
+    int numTasks = paths.empty() ? 1 : (int) ((paths.size() + LIST_DIRECTORY_STAT_CHUNK_SIZE - 1) / LIST_DIRECTORY_STAT_CHUNK_SIZE);
+    job->numPendingTasks = numTasks;
+
+    WorkerPool* pool = GetPool();
+    for (int i = 0; i < numTasks; ++i)
+    {
+        size_t start = (size_t) i * LIST_DIRECTORY_STAT_CHUNK_SIZE;
+        size_t end = start + LIST_DIRECTORY_STAT_CHUNK_SIZE < paths.size() ? start + LIST_DIRECTORY_STAT_CHUNK_SIZE : paths.size();
+
+        pool->Post([job, start, end]() {
+            // each task writes the stats of its chunk only
+            for (size_t j = start; j < end && !g_isStopping; ++j)
+                FileUtil::GetFileStatus(job->paths[j], job->stats[j]);
+
+            if (--job->numPendingTasks == 0)
+                job->onCompleted(job->stats);
+        });
+    }
+}
+
+void Stop()
+{
+    WorkerPool* pool = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_isStopping = true;
+        pool = g_pool;
+        g_pool = NULL;
+    }
+
+    // waits for the (aborted) tasks
+    delete pool;
+}
+
+} // namespace DirectoryLister
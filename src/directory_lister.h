@@ -0,0 +1,87 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef __directory_lister_h
+#define __directory_lister_h
+
+
+#include <functional>
+#include <vector>
+
+#include "types.h"
+#include "file_util.h"
+
+
+// The number of threads reading directories and retrieving stats
+#define LIST_DIRECTORY_NUM_THREADS 8
+
+// The number of entries whose stats are retrieved by a single task
+#define LIST_DIRECTORY_STAT_CHUNK_SIZE 256
+
+// Results are passed on when the batch has reached this size...
+#define LIST_DIRECTORY_MAX_BATCH_SIZE 2000
+
+// ...or if this many milliseconds have passed since the last batch was passed on
+#define LIST_DIRECTORY_BATCH_INTERVAL 30
+
+
+namespace DirectoryLister {
+
+//
+// Receives a batch of entries; their names are paths relative to the listed
+// directory. isDone is set for the last batch.
+//
+typedef std::function<void(std::vector<FileUtil::FileInfo>& entries, bool isDone)> ResultCallback;
+
+//
+// Lists the directory (and its subdirectories if "recursive" is set) on a pool
+// of worker threads, reading the directories and retrieving the stats in
+// parallel. Only the entries whose names match the glob pattern "filter" (if
+// not empty) are returned; subdirectories are searched regardless. The first
+// batch is passed on as soon as it is available.
+// onResults is called from the worker threads, but never concurrently.
+// Returns false if "path" isn't a directory.
+//
+bool List(const String& path, bool recursive, bool includeStats, const String& filter, ResultCallback onResults);
+
+//
+// Receives the stats of the files in the order of the paths.
+//
+typedef std::function<void(std::vector<FileUtil::FileStatus>& stats)> StatCallback;
+
+//
+// Retrieves the stats of the files on the pool of worker threads, in chunks of
+// LIST_DIRECTORY_STAT_CHUNK_SIZE files. onCompleted is called from a worker
+// thread.
+//
+void StatMany(const std::vector<String>& paths, StatCallback onCompleted);
+
+//
+// Aborts the listings in progress and stops the worker threads.
+//
+void Stop();
+
+} // namespace DirectoryLister
+
+
+#endif
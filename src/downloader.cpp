@@ -0,0 +1,436 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "network_util.h"
+#include "file_util.h"
+
+
+#ifdef OS_WIN
+// VS2012 doesn't have strtoll
+#define strtoll _strtoi64
+#endif
+
+
+namespace NetworkUtil {
+
+typedef std::chrono::steady_clock Clock;
+
+struct DownloadJob
+{
+    int id;
+    int requestId;
+    String path;
+    String partPath;
+    String validatorPath;
+    DownloadOptions options;
+    DownloadCallback onProgress;
+
+    // only accessed on the network thread (and by the final report)
+    FileUtil::OutputFile file;
+    bool isFileOpen;
+    bool isFileError;
+    // set if the response carries the (rest of the) file
+    bool isAccepted;
+    // set if a partial response doesn't fit the partial file
+    bool isRejected;
+    // set if the server redirects to a URL the client doesn't support
+    bool isUnsupported;
+    int httpStatus;
+    uint64_t offset;
+    uint64_t numBytesReceived;
+    int64_t numBytesTotal;
+    Clock::time_point timeLastReport;
+};
+
+typedef std::shared_ptr<DownloadJob> DownloadJobPtr;
+
+
+static std::mutex g_mutex;
+static std::map<int, DownloadJobPtr> g_jobs;
+static int g_lastId = 0;
+
+
+//
+// Passes the progress on; unless "force" is set, only if the last report is
+// long enough ago.
+//
+static void Report(DownloadJobPtr job, DownloadStatus status, DownloadError error, bool force)
+{
+    Clock::time_point now = Clock::now();
+    if (!force && now - job->timeLastReport < std::chrono::milliseconds(HTTP_DOWNLOAD_PROGRESS_INTERVAL))
+        return;
+    job->timeLastReport = now;
+
+    DownloadProgress progress;
+    progress.id = job->id;
+    progress.status = status;
+    progress.error = error;
+    progress.httpStatus = job->httpStatus;
+    progress.numBytesReceived = job->numBytesReceived;
+    progress.numBytesTotal = job->numBytesTotal;
+    job->onProgress(progress);
+}
+
+static void Finish(DownloadJobPtr job, DownloadStatus status, DownloadError error)
+{
+    if (status == DOWNLOAD_DONE)
+    {
+        if (FileUtil::RenameFile(job->partPath, job->path))
+            FileUtil::RemoveFile(job->validatorPath);
+        else
+        {
+            status = DOWNLOAD_FAILED;
+            error = DOWNLOAD_FILE_ERROR;
+        }
+    }
+    else if (!job->options.resume || error == DOWNLOAD_DIGEST_MISMATCH)
+    {
+        FileUtil::RemoveFile(job->partPath);
+        FileUtil::RemoveFile(job->validatorPath);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_jobs.erase(job->id);
+    }
+
+    Report(job, status, error, true);
+}
+
+//
+// Parses a Content-Range header ("bytes <first>-<last>/<total>" or
+// "bytes */<total>"); total is -1 if it's unknown ("*").
+//
+static bool ParseContentRange(const std::string& value, int64_t& first, int64_t& total)
+{
+    if (value.compare(0, 6, "bytes ") != 0)
+        return false;
+
+    size_t slash = value.find('/');
+    if (slash == std::string::npos)
+        return false;
+
+    first = value[6] == '*' ? -1 : strtoll(value.c_str() + 6, NULL, 10);
+    total = value[slash + 1] == '*' ? -1 : strtoll(value.c_str() + slash + 1, NULL, 10);
+    return true;
+}
+
+//
+// The validator of the response the partial file comes from is kept in
+// "<path>.part.validator" and sent in If-Range when the download is resumed,
+// so that the server sends the entire file if it has changed. If-Range
+// requires a strong ETag; otherwise, Last-Modified is used.
+//
+static std::string GetValidator(const HttpResponse& response)
+{
+    std::string etag = GetHeader(response.headers, "ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0)
+        return etag;
+
+    return GetHeader(response.headers, "Last-Modified");
+}
+
+static std::string ReadValidator(const String& path)
+{
+    FileUtil::InputFile file;
+    uint64_t size = 0;
+    if (!file.Open(path) || !file.GetSize(size) || size == 0 || size > HTTP_MAX_HEADER_SIZE)
+        return "";
+
+    std::string validator((size_t) size, '\0');
+    if (file.Read(0, (uint8_t*) &validator[0], (size_t) size) != (int64_t) size)
+        return "";
+
+    return validator;
+}
+
+static void WriteValidator(const String& path, const std::string& validator)
+{
+    FileUtil::OutputFile file;
+    if (!file.Open(path, false) || !file.Write((const uint8_t*) validator.data(), validator.length()))
+    {
+        // the download will start over if it's resumed
+        file.Close();
+        FileUtil::RemoveFile(path);
+    }
+}
+
+//
+// Tests whether the native client can load the URL (or relative URL): it
+// doesn't support HTTPS.
+//
+static bool IsSupportedUrl(const std::string& url)
+{
+    std::string scheme = GetUrlScheme(url);
+    return scheme.empty() || scheme == "http";
+}
+
+//
+// Opens the partial file for the response; returns false if the response
+// can't be used.
+//
+static bool OnHeaders(DownloadJobPtr job, const HttpResponse& response)
+{
+    job->httpStatus = response.status;
+    std::string contentLength = GetHeader(response.headers, "Content-Length");
+    int64_t first = -1;
+    int64_t total = -1;
+
+    if (response.status == 206)
+    {
+        // the rest of the partial file
+        if (!ParseContentRange(GetHeader(response.headers, "Content-Range"), first, total) || first != (int64_t) job->offset)
+        {
+            job->isRejected = true;
+            return false;
+        }
+
+        job->numBytesReceived = job->offset;
+        job->numBytesTotal = total;
+        job->isFileOpen = job->file.Open(job->partPath, true);
+    }
+    else if (response.status == 416 && job->offset > 0)
+    {
+        // the partial file may be complete already
+        if (ParseContentRange(GetHeader(response.headers, "Content-Range"), first, total) && total == (int64_t) job->offset)
+        {
+            job->isAccepted = true;
+            job->numBytesReceived = job->offset;
+            job->numBytesTotal = total;
+        }
+        return true;
+    }
+    else if (response.status >= 300 && response.status < 400 && !IsSupportedUrl(GetHeader(response.headers, "Location")))
+    {
+        // the client only follows redirects to "http://" URLs
+        job->isUnsupported = true;
+        return false;
+    }
+    else if (response.status >= 200 && response.status < 300)
+    {
+        // the server doesn't support ranges or the file has changed; start
+        // over. The old validator mustn't outlive the old data.
+        job->numBytesReceived = 0;
+        job->numBytesTotal = contentLength.empty() ? -1 : strtoll(contentLength.c_str(), NULL, 10);
+        if (job->options.resume)
+            FileUtil::RemoveFile(job->validatorPath);
+        job->isFileOpen = job->file.Open(job->partPath, false);
+
+        std::string validator = GetValidator(response);
+        if (job->isFileOpen && job->options.resume && !validator.empty())
+            WriteValidator(job->validatorPath, validator);
+    }
+    else
+        return true;
+
+    if (!job->isFileOpen)
+    {
+        job->isFileError = true;
+        return false;
+    }
+
+    job->isAccepted = true;
+    Report(job, DOWNLOAD_IN_PROGRESS, DOWNLOAD_OK, true);
+    return true;
+}
+
+static bool OnData(DownloadJobPtr job, const char* data, size_t length)
+{
+    if (!job->isFileOpen)
+        return true;
+
+    if (!job->file.Write((const uint8_t*) data, length))
+    {
+        job->isFileError = true;
+        return false;
+    }
+
+    job->numBytesReceived += length;
+    Report(job, DOWNLOAD_IN_PROGRESS, DOWNLOAD_OK, false);
+    return true;
+}
+
+static void OnCompleted(DownloadJobPtr job, const HttpResponse& response)
+{
+    if (job->isFileOpen)
+    {
+        job->file.Close();
+        job->isFileOpen = false;
+    }
+
+    if (job->isFileError)
+    {
+        Finish(job, DOWNLOAD_FAILED, DOWNLOAD_FILE_ERROR);
+        return;
+    }
+
+    if (job->isRejected)
+    {
+        Finish(job, DOWNLOAD_FAILED, DOWNLOAD_HTTP_ERROR);
+        return;
+    }
+
+    if (job->isUnsupported)
+    {
+        Finish(job, DOWNLOAD_FAILED, DOWNLOAD_UNSUPPORTED_URL);
+        return;
+    }
+
+    if (response.error == REQUEST_CANCELLED)
+    {
+        Finish(job, DOWNLOAD_CANCELLED, DOWNLOAD_OK);
+        return;
+    }
+
+    if (response.error != REQUEST_OK)
+    {
+        Finish(job, DOWNLOAD_FAILED, DOWNLOAD_REQUEST_FAILED);
+        return;
+    }
+
+    if (!job->isAccepted)
+    {
+        Finish(job, DOWNLOAD_FAILED, DOWNLOAD_HTTP_ERROR);
+        return;
+    }
+
+    if ((job->numBytesTotal >= 0 && job->numBytesReceived != (uint64_t) job->numBytesTotal) ||
+        (job->options.size >= 0 && job->numBytesReceived != (uint64_t) job->options.size))
+    {
+        Finish(job, DOWNLOAD_FAILED, DOWNLOAD_SIZE_MISMATCH);
+        return;
+    }
+
+    if (job->numBytesTotal < 0)
+        job->numBytesTotal = (int64_t) job->numBytesReceived;
+
+    if (job->options.digest.empty())
+    {
+        Finish(job, DOWNLOAD_DONE, DOWNLOAD_OK);
+        return;
+    }
+
+    // hash the entire file (including a resumed part) on the hasher's threads
+    std::vector<String> paths;
+    paths.push_back(job->partPath);
+    FileHasher::HashFiles(paths, job->options.algorithm, [job](std::vector<String>& digests) {
+        String expected = job->options.digest;
+        std::transform(expected.begin(), expected.end(), expected.begin(), tolower);
+
+        if (digests[0].empty())
+            Finish(job, DOWNLOAD_FAILED, DOWNLOAD_FILE_ERROR);
+        else if (digests[0] != expected)
+            Finish(job, DOWNLOAD_FAILED, DOWNLOAD_DIGEST_MISMATCH);
+        else
+            Finish(job, DOWNLOAD_DONE, DOWNLOAD_OK);
+    });
+}
+
+int Download(const std::string& url, const String& path, const DownloadOptions& options, DownloadCallback onProgress)
+{
+    DownloadJobPtr job(new DownloadJob());
+    job->requestId = 0;
+    job->path = path;
+    job->partPath = path + TEXT(".part");
+    job->validatorPath = job->partPath + TEXT(".validator");
+    job->options = options;
+    job->onProgress = onProgress;
+    job->isFileOpen = false;
+    job->isFileError = false;
+    job->isAccepted = false;
+    job->isRejected = false;
+    job->isUnsupported = false;
+    job->httpStatus = 0;
+    job->offset = 0;
+    job->numBytesReceived = 0;
+    job->numBytesTotal = -1;
+
+    if (GetUrlScheme(url) != "http")
+    {
+        // the partial file of a resumable download is left alone
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            job->id = ++g_lastId;
+        }
+
+        Report(job, DOWNLOAD_FAILED, DOWNLOAD_UNSUPPORTED_URL, true);
+        return job->id;
+    }
+
+    HttpRequest request;
+    request.method = "GET";
+    request.url = url;
+
+    if (options.resume)
+    {
+        FileUtil::FileStatus status;
+        FileUtil::GetFileStatus(job->partPath, status);
+        // without a validator, the server can't tell whether the partial
+        // file is still part of the file; it's replaced
+        std::string validator = ReadValidator(job->validatorPath);
+        if (status.error == FileUtil::STAT_OK && status.size > 0 && !validator.empty())
+        {
+            job->offset = status.size;
+
+            char range[48];
+            sprintf(range, "bytes=%llu-", (unsigned long long) job->offset);
+            request.headers.push_back(std::make_pair(std::string("Range"), std::string(range)));
+            request.headers.push_back(std::make_pair(std::string("If-Range"), validator));
+        }
+    }
+
+    request.onHeaders = [job](const HttpResponse& response) { return OnHeaders(job, response); };
+    request.onData = [job](const char* data, size_t length) { return OnData(job, data, length); };
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    job->id = ++g_lastId;
+    g_jobs[job->id] = job;
+    job->requestId = SendRequest(request, [job](HttpResponse& response) { OnCompleted(job, response); });
+
+    return job->id;
+}
+
+void CancelDownload(int id)
+{
+    int requestId = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        std::map<int, DownloadJobPtr>::iterator it = g_jobs.find(id);
+        if (it != g_jobs.end())
+            requestId = it->second->requestId;
+    }
+
+    if (requestId != 0)
+        CancelRequest(requestId);
+}
+
+} // namespace NetworkUtil
@@ -22,6 +22,8 @@
 
 #include <stdint.h>
 
+#include "lib/Libcef/Include/cef_task.h"
+
 #include "app.h"
 #include "extension_handler.h"
 #include "util.h"
@@ -58,6 +60,75 @@ void ClientCallback::Invoke(String functionName, CefRefPtr<CefListValue> args)
 }
 
 
+///////////////////////////////////////////////////////////////
+// DelayedCallback Implementation
+
+//
+// A task running a function object.
+//
+class FunctionTask : public CefTask
+{
+public:
+    FunctionTask(std::function<void()> fnx)
+        : m_fnx(fnx)
+    {
+    }
+
+    virtual void Execute()
+    {
+        m_fnx();
+    }
+
+private:
+    std::function<void()> m_fnx;
+
+    IMPLEMENT_REFCOUNTING(FunctionTask);
+};
+
+
+DelayedCallback::DelayedCallback(CefRefPtr<CefBrowser> browser, int32 messageId, String functionName)
+    : m_browser(browser), m_messageId(messageId), m_functionName(functionName)
+{
+}
+
+DelayedCallback::~DelayedCallback()
+{
+    m_browser = NULL;
+}
+
+void DelayedCallback::Invoke(ArgsSetter fnxSetArgs, bool isLast)
+{
+    // the renderer process is messaged from the UI thread
+    DelayedCallbackPtr self = shared_from_this();
+    CefPostTask(TID_UI, new FunctionTask([self, fnxSetArgs, isLast]() { self->DoInvoke(fnxSetArgs, isLast); }));
+}
+
+void DelayedCallback::DoInvoke(ArgsSetter fnxSetArgs, bool isLast)
+{
+    if (m_browser == NULL)
+        return;
+
+    CefRefPtr<CefListValue> returnValues = CefListValue::Create();
+    if (fnxSetArgs)
+        fnxSetArgs(returnValues);
+
+    // an INVOKE_DELAYED_CALLBACK message keeps the JavaScript callback registered,
+    // INVOKE_CALLBACK releases it; the arguments are the same
+    CefRefPtr<CefProcessMessage> response = CefProcessMessage::Create(isLast ? INVOKE_CALLBACK : INVOKE_DELAYED_CALLBACK);
+    CefRefPtr<CefListValue> responseArgs = response->GetArgumentList();
+
+    responseArgs->SetInt(0, m_messageId);
+    responseArgs->SetString(1, m_functionName);
+    responseArgs->SetInt(2, NO_ERROR);
+    CopyList(returnValues, responseArgs, 3);
+
+    m_browser->SendProcessMessage(PID_RENDERER, response);
+
+    if (isLast)
+        m_browser = NULL;
+}
+
+
 ///////////////////////////////////////////////////////////////
 // NativeFunction Implementation
 
@@ -106,7 +177,7 @@ int NativeFunction::Call(CefRefPtr<ClientHandler> handler, CefRefPtr<CefBrowser>
     
     CefRefPtr<CefListValue> fnArgs = CefListValue::Create();
     CopyList(args, fnArgs, -1);
-    return m_fnx(handler, browser, state, fnArgs, ret);
+    return m_fnx(handler, browser, state, fnArgs, ret, DelayedCallbackPtr(new DelayedCallback(browser, args->GetInt(0), m_name)));
 }
 
 void NativeFunction::AddCallback(int messageId, CefBrowser* browser)
@@ -282,7 +353,7 @@ bool ClientExtensionHandler::OnProcessMessageReceived(CefRefPtr<ClientHandler> h
                 browser->SendProcessMessage(PID_RENDERER, throwExceptionMsg);
             }
         }
-        else
+        else if (ret != RET_DELAYED_CALLBACK)
         {
             // this function doesn't have a persistent callback;
             // call it immediately to send the response
@@ -464,9 +535,10 @@ bool AppExtensionHandler::OnProcessMessageReceived(CefRefPtr<ClientApp> app, Cef
     CefRefPtr<CefListValue> args = message->GetArgumentList();
     String name = message->GetName();
     
-    if (name == INVOKE_CALLBACK)
+    if (name == INVOKE_CALLBACK || name == INVOKE_DELAYED_CALLBACK)
     {
         // invoke a callback function
+        // (INVOKE_DELAYED_CALLBACK: more invocations of the callback will follow)
         
         // arguments:
         // 0: messageId
@@ -529,7 +601,7 @@ bool AppExtensionHandler::OnProcessMessageReceived(CefRefPtr<ClientApp> app, Cef
             }
 
             // remove the callback if it isn't set to be persistent
-            if (!HasPersistentCallback(functionName))
+            if (name == INVOKE_CALLBACK && !HasPersistentCallback(functionName))
 			{
 				delete it->second;
                 m_mapCallbacks.erase(it);
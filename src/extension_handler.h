@@ -24,6 +24,9 @@
 #define __extension_handler__
 
 
+#include <functional>
+#include <memory>
+
 #include "lib\Libcef\Include/cef_process_message.h"
 #include "lib\Libcef\Include/cef_v8.h"
 
@@ -40,6 +43,7 @@ static const int NO_ERROR                   = 0;
 static const int ERR_UNKNOWN                = 1;
 static const int ERR_INVALID_PARAM_NUM      = 2;
 static const int ERR_INVALID_PARAM_TYPES    = 3;
+static const int RET_DELAYED_CALLBACK       = -1;
 
 
 #define END_MARKER -999
@@ -47,15 +51,21 @@ static const int ERR_INVALID_PARAM_TYPES    = 3;
 
 #define INVOKE_CALLBACK TEXT("@invokeCallback")
 #define CALLBACK_COMPLETED TEXT("@callbackCompleted")
+#define INVOKE_DELAYED_CALLBACK TEXT("@invokeDelayedCallback")
 #define THROW_EXCEPTION TEXT("@throwException")
 
 
+class DelayedCallback;
+typedef std::shared_ptr<DelayedCallback> DelayedCallbackPtr;
+
+
 typedef int (*Function)(
     CefRefPtr<ClientHandler> handler,
     CefRefPtr<CefBrowser> browser,
     CefRefPtr<ExtensionState> ext,
     CefRefPtr<CefListValue> args,
-    CefRefPtr<CefListValue> ret
+    CefRefPtr<CefListValue> ret,
+    DelayedCallbackPtr callback
 );
 
 typedef void (*CallbacksCompleteHandler)(
@@ -99,6 +109,40 @@ private:
 };
 
 
+//
+// The callback of a native function which returned RET_DELAYED_CALLBACK.
+// Invoke can be called from any thread and any number of times; the function
+// setting the callback arguments is run on the UI thread. The JavaScript
+// callback is released after the invocation with isLast set.
+//
+class DelayedCallback : public std::enable_shared_from_this<DelayedCallback>
+{
+public:
+    typedef std::function<void(CefRefPtr<CefListValue> ret)> ArgsSetter;
+
+    DelayedCallback(CefRefPtr<CefBrowser> browser, int32 messageId, String functionName);
+    ~DelayedCallback();
+
+    void Invoke(ArgsSetter fnxSetArgs, bool isLast = true);
+
+private:
+    void DoInvoke(ArgsSetter fnxSetArgs, bool isLast);
+
+    CefRefPtr<CefBrowser> m_browser;
+    int32 m_messageId;
+    String m_functionName;
+};
+
+//
+// Returns a handle to the callback passed to the native function which can
+// be invoked once the function has returned RET_DELAYED_CALLBACK.
+//
+inline DelayedCallbackPtr CreateDelayedCallback(DelayedCallbackPtr callback)
+{
+    return callback;
+}
+
+
 class NativeFunction
 {
 public:
@@ -0,0 +1,389 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "file_util.h"
+#include "worker_pool.h"
+
+
+namespace FileUtil {
+
+typedef std::chrono::steady_clock Clock;
+
+enum OperationType
+{
+    OPERATION_COPY,
+    OPERATION_MOVE,
+    OPERATION_COPY_TREE
+};
+
+struct CopyJob
+{
+    int id;
+    OperationType type;
+    String from;
+    String to;
+    CopyCallback onProgress;
+
+    WorkerPool* pool;
+    std::atomic<int> numPendingTasks;
+    std::atomic<bool> isCancelled;
+    std::atomic<bool> isFailed;
+
+    // set by the first task, before the tasks copying the files are posted
+    uint64_t numBytesTotal;
+    int numFilesTotal;
+    bool isRemovingSource;
+    std::vector<String> directories;
+    std::vector<String> files;
+
+    std::atomic<uint64_t> numBytesCopied;
+    std::atomic<int> numFilesCopied;
+
+    std::mutex mutex;
+    Clock::time_point timeLastReport;
+};
+
+typedef std::shared_ptr<CopyJob> CopyJobPtr;
+
+
+static std::mutex g_mutex;
+static WorkerPool* g_pool = NULL;
+static std::map<int, CopyJobPtr> g_jobs;
+static int g_lastId = 0;
+static std::atomic<bool> g_isStopping(false);
+
+
+static String GetPath(const String& root, const String& relativePath)
+{
+    return relativePath.length() == 0 ? root : root + GetPathSeparator() + relativePath;
+}
+
+//
+// Passes the progress on; unless "force" is set, only if the last report is
+// long enough ago.
+//
+static void Report(CopyJobPtr job, CopyStatus status, bool force)
+{
+    std::lock_guard<std::mutex> lock(job->mutex);
+
+    Clock::time_point now = Clock::now();
+    if (!force && now - job->timeLastReport < std::chrono::milliseconds(FILE_COPY_PROGRESS_INTERVAL))
+        return;
+    job->timeLastReport = now;
+
+    CopyProgress progress;
+    progress.id = job->id;
+    progress.status = status;
+    progress.numBytesCopied = job->numBytesCopied;
+    progress.numBytesTotal = job->numBytesTotal;
+    progress.numFilesCopied = job->numFilesCopied;
+    progress.numFilesTotal = job->numFilesTotal;
+    job->onProgress(progress);
+}
+
+static bool IsAborted(CopyJobPtr job)
+{
+    return g_isStopping || job->isCancelled || job->isFailed;
+}
+
+static void CopyOneFile(CopyJobPtr job, const String& from, const String& to)
+{
+    uint64_t numBytesReported = 0;
+    bool isCopied = CopyFileContents(from, to, [job, &numBytesReported](uint64_t numBytesCopied) {
+        job->numBytesCopied += numBytesCopied - numBytesReported;
+        numBytesReported = numBytesCopied;
+        Report(job, COPY_IN_PROGRESS, false);
+        return !IsAborted(job);
+    });
+
+    if (isCopied)
+    {
+        ++job->numFilesCopied;
+        Report(job, COPY_IN_PROGRESS, false);
+    }
+    else if (!IsAborted(job))
+        job->isFailed = true;
+}
+
+//
+// Deletes the source of a move once it has been copied.
+//
+static bool RemoveSource(CopyJobPtr job)
+{
+    if (job->type != OPERATION_COPY_TREE)
+        return RemoveFile(job->from);
+
+    bool isRemoved = true;
+    for (std::vector<String>::iterator it = job->files.begin(); it != job->files.end(); ++it)
+        isRemoved = RemoveFile(GetPath(job->from, *it)) && isRemoved;
+
+    // the subdirectories come after their parents
+    for (std::vector<String>::reverse_iterator it = job->directories.rbegin(); it != job->directories.rend(); ++it)
+        isRemoved = RemoveEmptyDirectory(GetPath(job->from, *it)) && isRemoved;
+
+    return RemoveEmptyDirectory(job->from) && isRemoved;
+}
+
+//
+// Called by the job's last task.
+//
+static void Complete(CopyJobPtr job)
+{
+    CopyStatus status = COPY_DONE;
+    if (g_isStopping || job->isCancelled)
+        status = COPY_CANCELLED;
+    else if (job->isFailed)
+        status = COPY_FAILED;
+    else if (job->isRemovingSource && !RemoveSource(job))
+        status = COPY_FAILED;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_jobs.erase(job->id);
+    }
+
+    Report(job, status, true);
+}
+
+static void PostTask(CopyJobPtr job, std::function<void()> task)
+{
+    ++job->numPendingTasks;
+    job->pool->Post([job, task]() {
+        if (!IsAborted(job))
+            task();
+
+        if (--job->numPendingTasks == 0)
+            Complete(job);
+    });
+}
+
+//
+// Collects the subdirectories (parents before their children) and files of
+// the directory "relativePath" within job->from.
+//
+static bool ScanTree(CopyJobPtr job, const String& relativePath)
+{
+    std::vector<FileInfo> entries;
+    if (!ReadDirectory(GetPath(job->from, relativePath), entries))
+        return false;
+
+    for (std::vector<FileInfo>::iterator it = entries.begin(); it != entries.end() && !IsAborted(job); ++it)
+    {
+        String path = relativePath.length() == 0 ? it->name : relativePath + GetPathSeparator() + it->name;
+        if (!it->hasStats && !GetFileStats(GetPath(job->from, path), *it))
+            return false;
+
+        if (it->isDirectory)
+        {
+            // don't follow symbolic links to avoid cycles
+            if (it->isSymbolicLink)
+                continue;
+
+            job->directories.push_back(path);
+            if (!ScanTree(job, path))
+                return false;
+        }
+        else
+        {
+            job->files.push_back(path);
+            job->numBytesTotal += it->size;
+        }
+    }
+
+    return true;
+}
+
+static void CopyTreeTask(CopyJobPtr job)
+{
+    // the scan would find the copies if "to" were within "from"
+    String prefix = job->from + GetPathSeparator();
+    if (job->to.compare(0, prefix.length(), prefix) == 0 || !ScanTree(job, String()))
+    {
+        job->isFailed = true;
+        return;
+    }
+
+    job->numFilesTotal = (int) job->files.size();
+    Report(job, COPY_IN_PROGRESS, true);
+
+    if (!MakeDirectory(job->to))
+    {
+        job->isFailed = true;
+        return;
+    }
+
+    for (std::vector<String>::iterator it = job->directories.begin(); it != job->directories.end(); ++it)
+    {
+        if (!MakeDirectory(GetPath(job->to, *it)))
+        {
+            job->isFailed = true;
+            return;
+        }
+    }
+
+    for (std::vector<String>::iterator it = job->files.begin(); it != job->files.end(); ++it)
+    {
+        String from = GetPath(job->from, *it);
+        String to = GetPath(job->to, *it);
+        PostTask(job, [job, from, to]() { CopyOneFile(job, from, to); });
+    }
+}
+
+static void StartTask(CopyJobPtr job)
+{
+    FileInfo info;
+    if (job->from == job->to || !GetFileStats(job->from, info))
+    {
+        job->isFailed = true;
+        return;
+    }
+
+    if (job->type == OPERATION_MOVE)
+    {
+        if (RenameFile(job->from, job->to))
+        {
+            job->numBytesTotal = info.isDirectory ? 0 : info.size;
+            job->numBytesCopied = job->numBytesTotal;
+            job->numFilesTotal = info.isDirectory ? 0 : 1;
+            job->numFilesCopied = job->numFilesTotal;
+            return;
+        }
+
+        // e.g., "to" is on another volume
+        job->isRemovingSource = true;
+        if (info.isDirectory)
+            job->type = OPERATION_COPY_TREE;
+    }
+
+    // copying a file or directory onto itself (e.g., through a link) would
+    // destroy it; renaming it is fine, e.g., to change the case of its name
+    if (IsSameFile(job->from, job->to))
+    {
+        job->isFailed = true;
+        return;
+    }
+
+    if (job->type == OPERATION_COPY_TREE)
+    {
+        if (!info.isDirectory)
+            job->isFailed = true;
+        else
+            CopyTreeTask(job);
+        return;
+    }
+
+    if (info.isDirectory)
+    {
+        job->isFailed = true;
+        return;
+    }
+
+    job->numBytesTotal = info.size;
+    job->numFilesTotal = 1;
+    Report(job, COPY_IN_PROGRESS, true);
+
+    CopyOneFile(job, job->from, job->to);
+}
+
+static int Start(OperationType type, const String& from, const String& to, CopyCallback onProgress)
+{
+    CopyJobPtr job(new CopyJob());
+    job->type = type;
+    job->from = from;
+    job->to = to;
+    job->onProgress = onProgress;
+    job->numPendingTasks = 0;
+    job->isCancelled = false;
+    job->isFailed = false;
+    job->numBytesTotal = 0;
+    job->numFilesTotal = 0;
+    job->isRemovingSource = false;
+    job->numBytesCopied = 0;
+    job->numFilesCopied = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (g_pool == NULL)
+        {
+            g_isStopping = false;
+            g_pool = new WorkerPool(FILE_COPY_NUM_THREADS);
+        }
+
+        job->pool = g_pool;
+        job->id = ++g_lastId;
+        g_jobs[job->id] = job;
+    }
+
+    PostTask(job, [job]() { StartTask(job); });
+    return job->id;
+}
+
+
+int Copy(const String& from, const String& to, CopyCallback onProgress)
+{
+    return Start(OPERATION_COPY, from, to, onProgress);
+}
+
+int Move(const String& from, const String& to, CopyCallback onProgress)
+{
+    return Start(OPERATION_MOVE, from, to, onProgress);
+}
+
+int CopyTree(const String& from, const String& to, CopyCallback onProgress)
+{
+    return Start(OPERATION_COPY_TREE, from, to, onProgress);
+}
+
+void CancelCopy(int id)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    std::map<int, CopyJobPtr>::iterator it = g_jobs.find(id);
+    if (it != g_jobs.end())
+        it->second->isCancelled = true;
+}
+
+void StopCopier()
+{
+    WorkerPool* pool = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_isStopping = true;
+        pool = g_pool;
+        g_pool = NULL;
+    }
+
+    // waits for the (aborted) tasks
+    delete pool;
+}
+
+} // namespace FileUtil
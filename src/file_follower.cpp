@@ -0,0 +1,355 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "file_follower.h"
+#include "file_util.h"
+#include "file_watcher.h"
+#include "utf8_util.h"
+
+
+namespace FileFollower {
+
+typedef std::chrono::steady_clock Clock;
+
+
+class FollowedFile : public FileWatcher::MonitorDelegate
+{
+public:
+    FollowedFile(const String& path, const String& name, uint64_t offset, UpdateCallback onUpdate)
+        : m_path(path), m_name(name), m_onUpdate(onUpdate), m_monitor(NULL), m_isActive(true),
+          m_hasPending(false), m_deadline(Clock::now()), m_isInitial(true), m_offset(offset)
+    {
+    }
+
+    virtual void OnChange(const String& relativePath, bool isRescanNeeded);
+
+    String m_path;
+    String m_name;
+    UpdateCallback m_onUpdate;
+    FileWatcher::Monitor* m_monitor;
+    std::atomic<bool> m_isActive;
+
+    // guarded by g_mutex
+    bool m_hasPending;
+    Clock::time_point m_deadline;
+
+    // only accessed by the follower thread
+    FileUtil::InputFile m_file;
+    bool m_isInitial;
+    uint64_t m_offset;
+    std::vector<uint8_t> m_incomplete;
+};
+
+typedef std::shared_ptr<FollowedFile> FollowPtr;
+
+
+static std::mutex g_mutex;
+static std::condition_variable g_cvWork;
+static std::map<String, FollowPtr> g_follows;
+static std::thread* g_follower = NULL;
+static std::atomic<bool> g_isStopping(false);
+
+
+void FollowedFile::OnChange(const String& relativePath, bool isRescanNeeded)
+{
+    // the monitor reports the changes of all the files in the directory
+    if (!isRescanNeeded && relativePath != m_name)
+        return;
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    // changes are collected for FILE_FOLLOWER_LATENCY after the first one, so
+    // that the file is read at most once per frame
+    if (!m_hasPending)
+    {
+        m_hasPending = true;
+
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(FILE_FOLLOWER_LATENCY);
+        if (deadline < m_deadline)
+        {
+            m_deadline = deadline;
+            g_cvWork.notify_one();
+        }
+    }
+}
+
+
+//
+// Reads the data appended to the file since the last check. Returns true if
+// there is more data to read.
+//
+static bool Check(FollowPtr follow)
+{
+    UpdateType type = UPDATE_APPENDED;
+    bool hasUpdate = false;
+
+    if (!follow->m_file.IsOpen())
+    {
+        if (!follow->m_file.Open(follow->m_path))
+            return false;
+
+        // a file which appears after the previous one has been renamed or
+        // deleted is read from the beginning
+        if (!follow->m_isInitial)
+        {
+            follow->m_offset = 0;
+            type = UPDATE_ROTATED;
+            hasUpdate = true;
+        }
+
+        follow->m_isInitial = false;
+    }
+
+    uint64_t size = 0;
+    if (!follow->m_file.GetSize(size))
+        return false;
+
+    if (size < follow->m_offset)
+    {
+        follow->m_offset = 0;
+        follow->m_incomplete.clear();
+        type = UPDATE_TRUNCATED;
+        hasUpdate = true;
+    }
+
+    // switch to the new file once all of the old file's data has been passed on
+    if (size == follow->m_offset && !follow->m_file.IsFileAt(follow->m_path))
+    {
+        follow->m_file.Close();
+        follow->m_incomplete.clear();
+
+        if (!follow->m_file.Open(follow->m_path) || !follow->m_file.GetSize(size))
+        {
+            // wait for the new file to be created
+            follow->m_file.Close();
+            return false;
+        }
+
+        follow->m_offset = 0;
+        type = UPDATE_ROTATED;
+        hasUpdate = true;
+    }
+
+    uint64_t length = size - follow->m_offset;
+    if (length > FILE_FOLLOWER_MAX_CHUNK_SIZE)
+        length = FILE_FOLLOWER_MAX_CHUNK_SIZE;
+
+    // prepend the bytes of a multi-byte sequence which was cut off last time
+    std::vector<uint8_t> buf;
+    buf.swap(follow->m_incomplete);
+    size_t numBytes = buf.size();
+    buf.resize(numBytes + (size_t) length);
+
+    while (numBytes < buf.size())
+    {
+        int64_t numBytesRead = follow->m_file.Read(follow->m_offset, &buf[numBytes], buf.size() - numBytes);
+        if (numBytesRead <= 0)
+            break;
+
+        numBytes += (size_t) numBytesRead;
+        follow->m_offset += (uint64_t) numBytesRead;
+    }
+
+    size_t completeLength = numBytes > 0 ? GetCompleteUTF8Length(&buf[0], numBytes) : 0;
+    if (completeLength < numBytes)
+        follow->m_incomplete.assign(buf.begin() + completeLength, buf.begin() + numBytes);
+
+    std::string data;
+    if (completeLength > 0)
+        AppendValidUTF8(data, &buf[0], completeLength);
+
+    if ((hasUpdate || data.length() > 0) && follow->m_isActive)
+        follow->m_onUpdate(type, data, follow->m_offset - follow->m_incomplete.size());
+
+    return follow->m_offset < size || !follow->m_file.IsFileAt(follow->m_path);
+}
+
+static void RunFollower()
+{
+    std::unique_lock<std::mutex> lock(g_mutex);
+
+    while (!g_isStopping)
+    {
+        FollowPtr follow;
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = (Clock::time_point::max)();
+
+        for (std::map<String, FollowPtr>::iterator it = g_follows.begin(); it != g_follows.end(); ++it)
+        {
+            if (it->second->m_deadline <= now)
+            {
+                follow = it->second;
+                break;
+            }
+
+            if (it->second->m_deadline < next)
+                next = it->second->m_deadline;
+        }
+
+        if (!follow)
+        {
+            if (next == (Clock::time_point::max)())
+                g_cvWork.wait(lock);
+            else
+                g_cvWork.wait_until(lock, next);
+            continue;
+        }
+
+        // changes reported while the file is checked schedule another check
+        follow->m_hasPending = false;
+        follow->m_deadline = now + std::chrono::milliseconds(follow->m_monitor != NULL ? FILE_FOLLOWER_CHECK_INTERVAL : FILE_FOLLOWER_POLL_INTERVAL);
+        lock.unlock();
+
+        bool hasMore = Check(follow);
+
+        lock.lock();
+
+        // continue with the rest of the data in the next frame
+        if (hasMore)
+        {
+            Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(FILE_FOLLOWER_LATENCY);
+            if (deadline < follow->m_deadline)
+                follow->m_deadline = deadline;
+        }
+    }
+}
+
+//
+// Deletes the monitor and deactivates the follow. Must be called without
+// holding g_mutex, since the monitor's thread might be waiting for it.
+//
+static void Release(FollowPtr follow)
+{
+    if (!follow)
+        return;
+
+    delete follow->m_monitor;
+    follow->m_isActive = false;
+}
+
+
+bool Follow(const String& path, int64_t offset, UpdateCallback onUpdate)
+{
+    // the directory containing the file is watched
+    size_t pos = path.find_last_of(FileUtil::GetPathSeparator());
+#ifdef OS_WIN
+    size_t posSlash = path.find_last_of(TEXT('/'));
+    if (posSlash != String::npos && (pos == String::npos || posSlash > pos))
+        pos = posSlash;
+#endif
+    if (pos == String::npos || pos == path.length() - 1)
+        return false;
+
+    String dir = pos == 0 ? path.substr(0, 1) : path.substr(0, pos);
+    String name = path.substr(pos + 1);
+
+    FileUtil::FileInfo info;
+    if (!FileUtil::GetFileStats(dir, info) || !info.isDirectory)
+        return false;
+
+    // a file which doesn't exist yet is followed from its beginning
+    uint64_t startOffset = 0;
+    if (FileUtil::GetFileStats(path, info))
+    {
+        if (info.isDirectory)
+            return false;
+        startOffset = offset < 0 ? info.size : (uint64_t) offset;
+    }
+
+    FollowPtr follow(new FollowedFile(path, name, startOffset, onUpdate));
+
+    // poll if the directory can't be watched
+    follow->m_monitor = FileWatcher::Monitor::Create(dir, false, follow.get());
+
+    FollowPtr oldFollow;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        g_isStopping = false;
+        if (g_follower == NULL)
+            g_follower = new std::thread(RunFollower);
+
+        FollowPtr& entry = g_follows[path];
+        oldFollow = entry;
+        entry = follow;
+        g_cvWork.notify_one();
+    }
+
+    Release(oldFollow);
+    return true;
+}
+
+void Unfollow(const String& path)
+{
+    FollowPtr follow;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        std::map<String, FollowPtr>::iterator it = g_follows.find(path);
+        if (it == g_follows.end())
+            return;
+
+        follow = it->second;
+        g_follows.erase(it);
+    }
+
+    Release(follow);
+}
+
+void Stop()
+{
+    std::map<String, FollowPtr> follows;
+    std::thread* follower = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        follows.swap(g_follows);
+        follower = g_follower;
+        g_follower = NULL;
+        g_isStopping = true;
+        g_cvWork.notify_all();
+    }
+
+    for (std::map<String, FollowPtr>::iterator it = follows.begin(); it != follows.end(); ++it)
+        Release(it->second);
+
+    if (follower != NULL)
+    {
+        follower->join();
+        delete follower;
+    }
+}
+
+} // namespace FileFollower
@@ -0,0 +1,92 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#ifndef __file_follower_h
+#define __file_follower_h
+
+
+#include <functional>
+#include <string>
+
+#include "types.h"
+
+
+// The time (in milliseconds) appended data is collected before it is passed on (about one frame)
+#define FILE_FOLLOWER_LATENCY 16
+
+// The interval (in milliseconds) in which files are checked if the OS doesn't notify of changes
+#define FILE_FOLLOWER_POLL_INTERVAL 250
+
+// The interval (in milliseconds) in which files are checked in addition to the OS's notifications,
+// which aren't reliable on network drives or while another process holds the file open on Windows
+#define FILE_FOLLOWER_CHECK_INTERVAL 1000
+
+// The maximum number of bytes passed on at once
+#define FILE_FOLLOWER_MAX_CHUNK_SIZE (1024 * 1024)
+
+
+namespace FileFollower {
+
+enum UpdateType
+{
+    UPDATE_APPENDED,
+    UPDATE_TRUNCATED,
+    UPDATE_ROTATED
+};
+
+//
+// Receives the data appended to a followed file (as UTF-8; a multi-byte
+// sequence cut off at the end is passed on with the next update) and the file
+// offset following it. If the file was truncated or replaced by a new file
+// (e.g., when a log is rotated), the type is UPDATE_TRUNCATED or UPDATE_ROTATED
+// and the data starts at the beginning of the file.
+//
+typedef std::function<void(UpdateType type, std::string& data, uint64_t offset)> UpdateCallback;
+
+//
+// Starts following the file "path" from "offset" (from its current end if
+// negative). The file doesn't need to exist yet. Changes are detected using
+// the OS's notification mechanism for the file's directory, or by polling if
+// the directory can't be watched. onUpdate is called from a background thread,
+// at most once every FILE_FOLLOWER_LATENCY milliseconds per file. If the file
+// is already followed, it is followed from the new offset.
+// Returns false if the file's directory doesn't exist.
+//
+bool Follow(const String& path, int64_t offset, UpdateCallback onUpdate);
+
+//
+// Stops following the file "path".
+//
+void Unfollow(const String& path);
+
+//
+// Stops following all files.
+//
+void Stop();
+
+} // namespace FileFollower
+
+
+#endif
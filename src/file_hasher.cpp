@@ -0,0 +1,199 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "file_hasher.h"
+#include "file_util.h"
+#include "hash_util.h"
+#include "worker_pool.h"
+
+
+namespace FileHasher {
+
+struct HashJob
+{
+    std::vector<String> paths;
+    Algorithm algorithm;
+    HashCallback onCompleted;
+
+    WorkerPool* pool;
+    std::atomic<int> numPendingTasks;
+
+    // each task writes the digest of its file only
+    std::vector<String> digests;
+};
+
+typedef std::shared_ptr<HashJob> HashJobPtr;
+
+
+static std::mutex g_mutex;
+static WorkerPool* g_pool = NULL;
+static std::atomic<bool> g_isStopping(false);
+
+
+//
+// Computes the digest of data passed in pieces.
+//
+class Hasher
+{
+public:
+    Hasher(Algorithm algorithm)
+        : m_algorithm(algorithm)
+    {
+    }
+
+    void Update(const uint8_t* data, size_t length)
+    {
+        if (m_algorithm == ALGORITHM_SHA256)
+            m_sha256.Update(data, length);
+        else
+            m_xxh64.Update(data, length);
+    }
+
+    String Final()
+    {
+        if (m_algorithm == ALGORITHM_XXH64)
+            return HashUtil::ToHex(m_xxh64.Final());
+
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        m_sha256.Final(digest);
+        return HashUtil::ToHex(digest, SHA256_DIGEST_SIZE);
+    }
+
+private:
+    Algorithm m_algorithm;
+    HashUtil::Sha256 m_sha256;
+    HashUtil::XXHash64 m_xxh64;
+};
+
+
+static void HashFileTask(HashJobPtr job, size_t index)
+{
+    FileUtil::InputFile file;
+    if (!file.Open(job->paths[index]))
+        return;
+
+    Hasher hasher(job->algorithm);
+    std::vector<uint8_t> buf(HASH_FILES_READ_SIZE);
+    uint64_t offset = 0;
+
+    for ( ; ; )
+    {
+        if (g_isStopping)
+            return;
+
+        int64_t numBytesRead = file.Read(offset, &buf[0], buf.size());
+        if (numBytesRead < 0)
+            return;
+        if (numBytesRead == 0)
+            break;
+
+        hasher.Update(&buf[0], (size_t) numBytesRead);
+        offset += (uint64_t) numBytesRead;
+    }
+
+    job->digests[index] = hasher.Final();
+}
+
+static void PostTask(HashJobPtr job, size_t index)
+{
+    job->pool->Post([job, index]() {
+        if (!g_isStopping && index < job->paths.size())
+            HashFileTask(job, index);
+
+        // the last task passes on the digests
+        if (--job->numPendingTasks == 0)
+            job->onCompleted(job->digests);
+    });
+}
+
+
+bool GetAlgorithm(const String& name, Algorithm& algorithm)
+{
+    String lowerName = name;
+    std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), tolower);
+
+    if (lowerName == TEXT("xxh64") || lowerName == TEXT("xxhash64"))
+        algorithm = ALGORITHM_XXH64;
+    else if (lowerName == TEXT("sha256") || lowerName == TEXT("sha-256"))
+        algorithm = ALGORITHM_SHA256;
+    else
+        return false;
+
+    return true;
+}
+
+void HashFiles(const std::vector<String>& paths, Algorithm algorithm, HashCallback onCompleted)
+{
+    HashJobPtr job(new HashJob());
+    job->paths = paths;
+    job->algorithm = algorithm;
+    job->onCompleted = onCompleted;
+    job->digests.resize(paths.size());
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (g_pool == NULL)
+        {
+            g_isStopping = false;
+            g_pool = new WorkerPool();
+        }
+        job->pool = g_pool;
+    }
+
+    // a job without files still needs a task to pass on the (empty) result
+    size_t numTasks = paths.size() > 0 ? paths.size() : 1;
+    job->numPendingTasks = (int) numTasks;
+    for (size_t i = 0; i < numTasks; ++i)
+        PostTask(job, i);
+}
+
+String HashBuffer(const uint8_t* data, size_t length, Algorithm algorithm)
+{
+    Hasher hasher(algorithm);
+    hasher.Update(data, length);
+    return hasher.Final();
+}
+
+void Stop()
+{
+    WorkerPool* pool = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_isStopping = true;
+        pool = g_pool;
+        g_pool = NULL;
+    }
+
+    // waits for the (aborted) tasks
+    delete pool;
+}
+
+} // namespace FileHasher
@@ -0,0 +1,79 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#ifndef __file_hasher_h
+#define __file_hasher_h
+
+
+#include <functional>
+#include <vector>
+
+#include "types.h"
+
+
+// The size of the (sequential) reads
+#define HASH_FILES_READ_SIZE (1024 * 1024)
+
+
+namespace FileHasher {
+
+enum Algorithm
+{
+    ALGORITHM_XXH64,
+    ALGORITHM_SHA256
+};
+
+//
+// Looks up an algorithm by its name ("xxh64" or "sha256"; case-insensitive,
+// "xxhash64" and "sha-256" are accepted as well).
+//
+bool GetAlgorithm(const String& name, Algorithm& algorithm);
+
+//
+// Receives the digests (lower-case hexadecimal strings) in the order of the
+// paths; the digest of a file which couldn't be read is empty.
+//
+typedef std::function<void(std::vector<String>& digests)> HashCallback;
+
+//
+// Hashes the files on a pool of background threads, one file per thread, and
+// calls onCompleted from a background thread once all files have been hashed.
+//
+void HashFiles(const std::vector<String>& paths, Algorithm algorithm, HashCallback onCompleted);
+
+//
+// Returns the digest of the data.
+//
+String HashBuffer(const uint8_t* data, size_t length, Algorithm algorithm);
+
+//
+// Aborts the pending jobs and stops the threads.
+//
+void Stop();
+
+} // namespace FileHasher
+
+
+#endif
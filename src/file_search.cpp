@@ -0,0 +1,332 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string.h>
+
+#include "file_search.h"
+#include "file_util.h"
+#include "search_pattern.h"
+#include "utf8_util.h"
+#include "worker_pool.h"
+
+
+namespace FileSearch {
+
+typedef std::chrono::steady_clock Clock;
+
+struct SearchJob
+{
+    String root;
+    Options options;
+    SearchPattern pattern;
+    ResultCallback onResults;
+
+    WorkerPool* pool;
+    std::atomic<int> numPendingTasks;
+    std::atomic<int> numResults;
+    std::atomic<bool> isCancelled;
+
+    std::mutex mutex;
+    std::vector<Match> batch;
+    Clock::time_point timeLastBatch;
+};
+
+typedef std::shared_ptr<SearchJob> SearchJobPtr;
+
+
+static std::mutex g_mutex;
+static WorkerPool* g_pool = NULL;
+static std::atomic<bool> g_isStopping(false);
+
+
+static String GetPath(SearchJobPtr job, const String& relativePath)
+{
+    return relativePath.length() == 0 ? job->root : job->root + FileUtil::GetPathSeparator() + relativePath;
+}
+
+//
+// Passes the batch on to the callback. The caller must hold the job's lock.
+//
+static void PassBatch(SearchJobPtr job, bool isDone)
+{
+    std::vector<Match> matches;
+    matches.swap(job->batch);
+    job->timeLastBatch = Clock::now();
+
+    job->onResults(matches, isDone);
+}
+
+static void AddResults(SearchJobPtr job, std::vector<Match>& matches)
+{
+    if (matches.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->batch.insert(job->batch.end(), matches.begin(), matches.end());
+
+    if (job->batch.size() >= SEARCH_FILES_MAX_BATCH_SIZE ||
+        Clock::now() - job->timeLastBatch >= std::chrono::milliseconds(SEARCH_FILES_BATCH_INTERVAL))
+    {
+        PassBatch(job, false);
+    }
+}
+
+static void PostTask(SearchJobPtr job, std::function<void()> task)
+{
+    ++job->numPendingTasks;
+    job->pool->Post([job, task]() {
+        if (!g_isStopping && !job->isCancelled)
+            task();
+
+        // the last task passes on the remaining matches
+        if (--job->numPendingTasks == 0)
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            PassBatch(job, true);
+        }
+    });
+}
+
+//
+// Creates the match for a line. start is the byte offset of the match.
+//
+static void AddMatch(std::vector<Match>& matches, const String& path, int lineNumber, const uint8_t* line, size_t length, size_t start)
+{
+    Match match;
+    match.path = path;
+    match.line = lineNumber;
+
+    // count the characters, i.e., the bytes which aren't UTF-8 continuation bytes
+    match.column = 1;
+    for (size_t i = 0; i < start; ++i)
+        if ((line[i] & 0xc0) != 0x80)
+            ++match.column;
+
+    // show some context before the match if the line is too long
+    size_t from = 0;
+    size_t to = length;
+    if (length > SEARCH_FILES_MAX_PREVIEW_LENGTH)
+    {
+        from = start > SEARCH_FILES_MAX_PREVIEW_LENGTH / 4 ? start - SEARCH_FILES_MAX_PREVIEW_LENGTH / 4 : 0;
+        while (from < length && (line[from] & 0xc0) == 0x80)
+            ++from;
+
+        to = from + SEARCH_FILES_MAX_PREVIEW_LENGTH < length ? from + SEARCH_FILES_MAX_PREVIEW_LENGTH : length;
+        while (to < length && to > from && (line[to] & 0xc0) == 0x80)
+            --to;
+    }
+
+    AppendValidUTF8(match.preview, line + from, to - from);
+    matches.push_back(match);
+}
+
+//
+// Searches the contents of a file line by line. If the pattern has a literal,
+// only the lines containing it are inspected.
+//
+static void SearchBuffer(SearchJobPtr job, const String& path, const uint8_t* data, size_t size, std::vector<Match>& matches)
+{
+    const SearchPattern& pattern = job->pattern;
+    SearchPattern::State state;
+
+    const uint8_t* end = data + size;
+    const uint8_t* p = data;
+    int lineNumber = 1;
+
+    while (p < end && !job->isCancelled && !g_isStopping)
+    {
+        const uint8_t* lineStart = p;
+        const uint8_t* found = NULL;
+
+        if (pattern.HasLiteral())
+        {
+            found = pattern.FindLiteral(p, end);
+            if (found == NULL)
+                break;
+
+            // skip to the line containing the literal
+            for (lineStart = found; lineStart > p && lineStart[-1] != '\n'; --lineStart)
+                ;
+            lineNumber += (int) std::count(p, lineStart, '\n');
+        }
+
+        const uint8_t* lineEnd = (const uint8_t*) memchr(lineStart, '\n', end - lineStart);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        size_t length = lineEnd - lineStart;
+        if (length > 0 && lineStart[length - 1] == '\r')
+            --length;
+
+        size_t start = 0;
+        size_t matchEnd = 0;
+        bool isMatch = false;
+
+        if (pattern.IsLiteral())
+        {
+            // the literal might span lines if it contains a line break
+            start = found - lineStart;
+            isMatch = start + pattern.GetLiteralLength() <= length;
+        }
+        else
+            isMatch = pattern.Match(lineStart, length, state, start, matchEnd);
+
+        if (isMatch)
+        {
+            if (job->numResults++ >= job->options.maxResults)
+            {
+                job->isCancelled = true;
+                break;
+            }
+
+            AddMatch(matches, path, lineNumber, lineStart, length, start);
+        }
+
+        if (lineEnd == end)
+            break;
+
+        p = lineEnd + 1;
+        ++lineNumber;
+    }
+
+    // stop the other tasks once enough matches have been found
+    if (job->numResults >= job->options.maxResults)
+        job->isCancelled = true;
+}
+
+static void SearchFileTask(SearchJobPtr job, String relativePath)
+{
+    FileUtil::MappedFile file;
+    if (!file.Open(GetPath(job, relativePath)))
+        return;
+
+    uint64_t size = file.GetSize();
+    if (size == 0 || size > SEARCH_FILES_MAX_FILE_SIZE)
+        return;
+
+    const uint8_t* data = file.Map(0, (size_t) size);
+    if (data == NULL)
+        return;
+
+    // skip binary files
+    if (memchr(data, 0, size < SEARCH_FILES_BINARY_CHECK_SIZE ? (size_t) size : SEARCH_FILES_BINARY_CHECK_SIZE) != NULL)
+        return;
+
+    std::vector<Match> matches;
+    SearchBuffer(job, relativePath, data, (size_t) size, matches);
+    AddResults(job, matches);
+}
+
+static void SearchDirectoryTask(SearchJobPtr job, String relativePath)
+{
+    std::vector<FileUtil::FileInfo> entries;
+    if (!FileUtil::ReadDirectory(GetPath(job, relativePath), entries))
+        return;
+
+#ifdef OS_WIN
+    bool caseInsensitive = true;
+#else
+    bool caseInsensitive = false;
+#endif
+
+    for (FileUtil::FileInfo& info : entries)
+    {
+        String path = relativePath.length() == 0 ? info.name : relativePath + FileUtil::GetPathSeparator() + info.name;
+
+        // don't follow symbolic links to avoid cycles and searching files twice
+        if (info.isSymbolicLink)
+            continue;
+
+        if (info.isDirectory)
+        {
+            PostTask(job, [job, path]() { SearchDirectoryTask(job, path); });
+            continue;
+        }
+
+        bool isIncluded = job->options.globs.empty();
+        for (std::vector<String>::iterator it = job->options.globs.begin(); it != job->options.globs.end() && !isIncluded; ++it)
+            isIncluded = FileUtil::MatchGlob(info.name, *it, caseInsensitive);
+
+        if (isIncluded)
+            PostTask(job, [job, path]() { SearchFileTask(job, path); });
+    }
+}
+
+bool Search(const String& root, const std::string& pattern, const Options& options, ResultCallback onResults)
+{
+    FileUtil::FileInfo info;
+    if (!FileUtil::GetFileStats(root, info) || !info.isDirectory)
+        return false;
+
+    SearchJobPtr job(new SearchJob());
+    if (!job->pattern.Compile(pattern, options.isRegex, options.caseInsensitive))
+        return false;
+
+    job->root = root;
+    job->options = options;
+    if (job->options.maxResults <= 0)
+        job->options.maxResults = SEARCH_FILES_DEFAULT_MAX_RESULTS;
+    job->onResults = onResults;
+    job->numPendingTasks = 0;
+    job->numResults = 0;
+    job->isCancelled = false;
+
+    // pass the first matches on immediately
+    job->timeLastBatch = Clock::now() - std::chrono::milliseconds(SEARCH_FILES_BATCH_INTERVAL);
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (g_pool == NULL)
+        {
+            g_isStopping = false;
+            g_pool = new WorkerPool();
+        }
+        job->pool = g_pool;
+    }
+
+    PostTask(job, [job]() { SearchDirectoryTask(job, String()); });
+    return true;
+}
+
+void Stop()
+{
+    WorkerPool* pool = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_isStopping = true;
+        pool = g_pool;
+        g_pool = NULL;
+    }
+
+    // waits for the (aborted) tasks
+    delete pool;
+}
+
+} // namespace FileSearch
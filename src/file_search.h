@@ -0,0 +1,107 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __file_search_h
+#define __file_search_h
+
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+
+// The default maximum number of matches returned by a search
+#define SEARCH_FILES_DEFAULT_MAX_RESULTS 1000
+
+// Files larger than this are skipped
+#define SEARCH_FILES_MAX_FILE_SIZE (64 * 1024 * 1024)
+
+// Files containing a zero byte within this many bytes from the start are
+// considered binary and skipped
+#define SEARCH_FILES_BINARY_CHECK_SIZE 8000
+
+// The maximum length (in bytes) of the line previews
+#define SEARCH_FILES_MAX_PREVIEW_LENGTH 200
+
+// Matches are passed on when the batch has reached this size...
+#define SEARCH_FILES_MAX_BATCH_SIZE 500
+
+// ...or if this many milliseconds have passed since the last batch was passed on
+#define SEARCH_FILES_BATCH_INTERVAL 30
+
+
+namespace FileSearch {
+
+//
+// A line matching the pattern. The path is relative to the searched directory,
+// line and column are 1-based; the column counts characters. The preview is
+// the (UTF-8 encoded) line, shortened around the match if it is too long.
+//
+struct Match
+{
+    String path;
+    int line;
+    int column;
+    std::string preview;
+};
+
+struct Options
+{
+    bool isRegex;
+    bool caseInsensitive;
+
+    // glob patterns of which the file names must match one; all files are
+    // searched if empty
+    std::vector<String> globs;
+
+    int maxResults;
+};
+
+//
+// Receives a batch of matches. isDone is set for the last batch.
+//
+typedef std::function<void(std::vector<Match>& matches, bool isDone)> ResultCallback;
+
+//
+// Searches the files in the directory "root" and its subdirectories for the
+// (UTF-8 encoded) pattern on a pool of worker threads, which steal work from
+// each other so large and small directories are balanced. Binary files are
+// skipped. There is at most one match per line. The search ends once
+// options.maxResults matches have been found.
+// onResults is called from the worker threads, but never concurrently.
+// Returns false if "root" isn't a directory or the pattern is invalid.
+//
+bool Search(const String& root, const std::string& pattern, const Options& options, ResultCallback onResults);
+
+//
+// Aborts the searches in progress and stops the worker threads.
+//
+void Stop();
+
+} // namespace FileSearch
+
+
+#endif
@@ -0,0 +1,213 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <algorithm>
+
+#include "file_util.h"
+#include "utf8_util.h"
+
+
+namespace FileUtil {
+
+static inline TCHAR ToLowerASCII(TCHAR c)
+{
+    return c >= TEXT('A') && c <= TEXT('Z') ? (TCHAR) (c - TEXT('A') + TEXT('a')) : c;
+}
+
+//
+// Matches a "[...]" character class starting at pattern[pos]; sets "end" to the
+// position after the closing bracket.
+//
+static bool MatchCharacterClass(const String& pattern, size_t pos, TCHAR c, bool caseInsensitive, size_t& end)
+{
+    size_t i = pos + 1;
+    bool isNegated = i < pattern.length() && (pattern[i] == TEXT('!') || pattern[i] == TEXT('^'));
+    if (isNegated)
+        ++i;
+
+    bool isMatch = false;
+    bool isFirst = true;
+    for ( ; i < pattern.length() && (isFirst || pattern[i] != TEXT(']')); ++i, isFirst = false)
+    {
+        TCHAR lo = pattern[i];
+        TCHAR hi = lo;
+        if (i + 2 < pattern.length() && pattern[i + 1] == TEXT('-') && pattern[i + 2] != TEXT(']'))
+        {
+            hi = pattern[i + 2];
+            i += 2;
+        }
+
+        if ((c >= lo && c <= hi) || (caseInsensitive && ToLowerASCII(c) >= ToLowerASCII(lo) && ToLowerASCII(c) <= ToLowerASCII(hi)))
+            isMatch = true;
+    }
+
+    end = i < pattern.length() ? i + 1 : i;
+    return isMatch != isNegated;
+}
+
+bool MatchGlob(const String& name, const String& pattern, bool caseInsensitive)
+{
+    // iterative matching, backtracking to the last "*" on a mismatch
+    size_t n = 0;
+    size_t p = 0;
+    size_t starP = String::npos;
+    size_t starN = 0;
+
+    while (n < name.length())
+    {
+        if (p < pattern.length())
+        {
+            TCHAR pc = pattern[p];
+            if (pc == TEXT('*'))
+            {
+                starP = p++;
+                starN = n;
+                continue;
+            }
+
+            size_t next = p + 1;
+            bool isMatch;
+            if (pc == TEXT('?'))
+                isMatch = true;
+            else if (pc == TEXT('['))
+                isMatch = MatchCharacterClass(pattern, p, name[n], caseInsensitive, next);
+            else
+                isMatch = pc == name[n] || (caseInsensitive && ToLowerASCII(pc) == ToLowerASCII(name[n]));
+
+            if (isMatch)
+            {
+                p = next;
+                ++n;
+                continue;
+            }
+        }
+
+        if (starP == String::npos)
+            return false;
+
+        // let the last "*" consume one more character
+        p = starP + 1;
+        n = ++starN;
+    }
+
+    while (p < pattern.length() && pattern[p] == TEXT('*'))
+        ++p;
+
+    return p == pattern.length();
+}
+
+//
+// Looks up an encoding by name; an empty name selects detection.
+//
+static bool GetTextEncoding(const String& name, TextEncoding& encoding, bool& isDetected)
+{
+    String lowerName = name;
+    std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), tolower);
+
+    isDetected = false;
+    if (lowerName == TEXT("") || lowerName == TEXT("auto"))
+        isDetected = true;
+    else if (lowerName == TEXT("utf-8") || lowerName == TEXT("utf8") || lowerName == TEXT("text/plain;utf-8"))
+        encoding = ENCODING_UTF8;
+    else if (lowerName == TEXT("utf-16le"))
+        encoding = ENCODING_UTF16LE;
+    else if (lowerName == TEXT("utf-16be"))
+        encoding = ENCODING_UTF16BE;
+    else if (lowerName == TEXT("latin1") || lowerName == TEXT("iso-8859-1"))
+        encoding = ENCODING_LATIN1;
+    else
+        return false;
+
+    return true;
+}
+
+bool ReadFile(const String& filename, const String& encoding, JavaScript::Array ret)
+{
+    TextEncoding textEncoding = ENCODING_UTF8;
+    bool isDetected;
+    if (!GetTextEncoding(encoding, textEncoding, isDetected))
+        return false;
+
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+
+    uint64_t fileSize = file.GetSize();
+    if (fileSize > (size_t) -1)
+        return false;
+
+    const uint8_t* data = NULL;
+    if (fileSize > 0)
+    {
+        data = file.Map(0, (size_t) fileSize);
+        if (data == NULL)
+            return false;
+    }
+
+    // a BOM is skipped if it matches the requested encoding
+    size_t bomLength;
+    TextEncoding detectedEncoding = DetectTextEncoding(data, (size_t) fileSize, bomLength);
+    if (isDetected)
+        textEncoding = detectedEncoding;
+    else if (textEncoding != detectedEncoding)
+        bomLength = 0;
+
+    std::string text;
+    AppendAsUTF8(text, data + bomLength, (size_t) fileSize - bomLength, textEncoding);
+
+    static const TCHAR* encodingNames[] = { TEXT("utf-8"), TEXT("utf-16le"), TEXT("utf-16be"), TEXT("latin1") };
+    ret->SetString(0, text);
+    ret->SetDouble(1, (double) fileSize);
+    ret->SetString(2, encodingNames[textEncoding]);
+    return true;
+}
+
+bool ReadFileBinary(const String& filename, uint64_t offset, int64_t length, JavaScript::Array ret)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+
+    uint64_t fileSize = file.GetSize();
+    uint64_t available = offset < fileSize ? fileSize - offset : 0;
+    uint64_t size = length < 0 || (uint64_t) length > available ? available : (uint64_t) length;
+    if (size > FILE_MAX_SLICE_SIZE)
+        size = FILE_MAX_SLICE_SIZE;
+
+    if (size == 0)
+        JavaScript::SetBinary(ret, 0, NULL, 0);
+    else
+    {
+        const uint8_t* data = file.Map(offset, (size_t) size);
+        if (data == NULL)
+            return false;
+
+        // the bridge copies the bytes directly out of the mapped view
+        JavaScript::SetBinary(ret, 0, data, (size_t) size);
+    }
+
+    ret->SetDouble(1, (double) fileSize);
+    return true;
+}
+
+} // namespace FileUtil
@@ -20,11 +20,280 @@
 // IN THE SOFTWARE.
 //
 
+#ifndef __file_util_h
+#define __file_util_h
+
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#ifdef OS_WIN
+#include <windows.h>
+#endif
+
 #include "types.h"
 
 
+//
+// The maximum number of bytes returned by a single binary readFile call.
+//
+#define FILE_MAX_SLICE_SIZE (64 * 1024 * 1024)
+
+//
+// The number of files copied concurrently.
+//
+#define FILE_COPY_NUM_THREADS 4
+
+//
+// The minimum interval (in milliseconds) between two progress reports of a
+// copy.
+//
+#define FILE_COPY_PROGRESS_INTERVAL 100
+
+
 namespace FileUtil {
 
+//
+// A read-only memory mapping of a file. Only the window requested by Map is
+// mapped, so files larger than the address space (or 4 GB) can be accessed.
+//
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const String& path);
+    void Close();
+
+    uint64_t GetSize() const { return m_size; }
+
+    //
+    // Maps the range [offset, offset + length) and returns a pointer to its
+    // first byte. The pointer stays valid until the next call to Map or Close.
+    //
+    const uint8_t* Map(uint64_t offset, size_t length);
+
+private:
+    void Unmap();
+
+    uint64_t m_size;
+    void* m_view;
+    size_t m_viewSize;
+
+#ifdef OS_WIN
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+#else
+    int m_fd;
+#endif
+
+    // not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+//
+// An entry of a directory. The size and modification time (in milliseconds
+// since 1970) are only valid if hasStats is set.
+//
+struct FileInfo
+{
+    String name;
+    bool isDirectory;
+    bool isSymbolicLink;
+    bool hasStats;
+    uint64_t size;
+    double modified;
+};
+
+//
+// Lists the entries of a directory (without "." and ".."). On Windows, the
+// stats are retrieved along with the entries.
+//
+bool ReadDirectory(const String& path, std::vector<FileInfo>& entries);
+
+//
+// Retrieves the size, modification time and type of a file, following
+// symbolic links.
+//
+bool GetFileStats(const String& path, FileInfo& info);
+
+enum StatError
+{
+    STAT_OK,
+    STAT_NOT_FOUND,
+    STAT_ACCESS_DENIED,
+    STAT_FAILED
+};
+
+//
+// The stats of a file as returned by GetFileStatus. The mode contains the
+// POSIX file type and permission bits (derived from the attributes on
+// Windows); the modification time is in milliseconds since 1970. If the error
+// isn't STAT_OK, the other fields are 0.
+//
+struct FileStatus
+{
+    uint64_t size;
+    double modified;
+    uint32_t mode;
+    StatError error;
+};
+
+//
+// Retrieves the stats of a file (following symbolic links), including the
+// reason why they couldn't be retrieved.
+//
+void GetFileStatus(const String& path, FileStatus& status);
+
+//
+// Tests whether a file name matches a glob pattern ("*", "?" and "[...]" with
+// ranges and "!" for negation).
+//
+bool MatchGlob(const String& name, const String& pattern, bool caseInsensitive = false);
+
+//
+// Returns the separator for paths on the current platform.
+//
+inline TCHAR GetPathSeparator()
+{
+#ifdef OS_WIN
+    return TEXT('\\');
+#else
+    return TEXT('/');
+#endif
+}
+
+//
+// A file opened for reading. The file can be renamed or deleted by other
+// processes while it is open.
+//
+class InputFile
+{
+public:
+    InputFile();
+    ~InputFile();
+
+    bool Open(const String& path);
+    void Close();
+
+    bool IsOpen() const;
+    bool GetSize(uint64_t& size);
+
+    //
+    // Reads up to "length" bytes starting at "offset". Returns the number of
+    // bytes read (0 at the end of the file) or -1 if an error occurred.
+    //
+    int64_t Read(uint64_t offset, uint8_t* data, size_t length);
+
+    //
+    // Tests whether "path" still refers to the open file, i.e., whether the
+    // file hasn't been renamed or deleted (and possibly replaced).
+    //
+    bool IsFileAt(const String& path);
+
+private:
+#ifdef OS_WIN
+    HANDLE m_hFile;
+#else
+    int m_fd;
+#endif
+
+    // not copyable
+    InputFile(const InputFile&);
+    InputFile& operator=(const InputFile&);
+};
+
+//
+// A file opened for writing.
+//
+class OutputFile
+{
+public:
+    OutputFile();
+    ~OutputFile();
+
+    //
+    // Creates or truncates the file, or opens it for appending.
+    //
+    bool Open(const String& path, bool append);
+
+    //
+    // Creates or truncates a file which is to replace "original" and gives it
+    // the permissions (and, if possible, the owner) of original if that
+    // exists.
+    //
+    bool OpenReplacement(const String& path, const String& original);
+
+    void Close();
+
+    bool Write(const uint8_t* data, size_t length);
+
+    //
+    // Flushes the file's data to the storage device. On Mac, fsync doesn't
+    // flush the drive's cache; if flushDeviceCache is set, this is done as
+    // well (for all the files written before), which is expensive.
+    //
+    bool Sync(bool flushDeviceCache);
+
+private:
+#ifdef OS_WIN
+    HANDLE m_hFile;
+#else
+    int m_fd;
+#endif
+
+    // not copyable
+    OutputFile(const OutputFile&);
+    OutputFile& operator=(const OutputFile&);
+};
+
+//
+// Renames a file, replacing "to" if it exists.
+//
+bool RenameFile(const String& from, const String& to);
+
+//
+// Makes renames within the directory durable (a no-op on Windows).
+//
+bool SyncDirectory(const String& path);
+
+//
+// Creates a directory. Succeeds if the directory already exists.
+//
+bool MakeDirectory(const String& path);
+
+bool RemoveFile(const String& path);
+
+bool RemoveEmptyDirectory(const String& path);
+
+//
+// Returns true if both paths exist and refer to the same file or directory
+// (e.g., through hard or symbolic links).
+//
+bool IsSameFile(const String& path1, const String& path2);
+
+//
+// Receives the number of bytes copied so far; returns false to cancel the copy.
+//
+typedef std::function<bool(uint64_t numBytesCopied)> CopyProgressCallback;
+
+//
+// Copies the contents of the file "from" to the file "to" (which is replaced
+// if it exists) and gives it the permissions of "from". The copy is done by
+// the kernel where possible: reflinks (which share the data blocks),
+// copy_file_range or sendfile on Linux, CopyFileEx on Windows. Fails if "to"
+// is "from" itself. If the copy fails or is cancelled, "to" is deleted if the
+// copy has created it (on Windows, an existing "to" is replaced once the copy
+// is complete).
+//
+bool CopyFileContents(const String& from, const String& to, CopyProgressCallback onProgress);
+
+
+
 #ifdef USE_WEBVIEW
 void ShowOpenFileDialog(JSObjectRef callback);
 void ShowOpenDirectoryDialog(JSObjectRef callback);
@@ -35,6 +304,112 @@ String ShowOpenDirectoryDialog();
 
 void ShowInFileManager(String path);
 
-bool ReadFile(String filename, JavaScript::Object options, String& result);
+#ifndef NATIVE_ONLY
+//
+// Reads a text file and converts it to UTF-8. encoding is "utf-8", "utf-16le",
+// "utf-16be", "latin1" or empty to detect the encoding from the BOM (files
+// without a BOM are read as UTF-8 if they are valid UTF-8, and as Latin-1
+// otherwise). Sets the text at ret[0], the file size at ret[1] and the name of
+// the encoding used at ret[2]. Returns false if the file can't be read or the
+// encoding isn't supported.
+//
+bool ReadFile(const String& filename, const String& encoding, JavaScript::Array ret);
+
+//
+// Reads up to "length" bytes (to the end of the file if negative) from the
+// file, starting at "offset", without transcoding. Sets the binary data at
+// ret[0] and the total file size at ret[1].
+//
+bool ReadFileBinary(const String& filename, uint64_t offset, int64_t length, JavaScript::Array ret);
+#endif
 
-} // namespace FileUtil
\ No newline at end of file
+typedef std::function<void(bool success)> WriteCallback;
+
+//
+// Writes data (swapped out of "data") to the file on the background writer
+// thread and calls onCompleted on that thread. Writes are executed in the order
+// in which they are issued.
+// If "atomic" is set, the data is written to a temporary file which then
+// replaces the file, so readers see either the old or the new contents.
+// If "sync" is set, onCompleted is called once the data is on the storage
+// device; the writes which queue up while the writer is busy are synced as one
+// group, so concurrent durable writes share the cost of flushing.
+//
+void WriteFile(const String& filename, std::vector<uint8_t>& data, bool atomic, bool sync, WriteCallback onCompleted);
+
+//
+// Appends data to the file (creating it if necessary); see WriteFile.
+//
+void AppendFile(const String& filename, std::vector<uint8_t>& data, bool sync, WriteCallback onCompleted);
+
+//
+// Completes the pending writes and stops the writer thread.
+//
+void StopWriter();
+
+enum CopyStatus
+{
+    COPY_IN_PROGRESS,
+    COPY_DONE,
+    COPY_FAILED,
+    COPY_CANCELLED
+};
+
+struct CopyProgress
+{
+    int id;
+    CopyStatus status;
+    uint64_t numBytesCopied;
+    uint64_t numBytesTotal;
+    int numFilesCopied;
+    int numFilesTotal;
+};
+
+//
+// Receives the progress of a copy or move: right after it has started, at
+// most every FILE_COPY_PROGRESS_INTERVAL milliseconds while it is in progress,
+// and once it has ended (the status is no longer COPY_IN_PROGRESS).
+//
+typedef std::function<void(const CopyProgress& progress)> CopyCallback;
+
+//
+// Copies the file "from" to "to" on the copier's thread pool. Returns the ID of
+// the operation, which can be passed to CancelCopy. Copies and moves fail if
+// "to" is the same file or directory as "from".
+//
+int Copy(const String& from, const String& to, CopyCallback onProgress);
+
+//
+// Moves (renames) the file or directory "from" to "to". If that's not possible
+// (e.g., because "to" is on another volume), "from" is copied and deleted.
+//
+int Move(const String& from, const String& to, CopyCallback onProgress);
+
+//
+// Copies the directory "from" with all its contents to "to" (which is merged
+// with an existing directory), copying several files concurrently. Symbolic
+// links to directories aren't followed.
+//
+int CopyTree(const String& from, const String& to, CopyCallback onProgress);
+
+//
+// Cancels an operation. Files which have been copied completely are kept.
+//
+void CancelCopy(int id);
+
+//
+// Cancels all operations and stops the copier's threads.
+//
+void StopCopier();
+
+//
+// Retrieves the directory in which the app can store its data (creating it if
+// necessary): %APPDATA%\Vanamco\Zephyros on Windows,
+// ~/Library/Application Support/<bundle identifier> on Mac.
+//
+bool GetApplicationDataDirectory(String& path);
+
+} // namespace FileUtil
+
+
+#endif
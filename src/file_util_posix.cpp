@@ -0,0 +1,556 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#include "file_util.h"
+
+
+// The number of bytes copied per system call (between progress reports)
+#define FILE_COPY_CHUNK_SIZE (8 * 1024 * 1024)
+
+// The size of the buffer if the data has to be copied in user space
+#define FILE_COPY_BUFFER_SIZE (1024 * 1024)
+
+
+namespace FileUtil {
+
+MappedFile::MappedFile()
+    : m_size(0), m_view(NULL), m_viewSize(0), m_fd(-1)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const String& path)
+{
+    Close();
+
+    m_fd = open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        Close();
+        return false;
+    }
+
+    m_size = (uint64_t) st.st_size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    Unmap();
+
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+
+    m_size = 0;
+}
+
+const uint8_t* MappedFile::Map(uint64_t offset, size_t length)
+{
+    Unmap();
+
+    if (m_fd < 0 || length == 0 || offset >= m_size || length > m_size - offset)
+        return NULL;
+
+    // mmap offsets must be page-aligned
+    static const uint64_t pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+    uint64_t alignedOffset = offset - offset % pageSize;
+    size_t delta = (size_t) (offset - alignedOffset);
+
+    void* view = mmap(NULL, length + delta, PROT_READ, MAP_SHARED, m_fd, (off_t) alignedOffset);
+    if (view == MAP_FAILED)
+        return NULL;
+
+    // the data is consumed front-to-back
+    madvise(view, length + delta, MADV_SEQUENTIAL);
+
+    m_view = view;
+    m_viewSize = length + delta;
+    return (const uint8_t*) view + delta;
+}
+
+void MappedFile::Unmap()
+{
+    if (m_view != NULL)
+    {
+        munmap(m_view, m_viewSize);
+        m_view = NULL;
+        m_viewSize = 0;
+    }
+}
+
+
+bool ReadDirectory(const String& path, std::vector<FileInfo>& entries)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL)
+        return false;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        FileInfo info;
+        info.name = entry->d_name;
+        info.hasStats = false;
+        info.size = 0;
+        info.modified = 0;
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN)
+        {
+            // not all file systems report the type
+            struct stat st;
+            if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+                type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISLNK(st.st_mode) ? DT_LNK : DT_REG);
+        }
+
+        info.isDirectory = type == DT_DIR;
+        info.isSymbolicLink = type == DT_LNK;
+        entries.push_back(info);
+    }
+
+    closedir(dir);
+    return true;
+}
+
+bool GetFileStats(const String& path, FileInfo& info)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+    info.isDirectory = S_ISDIR(st.st_mode);
+    info.size = (uint64_t) st.st_size;
+#ifdef __APPLE__
+    info.modified = st.st_mtimespec.tv_sec * 1000.0 + st.st_mtimespec.tv_nsec / 1000000;
+#else
+    info.modified = st.st_mtim.tv_sec * 1000.0 + st.st_mtim.tv_nsec / 1000000;
+#endif
+    info.hasStats = true;
+
+    return true;
+}
+
+void GetFileStatus(const String& path, FileStatus& status)
+{
+    status.size = 0;
+    status.modified = 0;
+    status.mode = 0;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        status.error = errno == ENOENT || errno == ENOTDIR ? STAT_NOT_FOUND : (errno == EACCES || errno == EPERM ? STAT_ACCESS_DENIED : STAT_FAILED);
+        return;
+    }
+
+    status.size = (uint64_t) st.st_size;
+#ifdef __APPLE__
+    status.modified = st.st_mtimespec.tv_sec * 1000.0 + st.st_mtimespec.tv_nsec / 1000000;
+#else
+    status.modified = st.st_mtim.tv_sec * 1000.0 + st.st_mtim.tv_nsec / 1000000;
+#endif
+    status.mode = (uint32_t) st.st_mode;
+    status.error = STAT_OK;
+}
+
+InputFile::InputFile()
+    : m_fd(-1)
+{
+}
+
+InputFile::~InputFile()
+{
+    Close();
+}
+
+bool InputFile::Open(const String& path)
+{
+    Close();
+
+    m_fd = open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void InputFile::Close()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool InputFile::IsOpen() const
+{
+    return m_fd >= 0;
+}
+
+bool InputFile::GetSize(uint64_t& size)
+{
+    struct stat st;
+    if (m_fd < 0 || fstat(m_fd, &st) != 0)
+        return false;
+
+    size = (uint64_t) st.st_size;
+    return true;
+}
+
+int64_t InputFile::Read(uint64_t offset, uint8_t* data, size_t length)
+{
+    for ( ; ; )
+    {
+        ssize_t numBytesRead = pread(m_fd, data, length, (off_t) offset);
+        if (numBytesRead >= 0)
+            return numBytesRead;
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+bool InputFile::IsFileAt(const String& path)
+{
+    struct stat st;
+    struct stat stPath;
+    if (m_fd < 0 || fstat(m_fd, &st) != 0 || stat(path.c_str(), &stPath) != 0)
+        return false;
+
+    return st.st_dev == stPath.st_dev && st.st_ino == stPath.st_ino;
+}
+
+OutputFile::OutputFile()
+    : m_fd(-1)
+{
+}
+
+OutputFile::~OutputFile()
+{
+    Close();
+}
+
+bool OutputFile::Open(const String& path, bool append)
+{
+    Close();
+
+    m_fd = open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    return m_fd >= 0;
+}
+
+bool OutputFile::OpenReplacement(const String& path, const String& original)
+{
+    struct stat st;
+    if (stat(original.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return Open(path, false);
+
+    Close();
+
+    // create the file private and only then apply the original's owner and
+    // mode (changing the owner would clear the setuid and setgid bits)
+    m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (m_fd < 0)
+        return false;
+
+    if (fchown(m_fd, st.st_uid, st.st_gid) != 0)
+        fchown(m_fd, (uid_t) -1, st.st_gid);
+    fchmod(m_fd, st.st_mode & 07777);
+
+    return true;
+}
+
+void OutputFile::Close()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool OutputFile::Write(const uint8_t* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t numBytesWritten = write(m_fd, data, length);
+        if (numBytesWritten < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data += numBytesWritten;
+        length -= (size_t) numBytesWritten;
+    }
+
+    return true;
+}
+
+bool OutputFile::Sync(bool flushDeviceCache)
+{
+#ifdef F_FULLFSYNC
+    if (flushDeviceCache && fcntl(m_fd, F_FULLFSYNC) == 0)
+        return true;
+    return fsync(m_fd) == 0;
+#else
+    // only Mac can flush the device cache
+    (void) flushDeviceCache;
+#ifdef __linux__
+    return fdatasync(m_fd) == 0;
+#else
+    return fsync(m_fd) == 0;
+#endif
+#endif
+}
+
+bool RenameFile(const String& from, const String& to)
+{
+    return rename(from.c_str(), to.c_str()) == 0;
+}
+
+bool SyncDirectory(const String& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    bool ret = fsync(fd) == 0;
+    close(fd);
+    return ret;
+}
+
+bool MakeDirectory(const String& path)
+{
+    if (mkdir(path.c_str(), 0755) == 0)
+        return true;
+
+    struct stat st;
+    return errno == EEXIST && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool RemoveFile(const String& path)
+{
+    return unlink(path.c_str()) == 0;
+}
+
+bool RemoveEmptyDirectory(const String& path)
+{
+    return rmdir(path.c_str()) == 0;
+}
+
+//
+// Compares the device and inode numbers of both paths.
+//
+bool IsSameFile(const String& path1, const String& path2)
+{
+    struct stat st1;
+    struct stat st2;
+    if (stat(path1.c_str(), &st1) != 0 || stat(path2.c_str(), &st2) != 0)
+        return false;
+
+    return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+//
+// Copies the data by reading it into a buffer.
+//
+static bool CopyDataInUserSpace(int fdIn, int fdOut, uint64_t offset, CopyProgressCallback& onProgress)
+{
+    std::vector<uint8_t> buf(FILE_COPY_BUFFER_SIZE);
+
+    for ( ; ; )
+    {
+        ssize_t numBytesRead = pread(fdIn, &buf[0], buf.size(), (off_t) offset);
+        if (numBytesRead < 0 && errno == EINTR)
+            continue;
+        if (numBytesRead < 0)
+            return false;
+        if (numBytesRead == 0)
+            return true;
+
+        for (ssize_t numBytesWritten = 0; numBytesWritten < numBytesRead; )
+        {
+            ssize_t n = pwrite(fdOut, &buf[numBytesWritten], numBytesRead - numBytesWritten, (off_t) (offset + numBytesWritten));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return false;
+            numBytesWritten += n;
+        }
+
+        offset += (uint64_t) numBytesRead;
+        if (!onProgress(offset))
+            return false;
+    }
+}
+
+static bool CopyData(int fdIn, int fdOut, uint64_t size, CopyProgressCallback& onProgress)
+{
+#ifdef __linux__
+#ifdef FICLONE
+    // a reflink shares the data blocks (btrfs, XFS), so nothing is copied
+    if (ioctl(fdOut, FICLONE, fdIn) == 0)
+    {
+        onProgress(size);
+        return true;
+    }
+#endif
+
+    uint64_t offset = 0;
+#ifdef __NR_copy_file_range
+    // copies within the kernel (or the file system, e.g. server-side on NFS)
+    while (offset < size)
+    {
+        loff_t offsetIn = (loff_t) offset;
+        loff_t offsetOut = (loff_t) offset;
+        size_t length = size - offset < FILE_COPY_CHUNK_SIZE ? (size_t) (size - offset) : FILE_COPY_CHUNK_SIZE;
+        long n = syscall(__NR_copy_file_range, fdIn, &offsetIn, fdOut, &offsetOut, length, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        offset += (uint64_t) n;
+        if (!onProgress(offset))
+            return false;
+    }
+#endif
+
+    // sendfile writes at the file position of fdOut
+    if (offset < size && lseek(fdOut, (off_t) offset, SEEK_SET) == (off_t) offset)
+    {
+        while (offset < size)
+        {
+            off_t offsetIn = (off_t) offset;
+            size_t length = size - offset < FILE_COPY_CHUNK_SIZE ? (size_t) (size - offset) : FILE_COPY_CHUNK_SIZE;
+            ssize_t n = sendfile(fdOut, fdIn, &offsetIn, length);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+
+            offset += (uint64_t) n;
+            if (!onProgress(offset))
+                return false;
+        }
+    }
+
+    // the file might have grown, or the kernel can't copy between the files
+    return CopyDataInUserSpace(fdIn, fdOut, offset, onProgress);
+#else
+    (void) size;
+    return CopyDataInUserSpace(fdIn, fdOut, 0, onProgress);
+#endif
+}
+
+bool CopyFileContents(const String& from, const String& to, CopyProgressCallback onProgress)
+{
+    int fdIn = open(from.c_str(), O_RDONLY);
+    if (fdIn < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fdIn, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fdIn);
+        return false;
+    }
+
+    // "to" is only deleted on failure if it is created here
+    bool isCreated = true;
+    int fdOut = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 0777);
+    if (fdOut < 0 && errno == EEXIST)
+    {
+        isCreated = false;
+        fdOut = open(to.c_str(), O_WRONLY);
+    }
+
+    if (fdOut < 0)
+    {
+        close(fdIn);
+        return false;
+    }
+
+    // truncating "from" itself (e.g., through a link) would destroy the data
+    if (!isCreated)
+    {
+        struct stat stOut;
+        if (fstat(fdOut, &stOut) != 0 || (stOut.st_dev == st.st_dev && stOut.st_ino == st.st_ino) || ftruncate(fdOut, 0) != 0)
+        {
+            close(fdIn);
+            close(fdOut);
+            return false;
+        }
+    }
+
+    bool ret = CopyData(fdIn, fdOut, (uint64_t) st.st_size, onProgress);
+
+    close(fdIn);
+    if (close(fdOut) != 0)
+        ret = false;
+
+    if (!ret && isCreated)
+        unlink(to.c_str());
+
+    return ret;
+}
+
+} // namespace FileUtil
@@ -143,44 +143,439 @@ void ShowInFileManager(String path)
 	ShellExecute(NULL, TEXT("open"), path.c_str(), NULL, NULL, SW_SHOWDEFAULT);
 }
 
-bool ReadFile(String filename, JavaScript::Object options, String& result)
+static double FileTimeToMilliseconds(const FILETIME& fileTime)
 {
-	String encoding = TEXT("");
-	if (options->HasKey("encoding"))
-		options->GetString("encoding");
+	// FILETIMEs count 100 ns intervals since 1601
+	ULARGE_INTEGER time;
+	time.LowPart = fileTime.dwLowDateTime;
+	time.HighPart = fileTime.dwHighDateTime;
+	return (double) ((time.QuadPart - 116444736000000000ULL) / 10000);
+}
+
+bool ReadDirectory(const String& path, std::vector<FileInfo>& entries)
+{
+	WIN32_FIND_DATA findData;
+	HANDLE hFind = FindFirstFileEx((path + TEXT("\\*")).c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		if (_tcscmp(findData.cFileName, TEXT(".")) == 0 || _tcscmp(findData.cFileName, TEXT("..")) == 0)
+			continue;
+
+		// the stats come for free
+		FileInfo info;
+		info.name = findData.cFileName;
+		info.isDirectory = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		info.isSymbolicLink = (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+		info.hasStats = true;
+		info.size = ((uint64_t) findData.nFileSizeHigh << 32) | findData.nFileSizeLow;
+		info.modified = FileTimeToMilliseconds(findData.ftLastWriteTime);
+		entries.push_back(info);
+	} while (FindNextFile(hFind, &findData));
+
+	FindClose(hFind);
+	return true;
+}
+
+bool GetFileStats(const String& path, FileInfo& info)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+
+	info.isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+	info.size = ((uint64_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	info.modified = FileTimeToMilliseconds(data.ftLastWriteTime);
+	info.hasStats = true;
+
+	return true;
+}
+
+void GetFileStatus(const String& path, FileStatus& status)
+{
+	status.size = 0;
+	status.modified = 0;
+	status.mode = 0;
+
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+	{
+		DWORD error = GetLastError();
+		status.error = error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND || error == ERROR_INVALID_NAME ? STAT_NOT_FOUND :
+			(error == ERROR_ACCESS_DENIED ? STAT_ACCESS_DENIED : STAT_FAILED);
+		return;
+	}
+
+	status.size = ((uint64_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	status.modified = FileTimeToMilliseconds(data.ftLastWriteTime);
+
+	// S_IFDIR | 0755 or S_IFREG | 0644 (0444 if read-only)
+	if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		status.mode = 040755;
+	else
+		status.mode = (data.dwFileAttributes & FILE_ATTRIBUTE_READONLY) ? 0100444 : 0100644;
 
-	// text file
-	if (encoding == TEXT("") || encoding == TEXT("utf-8") || encoding == TEXT("text/plain;utf-8"))
+	status.error = STAT_OK;
+}
+
+MappedFile::MappedFile()
+	: m_size(0), m_view(NULL), m_viewSize(0), m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const String& path)
+{
+	Close();
+
+	m_hFile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_hFile, &fileSize))
 	{
-		HANDLE hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-		if (hFile != INVALID_HANDLE_VALUE)
+		Close();
+		return false;
+	}
+	m_size = (uint64_t) fileSize.QuadPart;
+
+	// empty files can't be mapped
+	if (m_size > 0)
+	{
+		m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_hMapping == NULL)
 		{
-			DWORD numBytesRead = 0;
-			LARGE_INTEGER fileSize;
-			GetFileSizeEx(hFile, &fileSize);
-
-			// we don't want to read too large files
-			_ASSERT(fileSize.HighPart == 0);
-
-			// allocate buffer and read file
-			BYTE* data = new BYTE[fileSize.LowPart];
-			::ReadFile(hFile, (LPVOID) data, (DWORD) fileSize.LowPart, &numBytesRead, NULL);
-
-			// convert the buffer
-			int wcLen = MultiByteToWideChar(CP_UTF8, 0, (LPCCH) data, numBytesRead, NULL, 0);
-			TCHAR* buf = new TCHAR[wcLen + 1];
-			MultiByteToWideChar(CP_UTF8, 0, (LPCCH) data, numBytesRead, buf, wcLen);
-			buf[wcLen] = 0;
-			result = String(buf, buf + wcLen);
-			delete[] buf;
-			delete[] data;
+			Close();
+			return false;
 		}
+	}
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	Unmap();
+
+	if (m_hMapping != NULL)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+
+	m_size = 0;
+}
+
+const uint8_t* MappedFile::Map(uint64_t offset, size_t length)
+{
+	Unmap();
+
+	if (m_hMapping == NULL || length == 0 || offset >= m_size || length > m_size - offset)
+		return NULL;
+
+	// view offsets must be aligned to the allocation granularity
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	uint64_t alignedOffset = offset - offset % info.dwAllocationGranularity;
+	size_t delta = (size_t) (offset - alignedOffset);
+
+	void* view = MapViewOfFile(m_hMapping, FILE_MAP_READ, (DWORD) (alignedOffset >> 32), (DWORD) (alignedOffset & 0xffffffff), length + delta);
+	if (view == NULL)
+		return NULL;
+
+	m_view = view;
+	m_viewSize = length + delta;
+	return (const uint8_t*) view + delta;
+}
+
+void MappedFile::Unmap()
+{
+	if (m_view != NULL)
+	{
+		UnmapViewOfFile(m_view);
+		m_view = NULL;
+		m_viewSize = 0;
+	}
+}
+
+InputFile::InputFile()
+	: m_hFile(INVALID_HANDLE_VALUE)
+{
+}
+
+InputFile::~InputFile()
+{
+	Close();
+}
+
+bool InputFile::Open(const String& path)
+{
+	Close();
+
+	// allow the writer to rename or delete the file (e.g., when rotating logs)
+	m_hFile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	BY_HANDLE_FILE_INFORMATION info;
+	if (!GetFileInformationByHandle(m_hFile, &info) || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void InputFile::Close()
+{
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool InputFile::IsOpen() const
+{
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+bool InputFile::GetSize(uint64_t& size)
+{
+	LARGE_INTEGER fileSize;
+	if (m_hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_hFile, &fileSize))
+		return false;
 
-		CloseHandle(hFile);
+	size = (uint64_t) fileSize.QuadPart;
+	return true;
+}
+
+int64_t InputFile::Read(uint64_t offset, uint8_t* data, size_t length)
+{
+	OVERLAPPED overlapped;
+	ZeroMemory(&overlapped, sizeof(overlapped));
+	overlapped.Offset = (DWORD) (offset & 0xffffffff);
+	overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+	DWORD numBytesToRead = length > 0x40000000 ? 0x40000000 : (DWORD) length;
+	DWORD numBytesRead = 0;
+	if (!::ReadFile(m_hFile, data, numBytesToRead, &numBytesRead, &overlapped))
+		return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+
+	return numBytesRead;
+}
+
+bool InputFile::IsFileAt(const String& path)
+{
+	HANDLE hFile = CreateFile(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	BY_HANDLE_FILE_INFORMATION info;
+	BY_HANDLE_FILE_INFORMATION infoPath;
+	bool isSame = GetFileInformationByHandle(m_hFile, &info) && GetFileInformationByHandle(hFile, &infoPath) &&
+		info.dwVolumeSerialNumber == infoPath.dwVolumeSerialNumber &&
+		info.nFileIndexHigh == infoPath.nFileIndexHigh && info.nFileIndexLow == infoPath.nFileIndexLow;
+
+	CloseHandle(hFile);
+	return isSame;
+}
+
+OutputFile::OutputFile()
+	: m_hFile(INVALID_HANDLE_VALUE)
+{
+}
+
+OutputFile::~OutputFile()
+{
+	Close();
+}
+
+bool OutputFile::Open(const String& path, bool append)
+{
+	Close();
+
+	m_hFile = CreateFile(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, FILE_SHARE_READ, NULL, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+bool OutputFile::OpenReplacement(const String& path, const String& original)
+{
+	DWORD attributes = GetFileAttributes(original.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		return Open(path, false);
+
+	Close();
+
+	// keep hidden and system files hidden; the security descriptor is
+	// inherited from the directory like the original's
+	attributes &= FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+	m_hFile = CreateFile(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, attributes != 0 ? attributes : FILE_ATTRIBUTE_NORMAL, NULL);
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+void OutputFile::Close()
+{
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool OutputFile::Write(const uint8_t* data, size_t length)
+{
+	while (length > 0)
+	{
+		DWORD numBytesToWrite = length > 0x40000000 ? 0x40000000 : (DWORD) length;
+		DWORD numBytesWritten = 0;
+		if (!::WriteFile(m_hFile, data, numBytesToWrite, &numBytesWritten, NULL))
+			return false;
+
+		data += numBytesWritten;
+		length -= numBytesWritten;
+	}
+
+	return true;
+}
+
+bool OutputFile::Sync(bool flushDeviceCache)
+{
+	UNREFERENCED_PARAMETER(flushDeviceCache);
+
+	// FlushFileBuffers also flushes the device cache
+	return FlushFileBuffers(m_hFile) != 0;
+}
+
+bool RenameFile(const String& from, const String& to)
+{
+	return MoveFileEx(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+bool SyncDirectory(const String& path)
+{
+	UNREFERENCED_PARAMETER(path);
+
+	// MOVEFILE_WRITE_THROUGH already makes the rename durable
+	return true;
+}
+
+bool MakeDirectory(const String& path)
+{
+	if (CreateDirectory(path.c_str(), NULL))
 		return true;
+	if (GetLastError() != ERROR_ALREADY_EXISTS)
+		return false;
+
+	DWORD attributes = GetFileAttributes(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+bool RemoveFile(const String& path)
+{
+	return DeleteFile(path.c_str()) != 0;
+}
+
+bool RemoveEmptyDirectory(const String& path)
+{
+	return RemoveDirectory(path.c_str()) != 0;
+}
+
+bool IsSameFile(const String& path1, const String& path2)
+{
+	// FILE_FLAG_BACKUP_SEMANTICS is required to open directories
+	HANDLE hFile1 = CreateFile(path1.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+	if (hFile1 == INVALID_HANDLE_VALUE)
+		return false;
+
+	HANDLE hFile2 = CreateFile(path2.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+	if (hFile2 == INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hFile1);
+		return false;
 	}
 
+	BY_HANDLE_FILE_INFORMATION info1;
+	BY_HANDLE_FILE_INFORMATION info2;
+	bool isSame = GetFileInformationByHandle(hFile1, &info1) && GetFileInformationByHandle(hFile2, &info2) &&
+		info1.dwVolumeSerialNumber == info2.dwVolumeSerialNumber &&
+		info1.nFileIndexHigh == info2.nFileIndexHigh && info1.nFileIndexLow == info2.nFileIndexLow;
+
+	CloseHandle(hFile1);
+	CloseHandle(hFile2);
+	return isSame;
+}
+
+static DWORD CALLBACK CopyProgressRoutine(
+	LARGE_INTEGER totalFileSize, LARGE_INTEGER totalBytesTransferred, LARGE_INTEGER streamSize, LARGE_INTEGER streamBytesTransferred,
+	DWORD dwStreamNumber, DWORD dwCallbackReason, HANDLE hSourceFile, HANDLE hDestinationFile, LPVOID lpData)
+{
+	UNREFERENCED_PARAMETER(totalFileSize);
+	UNREFERENCED_PARAMETER(streamSize);
+	UNREFERENCED_PARAMETER(streamBytesTransferred);
+	UNREFERENCED_PARAMETER(dwStreamNumber);
+	UNREFERENCED_PARAMETER(dwCallbackReason);
+	UNREFERENCED_PARAMETER(hSourceFile);
+	UNREFERENCED_PARAMETER(hDestinationFile);
+
+	CopyProgressCallback* onProgress = (CopyProgressCallback*) lpData;
+	return (*onProgress)((uint64_t) totalBytesTransferred.QuadPart) ? PROGRESS_CONTINUE : PROGRESS_CANCEL;
+}
+
+bool CopyFileContents(const String& from, const String& to, CopyProgressCallback onProgress)
+{
+	if (IsSameFile(from, to))
+		return false;
+
+	// CopyFileEx lets the file system (or the server) copy the data, and
+	// deletes the destination if the copy fails or is cancelled; an existing
+	// "to" is therefore only replaced once the copy is complete
+	if (GetFileAttributes(to.c_str()) == INVALID_FILE_ATTRIBUTES)
+		return CopyFileEx(from.c_str(), to.c_str(), CopyProgressRoutine, &onProgress, NULL, COPY_FILE_FAIL_IF_EXISTS) != 0;
+
+	static volatile LONG copyCount = 0;
+	StringStream ss;
+	ss << to << TEXT(".copy") << InterlockedIncrement(&copyCount);
+	String tempFilename = ss.str();
+
+	if (!CopyFileEx(from.c_str(), tempFilename.c_str(), CopyProgressRoutine, &onProgress, NULL, COPY_FILE_FAIL_IF_EXISTS))
+		return false;
+
+	if (RenameFile(tempFilename, to))
+		return true;
+
+	DeleteFile(tempFilename.c_str());
 	return false;
 }
 
+bool GetApplicationDataDirectory(String& path)
+{
+	TCHAR szPath[MAX_PATH];
+	if (FAILED(SHGetFolderPath(NULL, CSIDL_APPDATA, NULL, 0, szPath)))
+		return false;
+
+	PathAppend(szPath, TEXT("\\Vanamco"));
+	CreateDirectory(szPath, NULL);
+
+	PathAppend(szPath, TEXT("\\Zephyros"));
+	CreateDirectory(szPath, NULL);
+
+	path = szPath;
+	return true;
+}
+
 } // namespace FileUtil
\ No newline at end of file
@@ -0,0 +1,488 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "file_watcher.h"
+#include "file_util.h"
+
+
+namespace FileWatcher {
+
+typedef std::chrono::steady_clock Clock;
+
+//
+// The state of a file as seen at the last flush.
+//
+struct Entry
+{
+    bool isDirectory;
+    uint64_t size;
+    double modified;
+};
+
+typedef std::map<String, Entry> Snapshot;
+
+
+class WatchedDirectory : public MonitorDelegate
+{
+public:
+    WatchedDirectory(const String& root, bool recursive, int latency, EventCallback onEvents)
+        : m_root(root), m_recursive(recursive), m_latency(latency), m_onEvents(onEvents),
+          m_monitor(NULL), m_isActive(true), m_needsSnapshot(true), m_hasPending(false)
+    {
+    }
+
+    virtual void OnChange(const String& relativePath, bool isRescanNeeded);
+
+    String m_root;
+    bool m_recursive;
+    int m_latency;
+    EventCallback m_onEvents;
+    Monitor* m_monitor;
+    std::atomic<bool> m_isActive;
+
+    // guarded by g_mutex
+    bool m_needsSnapshot;
+    bool m_hasPending;
+    Clock::time_point m_deadline;
+    std::set<String> m_changes;
+    std::set<String> m_rescans;
+
+    // only accessed by the flusher thread
+    Snapshot m_snapshot;
+};
+
+typedef std::shared_ptr<WatchedDirectory> WatchPtr;
+
+
+static std::mutex g_mutex;
+static std::condition_variable g_cvWork;
+static std::map<String, WatchPtr> g_watches;
+static std::thread* g_flusher = NULL;
+static std::atomic<bool> g_isStopping(false);
+
+
+void WatchedDirectory::OnChange(const String& relativePath, bool isRescanNeeded)
+{
+    // a non-recursive watch only reports the direct children
+    if (!m_recursive && relativePath.find(FileUtil::GetPathSeparator()) != String::npos)
+        return;
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    if (isRescanNeeded)
+        m_rescans.insert(relativePath);
+    else
+        m_changes.insert(relativePath);
+
+    // the window starts with the first change; later changes are collected
+    // until the window has passed
+    if (!m_hasPending)
+    {
+        m_hasPending = true;
+        m_deadline = Clock::now() + std::chrono::milliseconds(m_latency);
+        g_cvWork.notify_one();
+    }
+}
+
+
+static String GetPath(const String& root, const String& relativePath)
+{
+    return relativePath.length() == 0 ? root : root + FileUtil::GetPathSeparator() + relativePath;
+}
+
+static String GetChildPath(const String& relativePath, const String& name)
+{
+    return relativePath.length() == 0 ? name : relativePath + FileUtil::GetPathSeparator() + name;
+}
+
+static Entry MakeEntry(const FileUtil::FileInfo& info)
+{
+    Entry entry;
+    entry.isDirectory = info.isDirectory;
+    entry.size = info.isDirectory ? 0 : info.size;
+    entry.modified = info.modified;
+    return entry;
+}
+
+//
+// Adds the entries below the directory relativePath to the snapshot.
+//
+static void Scan(const String& root, const String& relativePath, bool recursive, Snapshot& snapshot)
+{
+    std::vector<FileUtil::FileInfo> entries;
+    if (!FileUtil::ReadDirectory(GetPath(root, relativePath), entries))
+        return;
+
+    for (std::vector<FileUtil::FileInfo>::iterator it = entries.begin(); it != entries.end() && !g_isStopping; ++it)
+    {
+        String path = GetChildPath(relativePath, it->name);
+
+        if (!it->hasStats && !FileUtil::GetFileStats(GetPath(root, path), *it))
+            continue;
+
+        snapshot[path] = MakeEntry(*it);
+
+        // don't follow symbolic links to avoid cycles
+        if (recursive && it->isDirectory && !it->isSymbolicLink)
+            Scan(root, path, recursive, snapshot);
+    }
+}
+
+static void AddEvent(std::vector<Event>& events, const String& path, EventType type, bool isDirectory)
+{
+    Event event;
+    event.path = path;
+    event.type = type;
+    event.isDirectory = isDirectory;
+    events.push_back(event);
+}
+
+//
+// Compares the snapshot of the subtree below relativePath with the new state
+// and updates the snapshot.
+//
+static void DiffSubtree(WatchPtr watch, const String& relativePath, Snapshot& current, std::vector<Event>& events)
+{
+    Snapshot& snapshot = watch->m_snapshot;
+
+    // the entries of a subtree are stored contiguously in the map
+    Snapshot::iterator it;
+    Snapshot::iterator itEnd;
+    if (relativePath.length() == 0)
+    {
+        it = snapshot.begin();
+        itEnd = snapshot.end();
+    }
+    else
+    {
+        String prefix = relativePath + FileUtil::GetPathSeparator();
+        it = snapshot.lower_bound(prefix);
+        for (itEnd = it; itEnd != snapshot.end() && itEnd->first.compare(0, prefix.length(), prefix) == 0; ++itEnd)
+            ;
+    }
+
+    for ( ; it != itEnd; )
+    {
+        Snapshot::iterator itCurrent = current.find(it->first);
+        if (itCurrent == current.end())
+        {
+            AddEvent(events, it->first, EVENT_DELETED, it->second.isDirectory);
+            snapshot.erase(it++);
+            continue;
+        }
+
+        if (itCurrent->second.isDirectory != it->second.isDirectory)
+        {
+            AddEvent(events, it->first, EVENT_DELETED, it->second.isDirectory);
+            AddEvent(events, it->first, EVENT_CREATED, itCurrent->second.isDirectory);
+        }
+        else if (!it->second.isDirectory && (itCurrent->second.size != it->second.size || itCurrent->second.modified != it->second.modified))
+            AddEvent(events, it->first, EVENT_MODIFIED, false);
+
+        it->second = itCurrent->second;
+        current.erase(itCurrent);
+        ++it;
+    }
+
+    // the remaining entries are new
+    for (Snapshot::iterator itNew = current.begin(); itNew != current.end(); ++itNew)
+    {
+        AddEvent(events, itNew->first, EVENT_CREATED, itNew->second.isDirectory);
+        snapshot[itNew->first] = itNew->second;
+    }
+}
+
+//
+// Compares a single path with the snapshot. Directories which were created or
+// deleted are compared including their contents.
+//
+static void DiffPath(WatchPtr watch, const String& relativePath, std::vector<Event>& events)
+{
+    Snapshot& snapshot = watch->m_snapshot;
+    Snapshot::iterator it = snapshot.find(relativePath);
+
+    FileUtil::FileInfo info;
+    bool exists = FileUtil::GetFileStats(GetPath(watch->m_root, relativePath), info);
+
+    if (it == snapshot.end())
+    {
+        if (!exists)
+            return;  // created and deleted within the window
+
+        Entry entry = MakeEntry(info);
+        AddEvent(events, relativePath, EVENT_CREATED, entry.isDirectory);
+        snapshot[relativePath] = entry;
+
+        // a directory might have been moved into the tree along with its
+        // contents, or files might have been added before the OS watch was set up
+        if (entry.isDirectory && watch->m_recursive)
+        {
+            Snapshot current;
+            Scan(watch->m_root, relativePath, true, current);
+            DiffSubtree(watch, relativePath, current, events);
+        }
+
+        return;
+    }
+
+    if (!exists)
+    {
+        bool isDirectory = it->second.isDirectory;
+        snapshot.erase(it);
+
+        if (isDirectory)
+        {
+            Snapshot current;
+            DiffSubtree(watch, relativePath, current, events);
+        }
+
+        AddEvent(events, relativePath, EVENT_DELETED, isDirectory);
+        return;
+    }
+
+    Entry entry = MakeEntry(info);
+    if (entry.isDirectory != it->second.isDirectory)
+    {
+        AddEvent(events, relativePath, EVENT_DELETED, it->second.isDirectory);
+        AddEvent(events, relativePath, EVENT_CREATED, entry.isDirectory);
+
+        Snapshot current;
+        if (entry.isDirectory && watch->m_recursive)
+            Scan(watch->m_root, relativePath, true, current);
+        DiffSubtree(watch, relativePath, current, events);
+    }
+    else if (!entry.isDirectory && (entry.size != it->second.size || entry.modified != it->second.modified))
+        AddEvent(events, relativePath, EVENT_MODIFIED, false);
+
+    it->second = entry;
+}
+
+static void Flush(WatchPtr watch, std::set<String>& changes, std::set<String>& rescans)
+{
+    std::vector<Event> events;
+
+    // rescan the subtrees for which notifications were dropped
+    for (std::set<String>::iterator it = rescans.begin(); it != rescans.end(); ++it)
+    {
+        if (it->length() > 0)
+            DiffPath(watch, *it, events);
+
+        Snapshot current;
+        Scan(watch->m_root, *it, watch->m_recursive, current);
+        DiffSubtree(watch, *it, current, events);
+    }
+
+    for (std::set<String>::iterator it = changes.begin(); it != changes.end(); ++it)
+    {
+        // changes of the watched directory itself are covered by the changes
+        // of its entries
+        if (it->length() > 0)
+            DiffPath(watch, *it, events);
+    }
+
+    if (!events.empty() && watch->m_isActive)
+        watch->m_onEvents(events);
+}
+
+static void RunFlusher()
+{
+    std::unique_lock<std::mutex> lock(g_mutex);
+
+    while (!g_isStopping)
+    {
+        WatchPtr watch;
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = (Clock::time_point::max)();
+
+        for (std::map<String, WatchPtr>::iterator it = g_watches.begin(); it != g_watches.end(); ++it)
+        {
+            WatchPtr w = it->second;
+            if (w->m_needsSnapshot || (w->m_hasPending && w->m_deadline <= now))
+            {
+                watch = w;
+                break;
+            }
+
+            if (w->m_hasPending && w->m_deadline < next)
+                next = w->m_deadline;
+        }
+
+        if (!watch)
+        {
+            if (next == (Clock::time_point::max)())
+                g_cvWork.wait(lock);
+            else
+                g_cvWork.wait_until(lock, next);
+            continue;
+        }
+
+        if (watch->m_needsSnapshot)
+        {
+            // take the initial snapshot; changes reported in the meantime are
+            // compared with it once the window has passed
+            watch->m_needsSnapshot = false;
+            lock.unlock();
+
+            Snapshot snapshot;
+            Scan(watch->m_root, String(), watch->m_recursive, snapshot);
+            watch->m_snapshot.swap(snapshot);
+
+            lock.lock();
+            continue;
+        }
+
+        std::set<String> changes;
+        std::set<String> rescans;
+        changes.swap(watch->m_changes);
+        rescans.swap(watch->m_rescans);
+        watch->m_hasPending = false;
+        lock.unlock();
+
+        Flush(watch, changes, rescans);
+
+        lock.lock();
+    }
+}
+
+//
+// Deletes the monitor and deactivates the watch. Must be called without
+// holding g_mutex, since the monitor's thread might be waiting for it.
+//
+static void Release(WatchPtr watch, Monitor* monitor)
+{
+    delete monitor;
+
+    if (watch)
+        watch->m_isActive = false;
+}
+
+
+bool Watch(const String& path, bool recursive, int latency, EventCallback onEvents)
+{
+    if (latency < 0)
+        latency = 0;
+
+    FileUtil::FileInfo info;
+    if (!FileUtil::GetFileStats(path, info) || !info.isDirectory)
+        return false;
+
+    std::unique_lock<std::mutex> lock(g_mutex);
+
+    g_isStopping = false;
+    if (g_flusher == NULL)
+        g_flusher = new std::thread(RunFlusher);
+
+    std::map<String, WatchPtr>::iterator it = g_watches.find(path);
+    if (it != g_watches.end() && (it->second->m_recursive || !recursive))
+        return true;
+
+    // a new watch is created if the directory isn't watched yet or the
+    // existing watch isn't recursive
+    WatchPtr oldWatch;
+    if (it != g_watches.end())
+    {
+        oldWatch = it->second;
+        g_watches.erase(it);
+    }
+
+    lock.unlock();
+
+    WatchPtr watch(new WatchedDirectory(path, recursive, latency, onEvents));
+    Monitor* oldMonitor = oldWatch ? oldWatch->m_monitor : NULL;
+    watch->m_monitor = Monitor::Create(path, recursive, watch.get());
+
+    if (watch->m_monitor == NULL)
+    {
+        Release(oldWatch, oldMonitor);
+        return false;
+    }
+
+    lock.lock();
+    WatchPtr& entry = g_watches[path];
+    if (entry)
+    {
+        // another watch has been set up concurrently
+        lock.unlock();
+        Release(watch, watch->m_monitor);
+        Release(oldWatch, oldMonitor);
+        return true;
+    }
+
+    entry = watch;
+    g_cvWork.notify_one();
+    lock.unlock();
+
+    Release(oldWatch, oldMonitor);
+    return true;
+}
+
+void Unwatch(const String& path)
+{
+    std::unique_lock<std::mutex> lock(g_mutex);
+
+    std::map<String, WatchPtr>::iterator it = g_watches.find(path);
+    if (it == g_watches.end())
+        return;
+
+    WatchPtr watch = it->second;
+    g_watches.erase(it);
+    lock.unlock();
+
+    Release(watch, watch->m_monitor);
+}
+
+void Stop()
+{
+    std::map<String, WatchPtr> watches;
+    std::thread* flusher = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        watches.swap(g_watches);
+        flusher = g_flusher;
+        g_flusher = NULL;
+        g_isStopping = true;
+        g_cvWork.notify_all();
+    }
+
+    for (std::map<String, WatchPtr>::iterator it = watches.begin(); it != watches.end(); ++it)
+        Release(it->second, it->second->m_monitor);
+
+    if (flusher != NULL)
+    {
+        flusher->join();
+        delete flusher;
+    }
+}
+
+} // namespace FileWatcher
@@ -0,0 +1,120 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __file_watcher_h
+#define __file_watcher_h
+
+
+#include <functional>
+#include <vector>
+
+#include "types.h"
+
+
+// The default time (in milliseconds) changes are collected before they are passed on
+#define FILE_WATCHER_DEFAULT_LATENCY 100
+
+
+namespace FileWatcher {
+
+enum EventType
+{
+    EVENT_CREATED,
+    EVENT_MODIFIED,
+    EVENT_DELETED
+};
+
+//
+// A change in a watched directory. The path is relative to the watched
+// directory.
+//
+struct Event
+{
+    String path;
+    EventType type;
+    bool isDirectory;
+};
+
+//
+// Receives the events collected during the latency window. There is at most one
+// event per path; a file which was created and deleted again within the window
+// isn't reported.
+//
+typedef std::function<void(std::vector<Event>& events)> EventCallback;
+
+//
+// Starts watching the directory "path" (and its subdirectories if "recursive"
+// is set). The changes reported by the OS are collected for "latency"
+// milliseconds and compared to a snapshot of the directory, so that duplicate
+// notifications are merged. If the OS drops notifications, the affected
+// subtree is rescanned.
+// onEvents is called from a background thread. If the directory is already
+// watched, the existing watch is kept (and made recursive if requested).
+// Returns false if the directory can't be watched.
+//
+bool Watch(const String& path, bool recursive, int latency, EventCallback onEvents);
+
+//
+// Stops watching the directory "path".
+//
+void Unwatch(const String& path);
+
+//
+// Stops all watches.
+//
+void Stop();
+
+
+//
+// Receives the notifications of a platform-specific monitor. relativePath is
+// empty for the watched directory itself. If isRescanNeeded is set, changes
+// within the subtree might have been missed.
+//
+class MonitorDelegate
+{
+public:
+    virtual ~MonitorDelegate() {}
+    virtual void OnChange(const String& relativePath, bool isRescanNeeded) = 0;
+};
+
+//
+// Watches a directory using the OS's notification mechanism (inotify on Linux,
+// FSEvents on Mac, ReadDirectoryChangesW on Windows). The delegate may be
+// called from any thread, but not after the monitor has been deleted.
+//
+class Monitor
+{
+public:
+    virtual ~Monitor() {}
+
+    //
+    // Returns NULL if the directory can't be watched.
+    //
+    static Monitor* Create(const String& path, bool recursive, MonitorDelegate* delegate);
+};
+
+} // namespace FileWatcher
+
+
+#endif
@@ -0,0 +1,249 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <map>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "file_watcher.h"
+#include "file_util.h"
+
+
+#define INOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+
+namespace FileWatcher {
+
+//
+// Watches a directory with inotify. inotify doesn't watch subtrees, so for a
+// recursive monitor there is an inotify watch for each subdirectory.
+//
+class InotifyMonitor : public Monitor
+{
+public:
+    InotifyMonitor(const String& path, bool recursive, MonitorDelegate* delegate)
+        : m_root(path), m_recursive(recursive), m_delegate(delegate), m_fd(-1), m_rootWd(-1)
+    {
+        m_pipe[0] = m_pipe[1] = -1;
+    }
+
+    virtual ~InotifyMonitor()
+    {
+        if (m_thread.joinable())
+        {
+            // wake up the thread
+            char c = 0;
+            while (write(m_pipe[1], &c, 1) < 0 && errno == EINTR)
+                ;
+            m_thread.join();
+        }
+
+        if (m_fd >= 0)
+            close(m_fd);
+        if (m_pipe[0] >= 0)
+            close(m_pipe[0]);
+        if (m_pipe[1] >= 0)
+            close(m_pipe[1]);
+    }
+
+    bool Start()
+    {
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0 || pipe(m_pipe) < 0)
+            return false;
+
+        fcntl(m_pipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(m_pipe[1], F_SETFD, FD_CLOEXEC);
+
+        m_rootWd = AddWatches(String());
+        if (m_rootWd < 0)
+            return false;
+
+        m_thread = std::thread(&InotifyMonitor::Run, this);
+        return true;
+    }
+
+private:
+    //
+    // Adds a watch for the directory relativePath (and its subdirectories for a
+    // recursive monitor). Returns the watch descriptor.
+    //
+    int AddWatches(const String& relativePath)
+    {
+        String path = relativePath.length() == 0 ? m_root : m_root + "/" + relativePath;
+        int wd = inotify_add_watch(m_fd, path.c_str(), INOTIFY_MASK);
+        if (wd < 0)
+            return -1;
+
+        m_dirs[wd] = relativePath;
+
+        if (m_recursive)
+        {
+            std::vector<FileUtil::FileInfo> entries;
+            FileUtil::ReadDirectory(path, entries);
+
+            for (std::vector<FileUtil::FileInfo>::iterator it = entries.begin(); it != entries.end(); ++it)
+                if (it->isDirectory && !it->isSymbolicLink)
+                    AddWatches(relativePath.length() == 0 ? it->name : relativePath + "/" + it->name);
+        }
+
+        return wd;
+    }
+
+    //
+    // Removes the watches of the directory relativePath and its subdirectories.
+    //
+    void RemoveWatches(const String& relativePath)
+    {
+        String prefix = relativePath + "/";
+
+        for (std::map<int, String>::iterator it = m_dirs.begin(); it != m_dirs.end(); )
+        {
+            if (it->first != m_rootWd && (it->second == relativePath || it->second.compare(0, prefix.length(), prefix) == 0))
+            {
+                inotify_rm_watch(m_fd, it->first);
+                m_dirs.erase(it++);
+            }
+            else
+                ++it;
+        }
+    }
+
+    void Run()
+    {
+        // inotify_event structures are aligned to int
+        int buf[16384];
+
+        struct pollfd fds[2];
+        fds[0].fd = m_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = m_pipe[0];
+        fds[1].events = POLLIN;
+
+        for ( ; ; )
+        {
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            if (fds[1].revents != 0)
+                break;
+
+            ssize_t len = read(m_fd, buf, sizeof(buf));
+            if (len < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                break;
+            }
+
+            const char* p = reinterpret_cast<const char*>(buf);
+            const char* end = p + len;
+            while (p < end)
+            {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                ProcessEvent(event);
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+
+    void ProcessEvent(const struct inotify_event* event)
+    {
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            // events have been dropped; rescan everything
+            m_delegate->OnChange(String(), true);
+            return;
+        }
+
+        std::map<int, String>::iterator it = m_dirs.find(event->wd);
+        if (it == m_dirs.end())
+            return;
+
+        if (event->mask & IN_IGNORED)
+        {
+            if (event->wd != m_rootWd)
+                m_dirs.erase(it);
+            return;
+        }
+
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+        {
+            // subdirectories are reported by their parent
+            if (event->wd == m_rootWd)
+                m_delegate->OnChange(String(), true);
+            return;
+        }
+
+        if (event->len == 0)
+            return;
+
+        String relativePath = it->second.length() == 0 ? String(event->name) : it->second + "/" + event->name;
+
+        if (m_recursive && (event->mask & IN_ISDIR))
+        {
+            // the watch descriptors of a directory moved away would report the
+            // old paths; they are re-added if the directory is moved within the tree
+            if (event->mask & (IN_MOVED_FROM | IN_DELETE))
+                RemoveWatches(relativePath);
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                AddWatches(relativePath);
+        }
+
+        m_delegate->OnChange(relativePath, false);
+    }
+
+    String m_root;
+    bool m_recursive;
+    MonitorDelegate* m_delegate;
+    int m_fd;
+    int m_pipe[2];
+    int m_rootWd;
+    std::map<int, String> m_dirs;
+    std::thread m_thread;
+};
+
+
+Monitor* Monitor::Create(const String& path, bool recursive, MonitorDelegate* delegate)
+{
+    InotifyMonitor* monitor = new InotifyMonitor(path, recursive, delegate);
+    if (!monitor->Start())
+    {
+        delete monitor;
+        return NULL;
+    }
+
+    return monitor;
+}
+
+} // namespace FileWatcher
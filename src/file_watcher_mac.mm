@@ -0,0 +1,150 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <CoreServices/CoreServices.h>
+#include <dispatch/dispatch.h>
+#include <stdlib.h>
+
+#include "file_watcher.h"
+
+
+namespace FileWatcher {
+
+//
+// Watches a directory with FSEvents. FSEvents always watches the whole
+// subtree; the events below the direct children are ignored for non-recursive
+// watches.
+//
+class FSEventsMonitor : public Monitor
+{
+public:
+    FSEventsMonitor(const String& path, MonitorDelegate* delegate)
+        : m_delegate(delegate), m_stream(NULL), m_queue(nil)
+    {
+        // FSEvents reports paths with symbolic links resolved
+        char* realPath = realpath(path.c_str(), NULL);
+        m_root = realPath != NULL ? realPath : path;
+        free(realPath);
+    }
+
+    virtual ~FSEventsMonitor()
+    {
+        if (m_stream != NULL)
+        {
+            FSEventStreamStop(m_stream);
+            FSEventStreamInvalidate(m_stream);
+            FSEventStreamRelease(m_stream);
+
+            // wait until callbacks which are already running have finished
+            dispatch_sync(m_queue, ^{});
+        }
+
+        m_queue = nil;
+    }
+
+    bool Start()
+    {
+        CFStringRef path = CFStringCreateWithCString(NULL, m_root.c_str(), kCFStringEncodingUTF8);
+        if (path == NULL)
+            return false;
+
+        CFArrayRef paths = CFArrayCreate(NULL, (const void**) &path, 1, &kCFTypeArrayCallBacks);
+        CFRelease(path);
+
+        FSEventStreamContext context = { 0, this, NULL, NULL, NULL };
+
+        // the events are coalesced by the watch, so they are delivered without latency
+        m_stream = FSEventStreamCreate(
+            NULL, &FSEventsMonitor::Callback, &context, paths, kFSEventStreamEventIdSinceNow, 0,
+            kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagWatchRoot);
+        CFRelease(paths);
+
+        if (m_stream == NULL)
+            return false;
+
+        m_queue = dispatch_queue_create("zephyros.filewatcher", DISPATCH_QUEUE_SERIAL);
+        FSEventStreamSetDispatchQueue(m_stream, m_queue);
+
+        if (!FSEventStreamStart(m_stream))
+        {
+            FSEventStreamInvalidate(m_stream);
+            FSEventStreamRelease(m_stream);
+            m_stream = NULL;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    static void Callback(ConstFSEventStreamRef stream, void* info, size_t numEvents, void* eventPaths, const FSEventStreamEventFlags* eventFlags, const FSEventStreamEventId* eventIds)
+    {
+        FSEventsMonitor* monitor = reinterpret_cast<FSEventsMonitor*>(info);
+        const char** paths = reinterpret_cast<const char**>(eventPaths);
+
+        for (size_t i = 0; i < numEvents; ++i)
+        {
+            FSEventStreamEventFlags flags = eventFlags[i];
+
+            if (flags & kFSEventStreamEventFlagRootChanged)
+            {
+                monitor->m_delegate->OnChange(String(), true);
+                continue;
+            }
+
+            String path(paths[i]);
+            if (path.compare(0, monitor->m_root.length(), monitor->m_root) != 0)
+                continue;
+
+            String relativePath = path.substr(monitor->m_root.length());
+            if (relativePath.length() > 0 && relativePath[0] == '/')
+                relativePath = relativePath.substr(1);
+            if (relativePath.length() > 0 && relativePath[relativePath.length() - 1] == '/')
+                relativePath.erase(relativePath.length() - 1);
+
+            // if events have been dropped, the subtree must be rescanned
+            bool isRescanNeeded = (flags & (kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagUserDropped | kFSEventStreamEventFlagKernelDropped)) != 0;
+            monitor->m_delegate->OnChange(relativePath, isRescanNeeded);
+        }
+    }
+
+    String m_root;
+    MonitorDelegate* m_delegate;
+    FSEventStreamRef m_stream;
+    dispatch_queue_t m_queue;
+};
+
+
+Monitor* Monitor::Create(const String& path, bool recursive, MonitorDelegate* delegate)
+{
+    FSEventsMonitor* monitor = new FSEventsMonitor(path, delegate);
+    if (!monitor->Start())
+    {
+        delete monitor;
+        return NULL;
+    }
+
+    return monitor;
+}
+
+} // namespace FileWatcher
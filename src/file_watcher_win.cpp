@@ -0,0 +1,155 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <windows.h>
+#include <thread>
+
+#include "file_watcher.h"
+
+
+// The size of the buffer receiving the notifications; if it is exceeded,
+// the notifications are dropped and the directory is rescanned
+#define FILE_WATCHER_BUFFER_SIZE (64 * 1024)
+
+#define FILE_WATCHER_NOTIFY_FILTER (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_CREATION)
+
+
+namespace FileWatcher {
+
+//
+// Watches a directory with ReadDirectoryChangesW.
+//
+class Win32Monitor : public Monitor
+{
+public:
+    Win32Monitor(const String& path, bool recursive, MonitorDelegate* delegate)
+        : m_recursive(recursive), m_delegate(delegate), m_hDir(INVALID_HANDLE_VALUE), m_hStop(NULL)
+    {
+        m_hDir = CreateFile(
+            path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        m_hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+
+    virtual ~Win32Monitor()
+    {
+        if (m_thread.joinable())
+        {
+            SetEvent(m_hStop);
+            m_thread.join();
+        }
+
+        if (m_hDir != INVALID_HANDLE_VALUE)
+            CloseHandle(m_hDir);
+        if (m_hStop != NULL)
+            CloseHandle(m_hStop);
+    }
+
+    bool Start()
+    {
+        if (m_hDir == INVALID_HANDLE_VALUE || m_hStop == NULL)
+            return false;
+
+        m_thread = std::thread(&Win32Monitor::Run, this);
+        return true;
+    }
+
+private:
+    void Run()
+    {
+        // FILE_NOTIFY_INFORMATION structures are aligned to DWORD
+        std::vector<DWORD> buf(FILE_WATCHER_BUFFER_SIZE / sizeof(DWORD));
+
+        OVERLAPPED overlapped;
+        ZeroMemory(&overlapped, sizeof(overlapped));
+        overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (overlapped.hEvent == NULL)
+            return;
+
+        HANDLE handles[2] = { overlapped.hEvent, m_hStop };
+
+        for ( ; ; )
+        {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadDirectoryChangesW(m_hDir, &buf[0], FILE_WATCHER_BUFFER_SIZE, m_recursive ? TRUE : FALSE, FILE_WATCHER_NOTIFY_FILTER, NULL, &overlapped, NULL))
+                break;
+
+            DWORD bytesReturned = 0;
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+            {
+                CancelIo(m_hDir);
+                GetOverlappedResult(m_hDir, &overlapped, &bytesReturned, TRUE);
+                break;
+            }
+
+            if (!GetOverlappedResult(m_hDir, &overlapped, &bytesReturned, FALSE))
+            {
+                if (GetLastError() != ERROR_NOTIFY_ENUM_DIR)
+                    break;
+                bytesReturned = 0;
+            }
+
+            if (bytesReturned == 0)
+            {
+                // the buffer overflowed; rescan everything
+                m_delegate->OnChange(String(), true);
+                continue;
+            }
+
+            const BYTE* p = reinterpret_cast<const BYTE*>(&buf[0]);
+            for ( ; ; )
+            {
+                const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+                m_delegate->OnChange(String(info->FileName, info->FileNameLength / sizeof(WCHAR)), false);
+
+                if (info->NextEntryOffset == 0)
+                    break;
+                p += info->NextEntryOffset;
+            }
+        }
+
+        CloseHandle(overlapped.hEvent);
+    }
+
+    bool m_recursive;
+    MonitorDelegate* m_delegate;
+    HANDLE m_hDir;
+    HANDLE m_hStop;
+    std::thread m_thread;
+};
+
+
+Monitor* Monitor::Create(const String& path, bool recursive, MonitorDelegate* delegate)
+{
+    Win32Monitor* monitor = new Win32Monitor(path, recursive, delegate);
+    if (!monitor->Start())
+    {
+        delete monitor;
+        return NULL;
+    }
+
+    return monitor;
+}
+
+} // namespace FileWatcher
@@ -0,0 +1,296 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "file_util.h"
+
+
+namespace FileUtil {
+
+struct WriteRequest
+{
+    String filename;
+    std::vector<uint8_t> data;
+    bool append;
+    bool atomic;
+    bool sync;
+    WriteCallback onCompleted;
+};
+
+typedef std::shared_ptr<WriteRequest> WriteRequestPtr;
+
+//
+// A durable write which has been executed, but not synced yet.
+//
+struct PendingSync
+{
+    WriteRequestPtr request;
+    std::shared_ptr<OutputFile> file;
+
+    // for atomic writes: the temporary file to rename once it has been synced
+    String tempFilename;
+
+    // false once the file has been replaced or truncated by a later write
+    bool canAppend;
+};
+
+
+static std::thread g_thread;
+static std::mutex g_mutex;
+static std::condition_variable g_cvRequests;
+static std::deque<WriteRequestPtr> g_requests;
+static bool g_isStopping = false;
+static int g_tempFileCount = 0;
+
+
+static void Complete(WriteRequestPtr request, bool success)
+{
+    if (request->onCompleted)
+        request->onCompleted(success);
+}
+
+static String GetDirectory(const String& filename)
+{
+    size_t pos = filename.find_last_of(TEXT("/\\"));
+    if (pos == String::npos)
+        return TEXT(".");
+    return filename.substr(0, pos == 0 ? 1 : pos);
+}
+
+static PendingSync* FindPendingSync(std::vector<PendingSync>& group, const String& filename)
+{
+    for (size_t i = group.size(); i > 0; --i)
+        if (group[i - 1].request->filename == filename)
+            return &group[i - 1];
+    return NULL;
+}
+
+//
+// Syncs the files written by the group, each one only once, then renames the
+// temporary files of atomic writes into place and invokes the callbacks.
+//
+static void FlushGroup(std::vector<PendingSync>& group)
+{
+    if (group.empty())
+        return;
+
+    // collect the distinct files (appends to the same file share it)
+    std::vector<std::shared_ptr<OutputFile> > files;
+    std::set<OutputFile*> seen;
+    for (PendingSync& pending : group)
+        if (seen.insert(pending.file.get()).second)
+            files.push_back(pending.file);
+
+    // flush the device cache only once, after the last file
+    std::map<OutputFile*, bool> syncResults;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        syncResults[files[i].get()] = files[i]->Sync(i == files.size() - 1);
+        files[i]->Close();
+    }
+
+    std::vector<bool> results(group.size());
+    std::set<String> directories;
+    for (size_t i = 0; i < group.size(); ++i)
+    {
+        PendingSync& pending = group[i];
+        results[i] = syncResults[pending.file.get()];
+
+        if (pending.tempFilename.length() > 0)
+        {
+            if (results[i] && RenameFile(pending.tempFilename, pending.request->filename))
+                directories.insert(GetDirectory(pending.request->filename));
+            else
+            {
+                _tremove(pending.tempFilename.c_str());
+                results[i] = false;
+            }
+        }
+    }
+
+    // make the renames durable
+    for (const String& directory : directories)
+        SyncDirectory(directory);
+
+    for (size_t i = 0; i < group.size(); ++i)
+        Complete(group[i].request, results[i]);
+
+    group.clear();
+}
+
+static void Execute(WriteRequestPtr request, std::vector<PendingSync>& group)
+{
+    PendingSync* previous = FindPendingSync(group, request->filename);
+
+    // the file is about to be replaced by a pending atomic write;
+    // flush the group to keep the writes in order
+    if (previous != NULL && previous->tempFilename.length() > 0)
+    {
+        FlushGroup(group);
+        previous = NULL;
+    }
+
+    std::shared_ptr<OutputFile> file;
+    String tempFilename;
+    bool success = true;
+
+    if (request->append && previous != NULL && previous->canAppend)
+    {
+        // the file is still open; its sync will cover this write, too
+        file = previous->file;
+    }
+    else
+    {
+        if (previous != NULL)
+            previous->canAppend = false;
+
+        if (request->atomic)
+        {
+            StringStream ss;
+            ss << request->filename << TEXT(".tmp") << ++g_tempFileCount;
+            tempFilename = ss.str();
+        }
+
+        file.reset(new OutputFile());
+        if (tempFilename.length() > 0)
+            success = file->OpenReplacement(tempFilename, request->filename);
+        else
+            success = file->Open(request->filename, request->append);
+    }
+
+    if (success && !request->data.empty())
+        success = file->Write(&request->data[0], request->data.size());
+
+    // release the memory early
+    std::vector<uint8_t>().swap(request->data);
+
+    if (success && request->sync)
+    {
+        PendingSync pending;
+        pending.request = request;
+        pending.file = file;
+        pending.tempFilename = tempFilename;
+        pending.canAppend = true;
+        group.push_back(pending);
+        return;
+    }
+
+    // shared files are closed when the group is flushed
+    if (file && (previous == NULL || file != previous->file))
+        file->Close();
+
+    if (tempFilename.length() > 0)
+    {
+        if (success)
+            success = RenameFile(tempFilename, request->filename);
+        if (!success)
+            _tremove(tempFilename.c_str());
+    }
+
+    Complete(request, success);
+}
+
+//
+// The writer thread. Requests issued while a batch is being written are
+// collected and written as the next batch.
+//
+static void Run()
+{
+    std::vector<PendingSync> group;
+
+    for ( ; ; )
+    {
+        std::deque<WriteRequestPtr> batch;
+
+        {
+            std::unique_lock<std::mutex> lock(g_mutex);
+            while (g_requests.empty() && !g_isStopping)
+                g_cvRequests.wait(lock);
+
+            if (g_requests.empty())
+                return;
+
+            batch.swap(g_requests);
+        }
+
+        for (WriteRequestPtr request : batch)
+            Execute(request, group);
+
+        FlushGroup(group);
+    }
+}
+
+static void Post(const String& filename, std::vector<uint8_t>& data, bool append, bool atomic, bool sync, WriteCallback onCompleted)
+{
+    WriteRequestPtr request(new WriteRequest());
+    request->filename = filename;
+    request->data.swap(data);
+    request->append = append;
+    request->atomic = atomic;
+    request->sync = sync;
+    request->onCompleted = onCompleted;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_requests.push_back(request);
+
+        if (!g_thread.joinable() && !g_isStopping)
+            g_thread = std::thread(Run);
+    }
+
+    g_cvRequests.notify_one();
+}
+
+void WriteFile(const String& filename, std::vector<uint8_t>& data, bool atomic, bool sync, WriteCallback onCompleted)
+{
+    Post(filename, data, false, atomic, sync, onCompleted);
+}
+
+void AppendFile(const String& filename, std::vector<uint8_t>& data, bool sync, WriteCallback onCompleted)
+{
+    Post(filename, data, true, false, sync, onCompleted);
+}
+
+void StopWriter()
+{
+    std::thread thread;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_isStopping = true;
+        thread.swap(g_thread);
+    }
+
+    g_cvRequests.notify_one();
+    if (thread.joinable())
+        thread.join();
+}
+
+} // namespace FileUtil
@@ -0,0 +1,417 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <string.h>
+
+#include "hash_util.h"
+#include "simd_util.h"
+
+
+namespace HashUtil {
+
+uint64_t Fnv1a64(const void* data, size_t length, uint64_t hash)
+{
+    const uint8_t* p = (const uint8_t*) data;
+    const uint8_t* end = p + length;
+
+    for ( ; p < end; ++p)
+    {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+String ToHex(uint64_t hash)
+{
+    static const TCHAR digits[] = TEXT("0123456789abcdef");
+
+    TCHAR buf[17];
+    for (int i = 15; i >= 0; --i)
+    {
+        buf[i] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+    buf[16] = 0;
+
+    return String(buf);
+}
+
+String ToHex(const uint8_t* data, size_t length)
+{
+    static const TCHAR digits[] = TEXT("0123456789abcdef");
+
+    String ret;
+    ret.reserve(2 * length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        ret.push_back(digits[data[i] >> 4]);
+        ret.push_back(digits[data[i] & 0xf]);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// SHA-256
+
+static const uint32_t g_sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t RotateRight(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+Sha256::Sha256()
+    : m_length(0), m_bufferLength(0)
+{
+    m_state[0] = 0x6a09e667;
+    m_state[1] = 0xbb67ae85;
+    m_state[2] = 0x3c6ef372;
+    m_state[3] = 0xa54ff53a;
+    m_state[4] = 0x510e527f;
+    m_state[5] = 0x9b05688c;
+    m_state[6] = 0x1f83d9ab;
+    m_state[7] = 0x5be0cd19;
+}
+
+void Sha256::Update(const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*) data;
+    m_length += length;
+
+    // complete a partially filled block
+    if (m_bufferLength > 0)
+    {
+        size_t len = SHA256_BLOCK_SIZE - m_bufferLength;
+        if (len > length)
+            len = length;
+
+        memcpy(m_buffer + m_bufferLength, p, len);
+        m_bufferLength += len;
+        p += len;
+        length -= len;
+
+        if (m_bufferLength < SHA256_BLOCK_SIZE)
+            return;
+
+        Transform(m_buffer, 1);
+        m_bufferLength = 0;
+    }
+
+    size_t numBlocks = length / SHA256_BLOCK_SIZE;
+    if (numBlocks > 0)
+    {
+        Transform(p, numBlocks);
+        p += numBlocks * SHA256_BLOCK_SIZE;
+        length -= numBlocks * SHA256_BLOCK_SIZE;
+    }
+
+    if (length > 0)
+    {
+        memcpy(m_buffer, p, length);
+        m_bufferLength = length;
+    }
+}
+
+void Sha256::Final(uint8_t* digest)
+{
+    uint64_t numBits = m_length * 8;
+
+    // append the bit "1", pad with zeros and append the message length in bits
+    uint8_t padding[SHA256_BLOCK_SIZE + 8];
+    size_t padLength = (m_bufferLength < 56 ? 56 : 120) - m_bufferLength;
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0x80;
+    for (int i = 0; i < 8; ++i)
+        padding[padLength + i] = (uint8_t) (numBits >> (56 - 8 * i));
+
+    Update(padding, padLength + 8);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        digest[4 * i] = (uint8_t) (m_state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (m_state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (m_state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) m_state[i];
+    }
+}
+
+static void TransformBlock(uint32_t* state, const uint8_t* block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = ((uint32_t) block[4 * i] << 24) | ((uint32_t) block[4 * i + 1] << 16) | ((uint32_t) block[4 * i + 2] << 8) | block[4 * i + 3];
+    for (int i = 16; i < 64; ++i)
+    {
+        uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; ++i)
+    {
+        uint32_t S1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + S1 + ch + g_sha256K[i] + w[i];
+        uint32_t S0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = S0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+#ifdef SIMD_USE_SHA
+//
+// Processes the blocks using the SHA extensions. The state is kept in the
+// order ABEF/CDGH required by the instructions.
+//
+SIMD_TARGET_SHA static void TransformBlocksSHA(uint32_t* state, const uint8_t* blocks, size_t numBlocks)
+{
+    const __m128i byteSwapMask = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[0]), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[4]), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for ( ; numBlocks > 0; --numBlocks, blocks += SHA256_BLOCK_SIZE)
+    {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+
+        __m128i w[4];
+        for (int i = 0; i < 4; ++i)
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (blocks + 16 * i)), byteSwapMask);
+
+        // 4 rounds per iteration; the message schedule is computed along the way
+        for (int i = 0; i < 16; ++i)
+        {
+            __m128i& cur = w[i & 3];
+            __m128i msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i*) &g_sha256K[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            if (i >= 3 && i <= 14)
+            {
+                __m128i& next = w[(i + 1) & 3];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(cur, w[(i + 3) & 3], 4));
+                next = _mm_sha256msg2_epu32(next, cur);
+            }
+
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+
+            if (i >= 1 && i <= 12)
+                w[(i + 3) & 3] = _mm_sha256msg1_epu32(w[(i + 3) & 3], cur);
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128((__m128i*) &state[0], _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128((__m128i*) &state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+static const bool g_hasSHAExtensions = HasSHAExtensions();
+#endif
+
+void Sha256::Transform(const uint8_t* blocks, size_t numBlocks)
+{
+#ifdef SIMD_USE_SHA
+    if (g_hasSHAExtensions)
+    {
+        TransformBlocksSHA(m_state, blocks, numBlocks);
+        return;
+    }
+#endif
+
+    for ( ; numBlocks > 0; --numBlocks, blocks += SHA256_BLOCK_SIZE)
+        TransformBlock(m_state, blocks);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// XXH64
+
+static const uint64_t XXH_PRIME64_1 = 0x9e3779b185ebca87ULL;
+static const uint64_t XXH_PRIME64_2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64_t XXH_PRIME64_3 = 0x165667b19e3779f9ULL;
+static const uint64_t XXH_PRIME64_4 = 0x85ebca77c2b2ae63ULL;
+static const uint64_t XXH_PRIME64_5 = 0x27d4eb2f165667c5ULL;
+
+static inline uint64_t RotateLeft64(uint64_t x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+// the supported platforms are little-endian
+static inline uint64_t Read64(const uint8_t* p)
+{
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint64_t XXHRound(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    return RotateLeft64(acc, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64_t XXHMergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= XXHRound(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+XXHash64::XXHash64(uint64_t seed)
+    : m_seed(seed), m_length(0), m_bufferLength(0)
+{
+    m_state[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    m_state[1] = seed + XXH_PRIME64_2;
+    m_state[2] = seed;
+    m_state[3] = seed - XXH_PRIME64_1;
+}
+
+void XXHash64::Update(const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*) data;
+    const uint8_t* end = p + length;
+    m_length += length;
+
+    // complete a partially filled stripe
+    if (m_bufferLength > 0)
+    {
+        size_t len = sizeof(m_buffer) - m_bufferLength;
+        if (len > length)
+            len = length;
+
+        memcpy(m_buffer + m_bufferLength, p, len);
+        m_bufferLength += len;
+        p += len;
+
+        if (m_bufferLength < sizeof(m_buffer))
+            return;
+
+        for (int i = 0; i < 4; ++i)
+            m_state[i] = XXHRound(m_state[i], Read64(m_buffer + 8 * i));
+        m_bufferLength = 0;
+    }
+
+    // the four lanes are independent, so the CPU processes them in parallel
+    uint64_t v0 = m_state[0], v1 = m_state[1], v2 = m_state[2], v3 = m_state[3];
+    for ( ; end - p >= 32; p += 32)
+    {
+        v0 = XXHRound(v0, Read64(p));
+        v1 = XXHRound(v1, Read64(p + 8));
+        v2 = XXHRound(v2, Read64(p + 16));
+        v3 = XXHRound(v3, Read64(p + 24));
+    }
+    m_state[0] = v0;
+    m_state[1] = v1;
+    m_state[2] = v2;
+    m_state[3] = v3;
+
+    if (p < end)
+    {
+        memcpy(m_buffer, p, end - p);
+        m_bufferLength = end - p;
+    }
+}
+
+uint64_t XXHash64::Final() const
+{
+    uint64_t hash;
+    if (m_length >= 32)
+    {
+        hash = RotateLeft64(m_state[0], 1) + RotateLeft64(m_state[1], 7) + RotateLeft64(m_state[2], 12) + RotateLeft64(m_state[3], 18);
+        for (int i = 0; i < 4; ++i)
+            hash = XXHMergeRound(hash, m_state[i]);
+    }
+    else
+        hash = m_seed + XXH_PRIME64_5;
+
+    hash += m_length;
+
+    const uint8_t* p = m_buffer;
+    const uint8_t* end = m_buffer + m_bufferLength;
+    for ( ; end - p >= 8; p += 8)
+        hash = RotateLeft64(hash ^ XXHRound(0, Read64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    if (end - p >= 4)
+    {
+        hash = RotateLeft64(hash ^ (Read32(p) * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for ( ; p < end; ++p)
+        hash = RotateLeft64(hash ^ (*p * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+} // namespace HashUtil
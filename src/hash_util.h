@@ -0,0 +1,116 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef __hash_util_h
+#define __hash_util_h
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "types.h"
+
+
+namespace HashUtil {
+
+static const uint64_t FNV1A64_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+//
+// Incremental SHA-256 (FIPS 180-4).
+//
+class Sha256
+{
+public:
+    Sha256();
+
+    //
+    // Adds data to the message.
+    //
+    void Update(const void* data, size_t length);
+
+    //
+    // Completes the computation and writes the 32 byte digest to digest.
+    // The object must not be updated afterwards.
+    //
+    void Final(uint8_t* digest);
+
+private:
+    void Transform(const uint8_t* blocks, size_t numBlocks);
+
+private:
+    uint32_t m_state[8];
+    uint64_t m_length;
+    uint8_t m_buffer[SHA256_BLOCK_SIZE];
+    size_t m_bufferLength;
+};
+
+//
+// Incremental XXH64, a fast non-cryptographic hash (compatible with the
+// reference implementation of xxHash).
+//
+class XXHash64
+{
+public:
+    XXHash64(uint64_t seed = 0);
+
+    //
+    // Adds data to the message.
+    //
+    void Update(const void* data, size_t length);
+
+    //
+    // Returns the hash of the data added so far.
+    //
+    uint64_t Final() const;
+
+private:
+    uint64_t m_state[4];
+    uint64_t m_seed;
+    uint64_t m_length;
+    uint8_t m_buffer[32];
+    size_t m_bufferLength;
+};
+
+//
+// Computes the 64-bit FNV-1a hash of the buffer. Pass the result of a previous
+// call as hash to compute the hash of data which is processed in pieces.
+//
+uint64_t Fnv1a64(const void* data, size_t length, uint64_t hash = FNV1A64_OFFSET_BASIS);
+
+//
+// Returns the 16 digit hexadecimal (lower case) representation of a 64-bit hash.
+//
+String ToHex(uint64_t hash);
+
+//
+// Returns the hexadecimal (lower case) representation of a byte sequence.
+//
+String ToHex(const uint8_t* data, size_t length);
+
+} // namespace HashUtil
+
+
+#endif
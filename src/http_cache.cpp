@@ -0,0 +1,799 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "network_util.h"
+#include "file_util.h"
+#include "hash_util.h"
+#include "worker_pool.h"
+
+
+#define HTTP_CACHE_MAGIC 0x31454348  // "HCE1"
+#define HTTP_CACHE_VERSION 1
+
+#ifdef OS_WIN
+// VS2012 doesn't have strtoll
+#define strtoll _strtoi64
+#endif
+
+
+namespace NetworkUtil {
+
+//
+// A cache file consists of the header, the URL, the response headers
+// ("Name: value\r\n" lines) and the body.
+//
+struct CacheFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t timeStored;
+    uint32_t status;
+    uint32_t urlLength;
+    uint32_t headersLength;
+    uint32_t reserved;
+    uint64_t bodyLength;
+};
+
+//
+// The index entry of a cached response. Times are in seconds; timeStored is
+// the time the response was received, less its Age.
+//
+struct CacheEntry
+{
+    std::string url;
+    uint64_t size;
+    int64_t timeStored;
+    int64_t lifetime;
+    int64_t staleWhileRevalidate;
+    std::string etag;
+    std::string lastModified;
+    bool isRevalidating;
+    std::list<uint64_t>::iterator lruPosition;
+};
+
+typedef std::shared_ptr<CacheEntry> CacheEntryPtr;
+
+// an entry read from a cache file with its key, by the time it was stored
+typedef std::pair<int64_t, std::pair<uint64_t, CacheEntryPtr> > LoadedEntry;
+
+struct CacheControl
+{
+    bool noStore;
+    bool noCache;
+    bool mustRevalidate;
+    int64_t maxAge;
+    int64_t staleWhileRevalidate;
+};
+
+
+static std::mutex g_mutex;
+static WorkerPool* g_pool = NULL;
+
+// the index is loaded when the cache is used first; if g_directory is empty
+// the cache can't be used
+static bool g_isLoaded = false;
+static String g_directory;
+
+// the entries by the hash of their URLs, and their keys, the most recently
+// used first
+static std::map<uint64_t, CacheEntryPtr> g_entries;
+static std::list<uint64_t> g_lru;
+
+static HttpCacheStats g_stats;
+static unsigned int g_lastTempFileId = 0;
+
+
+static int64_t Now()
+{
+    return (int64_t) time(NULL);
+}
+
+static uint64_t GetKey(const std::string& url)
+{
+    return HashUtil::Fnv1a64(url.data(), url.length());
+}
+
+static String GetPath(uint64_t key)
+{
+    return g_directory + FileUtil::GetPathSeparator() + HashUtil::ToHex(key) + TEXT(".cache");
+}
+
+static void ParseCacheControl(const std::string& value, CacheControl& cc)
+{
+    cc.noStore = false;
+    cc.noCache = false;
+    cc.mustRevalidate = false;
+    cc.maxAge = -1;
+    cc.staleWhileRevalidate = 0;
+
+    size_t pos = 0;
+    while (pos < value.length())
+    {
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos)
+            end = value.length();
+
+        std::string directive = value.substr(pos, end - pos);
+        pos = end + 1;
+
+        std::transform(directive.begin(), directive.end(), directive.begin(), tolower);
+        directive.erase(0, directive.find_first_not_of(" \t"));
+        size_t eq = directive.find('=');
+        std::string name = directive.substr(0, (std::min)(eq, directive.find_first_of(" \t")));
+        const char* arg = eq == std::string::npos ? "" : directive.c_str() + eq + 1 + (directive[eq + 1] == '"' ? 1 : 0);
+
+        if (name == "no-store")
+            cc.noStore = true;
+        else if (name == "no-cache")
+            cc.noCache = true;
+        else if (name == "must-revalidate")
+            cc.mustRevalidate = true;
+        else if (name == "max-age" && eq != std::string::npos)
+            cc.maxAge = (std::max)((int64_t) 0, (int64_t) strtoll(arg, NULL, 10));
+        else if (name == "stale-while-revalidate" && eq != std::string::npos)
+            cc.staleWhileRevalidate = (std::max)((int64_t) 0, (int64_t) strtoll(arg, NULL, 10));
+    }
+}
+
+//
+// Parses a HTTP date ("Sun, 06 Nov 1994 08:49:37 GMT"); returns -1 if the
+// date is invalid.
+//
+static int64_t ParseHttpDate(const std::string& value)
+{
+    static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    int day, year, hour, minute, second;
+    char month[4];
+    if (sscanf(value.c_str(), "%*[^,], %d %3s %d %d:%d:%d", &day, month, &year, &hour, &minute, &second) != 6)
+        return -1;
+
+    const char* m = strstr(months, month);
+    if (m == NULL || strlen(month) != 3 || (m - months) % 3 != 0)
+        return -1;
+
+    // days since 1970-01-01 of the civil date (March-based years)
+    int mon = (int) (m - months) / 3 + 1;
+    int y = year - (mon <= 2 ? 1 : 0);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = (int64_t) era * 146097 + doe - 719468;
+
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+//
+// Sets the freshness information and the validators of the entry from the
+// headers of a response received at timeReceived. Returns false if the
+// response must not be stored.
+//
+static bool ParseResponseHeaders(const HttpHeaders& headers, int64_t timeReceived, CacheEntry& entry)
+{
+    CacheControl cc;
+    ParseCacheControl(GetHeader(headers, "Cache-Control"), cc);
+
+    std::string age = GetHeader(headers, "Age");
+    entry.timeStored = timeReceived - (age.empty() ? 0 : (std::max)((int64_t) 0, (int64_t) strtoll(age.c_str(), NULL, 10)));
+    entry.etag = GetHeader(headers, "ETag");
+    entry.lastModified = GetHeader(headers, "Last-Modified");
+
+    int64_t date = ParseHttpDate(GetHeader(headers, "Date"));
+    if (date < 0)
+        date = timeReceived;
+
+    std::string expires = GetHeader(headers, "Expires");
+    if (cc.noCache)
+        entry.lifetime = 0;
+    else if (cc.maxAge >= 0)
+        entry.lifetime = cc.maxAge;
+    else if (!expires.empty())
+        entry.lifetime = (std::max)((int64_t) 0, ParseHttpDate(expires) - date);
+    else if (!entry.lastModified.empty())
+    {
+        int64_t lastModified = ParseHttpDate(entry.lastModified);
+        entry.lifetime = lastModified < 0 ? 0 :
+            (std::min)((int64_t) HTTP_CACHE_MAX_HEURISTIC_LIFETIME, (std::max)((int64_t) 0, (date - lastModified) / 10));
+    }
+    else
+        entry.lifetime = 0;
+
+    entry.staleWhileRevalidate = cc.noCache || cc.mustRevalidate ? 0 : cc.staleWhileRevalidate;
+
+    // responses varying with request headers aren't cached since the index
+    // has one entry per URL
+    return !cc.noStore && GetHeader(headers, "Vary").empty() &&
+        (entry.lifetime > 0 || !entry.etag.empty() || !entry.lastModified.empty());
+}
+
+static std::string SerializeHeaders(const HttpHeaders& headers)
+{
+    std::string result;
+    for (HttpHeaders::const_iterator it = headers.begin(); it != headers.end(); ++it)
+        result.append(it->first).append(": ").append(it->second).append("\r\n");
+    return result;
+}
+
+static void ParseHeaders(const std::string& data, HttpHeaders& headers)
+{
+    size_t pos = 0;
+    while (pos < data.length())
+    {
+        size_t end = data.find("\r\n", pos);
+        if (end == std::string::npos)
+            end = data.length();
+
+        size_t colon = data.find(':', pos);
+        if (colon < end)
+        {
+            size_t valueStart = (std::min)(end, colon + 2);
+            headers.push_back(std::make_pair(data.substr(pos, colon - pos), data.substr(valueStart, end - valueStart)));
+        }
+
+        pos = end + 2;
+    }
+}
+
+//
+// Reads a cache file; the body is only read if "body" is set.
+//
+static bool ReadCacheFile(const String& path, CacheFileHeader& header, std::string& url, HttpHeaders& headers, std::string* body)
+{
+    FileUtil::InputFile file;
+    if (!file.Open(path) || file.Read(0, (uint8_t*) &header, sizeof(header)) != (int64_t) sizeof(header) ||
+        header.magic != HTTP_CACHE_MAGIC || header.version != HTTP_CACHE_VERSION)
+    {
+        return false;
+    }
+
+    std::string data(header.urlLength + header.headersLength, '\0');
+    if (!data.empty() && file.Read(sizeof(header), (uint8_t*) &data[0], data.length()) != (int64_t) data.length())
+        return false;
+
+    url = data.substr(0, header.urlLength);
+    ParseHeaders(data.substr(header.urlLength), headers);
+
+    if (body == NULL)
+        return true;
+
+    body->resize((size_t) header.bodyLength);
+    uint64_t offset = sizeof(header) + data.length();
+    for (size_t pos = 0; pos < body->length(); )
+    {
+        int64_t n = file.Read(offset + pos, (uint8_t*) &(*body)[pos], body->length() - pos);
+        if (n <= 0)
+            return false;
+        pos += (size_t) n;
+    }
+
+    return true;
+}
+
+//
+// Writes a cache file to a temporary file in the directory and returns the
+// path of the temporary file, or an empty string if it can't be written.
+//
+static String WriteCacheFile(const String& directory, unsigned int id, const CacheFileHeader& header,
+    const std::string& url, const std::string& headers, const std::string& body)
+{
+    String path = directory + FileUtil::GetPathSeparator() + HashUtil::ToHex((uint64_t) id) + TEXT(".tmp");
+
+    FileUtil::OutputFile file;
+    if (!file.Open(path, false))
+        return String();
+
+    bool success = file.Write((const uint8_t*) &header, sizeof(header)) &&
+        file.Write((const uint8_t*) url.data(), url.length()) &&
+        file.Write((const uint8_t*) headers.data(), headers.length()) &&
+        file.Write((const uint8_t*) body.data(), body.length());
+    file.Close();
+
+    if (!success)
+    {
+        FileUtil::RemoveFile(path);
+        return String();
+    }
+
+    return path;
+}
+
+//
+// Removes the entry from the index and deletes its file. Call with g_mutex
+// locked.
+//
+static void RemoveEntry(uint64_t key)
+{
+    std::map<uint64_t, CacheEntryPtr>::iterator it = g_entries.find(key);
+    if (it == g_entries.end())
+        return;
+
+    g_stats.size -= it->second->size;
+    g_lru.erase(it->second->lruPosition);
+    g_entries.erase(it);
+    FileUtil::RemoveFile(GetPath(key));
+}
+
+//
+// Adds (or replaces) an entry and evicts the least recently used entries if
+// the cache has grown too large. Call with g_mutex locked.
+//
+static void AddEntry(uint64_t key, CacheEntryPtr entry)
+{
+    std::map<uint64_t, CacheEntryPtr>::iterator it = g_entries.find(key);
+    if (it != g_entries.end())
+    {
+        g_stats.size -= it->second->size;
+        g_lru.erase(it->second->lruPosition);
+    }
+
+    g_lru.push_front(key);
+    entry->lruPosition = g_lru.begin();
+    g_entries[key] = entry;
+    g_stats.size += entry->size;
+
+    while (g_stats.size > HTTP_CACHE_MAX_SIZE && g_lru.size() > 1)
+    {
+        RemoveEntry(g_lru.back());
+        g_stats.numEvictions++;
+    }
+}
+
+//
+// Builds the index from the headers of the cache files. The recency of use
+// isn't persisted; the entries are ordered by the time they were stored.
+// Call with g_mutex locked.
+//
+static void LoadIndex()
+{
+    if (g_isLoaded)
+        return;
+    g_isLoaded = true;
+
+    String directory;
+    if (!FileUtil::GetApplicationDataDirectory(directory))
+        return;
+
+    directory += FileUtil::GetPathSeparator();
+    directory += TEXT("HttpCache");
+    if (!FileUtil::MakeDirectory(directory))
+        return;
+    g_directory = directory;
+
+    std::vector<FileUtil::FileInfo> files;
+    FileUtil::ReadDirectory(g_directory, files);
+
+    std::vector<LoadedEntry> entries;
+    for (std::vector<FileUtil::FileInfo>::iterator it = files.begin(); it != files.end(); ++it)
+    {
+        if (it->isDirectory)
+            continue;
+
+        String path = g_directory + FileUtil::GetPathSeparator() + it->name;
+
+        CacheFileHeader header;
+        std::string url;
+        HttpHeaders headers;
+        CacheEntryPtr entry(new CacheEntry());
+        uint64_t key = 0;
+
+        bool isValid = ReadCacheFile(path, header, url, headers, NULL);
+        if (isValid)
+        {
+            key = GetKey(url);
+            isValid = GetPath(key) == path;
+        }
+
+        if (!isValid)
+        {
+            // left over from an interrupted write or an older version
+            FileUtil::RemoveFile(path);
+            continue;
+        }
+
+        ParseResponseHeaders(headers, header.timeStored, *entry);
+        entry->url = url;
+        entry->size = sizeof(header) + header.urlLength + header.headersLength + header.bodyLength;
+        entry->timeStored = header.timeStored;
+        entry->isRevalidating = false;
+
+        entries.push_back(LoadedEntry(header.timeStored, std::make_pair(key, entry)));
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const LoadedEntry& a, const LoadedEntry& b) { return a.first < b.first; });
+
+    for (size_t i = 0; i < entries.size(); ++i)
+        AddEntry(entries[i].second.first, entries[i].second.second);
+}
+
+//
+// Writes the response to the cache. Runs on the cache's threads.
+//
+static void Store(const std::string& url, std::shared_ptr<HttpResponse> response, CacheEntryPtr entry)
+{
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HTTP_CACHE_MAGIC;
+    header.version = HTTP_CACHE_VERSION;
+    header.timeStored = entry->timeStored;
+    header.status = (uint32_t) response->status;
+
+    std::string headers = SerializeHeaders(response->headers);
+    header.urlLength = (uint32_t) url.length();
+    header.headersLength = (uint32_t) headers.length();
+    header.bodyLength = response->body.length();
+
+    entry->url = url;
+    entry->size = sizeof(header) + url.length() + headers.length() + response->body.length();
+    entry->isRevalidating = false;
+
+    String directory;
+    unsigned int id;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        LoadIndex();
+        directory = g_directory;
+        id = ++g_lastTempFileId;
+    }
+
+    if (directory.empty())
+        return;
+
+    String tempPath = WriteCacheFile(directory, id, header, url, headers, response->body);
+    uint64_t key = GetKey(url);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (tempPath.empty() || !FileUtil::RenameFile(tempPath, GetPath(key)))
+    {
+        FileUtil::RemoveFile(tempPath);
+        RemoveEntry(key);
+        return;
+    }
+
+    AddEntry(key, entry);
+}
+
+//
+// Returns a callback which stores cacheable responses before passing them on
+// (if onCompleted is set).
+//
+static HttpCallback CreateStoreCallback(const std::string& url, HttpCallback onCompleted)
+{
+    return [url, onCompleted](HttpResponse& response) {
+        if (response.error == REQUEST_OK)
+        {
+            CacheEntryPtr entry(new CacheEntry());
+            bool isCacheable = response.status == 200 && response.body.length() <= HTTP_CACHE_MAX_SIZE / 8 &&
+                ParseResponseHeaders(response.headers, Now(), *entry);
+
+            std::lock_guard<std::mutex> lock(g_mutex);
+            if (isCacheable && g_pool != NULL)
+            {
+                std::shared_ptr<HttpResponse> copy(new HttpResponse(response));
+                g_pool->Post([url, copy, entry]() { Store(url, copy, entry); });
+            }
+            else
+            {
+                // the cached response (if any) is outdated
+                std::map<uint64_t, CacheEntryPtr>::iterator it = g_entries.find(GetKey(url));
+                if (it != g_entries.end() && it->second->url == url)
+                    RemoveEntry(it->first);
+            }
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            std::map<uint64_t, CacheEntryPtr>::iterator it = g_entries.find(GetKey(url));
+            if (it != g_entries.end())
+                it->second->isRevalidating = false;
+        }
+
+        if (onCompleted)
+            onCompleted(response);
+    };
+}
+
+static void Fetch(const HttpRequest& request, RequestPriority priority, const std::string& group, HttpCallback onCompleted)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_stats.numMisses++;
+    }
+
+    ScheduleRequest(request, priority, group, CreateStoreCallback(request.url, onCompleted));
+}
+
+//
+// Reads the cached response. Returns false (and removes the entry) if the
+// file can't be read.
+//
+static bool ReadResponse(uint64_t key, CacheEntryPtr entry, HttpResponse& response)
+{
+    String path;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        path = GetPath(key);
+    }
+
+    CacheFileHeader header;
+    std::string url;
+    if (ReadCacheFile(path, header, url, response.headers, &response.body) && url == entry->url)
+    {
+        response.error = REQUEST_OK;
+        response.status = (int) header.status;
+        response.url = url;
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    std::map<uint64_t, CacheEntryPtr>::iterator it = g_entries.find(key);
+    if (it != g_entries.end() && it->second == entry)
+        RemoveEntry(key);
+
+    return false;
+}
+
+//
+// Updates a cached response with the headers of a "304 Not Modified"
+// response and passes it on (if onCompleted is set). Runs on the cache's
+// threads.
+//
+static void Refresh(const HttpRequest& request, RequestPriority priority, const std::string& group,
+    CacheEntryPtr entry, std::shared_ptr<HttpResponse> notModified, int64_t timeReceived, HttpCallback onCompleted)
+{
+    uint64_t key = GetKey(request.url);
+    std::shared_ptr<HttpResponse> response(new HttpResponse());
+    if (!ReadResponse(key, entry, *response))
+    {
+        if (onCompleted)
+            Fetch(request, priority, group, onCompleted);
+        return;
+    }
+
+    // the headers of the 304 response replace the stored ones
+    for (HttpHeaders::iterator it = notModified->headers.begin(); it != notModified->headers.end(); ++it)
+    {
+        std::string name = it->first;
+        std::transform(name.begin(), name.end(), name.begin(), tolower);
+        if (name == "content-length" || name == "transfer-encoding" || name == "connection" || name == "keep-alive")
+            continue;
+
+        HttpHeaders::iterator itStored = response->headers.begin();
+        for ( ; itStored != response->headers.end(); ++itStored)
+        {
+            std::string storedName = itStored->first;
+            std::transform(storedName.begin(), storedName.end(), storedName.begin(), tolower);
+            if (storedName == name)
+                break;
+        }
+
+        if (itStored != response->headers.end())
+            itStored->second = it->second;
+        else
+            response->headers.push_back(*it);
+    }
+
+    CacheEntryPtr refreshed(new CacheEntry());
+    if (ParseResponseHeaders(response->headers, timeReceived, *refreshed))
+        Store(request.url, response, refreshed);
+    else
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        std::map<uint64_t, CacheEntryPtr>::iterator it = g_entries.find(key);
+        if (it != g_entries.end() && it->second == entry)
+            RemoveEntry(key);
+    }
+
+    if (onCompleted)
+    {
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            g_stats.numRevalidations++;
+        }
+
+        onCompleted(*response);
+    }
+}
+
+//
+// Sends a conditional request for a cached response. If onCompleted isn't
+// set, the response is revalidated in the background.
+//
+static void Revalidate(const HttpRequest& request, RequestPriority priority, const std::string& group, CacheEntryPtr entry, HttpCallback onCompleted)
+{
+    HttpRequest conditional = request;
+    if (!entry->etag.empty())
+        conditional.headers.push_back(std::make_pair(std::string("If-None-Match"), entry->etag));
+    if (!entry->lastModified.empty())
+        conditional.headers.push_back(std::make_pair(std::string("If-Modified-Since"), entry->lastModified));
+
+    HttpCallback onStored = CreateStoreCallback(request.url, onCompleted);
+    ScheduleRequest(conditional, priority, group, [request, priority, group, entry, onCompleted, onStored](HttpResponse& response) {
+        if (response.error != REQUEST_OK || response.status != 304)
+        {
+            if (onCompleted)
+            {
+                std::lock_guard<std::mutex> lock(g_mutex);
+                g_stats.numMisses++;
+            }
+
+            onStored(response);
+            return;
+        }
+
+        std::shared_ptr<HttpResponse> notModified(new HttpResponse(response));
+        int64_t timeReceived = Now();
+
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (g_pool != NULL)
+        {
+            g_pool->Post([request, priority, group, entry, notModified, timeReceived, onCompleted]() {
+                Refresh(request, priority, group, entry, notModified, timeReceived, onCompleted);
+            });
+        }
+    });
+}
+
+//
+// Serves a request from the cache or sends it. Runs on the cache's threads.
+//
+static void Lookup(const HttpRequest& request, RequestPriority priority, const std::string& group, HttpCallback onCompleted)
+{
+    enum { LOOKUP_MISS, LOOKUP_FRESH, LOOKUP_STALE, LOOKUP_REVALIDATE } result = LOOKUP_MISS;
+
+    CacheControl cc;
+    ParseCacheControl(GetHeader(request.headers, "Cache-Control"), cc);
+
+    uint64_t key = GetKey(request.url);
+    CacheEntryPtr entry;
+    bool isRevalidationNeeded = false;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        LoadIndex();
+
+        std::map<uint64_t, CacheEntryPtr>::iterator it = g_entries.find(key);
+        if (it != g_entries.end() && it->second->url == request.url)
+        {
+            entry = it->second;
+            g_lru.splice(g_lru.begin(), g_lru, entry->lruPosition);
+
+            int64_t age = Now() - entry->timeStored;
+            int64_t lifetime = cc.noCache ? 0 : cc.maxAge >= 0 ? (std::min)(cc.maxAge, entry->lifetime) : entry->lifetime;
+
+            if (age < lifetime)
+                result = LOOKUP_FRESH;
+            else if (!cc.noCache && age < entry->lifetime + entry->staleWhileRevalidate)
+            {
+                result = LOOKUP_STALE;
+                isRevalidationNeeded = !entry->isRevalidating;
+                entry->isRevalidating = true;
+            }
+            else if (!entry->etag.empty() || !entry->lastModified.empty())
+                result = LOOKUP_REVALIDATE;
+        }
+    }
+
+    if (result == LOOKUP_FRESH || result == LOOKUP_STALE)
+    {
+        HttpResponse response;
+        if (ReadResponse(key, entry, response))
+        {
+            {
+                std::lock_guard<std::mutex> lock(g_mutex);
+                if (result == LOOKUP_FRESH)
+                    g_stats.numHits++;
+                else
+                    g_stats.numStaleHits++;
+            }
+
+            if (isRevalidationNeeded)
+                Revalidate(request, PRIORITY_BACKGROUND, std::string(), entry, HttpCallback());
+
+            onCompleted(response);
+            return;
+        }
+
+        result = LOOKUP_MISS;
+    }
+
+    if (result == LOOKUP_REVALIDATE)
+        Revalidate(request, priority, group, entry, onCompleted);
+    else
+        Fetch(request, priority, group, onCompleted);
+}
+
+void SendCachedRequest(const HttpRequest& request, RequestPriority priority, const std::string& group, HttpCallback onCompleted)
+{
+    std::string method = request.method;
+    std::transform(method.begin(), method.end(), method.begin(), toupper);
+
+    CacheControl cc;
+    ParseCacheControl(GetHeader(request.headers, "Cache-Control"), cc);
+
+    // conditional and range requests are left to the caller
+    bool isCacheable = (method == "GET" || method.empty()) && request.body.empty() && !request.onHeaders && !request.onData &&
+        !cc.noStore && GetHeader(request.headers, "If-None-Match").empty() &&
+        GetHeader(request.headers, "If-Modified-Since").empty() && GetHeader(request.headers, "Range").empty();
+
+    if (!isCacheable)
+    {
+        ScheduleRequest(request, priority, group, onCompleted);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_pool == NULL)
+        g_pool = new WorkerPool(HTTP_CACHE_NUM_THREADS);
+    g_pool->Post([request, priority, group, onCompleted]() { Lookup(request, priority, group, onCompleted); });
+}
+
+void GetHttpCacheStats(HttpCacheStats& stats)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    stats = g_stats;
+    stats.numEntries = g_entries.size();
+}
+
+void ClearHttpCache()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_pool == NULL)
+        g_pool = new WorkerPool(HTTP_CACHE_NUM_THREADS);
+
+    g_pool->Post([]() {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        LoadIndex();
+        while (!g_lru.empty())
+            RemoveEntry(g_lru.back());
+    });
+}
+
+void StopHttpCache()
+{
+    WorkerPool* pool = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        pool = g_pool;
+        g_pool = NULL;
+    }
+
+    // waits for the pending tasks
+    delete pool;
+}
+
+} // namespace NetworkUtil
@@ -0,0 +1,1409 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+// the Winsock headers must be included before windows.h
+#ifdef OS_WIN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "network_util.h"
+#include "worker_pool.h"
+
+
+// The number of threads resolving host names (getaddrinfo blocks)
+#define HTTP_NUM_RESOLVER_THREADS 2
+
+// The size of the buffer data is received into
+#define HTTP_RECEIVE_BUFFER_SIZE (64 * 1024)
+
+
+#ifdef OS_WIN
+typedef SOCKET Socket;
+typedef WSAPOLLFD PollFD;
+#define NO_SOCKET INVALID_SOCKET
+#define SEND_FLAGS 0
+// VS2012 doesn't have strtoull
+#define strtoull _strtoui64
+#else
+typedef int Socket;
+typedef struct pollfd PollFD;
+#define NO_SOCKET -1
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+#endif
+
+
+namespace NetworkUtil {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::function<void()> Command;
+
+struct Url
+{
+    std::string host;
+    int port;
+    std::string path;
+
+    // the value of the Host header and the key of the host's pool
+    std::string hostHeader;
+};
+
+struct Request
+{
+    int id;
+    HttpRequest request;
+    HttpCallback onCompleted;
+    Url url;
+    int numRedirects;
+    int numRetries;
+};
+
+typedef std::shared_ptr<Request> RequestPtr;
+
+enum ParseState
+{
+    PARSE_HEADERS,
+    PARSE_BODY,
+    PARSE_CHUNK_SIZE,
+    PARSE_CHUNK_DATA,
+    PARSE_CHUNK_END,
+    PARSE_TRAILERS,
+    PARSE_BODY_UNTIL_CLOSE
+};
+
+struct HostPool;
+
+struct Connection
+{
+    HostPool* host;
+    Socket socket;
+    size_t addressIndex;
+    bool isConnected;
+
+    // set once a response has confirmed that the server keeps the connection
+    // open, which makes pipelining safe
+    bool isPersistent;
+    bool isClosing;
+    int numResponses;
+
+    // the requests which have been sent (or are being sent), in order; the
+    // response being parsed belongs to the first one
+    std::deque<RequestPtr> requests;
+    std::string outBuffer;
+    size_t outOffset;
+
+    std::string inBuffer;
+    ParseState state;
+    HttpResponse response;
+    uint64_t numBytesRemaining;
+    bool hasReceivedData;
+
+    // set if the body of the response is passed to the request's onData
+    bool isStreaming;
+
+    Clock::time_point deadline;
+};
+
+struct Address
+{
+    sockaddr_storage addr;
+    int length;
+};
+
+struct HostPool
+{
+    std::string key;
+    std::string host;
+    int port;
+
+    std::vector<Address> addresses;
+    bool isResolving;
+
+    std::deque<RequestPtr> pending;
+    std::vector<Connection*> connections;
+};
+
+
+static std::mutex g_mutex;
+static std::thread g_thread;
+static std::vector<Command> g_commands;
+static bool g_isRunning = false;
+static bool g_isStopping = false;
+static Socket g_wakeupRead = NO_SOCKET;
+static Socket g_wakeupWrite = NO_SOCKET;
+static std::atomic<int> g_nextId(1);
+
+// only accessed on the network thread
+static std::map<std::string, HostPool*> g_hosts;
+static WorkerPool* g_resolver = NULL;
+
+
+static void Dispatch(HostPool* host);
+static void StartRequest(RequestPtr request);
+
+
+//////////////////////////////////////////////////////////////////////
+// Sockets
+
+static void CloseSocket(Socket s)
+{
+#ifdef OS_WIN
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+static bool SetNonBlocking(Socket s)
+{
+#ifdef OS_WIN
+    u_long isNonBlocking = 1;
+    return ioctlsocket(s, FIONBIO, &isNonBlocking) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+//
+// Tests whether the last socket operation failed only because it would have
+// blocked.
+//
+static bool WouldBlock()
+{
+#ifdef OS_WIN
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS || error == WSAEINTR;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+//
+// Creates a pair of connected sockets (a pipe on POSIX systems) which wakes
+// the network thread up when a byte is written to writeEnd.
+//
+static bool CreateWakeupPair(Socket& readEnd, Socket& writeEnd)
+{
+#ifdef OS_WIN
+    Socket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == NO_SOCKET)
+        return false;
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int length = sizeof(addr);
+
+    readEnd = NO_SOCKET;
+    writeEnd = NO_SOCKET;
+    if (bind(listener, (sockaddr*) &addr, length) == 0 && listen(listener, 1) == 0 && getsockname(listener, (sockaddr*) &addr, &length) == 0)
+    {
+        writeEnd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (writeEnd != NO_SOCKET && connect(writeEnd, (sockaddr*) &addr, length) == 0)
+            readEnd = accept(listener, NULL, NULL);
+    }
+
+    CloseSocket(listener);
+    if (readEnd == NO_SOCKET)
+    {
+        if (writeEnd != NO_SOCKET)
+            CloseSocket(writeEnd);
+        return false;
+    }
+#else
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    readEnd = fds[0];
+    writeEnd = fds[1];
+#endif
+
+    SetNonBlocking(readEnd);
+    SetNonBlocking(writeEnd);
+    return true;
+}
+
+static void Wake()
+{
+    char c = 0;
+#ifdef OS_WIN
+    send(g_wakeupWrite, &c, 1, 0);
+#else
+    ssize_t ret = write(g_wakeupWrite, &c, 1);
+    (void) ret;
+#endif
+}
+
+static void DrainWakeups()
+{
+    char buf[256];
+#ifdef OS_WIN
+    while (recv(g_wakeupRead, buf, sizeof(buf), 0) > 0)
+        ;
+#else
+    while (read(g_wakeupRead, buf, sizeof(buf)) > 0)
+        ;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// URLs and Headers
+
+static std::string ToLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), tolower);
+    return s;
+}
+
+static std::string Trim(const std::string& s)
+{
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(start, end - start + 1);
+}
+
+//
+// Parses an absolute "http://" URL. IPv6 addresses must be enclosed in
+// brackets. The fragment is removed.
+//
+static bool ParseUrl(const std::string& url, Url& parsed)
+{
+    if (url.length() < 7 || ToLower(url.substr(0, 7)) != "http://")
+        return false;
+
+    size_t hostStart = 7;
+    size_t pathStart = url.find_first_of("/?#", hostStart);
+    if (pathStart == std::string::npos)
+        pathStart = url.length();
+
+    std::string authority = url.substr(hostStart, pathStart - hostStart);
+    size_t at = authority.rfind('@');
+    if (at != std::string::npos)
+        authority = authority.substr(at + 1);
+
+    std::string port;
+    if (authority.length() > 0 && authority[0] == '[')
+    {
+        size_t end = authority.find(']');
+        if (end == std::string::npos)
+            return false;
+        parsed.host = authority.substr(1, end - 1);
+        if (end + 1 < authority.length())
+        {
+            if (authority[end + 1] != ':')
+                return false;
+            port = authority.substr(end + 2);
+        }
+    }
+    else
+    {
+        size_t colon = authority.find(':');
+        parsed.host = authority.substr(0, colon);
+        if (colon != std::string::npos)
+            port = authority.substr(colon + 1);
+    }
+
+    parsed.host = ToLower(parsed.host);
+    if (parsed.host.empty())
+        return false;
+
+    parsed.port = 80;
+    if (!port.empty())
+    {
+        if (port.length() > 5 || port.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        parsed.port = atoi(port.c_str());
+        if (parsed.port == 0 || parsed.port > 65535)
+            return false;
+    }
+
+    size_t fragment = url.find('#', pathStart);
+    parsed.path = url.substr(pathStart, fragment == std::string::npos ? std::string::npos : fragment - pathStart);
+    if (parsed.path.empty() || parsed.path[0] != '/')
+        parsed.path = "/" + parsed.path;
+
+    parsed.hostHeader = parsed.host.find(':') != std::string::npos ? "[" + parsed.host + "]" : parsed.host;
+    if (parsed.port != 80)
+    {
+        char buf[16];
+        sprintf(buf, ":%d", parsed.port);
+        parsed.hostHeader += buf;
+    }
+
+    return true;
+}
+
+std::string GetUrlScheme(const std::string& url)
+{
+    size_t colon = url.find(':');
+    if (colon == std::string::npos || colon == 0 || !isalpha((unsigned char) url[0]))
+        return "";
+
+    for (size_t i = 1; i < colon; i++)
+    {
+        char c = url[i];
+        if (!isalnum((unsigned char) c) && c != '+' && c != '-' && c != '.')
+            return "";
+    }
+
+    return ToLower(url.substr(0, colon));
+}
+
+//
+// Resolves the target of a redirect relative to the URL it came from.
+//
+static std::string ResolveUrl(const Url& base, const std::string& location)
+{
+    if (!GetUrlScheme(location).empty())
+        return location;
+    if (location.compare(0, 2, "//") == 0)
+        return "http:" + location;
+    if (location.length() > 0 && location[0] == '/')
+        return "http://" + base.hostHeader + location;
+
+    // relative to the directory of the base path
+    std::string path = base.path.substr(0, base.path.find('?'));
+    return "http://" + base.hostHeader + path.substr(0, path.rfind('/') + 1) + location;
+}
+
+std::string GetHeader(const HttpHeaders& headers, const std::string& name)
+{
+    std::string lowerName = ToLower(name);
+    for (HttpHeaders::const_iterator it = headers.begin(); it != headers.end(); ++it)
+        if (ToLower(it->first) == lowerName)
+            return it->second;
+
+    return "";
+}
+
+static bool IsIdempotent(const RequestPtr& request)
+{
+    const std::string& method = request->request.method;
+    return method == "GET" || method == "HEAD" || method == "OPTIONS";
+}
+
+static std::string SerializeRequest(const RequestPtr& request)
+{
+    const HttpRequest& req = request->request;
+
+    std::string s = req.method + " " + request->url.path + " HTTP/1.1\r\nHost: " + request->url.hostHeader + "\r\n";
+    for (HttpHeaders::const_iterator it = req.headers.begin(); it != req.headers.end(); ++it)
+    {
+        std::string name = ToLower(it->first);
+        if (name != "host" && name != "content-length" && name != "connection" && name != "transfer-encoding")
+            s += it->first + ": " + it->second + "\r\n";
+    }
+
+    if (!req.body.empty() || req.method == "POST" || req.method == "PUT" || req.method == "PATCH")
+    {
+        char buf[32];
+        sprintf(buf, "%llu", (unsigned long long) req.body.length());
+        s += std::string("Content-Length: ") + buf + "\r\n";
+    }
+
+    s += "\r\n";
+    s += req.body;
+    return s;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Requests and Connections
+
+//
+// Tests whether the response is a redirect which is followed. Redirects to
+// other schemes than "http" (e.g., "https") are passed on to the caller.
+//
+static bool IsFollowedRedirect(const RequestPtr& request, const HttpResponse& response)
+{
+    int status = response.status;
+    if (response.error != REQUEST_OK || (status != 301 && status != 302 && status != 303 && status != 307 && status != 308) ||
+        request->numRedirects >= HTTP_MAX_REDIRECTS)
+    {
+        return false;
+    }
+
+    std::string location = GetHeader(response.headers, "Location");
+    return !location.empty() && GetUrlScheme(ResolveUrl(request->url, location)) == "http";
+}
+
+static void Complete(RequestPtr request, HttpResponse& response)
+{
+    if (IsFollowedRedirect(request, response))
+    {
+        request->request.url = ResolveUrl(request->url, GetHeader(response.headers, "Location"));
+        request->numRedirects++;
+        request->numRetries = 0;
+
+        // like browsers, change POSTs to GETs unless the status forbids it
+        int status = response.status;
+        if (status == 303 || ((status == 301 || status == 302) && request->request.method == "POST"))
+        {
+            if (request->request.method != "HEAD")
+                request->request.method = "GET";
+            request->request.body.clear();
+        }
+
+        StartRequest(request);
+        return;
+    }
+
+    response.url = request->request.url;
+    if (request->onCompleted)
+        request->onCompleted(response);
+}
+
+static void Fail(RequestPtr request, RequestError error)
+{
+    HttpResponse response;
+    response.error = error;
+    response.status = 0;
+    response.url = request->request.url;
+    if (request->onCompleted)
+        request->onCompleted(response);
+}
+
+static void ResetParser(Connection* conn)
+{
+    conn->state = PARSE_HEADERS;
+    conn->response = HttpResponse();
+    conn->response.error = REQUEST_OK;
+    conn->response.status = 0;
+    conn->numBytesRemaining = 0;
+    conn->hasReceivedData = false;
+    conn->isStreaming = false;
+}
+
+//
+// Creates a socket and starts connecting to the host's addresses, beginning
+// with the one at conn->addressIndex.
+//
+static bool StartConnect(Connection* conn)
+{
+    std::vector<Address>& addresses = conn->host->addresses;
+    for ( ; conn->addressIndex < addresses.size(); conn->addressIndex++)
+    {
+        const Address& address = addresses[conn->addressIndex];
+        Socket s = socket(address.addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+        if (s == NO_SOCKET)
+            continue;
+
+        int isEnabled = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*) &isEnabled, sizeof(isEnabled));
+#ifdef SO_NOSIGPIPE
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &isEnabled, sizeof(isEnabled));
+#endif
+
+        if (SetNonBlocking(s) && (connect(s, (const sockaddr*) &address.addr, address.length) == 0 || WouldBlock()))
+        {
+            conn->socket = s;
+            conn->isConnected = false;
+            conn->deadline = Clock::now() + std::chrono::milliseconds(HTTP_CONNECT_TIMEOUT);
+            return true;
+        }
+
+        CloseSocket(s);
+    }
+
+    return false;
+}
+
+static Connection* OpenConnection(HostPool* host)
+{
+    Connection* conn = new Connection();
+    conn->host = host;
+    conn->socket = NO_SOCKET;
+    conn->addressIndex = 0;
+    conn->isConnected = false;
+    conn->isPersistent = false;
+    conn->isClosing = false;
+    conn->numResponses = 0;
+    conn->outOffset = 0;
+    ResetParser(conn);
+
+    if (!StartConnect(conn))
+    {
+        delete conn;
+        return NULL;
+    }
+
+    host->connections.push_back(conn);
+    return conn;
+}
+
+//
+// Closes the connection. If canRetry is set, requests which haven't been
+// answered are sent again: always if the server has closed a persistent
+// connection before starting to respond to them (which servers do when they
+// reach their limit of requests per connection), and once if they are
+// idempotent. The others fail with "error".
+//
+static void CloseConnection(Connection* conn, RequestError error, bool canRetry)
+{
+    HostPool* host = conn->host;
+    host->connections.erase(std::find(host->connections.begin(), host->connections.end(), conn));
+    CloseSocket(conn->socket);
+
+    std::vector<RequestPtr> failed;
+    for (int i = (int) conn->requests.size() - 1; i >= 0; --i)
+    {
+        RequestPtr request = conn->requests[i];
+        bool isUnanswered = conn->numResponses > 0 && (i > 0 || !conn->hasReceivedData);
+        bool isStreamed = i == 0 && conn->isStreaming;
+        if (canRetry && !isStreamed && (isUnanswered || (request->numRetries == 0 && IsIdempotent(request))))
+        {
+            if (!isUnanswered)
+                request->numRetries++;
+            host->pending.push_front(request);
+        }
+        else
+            failed.push_back(request);
+    }
+
+    delete conn;
+
+    for (int i = (int) failed.size() - 1; i >= 0; --i)
+        Fail(failed[i], error);
+
+    Dispatch(host);
+}
+
+//
+// Called when a connection attempt has failed; tries the next address.
+//
+static void ConnectFailed(Connection* conn)
+{
+    CloseSocket(conn->socket);
+    conn->socket = NO_SOCKET;
+    conn->addressIndex++;
+
+    if (!StartConnect(conn))
+    {
+        // resolve the name again for the next connection
+        conn->host->addresses.clear();
+        conn->socket = NO_SOCKET;
+        HostPool* host = conn->host;
+        host->connections.erase(std::find(host->connections.begin(), host->connections.end(), conn));
+
+        std::deque<RequestPtr> requests;
+        requests.swap(conn->requests);
+        delete conn;
+
+        for (std::deque<RequestPtr>::iterator it = requests.begin(); it != requests.end(); ++it)
+            Fail(*it, REQUEST_CONNECT_FAILED);
+
+        Dispatch(host);
+    }
+}
+
+static void Send(Connection* conn, RequestPtr request)
+{
+    conn->requests.push_back(request);
+    conn->outBuffer.append(SerializeRequest(request));
+    if (conn->requests.size() == 1 && conn->isConnected)
+        conn->deadline = Clock::now() + std::chrono::milliseconds(HTTP_RESPONSE_TIMEOUT);
+}
+
+//
+// Finds the connection with the fewest outstanding requests on which a
+// request can be pipelined.
+//
+static Connection* FindPipelineConnection(HostPool* host)
+{
+    Connection* best = NULL;
+    for (std::vector<Connection*>::iterator it = host->connections.begin(); it != host->connections.end(); ++it)
+    {
+        Connection* conn = *it;
+        if (!conn->isPersistent || conn->isClosing || conn->state == PARSE_BODY_UNTIL_CLOSE || conn->requests.size() >= HTTP_MAX_PIPELINE_DEPTH)
+            continue;
+
+        bool isIdempotent = true;
+        for (std::deque<RequestPtr>::iterator itReq = conn->requests.begin(); itReq != conn->requests.end() && isIdempotent; ++itReq)
+            isIdempotent = IsIdempotent(*itReq);
+
+        if (isIdempotent && (best == NULL || conn->requests.size() < best->requests.size()))
+            best = conn;
+    }
+
+    return best;
+}
+
+static void Resolve(HostPool* host)
+{
+    host->isResolving = true;
+
+    std::string key = host->key;
+    std::string name = host->host;
+    int port = host->port;
+
+    g_resolver->Post([key, name, port]() {
+        char service[16];
+        sprintf(service, "%d", port);
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+
+        std::shared_ptr<std::vector<Address> > addresses(new std::vector<Address>());
+        addrinfo* result = NULL;
+        if (getaddrinfo(name.c_str(), service, &hints, &result) == 0)
+        {
+            for (addrinfo* ai = result; ai != NULL; ai = ai->ai_next)
+            {
+                Address address;
+                memset(&address, 0, sizeof(address));
+                memcpy(&address.addr, ai->ai_addr, ai->ai_addrlen);
+                address.length = (int) ai->ai_addrlen;
+                addresses->push_back(address);
+            }
+
+            freeaddrinfo(result);
+        }
+
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (g_isStopping)
+            return;
+
+        g_commands.push_back([key, addresses]() {
+            std::map<std::string, HostPool*>::iterator it = g_hosts.find(key);
+            if (it == g_hosts.end())
+                return;
+
+            HostPool* host = it->second;
+            host->isResolving = false;
+            host->addresses = *addresses;
+
+            if (host->addresses.empty())
+            {
+                std::deque<RequestPtr> requests;
+                requests.swap(host->pending);
+                for (std::deque<RequestPtr>::iterator itReq = requests.begin(); itReq != requests.end(); ++itReq)
+                    Fail(*itReq, REQUEST_RESOLVE_FAILED);
+            }
+            else
+                Dispatch(host);
+        });
+        Wake();
+    });
+}
+
+//
+// Assigns the host's pending requests to connections: idle connections are
+// used first, then new connections are opened, and when the maximum number
+// of connections has been reached, idempotent requests are pipelined.
+//
+static void Dispatch(HostPool* host)
+{
+    while (!host->pending.empty())
+    {
+        RequestPtr request = host->pending.front();
+
+        Connection* conn = NULL;
+        for (std::vector<Connection*>::iterator it = host->connections.begin(); it != host->connections.end() && conn == NULL; ++it)
+            if ((*it)->requests.empty() && !(*it)->isClosing)
+                conn = *it;
+
+        if (conn == NULL && host->connections.size() < HTTP_MAX_CONNECTIONS_PER_HOST)
+        {
+            if (host->addresses.empty())
+            {
+                if (!host->isResolving)
+                    Resolve(host);
+                return;
+            }
+
+            conn = OpenConnection(host);
+            if (conn == NULL)
+            {
+                host->addresses.clear();
+                host->pending.pop_front();
+                Fail(request, REQUEST_CONNECT_FAILED);
+                continue;
+            }
+        }
+
+        if (conn == NULL && IsIdempotent(request))
+            conn = FindPipelineConnection(host);
+        if (conn == NULL)
+            return;
+
+        host->pending.pop_front();
+        Send(conn, request);
+    }
+}
+
+static void StartRequest(RequestPtr request)
+{
+    if (!ParseUrl(request->request.url, request->url))
+    {
+        Fail(request, REQUEST_INVALID_URL);
+        return;
+    }
+
+    HostPool*& host = g_hosts[request->url.hostHeader];
+    if (host == NULL)
+    {
+        host = new HostPool();
+        host->key = request->url.hostHeader;
+        host->host = request->url.host;
+        host->port = request->url.port;
+        host->isResolving = false;
+    }
+
+    host->pending.push_back(request);
+    Dispatch(host);
+}
+
+
+//
+// Cancels a request which has been sent on the connection. The connection
+// can't be used anymore; the other requests on it are sent again.
+//
+static void Abort(Connection* conn, std::deque<RequestPtr>::iterator it)
+{
+    RequestPtr request = *it;
+    if (it == conn->requests.begin())
+    {
+        // the data received belongs to the aborted request
+        conn->hasReceivedData = false;
+        conn->isStreaming = false;
+    }
+    conn->requests.erase(it);
+    CloseConnection(conn, REQUEST_CANCELLED, true);
+    Fail(request, REQUEST_CANCELLED);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Responses
+
+//
+// Parses the status line and the headers; returns false if they're invalid.
+//
+static bool ParseHeaders(const std::string& data, HttpResponse& response, bool& isHTTP10)
+{
+    size_t lineEnd = data.find("\r\n");
+    std::string statusLine = data.substr(0, lineEnd);
+    if (statusLine.compare(0, 5, "HTTP/") != 0 || statusLine.length() < 12)
+        return false;
+
+    isHTTP10 = statusLine.compare(0, 8, "HTTP/1.0") == 0;
+    size_t space = statusLine.find(' ');
+    if (space == std::string::npos)
+        return false;
+    response.status = atoi(statusLine.c_str() + space + 1);
+    if (response.status < 100 || response.status > 999)
+        return false;
+
+    response.headers.clear();
+    while (lineEnd != std::string::npos && lineEnd + 2 < data.length())
+    {
+        size_t start = lineEnd + 2;
+        lineEnd = data.find("\r\n", start);
+        std::string line = data.substr(start, lineEnd == std::string::npos ? std::string::npos : lineEnd - start);
+        if (line.empty())
+            break;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0)
+            return false;
+        response.headers.push_back(std::make_pair(line.substr(0, colon), Trim(line.substr(colon + 1))));
+    }
+
+    return true;
+}
+
+//
+// Completes the response to the first request on the connection.
+//
+static void FinishResponse(Connection* conn)
+{
+    HostPool* host = conn->host;
+    RequestPtr request = conn->requests.front();
+    conn->requests.pop_front();
+
+    HttpResponse response;
+    std::swap(response, conn->response);
+    ResetParser(conn);
+    conn->numResponses++;
+
+    if (conn->isClosing)
+    {
+        // the server closes the connection; send the remaining requests on
+        // another one
+        CloseConnection(conn, REQUEST_CONNECTION_CLOSED, true);
+    }
+    else
+    {
+        conn->isPersistent = true;
+        conn->deadline = Clock::now() + std::chrono::milliseconds(conn->requests.empty() ? HTTP_KEEP_ALIVE_TIMEOUT : HTTP_RESPONSE_TIMEOUT);
+    }
+
+    Complete(request, response);
+
+    // "conn" may have been closed
+    Dispatch(host);
+}
+
+//
+// Adds data to the body of the response, or passes it to the request's
+// onData. Returns false if the request has been cancelled (which closes the
+// connection).
+//
+static bool AppendBody(Connection* conn, const char* data, size_t length)
+{
+    if (!conn->isStreaming)
+    {
+        conn->response.body.append(data, length);
+        return true;
+    }
+
+    if (length == 0 || conn->requests.front()->request.onData(data, length))
+        return true;
+
+    Abort(conn, conn->requests.begin());
+    return false;
+}
+
+//
+// Parses the data received on the connection. Returns false if the
+// connection has been closed.
+//
+static bool ProcessInput(Connection* conn)
+{
+    for (;;)
+    {
+        if (conn->requests.empty())
+        {
+            if (conn->inBuffer.empty())
+                return true;
+
+            // data nobody asked for
+            CloseConnection(conn, REQUEST_PROTOCOL_ERROR, false);
+            return false;
+        }
+
+        std::string& in = conn->inBuffer;
+        if (in.empty() && conn->state != PARSE_BODY && conn->state != PARSE_CHUNK_DATA)
+            return true;
+
+        switch (conn->state)
+        {
+        case PARSE_HEADERS:
+            {
+                size_t end = in.find("\r\n\r\n");
+                if (end == std::string::npos)
+                {
+                    if (in.length() > HTTP_MAX_HEADER_SIZE)
+                    {
+                        CloseConnection(conn, REQUEST_PROTOCOL_ERROR, false);
+                        return false;
+                    }
+                    return true;
+                }
+
+                bool isHTTP10 = false;
+                if (!ParseHeaders(in.substr(0, end + 2), conn->response, isHTTP10))
+                {
+                    CloseConnection(conn, REQUEST_PROTOCOL_ERROR, false);
+                    return false;
+                }
+                in.erase(0, end + 4);
+
+                HttpResponse& response = conn->response;
+                if (response.status >= 100 && response.status < 200)
+                {
+                    // interim response; the final one follows
+                    response.headers.clear();
+                    response.status = 0;
+                    continue;
+                }
+
+                std::string connection = ToLower(GetHeader(response.headers, "Connection"));
+                if (connection.find("close") != std::string::npos || (isHTTP10 && connection.find("keep-alive") == std::string::npos))
+                    conn->isClosing = true;
+
+                std::string transferEncoding = ToLower(GetHeader(response.headers, "Transfer-Encoding"));
+                std::string contentLength = GetHeader(response.headers, "Content-Length");
+
+                const RequestPtr& request = conn->requests.front();
+                if (!IsFollowedRedirect(request, response))
+                {
+                    if (request->request.onHeaders && !request->request.onHeaders(response))
+                    {
+                        Abort(conn, conn->requests.begin());
+                        return false;
+                    }
+
+                    conn->isStreaming = request->request.onData != NULL;
+                }
+
+                if (request->request.method == "HEAD" || response.status == 204 || response.status == 304)
+                {
+                    bool isClosing = conn->isClosing;
+                    FinishResponse(conn);
+                    if (isClosing)
+                        return false;
+                }
+                else if (transferEncoding.find("chunked") != std::string::npos)
+                    conn->state = PARSE_CHUNK_SIZE;
+                else if (!contentLength.empty())
+                {
+                    if (contentLength.find_first_not_of("0123456789") != std::string::npos)
+                    {
+                        CloseConnection(conn, REQUEST_PROTOCOL_ERROR, false);
+                        return false;
+                    }
+
+                    conn->numBytesRemaining = strtoull(contentLength.c_str(), NULL, 10);
+                    conn->state = PARSE_BODY;
+                }
+                else
+                {
+                    conn->state = PARSE_BODY_UNTIL_CLOSE;
+                    conn->isClosing = true;
+                }
+            }
+            break;
+
+        case PARSE_BODY:
+        case PARSE_CHUNK_DATA:
+            {
+                size_t n = (size_t) (std::min)((uint64_t) in.length(), conn->numBytesRemaining);
+                if (!AppendBody(conn, in.data(), n))
+                    return false;
+                in.erase(0, n);
+                conn->numBytesRemaining -= n;
+
+                if (conn->numBytesRemaining > 0)
+                    return true;
+
+                if (conn->state == PARSE_CHUNK_DATA)
+                    conn->state = PARSE_CHUNK_END;
+                else
+                {
+                    bool isClosing = conn->isClosing;
+                    FinishResponse(conn);
+                    if (isClosing)
+                        return false;
+                }
+            }
+            break;
+
+        case PARSE_CHUNK_SIZE:
+            {
+                size_t end = in.find("\r\n");
+                if (end == std::string::npos)
+                    return true;
+
+                char* endOfNumber = NULL;
+                conn->numBytesRemaining = strtoull(in.c_str(), &endOfNumber, 16);
+                if (endOfNumber == in.c_str())
+                {
+                    CloseConnection(conn, REQUEST_PROTOCOL_ERROR, false);
+                    return false;
+                }
+
+                in.erase(0, end + 2);
+                conn->state = conn->numBytesRemaining == 0 ? PARSE_TRAILERS : PARSE_CHUNK_DATA;
+            }
+            break;
+
+        case PARSE_CHUNK_END:
+            if (in.length() < 2)
+                return true;
+            if (in.compare(0, 2, "\r\n") != 0)
+            {
+                CloseConnection(conn, REQUEST_PROTOCOL_ERROR, false);
+                return false;
+            }
+            in.erase(0, 2);
+            conn->state = PARSE_CHUNK_SIZE;
+            break;
+
+        case PARSE_TRAILERS:
+            {
+                size_t end = in.find("\r\n");
+                if (end == std::string::npos)
+                    return true;
+
+                in.erase(0, end + 2);
+                if (end == 0)
+                {
+                    bool isClosing = conn->isClosing;
+                    FinishResponse(conn);
+                    if (isClosing)
+                        return false;
+                }
+            }
+            break;
+
+        case PARSE_BODY_UNTIL_CLOSE:
+            if (!AppendBody(conn, in.data(), in.length()))
+                return false;
+            in.clear();
+            return true;
+        }
+    }
+}
+
+//
+// Handles the events of a connection's socket.
+//
+static void HandleEvents(Connection* conn, int events)
+{
+    Clock::time_point now = Clock::now();
+
+    if (!conn->isConnected)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(conn->socket, SOL_SOCKET, SO_ERROR, (char*) &error, &length) != 0 || error != 0 || (events & POLLOUT) == 0)
+        {
+            ConnectFailed(conn);
+            return;
+        }
+
+        conn->isConnected = true;
+        conn->deadline = now + std::chrono::milliseconds(conn->requests.empty() ? HTTP_KEEP_ALIVE_TIMEOUT : HTTP_RESPONSE_TIMEOUT);
+    }
+
+    // send as much as the socket takes
+    while (conn->outOffset < conn->outBuffer.length())
+    {
+        int n = (int) send(conn->socket, conn->outBuffer.data() + conn->outOffset, (int) (conn->outBuffer.length() - conn->outOffset), SEND_FLAGS);
+        if (n < 0)
+        {
+            if (WouldBlock())
+                break;
+
+            CloseConnection(conn, REQUEST_CONNECTION_CLOSED, true);
+            return;
+        }
+
+        conn->outOffset += n;
+        conn->deadline = now + std::chrono::milliseconds(HTTP_RESPONSE_TIMEOUT);
+    }
+
+    if (conn->outOffset == conn->outBuffer.length())
+    {
+        conn->outBuffer.clear();
+        conn->outOffset = 0;
+    }
+
+    if ((events & (POLLIN | POLLHUP | POLLERR)) == 0)
+        return;
+
+    char buf[HTTP_RECEIVE_BUFFER_SIZE];
+    for (;;)
+    {
+        int n = (int) recv(conn->socket, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            conn->inBuffer.append(buf, n);
+            conn->hasReceivedData = true;
+            conn->deadline = now + std::chrono::milliseconds(HTTP_RESPONSE_TIMEOUT);
+            if (!ProcessInput(conn))
+                return;
+            continue;
+        }
+
+        if (n < 0 && WouldBlock())
+            return;
+
+        // closed by the server (or a connection error)
+        if (n == 0 && !conn->requests.empty() && conn->state == PARSE_BODY_UNTIL_CLOSE)
+        {
+            FinishResponse(conn);
+            return;
+        }
+
+        CloseConnection(conn, REQUEST_CONNECTION_CLOSED, true);
+        return;
+    }
+}
+
+static void CheckTimeouts()
+{
+    Clock::time_point now = Clock::now();
+
+    std::vector<Connection*> expired;
+    for (std::map<std::string, HostPool*>::iterator it = g_hosts.begin(); it != g_hosts.end(); ++it)
+        for (std::vector<Connection*>::iterator itConn = it->second->connections.begin(); itConn != it->second->connections.end(); ++itConn)
+            if ((*itConn)->deadline <= now)
+                expired.push_back(*itConn);
+
+    for (std::vector<Connection*>::iterator it = expired.begin(); it != expired.end(); ++it)
+    {
+        Connection* conn = *it;
+        if (!conn->isConnected)
+            ConnectFailed(conn);
+        else
+            CloseConnection(conn, REQUEST_TIMED_OUT, false);
+    }
+}
+
+static void Cancel(int id)
+{
+    for (std::map<std::string, HostPool*>::iterator it = g_hosts.begin(); it != g_hosts.end(); ++it)
+    {
+        HostPool* host = it->second;
+        for (std::deque<RequestPtr>::iterator itReq = host->pending.begin(); itReq != host->pending.end(); ++itReq)
+        {
+            if ((*itReq)->id == id)
+            {
+                RequestPtr request = *itReq;
+                host->pending.erase(itReq);
+                Fail(request, REQUEST_CANCELLED);
+                return;
+            }
+        }
+
+        for (std::vector<Connection*>::iterator itConn = host->connections.begin(); itConn != host->connections.end(); ++itConn)
+        {
+            Connection* conn = *itConn;
+            for (std::deque<RequestPtr>::iterator itReq = conn->requests.begin(); itReq != conn->requests.end(); ++itReq)
+            {
+                if ((*itReq)->id == id)
+                {
+                    Abort(conn, itReq);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Network Thread
+
+static void Run()
+{
+    std::vector<PollFD> fds;
+    std::vector<Connection*> connections;
+
+    for (;;)
+    {
+        std::vector<Command> commands;
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            if (g_isStopping)
+                break;
+            commands.swap(g_commands);
+        }
+
+        for (std::vector<Command>::iterator it = commands.begin(); it != commands.end(); ++it)
+            (*it)();
+
+        // wait for the sockets or the next deadline
+        fds.clear();
+        connections.clear();
+
+        PollFD wakeup;
+        wakeup.fd = g_wakeupRead;
+        wakeup.events = POLLIN;
+        wakeup.revents = 0;
+        fds.push_back(wakeup);
+
+        Clock::time_point now = Clock::now();
+        Clock::time_point nextDeadline = (Clock::time_point::max)();
+        for (std::map<std::string, HostPool*>::iterator it = g_hosts.begin(); it != g_hosts.end(); ++it)
+        {
+            for (std::vector<Connection*>::iterator itConn = it->second->connections.begin(); itConn != it->second->connections.end(); ++itConn)
+            {
+                Connection* conn = *itConn;
+
+                PollFD fd;
+                fd.fd = conn->socket;
+                fd.events = POLLIN;
+                if (!conn->isConnected || conn->outOffset < conn->outBuffer.length())
+                    fd.events |= POLLOUT;
+                fd.revents = 0;
+                fds.push_back(fd);
+                connections.push_back(conn);
+
+                if (conn->deadline < nextDeadline)
+                    nextDeadline = conn->deadline;
+            }
+        }
+
+        int timeout = -1;
+        if (nextDeadline != (Clock::time_point::max)())
+            timeout = nextDeadline <= now ? 0 : (int) std::chrono::duration_cast<std::chrono::milliseconds>(nextDeadline - now).count() + 1;
+
+#ifdef OS_WIN
+        // WSAPoll doesn't report failed connection attempts, so they are
+        // only detected by their timeout; check every second
+        if (timeout < 0 || timeout > 1000)
+            timeout = 1000;
+        int numEvents = WSAPoll(&fds[0], (ULONG) fds.size(), timeout);
+#else
+        int numEvents = poll(&fds[0], (nfds_t) fds.size(), timeout);
+#endif
+
+        if (numEvents > 0)
+        {
+            if (fds[0].revents != 0)
+                DrainWakeups();
+
+            // handling a connection never closes another one, so the
+            // pointers stay valid
+            for (size_t i = 1; i < fds.size(); ++i)
+                if (fds[i].revents != 0)
+                    HandleEvents(connections[i - 1], fds[i].revents);
+        }
+
+        CheckTimeouts();
+    }
+}
+
+//
+// Runs the command on the network thread, which is started if necessary.
+//
+static void Post(Command command)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_isStopping)
+        return;
+
+    if (!g_isRunning)
+    {
+#ifdef OS_WIN
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+        if (!CreateWakeupPair(g_wakeupRead, g_wakeupWrite))
+            return;
+
+        g_resolver = new WorkerPool(HTTP_NUM_RESOLVER_THREADS);
+        g_isRunning = true;
+        g_thread = std::thread(Run);
+    }
+
+    g_commands.push_back(command);
+    Wake();
+}
+
+int SendRequest(const HttpRequest& request, HttpCallback onCompleted)
+{
+    RequestPtr req(new Request());
+    req->id = g_nextId++;
+    req->request = request;
+    req->onCompleted = onCompleted;
+    req->numRedirects = 0;
+    req->numRetries = 0;
+
+    if (req->request.method.empty())
+        req->request.method = "GET";
+    std::transform(req->request.method.begin(), req->request.method.end(), req->request.method.begin(), toupper);
+
+    Post([req]() { StartRequest(req); });
+    return req->id;
+}
+
+void CancelRequest(int id)
+{
+    Post([id]() { Cancel(id); });
+}
+
+void StopHttpClient()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (!g_isRunning)
+            return;
+
+        g_isStopping = true;
+        Wake();
+    }
+
+    g_thread.join();
+
+    // wait for the pending name lookups
+    delete g_resolver;
+    g_resolver = NULL;
+
+    for (std::map<std::string, HostPool*>::iterator it = g_hosts.begin(); it != g_hosts.end(); ++it)
+    {
+        for (std::vector<Connection*>::iterator itConn = it->second->connections.begin(); itConn != it->second->connections.end(); ++itConn)
+        {
+            CloseSocket((*itConn)->socket);
+            delete *itConn;
+        }
+
+        delete it->second;
+    }
+    g_hosts.clear();
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_commands.clear();
+    CloseSocket(g_wakeupRead);
+    CloseSocket(g_wakeupWrite);
+    g_wakeupRead = NO_SOCKET;
+    g_wakeupWrite = NO_SOCKET;
+    g_isRunning = false;
+    g_isStopping = false;
+
+#ifdef OS_WIN
+    WSACleanup();
+#endif
+}
+
+} // namespace NetworkUtil
@@ -0,0 +1,357 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "network_util.h"
+
+
+namespace NetworkUtil {
+
+typedef std::chrono::steady_clock Clock;
+
+struct ScheduledRequest
+{
+    int id;
+    HttpRequest request;
+    RequestPriority priority;
+    std::string group;
+    std::string host;
+    HttpCallback onCompleted;
+    Clock::time_point timeQueued;
+
+    bool isActive;
+    bool isCancelled;
+
+    // the ID of the HTTP client's request once it has been started
+    int requestId;
+};
+
+typedef std::shared_ptr<ScheduledRequest> ScheduledRequestPtr;
+
+//
+// The queued requests of a priority by host, and the hosts with queued
+// requests in the order they take turns.
+//
+struct PriorityQueue
+{
+    std::map<std::string, std::deque<ScheduledRequestPtr> > requests;
+    std::list<std::string> hosts;
+
+    int numQueued;
+    int numActive;
+    uint64_t numStarted;
+    double totalWaitTime;
+    double maxWaitTime;
+};
+
+
+static std::mutex g_mutex;
+static PriorityQueue g_queues[NUM_REQUEST_PRIORITIES];
+static std::map<std::string, int> g_numActivePerHost;
+static int g_numActive = 0;
+
+// the queued and the active requests by ID
+static std::map<int, ScheduledRequestPtr> g_requests;
+static int g_lastId = 0;
+
+
+static double GetMilliseconds(Clock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+}
+
+//
+// Returns the authority of the URL ("host:port"), the key of the per-host
+// limit.
+//
+static std::string GetHostKey(const std::string& url)
+{
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+
+    std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    host.erase(0, host.rfind('@') + 1);
+    std::transform(host.begin(), host.end(), host.begin(), tolower);
+    return host;
+}
+
+static int GetNumActive(const std::string& host)
+{
+    std::map<std::string, int>::iterator it = g_numActivePerHost.find(host);
+    return it == g_numActivePerHost.end() ? 0 : it->second;
+}
+
+static void Complete(ScheduledRequestPtr scheduled, HttpResponse& response);
+
+//
+// Takes the requests which can be started now off the queues. Call with
+// g_mutex locked.
+//
+static void Dequeue(std::vector<ScheduledRequestPtr>& requests)
+{
+    for (int priority = 0; priority < NUM_REQUEST_PRIORITIES; ++priority)
+    {
+        PriorityQueue& queue = g_queues[priority];
+        Clock::time_point now = Clock::now();
+
+        while (g_numActive < HTTP_SCHEDULER_MAX_ACTIVE &&
+            (priority != PRIORITY_BACKGROUND || queue.numActive < HTTP_SCHEDULER_MAX_ACTIVE_BACKGROUND))
+        {
+            // the first host in turn which is below its limit
+            std::list<std::string>::iterator itHost = queue.hosts.begin();
+            while (itHost != queue.hosts.end() && GetNumActive(*itHost) >= HTTP_SCHEDULER_MAX_ACTIVE_PER_HOST)
+                ++itHost;
+            if (itHost == queue.hosts.end())
+                break;
+
+            std::deque<ScheduledRequestPtr>& hostQueue = queue.requests[*itHost];
+            ScheduledRequestPtr scheduled = hostQueue.front();
+            hostQueue.pop_front();
+
+            if (hostQueue.empty())
+            {
+                queue.requests.erase(*itHost);
+                queue.hosts.erase(itHost);
+            }
+            else
+                queue.hosts.splice(queue.hosts.end(), queue.hosts, itHost);
+
+            double waitTime = GetMilliseconds(now - scheduled->timeQueued);
+            queue.numQueued--;
+            queue.numActive++;
+            queue.numStarted++;
+            queue.totalWaitTime += waitTime;
+            queue.maxWaitTime = (std::max)(queue.maxWaitTime, waitTime);
+            g_numActivePerHost[scheduled->host]++;
+            g_numActive++;
+
+            scheduled->isActive = true;
+            requests.push_back(scheduled);
+        }
+    }
+}
+
+//
+// Sends the requests taken off the queues. Call without g_mutex locked: the
+// HTTP client may call the callback right away.
+//
+static void Start(std::vector<ScheduledRequestPtr>& requests)
+{
+    for (std::vector<ScheduledRequestPtr>::iterator it = requests.begin(); it != requests.end(); ++it)
+    {
+        ScheduledRequestPtr scheduled = *it;
+        int requestId = SendRequest(scheduled->request, [scheduled](HttpResponse& response) { Complete(scheduled, response); });
+
+        bool isCancelled = false;
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            scheduled->requestId = requestId;
+            isCancelled = scheduled->isCancelled;
+        }
+
+        // cancelled while it was being started
+        if (isCancelled)
+            CancelRequest(requestId);
+    }
+}
+
+static void Complete(ScheduledRequestPtr scheduled, HttpResponse& response)
+{
+    std::vector<ScheduledRequestPtr> requests;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        // the scheduler may have been stopped (and restarted) in the meantime
+        std::map<int, ScheduledRequestPtr>::iterator it = g_requests.find(scheduled->id);
+        if (it != g_requests.end() && it->second == scheduled)
+        {
+            g_requests.erase(it);
+            g_queues[scheduled->priority].numActive--;
+            if (--g_numActivePerHost[scheduled->host] == 0)
+                g_numActivePerHost.erase(scheduled->host);
+            g_numActive--;
+
+            Dequeue(requests);
+        }
+    }
+
+    Start(requests);
+
+    if (scheduled->onCompleted)
+        scheduled->onCompleted(response);
+}
+
+int ScheduleRequest(const HttpRequest& request, RequestPriority priority, const std::string& group, HttpCallback onCompleted)
+{
+    ScheduledRequestPtr scheduled(new ScheduledRequest());
+    scheduled->request = request;
+    scheduled->priority = priority;
+    scheduled->group = group;
+    scheduled->host = GetHostKey(request.url);
+    scheduled->onCompleted = onCompleted;
+    scheduled->timeQueued = Clock::now();
+    scheduled->isActive = false;
+    scheduled->isCancelled = false;
+    scheduled->requestId = 0;
+
+    std::vector<ScheduledRequestPtr> requests;
+    int id = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        id = scheduled->id = ++g_lastId;
+        g_requests[id] = scheduled;
+
+        PriorityQueue& queue = g_queues[priority];
+        std::deque<ScheduledRequestPtr>& hostQueue = queue.requests[scheduled->host];
+        if (hostQueue.empty())
+            queue.hosts.push_back(scheduled->host);
+        hostQueue.push_back(scheduled);
+        queue.numQueued++;
+
+        Dequeue(requests);
+    }
+
+    Start(requests);
+    return id;
+}
+
+void CancelScheduledRequest(int id)
+{
+    ScheduledRequestPtr scheduled;
+    int requestId = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        std::map<int, ScheduledRequestPtr>::iterator it = g_requests.find(id);
+        if (it == g_requests.end() || it->second->isCancelled)
+            return;
+
+        scheduled = it->second;
+        scheduled->isCancelled = true;
+
+        if (scheduled->isActive)
+            requestId = scheduled->requestId;
+        else
+        {
+            PriorityQueue& queue = g_queues[scheduled->priority];
+            std::deque<ScheduledRequestPtr>& hostQueue = queue.requests[scheduled->host];
+            hostQueue.erase(std::find(hostQueue.begin(), hostQueue.end(), scheduled));
+            if (hostQueue.empty())
+            {
+                queue.requests.erase(scheduled->host);
+                queue.hosts.remove(scheduled->host);
+            }
+
+            queue.numQueued--;
+            g_requests.erase(it);
+        }
+    }
+
+    if (scheduled->isActive)
+    {
+        // if the request is still being started, Start cancels it
+        if (requestId != 0)
+            CancelRequest(requestId);
+        return;
+    }
+
+    HttpResponse response;
+    response.error = REQUEST_CANCELLED;
+    response.status = 0;
+    response.url = scheduled->request.url;
+    if (scheduled->onCompleted)
+        scheduled->onCompleted(response);
+}
+
+void CancelRequestGroup(const std::string& group)
+{
+    if (group.empty())
+        return;
+
+    std::vector<int> ids;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        for (std::map<int, ScheduledRequestPtr>::iterator it = g_requests.begin(); it != g_requests.end(); ++it)
+            if (it->second->group == group)
+                ids.push_back(it->first);
+    }
+
+    for (std::vector<int>::iterator it = ids.begin(); it != ids.end(); ++it)
+        CancelScheduledRequest(*it);
+}
+
+void GetSchedulerStats(std::vector<SchedulerStats>& stats)
+{
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    stats.resize(NUM_REQUEST_PRIORITIES);
+    for (int priority = 0; priority < NUM_REQUEST_PRIORITIES; ++priority)
+    {
+        PriorityQueue& queue = g_queues[priority];
+        SchedulerStats& s = stats[priority];
+
+        s.numQueued = queue.numQueued;
+        s.numActive = queue.numActive;
+        s.numStarted = queue.numStarted;
+        s.averageWaitTime = queue.numStarted > 0 ? queue.totalWaitTime / queue.numStarted : 0;
+        s.maxWaitTime = queue.maxWaitTime;
+
+        // the fronts of the hosts' queues are the oldest requests
+        s.oldestWaitTime = 0;
+        for (std::map<std::string, std::deque<ScheduledRequestPtr> >::iterator it = queue.requests.begin(); it != queue.requests.end(); ++it)
+            s.oldestWaitTime = (std::max)(s.oldestWaitTime, GetMilliseconds(now - it->second.front()->timeQueued));
+    }
+}
+
+void StopScheduler()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    for (int priority = 0; priority < NUM_REQUEST_PRIORITIES; ++priority)
+    {
+        PriorityQueue& queue = g_queues[priority];
+        queue.requests.clear();
+        queue.hosts.clear();
+        queue.numQueued = 0;
+        queue.numActive = 0;
+    }
+
+    g_requests.clear();
+    g_numActivePerHost.clear();
+    g_numActive = 0;
+}
+
+} // namespace NetworkUtil
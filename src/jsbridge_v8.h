@@ -24,6 +24,9 @@
 #define Zephyros_jsbridge_v8_h
 
 
+#include <stdint.h>
+#include <vector>
+
 namespace JavaScript {
 
     
@@ -47,6 +50,55 @@ inline Array CreateArray()
 inline void FreeObject(Object obj) {}
 inline void FreeArray(Array arr) {}
 
+//
+// Sets binary data; it arrives in JavaScript as a "binary string", a string
+// with one character per byte.
+//
+inline bool SetBinary(Array arr, int index, const void* data, size_t length)
+{
+    if (length == 0)
+        return arr->SetString(index, CefString());
+    return arr->SetBinary(index, CefBinaryValue::Create(data, length));
+}
+
+//
+// Retrieves the bytes of a "binary string" (as created from an ArrayBuffer by
+// the JavaScript side). Returns false if the string contains characters which
+// don't fit in a byte.
+//
+inline bool GetBinary(Array arr, int index, std::vector<uint8_t>& data)
+{
+    CefString str = arr->GetString(index);
+    const char16* chars = str.c_str();
+    size_t length = str.length();
+
+    data.resize(length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (chars[i] > 0xff)
+            return false;
+        data[i] = (uint8_t) chars[i];
+    }
+
+    return true;
+}
+
+//
+// Returns the string at "index" encoded as UTF-8.
+//
+inline std::string GetUTF8String(Array arr, int index)
+{
+    return arr->GetString(index).ToString();
+}
+
+//
+// Returns the string at "key" encoded as UTF-8.
+//
+inline std::string GetUTF8String(Object obj, const KeyType& key)
+{
+    return obj->GetString(key).ToString();
+}
+
     
 } // namespace JavaScript
 
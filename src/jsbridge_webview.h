@@ -24,6 +24,7 @@
 #define Zephyros_jsbridge_webview_h
 
 
+#include <stdint.h>
 #include <vector>
 #include <map>
 #include <JavaScriptCore/JavaScriptCore.h>
@@ -173,6 +174,48 @@ public:
         return SetValue(key, JSValueMakeNumber(g_ctx, value));
     }
     
+    //
+    // Sets a "binary string", a string with one character per byte.
+    //
+    bool SetBinary(const K key, const void* data, size_t length)
+    {
+        const unsigned char* bytes = (const unsigned char*) data;
+        std::vector<JSChar> chars(bytes, bytes + length);
+        JSStringRef strValue = JSStringCreateWithCharacters(length > 0 ? &chars[0] : NULL, length);
+        bool result = SetValue(key, JSValueMakeString(g_ctx, strValue));
+        JSStringRelease(strValue);
+        
+        return result;
+    }
+    
+    //
+    // Retrieves the bytes of a "binary string"; returns false if the string
+    // contains characters which don't fit in a byte.
+    //
+    bool GetBinary(const K key, std::vector<uint8_t>& data)
+    {
+        JSValueRef value = GetValue(key);
+        data.clear();
+        if (!JSValueIsString(g_ctx, value))
+            return false;
+        
+        JSStringRef str = JSValueToStringCopy(g_ctx, value, NULL);
+        const JSChar* chars = JSStringGetCharactersPtr(str);
+        size_t length = JSStringGetLength(str);
+        
+        bool result = true;
+        data.resize(length);
+        for (size_t i = 0; i < length && result; ++i)
+        {
+            if (chars[i] > 0xff)
+                result = false;
+            data[i] = (uint8_t) chars[i];
+        }
+        
+        JSStringRelease(str);
+        return result;
+    }
+    
     bool SetString(const K key, const String& value)
     {
         JSStringRef strValue = JSStringCreateWithUTF8CString(value.c_str());
@@ -255,6 +298,41 @@ private:
 };
 
     
+//
+// Sets binary data; it arrives in JavaScript as a "binary string", a string
+// with one character per byte.
+//
+inline bool SetBinary(Array arr, int index, const void* data, size_t length)
+{
+    return arr->SetBinary(index, data, length);
+}
+
+//
+// Retrieves the bytes of a "binary string" (as created from an ArrayBuffer by
+// the JavaScript side).
+//
+inline bool GetBinary(Array arr, int index, std::vector<uint8_t>& data)
+{
+    return arr->GetBinary(index, data);
+}
+
+//
+// Returns the string at "index" encoded as UTF-8.
+//
+inline std::string GetUTF8String(Array arr, int index)
+{
+    return arr->GetString(index);
+}
+
+//
+// Returns the string at "key" encoded as UTF-8.
+//
+inline std::string GetUTF8String(Object obj, const KeyType& key)
+{
+    return obj->GetString(key);
+}
+
+    
 } // namespace JavaScript
 
 
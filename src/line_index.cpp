@@ -0,0 +1,595 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string.h>
+
+#include "line_index.h"
+#include "file_util.h"
+#include "hash_util.h"
+#include "simd_util.h"
+#include "utf8_util.h"
+#include "worker_pool.h"
+
+
+#define LINE_INDEX_CACHE_MAGIC 0x5849494c  // "LIIX"
+#define LINE_INDEX_CACHE_VERSION 1
+
+// The number of threads reading lines
+#define LINE_INDEX_NUM_READ_THREADS 2
+
+
+namespace LineIndex {
+
+struct PendingRead
+{
+    uint64_t start;
+    uint64_t count;
+    ReadCallback onRead;
+};
+
+struct Index
+{
+    String path;
+    uint64_t size;
+    double modified;
+
+    std::mutex mutex;
+
+    // the offset of line i * LINE_INDEX_GRANULARITY is stored in checkpoints[i]
+    std::vector<uint64_t> checkpoints;
+
+    // the number of line feeds found in the part of the file scanned so far
+    uint64_t numLineFeeds;
+    uint64_t numIndexedBytes;
+
+    // the total number of lines; valid once isComplete is set
+    uint64_t numLines;
+    bool isComplete;
+    bool isFailed;
+
+    std::vector<PendingRead> pendingReads;
+
+    std::thread builder;
+    std::atomic<bool> isCancelled;
+    uint64_t lastUsed;
+};
+
+typedef std::shared_ptr<Index> IndexPtr;
+
+//
+// The on-disk format of a cached index: the header is followed by the path
+// (pathLength bytes) and the checkpoints.
+//
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t granularity;
+    uint32_t pathLength;
+    uint64_t size;
+    double modified;
+    uint64_t numLines;
+    uint64_t numCheckpoints;
+};
+
+
+static std::mutex g_mutex;
+static std::map<String, IndexPtr> g_indexes;
+static WorkerPool* g_readPool = NULL;
+static uint64_t g_useCounter = 0;
+
+
+//
+// Reads the lines of a range of the file, which is mapped into memory chunk by
+// chunk.
+//
+class LineReader
+{
+public:
+    LineReader(FileUtil::MappedFile& file, uint64_t offset, uint64_t end)
+        : m_file(file), m_data(NULL), m_offset(offset), m_length(0), m_pos(0), m_end(end)
+    {
+    }
+
+    //
+    // Reads the next line into "line" (or skips it if line is NULL). Returns
+    // false if the end of the range has been reached.
+    //
+    bool ReadLine(std::string* line)
+    {
+        if (m_offset + m_pos >= m_end)
+            return false;
+
+        std::string bytes;
+        for ( ; ; )
+        {
+            if (m_pos >= m_length && !MapNext())
+                break;
+
+            const uint8_t* p = m_data + m_pos;
+            size_t available = m_length - m_pos;
+            const uint8_t* lineFeed = (const uint8_t*) memchr(p, '\n', available);
+            size_t n = lineFeed != NULL ? (size_t) (lineFeed - p) : available;
+
+            if (line != NULL && bytes.length() < LINE_INDEX_MAX_LINE_LENGTH)
+                bytes.append((const char*) p, n < LINE_INDEX_MAX_LINE_LENGTH - bytes.length() ? n : LINE_INDEX_MAX_LINE_LENGTH - bytes.length());
+
+            m_pos += n;
+            if (lineFeed != NULL)
+            {
+                ++m_pos;
+                break;
+            }
+        }
+
+        if (line != NULL)
+        {
+            if (bytes.length() > 0 && bytes[bytes.length() - 1] == '\r')
+                bytes.erase(bytes.length() - 1);
+            AppendValidUTF8(*line, (const uint8_t*) bytes.data(), bytes.length());
+        }
+
+        return true;
+    }
+
+private:
+    bool MapNext()
+    {
+        m_offset += m_length;
+        m_pos = 0;
+        m_length = 0;
+
+        if (m_offset >= m_end)
+            return false;
+
+        size_t length = m_end - m_offset < LINE_INDEX_CHUNK_SIZE ? (size_t) (m_end - m_offset) : LINE_INDEX_CHUNK_SIZE;
+        m_data = m_file.Map(m_offset, length);
+        if (m_data == NULL)
+            return false;
+
+        m_length = length;
+        return true;
+    }
+
+    FileUtil::MappedFile& m_file;
+    const uint8_t* m_data;
+    uint64_t m_offset;
+    size_t m_length;
+    size_t m_pos;
+    uint64_t m_end;
+};
+
+
+//
+// Counts the line feeds in [data, data + length), which starts at "offset" in
+// the file, and records the offset of the line following every
+// LINE_INDEX_GRANULARITY-th line feed.
+//
+static void ScanLines(const uint8_t* data, size_t length, uint64_t offset, uint64_t& numLineFeeds, std::vector<uint64_t>& checkpoints)
+{
+    size_t i = 0;
+
+#ifdef SIMD_USE_SSE2
+    // compare 64 bytes at once; the positions of the line feeds only need to
+    // be determined if a checkpoint is within the block
+    __m128i lineFeed = _mm_set1_epi8('\n');
+    for ( ; i + 64 <= length; i += 64)
+    {
+        const __m128i* p = (const __m128i*) (data + i);
+        uint64_t mask0 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p), lineFeed));
+        uint64_t mask1 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 1), lineFeed));
+        uint64_t mask2 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), lineFeed));
+        uint64_t mask3 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 3), lineFeed));
+        uint64_t mask = mask0 | (mask1 << 16) | (mask2 << 32) | (mask3 << 48);
+
+        if (mask == 0)
+            continue;
+
+        uint64_t n = (uint64_t) PopCount64(mask);
+        if ((numLineFeeds & (LINE_INDEX_GRANULARITY - 1)) + n < LINE_INDEX_GRANULARITY)
+        {
+            numLineFeeds += n;
+            continue;
+        }
+
+        for ( ; mask != 0; mask &= mask - 1)
+            if ((++numLineFeeds & (LINE_INDEX_GRANULARITY - 1)) == 0)
+                checkpoints.push_back(offset + i + CountTrailingZeros64(mask) + 1);
+    }
+#endif
+
+    for ( ; i < length; ++i)
+        if (data[i] == '\n' && (++numLineFeeds & (LINE_INDEX_GRANULARITY - 1)) == 0)
+            checkpoints.push_back(offset + i + 1);
+}
+
+static String GetCachePath(const String& path)
+{
+    String dir;
+    if (!FileUtil::GetApplicationDataDirectory(dir))
+        return String();
+
+    uint64_t hash = HashUtil::Fnv1a64(path.data(), path.length() * sizeof(TCHAR));
+    return dir + FileUtil::GetPathSeparator() + TEXT("lines-") + HashUtil::ToHex(hash) + TEXT(".idx");
+}
+
+static bool LoadCache(IndexPtr index)
+{
+    String cachePath = GetCachePath(index->path);
+    FileUtil::MappedFile file;
+    if (cachePath.length() == 0 || !file.Open(cachePath) || file.GetSize() < sizeof(CacheHeader))
+        return false;
+
+    const uint8_t* data = file.Map(0, (size_t) file.GetSize());
+    if (data == NULL)
+        return false;
+
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    size_t pathLength = index->path.length() * sizeof(TCHAR);
+    if (header.magic != LINE_INDEX_CACHE_MAGIC || header.version != LINE_INDEX_CACHE_VERSION ||
+        header.granularity != LINE_INDEX_GRANULARITY || header.size != index->size || header.modified != index->modified ||
+        header.pathLength != pathLength || header.numCheckpoints == 0 ||
+        file.GetSize() != sizeof(header) + pathLength + header.numCheckpoints * sizeof(uint64_t) ||
+        memcmp(data + sizeof(header), index->path.data(), pathLength) != 0)
+    {
+        return false;
+    }
+
+    std::vector<uint64_t> checkpoints((size_t) header.numCheckpoints);
+    memcpy(&checkpoints[0], data + sizeof(header) + pathLength, checkpoints.size() * sizeof(uint64_t));
+
+    std::lock_guard<std::mutex> lock(index->mutex);
+    index->checkpoints.swap(checkpoints);
+    index->numLineFeeds = header.numLines;
+    index->numIndexedBytes = index->size;
+    index->numLines = header.numLines;
+    index->isComplete = true;
+
+    return true;
+}
+
+static void SaveCache(IndexPtr index)
+{
+    String cachePath = GetCachePath(index->path);
+    if (cachePath.length() == 0)
+        return;
+
+    CacheHeader header;
+    size_t pathLength = index->path.length() * sizeof(TCHAR);
+    std::vector<uint8_t> data;
+
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+
+        header.magic = LINE_INDEX_CACHE_MAGIC;
+        header.version = LINE_INDEX_CACHE_VERSION;
+        header.granularity = LINE_INDEX_GRANULARITY;
+        header.pathLength = (uint32_t) pathLength;
+        header.size = index->size;
+        header.modified = index->modified;
+        header.numLines = index->numLines;
+        header.numCheckpoints = index->checkpoints.size();
+
+        data.resize(sizeof(header) + pathLength + index->checkpoints.size() * sizeof(uint64_t));
+        memcpy(&data[0], &header, sizeof(header));
+        memcpy(&data[sizeof(header)], index->path.data(), pathLength);
+        memcpy(&data[sizeof(header) + pathLength], &index->checkpoints[0], index->checkpoints.size() * sizeof(uint64_t));
+    }
+
+    FileUtil::WriteFile(cachePath, data, true, false, FileUtil::WriteCallback());
+}
+
+//
+// Reads the requested lines. Runs on the read pool.
+//
+static void PerformRead(IndexPtr index, PendingRead read)
+{
+    std::vector<std::string> lines;
+    uint64_t numLines = 0;
+    uint64_t count = 0;
+    uint64_t offset = 0;
+    uint64_t end = 0;
+    bool isComplete = false;
+    bool isOK = false;
+
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+
+        isOK = !index->isFailed;
+        isComplete = index->isComplete;
+        numLines = isComplete ? index->numLines : index->numLineFeeds;
+
+        if (isOK && read.start < numLines)
+        {
+            count = numLines - read.start < read.count ? numLines - read.start : read.count;
+            offset = index->checkpoints[(size_t) (read.start / LINE_INDEX_GRANULARITY)];
+
+            // the lines end before the next checkpoint or the end of the indexed part
+            size_t next = (size_t) ((read.start + count - 1) / LINE_INDEX_GRANULARITY) + 1;
+            end = next < index->checkpoints.size() ? index->checkpoints[next] : (isComplete ? index->size : index->numIndexedBytes);
+        }
+    }
+
+    if (isOK && count > 0)
+    {
+        FileUtil::MappedFile file;
+        isOK = file.Open(index->path) && file.GetSize() == index->size;
+
+        if (isOK)
+        {
+            LineReader reader(file, offset, end);
+            for (uint64_t i = read.start & ~((uint64_t) LINE_INDEX_GRANULARITY - 1); i < read.start; ++i)
+                reader.ReadLine(NULL);
+
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                lines.push_back(std::string());
+                if (!reader.ReadLine(&lines.back()))
+                {
+                    // the file has changed
+                    isOK = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!isOK)
+        lines.clear();
+
+    read.onRead(isOK, lines, numLines, isComplete);
+}
+
+//
+// Passes the reads whose lines have been indexed on to the read pool.
+//
+static void DispatchReads(IndexPtr index)
+{
+    std::vector<PendingRead> reads;
+
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+
+        std::vector<PendingRead> remaining;
+        for (std::vector<PendingRead>::iterator it = index->pendingReads.begin(); it != index->pendingReads.end(); ++it)
+        {
+            if (index->isComplete || index->isFailed || it->start + it->count <= index->numLineFeeds)
+                reads.push_back(*it);
+            else
+                remaining.push_back(*it);
+        }
+
+        index->pendingReads.swap(remaining);
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_readPool == NULL)
+        return;
+
+    for (std::vector<PendingRead>::iterator it = reads.begin(); it != reads.end(); ++it)
+    {
+        PendingRead read = *it;
+        g_readPool->Post([index, read]() { PerformRead(index, read); });
+    }
+}
+
+static void Fail(IndexPtr index)
+{
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+        index->isFailed = true;
+    }
+
+    DispatchReads(index);
+}
+
+//
+// Builds the index (or loads it from the cache). Runs on the index's thread.
+//
+static void BuildIndex(IndexPtr index)
+{
+    if (LoadCache(index))
+    {
+        DispatchReads(index);
+        return;
+    }
+
+    FileUtil::MappedFile file;
+    if (!file.Open(index->path))
+    {
+        Fail(index);
+        return;
+    }
+
+    uint64_t numLineFeeds = 0;
+    uint8_t lastByte = '\n';
+
+    for (uint64_t offset = 0; offset < index->size; offset += LINE_INDEX_CHUNK_SIZE)
+    {
+        if (index->isCancelled)
+        {
+            Fail(index);
+            return;
+        }
+
+        size_t length = index->size - offset < LINE_INDEX_CHUNK_SIZE ? (size_t) (index->size - offset) : LINE_INDEX_CHUNK_SIZE;
+        const uint8_t* data = file.Map(offset, length);
+        if (data == NULL)
+        {
+            Fail(index);
+            return;
+        }
+
+        std::vector<uint64_t> checkpoints;
+        ScanLines(data, length, offset, numLineFeeds, checkpoints);
+        lastByte = data[length - 1];
+
+        {
+            std::lock_guard<std::mutex> lock(index->mutex);
+            index->checkpoints.insert(index->checkpoints.end(), checkpoints.begin(), checkpoints.end());
+            index->numLineFeeds = numLineFeeds;
+            index->numIndexedBytes = offset + length;
+        }
+
+        // the lines indexed so far can be read while the rest is scanned
+        DispatchReads(index);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+
+        // the last line might not be terminated
+        index->numLines = numLineFeeds + (lastByte != '\n' ? 1 : 0);
+        index->isComplete = true;
+    }
+
+    DispatchReads(index);
+
+    if (index->size >= LINE_INDEX_MIN_CACHED_FILE_SIZE)
+        SaveCache(index);
+}
+
+//
+// Stops building the index. Must be called without holding g_mutex.
+//
+static void Release(IndexPtr index)
+{
+    if (!index)
+        return;
+
+    index->isCancelled = true;
+    if (index->builder.joinable())
+        index->builder.join();
+}
+
+
+void ReadLines(const String& path, uint64_t start, uint64_t count, ReadCallback onRead)
+{
+    if (count > LINE_INDEX_MAX_LINES_PER_READ)
+        count = LINE_INDEX_MAX_LINES_PER_READ;
+
+    FileUtil::FileInfo info;
+    if (!FileUtil::GetFileStats(path, info) || info.isDirectory)
+    {
+        std::vector<std::string> lines;
+        onRead(false, lines, 0, false);
+        return;
+    }
+
+    IndexPtr index;
+    IndexPtr replaced;
+    IndexPtr evicted;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        if (g_readPool == NULL)
+            g_readPool = new WorkerPool(LINE_INDEX_NUM_READ_THREADS);
+
+        // the index of a file which has changed is rebuilt
+        std::map<String, IndexPtr>::iterator it = g_indexes.find(path);
+        if (it != g_indexes.end() && (it->second->size != info.size || it->second->modified != info.modified))
+        {
+            replaced = it->second;
+            g_indexes.erase(it);
+            it = g_indexes.end();
+        }
+
+        if (it != g_indexes.end())
+            index = it->second;
+        else
+        {
+            if (g_indexes.size() >= LINE_INDEX_MAX_INDEXES)
+            {
+                std::map<String, IndexPtr>::iterator itOldest = g_indexes.begin();
+                for (std::map<String, IndexPtr>::iterator itIndex = g_indexes.begin(); itIndex != g_indexes.end(); ++itIndex)
+                    if (itIndex->second->lastUsed < itOldest->second->lastUsed)
+                        itOldest = itIndex;
+
+                evicted = itOldest->second;
+                g_indexes.erase(itOldest);
+            }
+
+            index = IndexPtr(new Index());
+            index->path = path;
+            index->size = info.size;
+            index->modified = info.modified;
+            index->checkpoints.push_back(0);
+            index->numLineFeeds = 0;
+            index->numIndexedBytes = 0;
+            index->numLines = 0;
+            index->isComplete = false;
+            index->isFailed = false;
+            index->isCancelled = false;
+
+            g_indexes[path] = index;
+            index->builder = std::thread(BuildIndex, index);
+        }
+
+        index->lastUsed = ++g_useCounter;
+    }
+
+    Release(replaced);
+    Release(evicted);
+
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+
+        PendingRead read;
+        read.start = start;
+        read.count = count;
+        read.onRead = onRead;
+        index->pendingReads.push_back(read);
+    }
+
+    DispatchReads(index);
+}
+
+void Stop()
+{
+    std::map<String, IndexPtr> indexes;
+    WorkerPool* pool = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        indexes.swap(g_indexes);
+        pool = g_readPool;
+        g_readPool = NULL;
+    }
+
+    for (std::map<String, IndexPtr>::iterator it = indexes.begin(); it != indexes.end(); ++it)
+        Release(it->second);
+
+    // waits for the reads in progress
+    delete pool;
+}
+
+} // namespace LineIndex
@@ -0,0 +1,86 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __line_index_h
+#define __line_index_h
+
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+
+// The offset of every LINE_INDEX_GRANULARITY-th line is stored in the index
+// (must be a power of 2)
+#define LINE_INDEX_GRANULARITY 1024
+
+// The size of the parts of the file which are mapped into memory at once
+#define LINE_INDEX_CHUNK_SIZE (16 * 1024 * 1024)
+
+// The indexes of files at least this large are cached on disk
+#define LINE_INDEX_MIN_CACHED_FILE_SIZE (16 * 1024 * 1024)
+
+// The maximum number of indexes kept in memory
+#define LINE_INDEX_MAX_INDEXES 16
+
+// The maximum number of lines returned by a single read
+#define LINE_INDEX_MAX_LINES_PER_READ 10000
+
+// Lines are truncated to this length (in bytes)
+#define LINE_INDEX_MAX_LINE_LENGTH (64 * 1024)
+
+
+namespace LineIndex {
+
+//
+// Receives the lines read (without line terminators and encoded as UTF-8).
+// numLines is the number of lines indexed so far, which is the total number
+// of lines in the file if isComplete is set. isOK is false if the file can't
+// be read or has changed while the lines were read.
+//
+typedef std::function<void(bool isOK, std::vector<std::string>& lines, uint64_t numLines, bool isComplete)> ReadCallback;
+
+//
+// Reads "count" lines starting with line "start" (0-based) from a text file.
+// The first read of a file starts indexing the offsets of its lines in the
+// background by scanning the file for line feeds with SIMD instructions; the
+// lines are passed on as soon as the part of the file containing them has
+// been indexed. If the end of the file is reached, fewer lines are returned.
+// Indexes of large files are cached on disk, keyed by the path, the size and
+// the modification time of the file.
+// onRead is called from a background thread.
+//
+void ReadLines(const String& path, uint64_t start, uint64_t count, ReadCallback onRead);
+
+//
+// Stops indexing and releases the indexes.
+//
+void Stop();
+
+} // namespace LineIndex
+
+
+#endif
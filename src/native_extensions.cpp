@@ -20,7 +20,15 @@
 // IN THE SOFTWARE.
 //
 
+#include <ctype.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include "app.h"
+#include "base64.h"
 
 #ifndef USE_WEBVIEW
 #include "extension_handler.h"
@@ -30,14 +38,416 @@
 
 #include "native_extensions.h"
 
+#include "directory_lister.h"
+#include "file_follower.h"
+#include "file_hasher.h"
+#include "file_search.h"
 #include "file_util.h"
+#include "file_watcher.h"
+#include "line_index.h"
 #include "network_util.h"
+#include "read_stream.h"
+#include "utf8_util.h"
+
+#ifndef USE_WEBVIEW
+#include "resource_stats.h"
+#endif
 
 #ifdef OS_WIN
 #include <minmax.h>
 #endif
 
 
+//////////////////////////////////////////////////////////////////////
+// Helpers
+
+//
+// Returns the numeric option "key" or "defaultValue" if the option isn't set.
+// Integral JavaScript numbers arrive as ints, all others as doubles.
+//
+static double GetNumberOption(JavaScript::Object options, String key, double defaultValue)
+{
+    switch (options->GetType(key))
+    {
+    case VTYPE_INT:
+        return options->GetInt(key);
+    case VTYPE_DOUBLE:
+        return options->GetDouble(key);
+    default:
+        return defaultValue;
+    }
+}
+
+//
+// Returns the numeric argument args[index] or "defaultValue" if it isn't a number.
+//
+static double GetNumberArg(JavaScript::Array args, int index, double defaultValue)
+{
+    switch (args->GetType(index))
+    {
+    case VTYPE_INT:
+        return args->GetInt(index);
+    case VTYPE_DOUBLE:
+        return args->GetDouble(index);
+    default:
+        return defaultValue;
+    }
+}
+
+//
+// Retrieves the data to write from args[index]: the bytes of a binary string
+// if the encoding option is "binary", otherwise the string encoded as UTF-8.
+//
+static bool GetDataToWrite(JavaScript::Array args, int index, JavaScript::Object options, std::vector<uint8_t>& data)
+{
+    if (options->GetString(TEXT("encoding")) == TEXT("binary"))
+        return JavaScript::GetBinary(args, index, data);
+
+    std::string text = JavaScript::GetUTF8String(args, index);
+    data.assign(text.begin(), text.end());
+    return true;
+}
+
+//
+// Converts directory entries to an array of objects.
+//
+static JavaScript::Array CreateFileInfoList(const std::vector<FileUtil::FileInfo>& entries, bool includeStats)
+{
+    JavaScript::Array list = JavaScript::CreateArray();
+
+    int i = 0;
+    for (const FileUtil::FileInfo& info : entries)
+    {
+        JavaScript::Object obj = JavaScript::CreateObject();
+        obj->SetString(TEXT("path"), info.name);
+        obj->SetBool(TEXT("isDirectory"), info.isDirectory);
+        obj->SetBool(TEXT("isSymbolicLink"), info.isSymbolicLink);
+        if (includeStats && info.hasStats)
+        {
+            obj->SetDouble(TEXT("size"), (double) info.size);
+            obj->SetDouble(TEXT("modified"), info.modified);
+        }
+
+        list->SetDictionary(i++, obj);
+    }
+
+    return list;
+}
+
+//
+// Converts file watcher events to an array of objects.
+//
+static JavaScript::Array CreateFileEventList(const std::vector<FileWatcher::Event>& events)
+{
+    JavaScript::Array list = JavaScript::CreateArray();
+
+    int i = 0;
+    for (const FileWatcher::Event& event : events)
+    {
+        JavaScript::Object obj = JavaScript::CreateObject();
+        obj->SetString(TEXT("path"), event.path);
+        obj->SetString(TEXT("type"), event.type == FileWatcher::EVENT_CREATED ? TEXT("created") : event.type == FileWatcher::EVENT_MODIFIED ? TEXT("modified") : TEXT("deleted"));
+        obj->SetBool(TEXT("isDirectory"), event.isDirectory);
+
+        list->SetDictionary(i++, obj);
+    }
+
+    return list;
+}
+
+//
+// Converts search matches to an array of objects.
+//
+static JavaScript::Array CreateMatchList(const std::vector<FileSearch::Match>& matches)
+{
+    JavaScript::Array list = JavaScript::CreateArray();
+
+    int i = 0;
+    for (const FileSearch::Match& match : matches)
+    {
+        JavaScript::Object obj = JavaScript::CreateObject();
+        obj->SetString(TEXT("path"), match.path);
+        obj->SetInt(TEXT("line"), match.line);
+        obj->SetInt(TEXT("column"), match.column);
+        obj->SetString(TEXT("preview"), match.preview);
+
+        list->SetDictionary(i++, obj);
+    }
+
+    return list;
+}
+
+//
+// The JavaScript callbacks of the functions which report repeatedly until they
+// are ended (watch, followFile), by path. Each call to such a function has its
+// own callback; registering a new callback for a path ends the previous one.
+//
+class CallbackRegistry
+{
+public:
+    void Register(const String& path, DelayedCallbackPtr callback)
+    {
+        DelayedCallbackPtr previous;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            DelayedCallbackPtr& entry = m_callbacks[path];
+            previous = entry;
+            entry = callback;
+        }
+
+        if (previous)
+            previous->Invoke(SetNullArg, true);
+    }
+
+    void Invoke(const String& path, DelayedCallback::ArgsSetter fnxSetArgs)
+    {
+        DelayedCallbackPtr callback;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<String, DelayedCallbackPtr>::iterator it = m_callbacks.find(path);
+            if (it == m_callbacks.end())
+                return;
+            callback = it->second;
+        }
+
+        callback->Invoke(fnxSetArgs, false);
+    }
+
+    //
+    // Ends the callback for the path (passing null) and releases it.
+    //
+    void End(const String& path)
+    {
+        DelayedCallbackPtr callback;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<String, DelayedCallbackPtr>::iterator it = m_callbacks.find(path);
+            if (it == m_callbacks.end())
+                return;
+            callback = it->second;
+            m_callbacks.erase(it);
+        }
+
+        callback->Invoke(SetNullArg, true);
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_callbacks.clear();
+    }
+
+    static void SetNullArg(JavaScript::Array args)
+    {
+        args->SetNull(0);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::map<String, DelayedCallbackPtr> m_callbacks;
+};
+
+static CallbackRegistry g_watchCallbacks;
+static CallbackRegistry g_followCallbacks;
+
+//
+// Returns a function passing the result of a write to the JavaScript callback.
+//
+static FileUtil::WriteCallback CreateWriteCallback(DelayedCallbackPtr delayedCallback)
+{
+    return [delayedCallback](bool success) {
+        delayedCallback->Invoke([success](JavaScript::Array ret) { ret->SetBool(0, success); });
+    };
+}
+
+//
+// Returns a function passing the progress of a copy to the JavaScript callback.
+//
+static FileUtil::CopyCallback CreateCopyCallback(DelayedCallbackPtr delayedCallback)
+{
+    return [delayedCallback](const FileUtil::CopyProgress& progress) {
+        FileUtil::CopyProgress p = progress;
+        delayedCallback->Invoke([p](JavaScript::Array ret) {
+            JavaScript::Object obj = JavaScript::CreateObject();
+            obj->SetInt(TEXT("id"), p.id);
+            obj->SetString(TEXT("status"),
+                p.status == FileUtil::COPY_DONE ? TEXT("done") :
+                p.status == FileUtil::COPY_FAILED ? TEXT("failed") :
+                p.status == FileUtil::COPY_CANCELLED ? TEXT("cancelled") : TEXT("copying"));
+            obj->SetDouble(TEXT("bytesCopied"), (double) p.numBytesCopied);
+            obj->SetDouble(TEXT("bytesTotal"), (double) p.numBytesTotal);
+            obj->SetInt(TEXT("filesCopied"), p.numFilesCopied);
+            obj->SetInt(TEXT("filesTotal"), p.numFilesTotal);
+            ret->SetDictionary(0, obj);
+        }, p.status != FileUtil::COPY_IN_PROGRESS);
+    };
+}
+
+//
+// Returns a function passing the progress of a download to the JavaScript callback.
+//
+static NetworkUtil::DownloadCallback CreateDownloadCallback(DelayedCallbackPtr delayedCallback)
+{
+    return [delayedCallback](const NetworkUtil::DownloadProgress& progress) {
+        NetworkUtil::DownloadProgress p = progress;
+        delayedCallback->Invoke([p](JavaScript::Array ret) {
+            JavaScript::Object obj = JavaScript::CreateObject();
+            obj->SetInt(TEXT("id"), p.id);
+            obj->SetString(TEXT("status"),
+                p.status == NetworkUtil::DOWNLOAD_DONE ? TEXT("done") :
+                p.status == NetworkUtil::DOWNLOAD_FAILED ? TEXT("failed") :
+                p.status == NetworkUtil::DOWNLOAD_CANCELLED ? TEXT("cancelled") : TEXT("downloading"));
+            if (p.error != NetworkUtil::DOWNLOAD_OK)
+            {
+                obj->SetString(TEXT("error"),
+                    p.error == NetworkUtil::DOWNLOAD_REQUEST_FAILED ? TEXT("request") :
+                    p.error == NetworkUtil::DOWNLOAD_HTTP_ERROR ? TEXT("http") :
+                    p.error == NetworkUtil::DOWNLOAD_FILE_ERROR ? TEXT("file") :
+                    p.error == NetworkUtil::DOWNLOAD_SIZE_MISMATCH ? TEXT("size") :
+                    p.error == NetworkUtil::DOWNLOAD_DIGEST_MISMATCH ? TEXT("digest") : TEXT("unsupported"));
+            }
+            obj->SetInt(TEXT("httpStatus"), p.httpStatus);
+            obj->SetDouble(TEXT("bytesReceived"), (double) p.numBytesReceived);
+            if (p.numBytesTotal >= 0)
+                obj->SetDouble(TEXT("bytesTotal"), (double) p.numBytesTotal);
+            else
+                obj->SetNull(TEXT("bytesTotal"));
+            ret->SetDictionary(0, obj);
+        }, p.status != NetworkUtil::DOWNLOAD_IN_PROGRESS);
+    };
+}
+
+//
+// Returns a function passing a response to the JavaScript callback of ajax:
+// (data, contentType, ok, statusCode, offset, length). Binary data
+// ("arraybuffer") is passed as binary strings in chunks of at most
+// HTTP_BINARY_CHUNK_SIZE bytes, "offset" being the position of the chunk and
+// "length" the size of the body.
+//
+static NetworkUtil::HttpCallback CreateAjaxCallback(DelayedCallbackPtr delayedCallback, const String& dataType)
+{
+    bool isBase64 = dataType == TEXT("base64");
+    bool isBinary = dataType == TEXT("arraybuffer");
+
+    return [delayedCallback, isBase64, isBinary](NetworkUtil::HttpResponse& response) {
+        std::string contentType = NetworkUtil::GetHeader(response.headers, "Content-Type");
+        contentType = contentType.substr(0, contentType.find(';'));
+        int status = response.status;
+        bool ok = status >= 200 && status < 300;
+
+        std::shared_ptr<std::string> data(new std::string());
+        if (isBinary && ok)
+        {
+            data->swap(response.body);
+            size_t length = data->length();
+            size_t offset = 0;
+
+            do
+            {
+                size_t chunkLength = (std::min)((size_t) HTTP_BINARY_CHUNK_SIZE, length - offset);
+                bool isLast = offset + chunkLength == length;
+
+                delayedCallback->Invoke([data, contentType, status, offset, chunkLength, length](JavaScript::Array ret) {
+                    JavaScript::SetBinary(ret, 0, data->data() + offset, chunkLength);
+                    ret->SetString(1, contentType);
+                    ret->SetBool(2, true);
+                    ret->SetInt(3, status);
+                    ret->SetDouble(4, (double) offset);
+                    ret->SetDouble(5, (double) length);
+                }, isLast);
+
+                offset += chunkLength;
+            } while (offset < length);
+
+            return;
+        }
+
+        if (isBase64)
+        {
+            Base64Encoder encoder;
+            data->resize(encoder.GetMaxEncodedLength(response.body.length()) + BASE64_MAX_FINAL_ENCODED_LENGTH);
+            size_t length = encoder.Update(response.body.data(), response.body.length(), &(*data)[0]);
+            length += encoder.Final(&(*data)[0] + length);
+            data->resize(length);
+        }
+        else if (!isBinary)
+            AppendValidUTF8(*data, (const uint8_t*) response.body.data(), response.body.length());
+
+        delayedCallback->Invoke([data, contentType, ok, status](JavaScript::Array ret) {
+            ret->SetString(0, *data);
+            ret->SetString(1, contentType);
+            ret->SetBool(2, ok);
+            ret->SetInt(3, status);
+        });
+    };
+}
+
+#ifdef USE_WEBVIEW
+//
+// Returns a function loading the target of a redirect to a "https://" URL,
+// which the native HTTP client doesn't follow, with NSURLConnection, and
+// passing any other response to onCompleted.
+//
+static NetworkUtil::HttpCallback CreateHttpsRedirectHandler(NetworkUtil::HttpCallback onCompleted, JSObjectRef callback,
+    String httpMethod, String postData, String postDataContentType, String responseDataType)
+{
+    return [onCompleted, callback, httpMethod, postData, postDataContentType, responseDataType](NetworkUtil::HttpResponse& response) {
+        int status = response.status;
+        std::string location = NetworkUtil::GetHeader(response.headers, "Location");
+        if (status < 300 || status >= 400 || NetworkUtil::GetUrlScheme(location) != "https")
+        {
+            onCompleted(response);
+            return;
+        }
+
+        // like the native client, change POSTs to GETs unless the status forbids it
+        if (status == 303 || ((status == 301 || status == 302) && httpMethod == TEXT("POST")))
+            NetworkUtil::MakeRequest(callback, httpMethod == TEXT("HEAD") ? httpMethod : String(TEXT("GET")), location, TEXT(""), TEXT(""), responseDataType);
+        else
+            NetworkUtil::MakeRequest(callback, httpMethod, location, postData, postDataContentType, responseDataType);
+    };
+}
+#else
+//
+// Returns a function loading the target of a redirect to a "https://" URL,
+// which the native HTTP client doesn't follow, with CefURLRequest, and
+// passing any other response to onCompleted.
+//
+static NetworkUtil::HttpCallback CreateHttpsRedirectHandler(NetworkUtil::HttpCallback onCompleted, const NetworkUtil::HttpRequest& request)
+{
+    return [onCompleted, request](NetworkUtil::HttpResponse& response) {
+        int status = response.status;
+        std::string location = NetworkUtil::GetHeader(response.headers, "Location");
+        if (status < 300 || status >= 400 || NetworkUtil::GetUrlScheme(location) != "https")
+        {
+            onCompleted(response);
+            return;
+        }
+
+        NetworkUtil::HttpRequest redirectRequest = request;
+        redirectRequest.url = location;
+
+        std::string method = request.method;
+        std::transform(method.begin(), method.end(), method.begin(), toupper);
+
+        // like the native client, change POSTs to GETs unless the status forbids it
+        if (status == 303 || ((status == 301 || status == 302) && method == "POST"))
+        {
+            if (method != "HEAD")
+                redirectRequest.method = "GET";
+            redirectRequest.headers.clear();
+            redirectRequest.body.clear();
+        }
+
+        NetworkUtil::SendCefRequest(redirectRequest, onCompleted);
+    };
+}
+#endif
+
+
 //////////////////////////////////////////////////////////////////////
 // Native Extensions
 
@@ -53,6 +463,8 @@
 //            information and objects can be put
 // - args:    the arguments passed to the function, a CefRefPtr<CefListValue>
 // - ret:     the arguments that will be passed to the callback function (if any)
+// - callback: the callback function; pass it to CreateDelayedCallback and return
+//            RET_DELAYED_CALLBACK to invoke it later (possibly from another thread)
 //
 void AddNativeExtensions(NativeJavaScriptFunctionAdder* e)
 {
@@ -168,27 +580,575 @@ void AddNativeExtensions(NativeJavaScriptFunctionAdder* e)
         ARG(VTYPE_STRING, "path")
     ));
 
-	// void readFile(string path, json<readFileOptions> options, function(string contents))
+	// void readFile(string path, json<readFileOptions> options, function(string|ArrayBuffer contents, number fileSize, string encoding))
+    // readFileOptions = {
+    //     encoding: {String, opt}, "utf-8", "utf-16le", "utf-16be", "latin1" or "binary"; default: detected from the BOM or the contents
+    //     offset: {Number, opt}, binary only: the position of the first byte to read; default: 0
+    //     length: {Number, opt}, binary only: the number of bytes to read; default: up to the end of the file
+    // }
+    // Binary reads return at most FILE_MAX_SLICE_SIZE bytes per call; use offset/length to read larger files in slices.
     e->AddNativeJavaScriptFunction(
         TEXT("readFile"),
         FUNC({
-            String result;
-            if (FileUtil::ReadFile(args->GetString(0), args->GetDictionary(1), result))
-                ret->SetString(0, result);
-            else
+            JavaScript::Object options = args->GetDictionary(1);
+            if (options->GetString(TEXT("encoding")) == TEXT("binary"))
+            {
+                double offset = GetNumberOption(options, TEXT("offset"), 0);
+                double length = GetNumberOption(options, TEXT("length"), -1);
+
+                if (offset < 0 || !FileUtil::ReadFileBinary(args->GetString(0), (uint64_t) offset, (int64_t) length, ret))
+                    ret->SetNull(0);
+
+                return NO_ERROR;
+            }
+
+            if (!FileUtil::ReadFile(args->GetString(0), options->GetString(TEXT("encoding")), ret))
                 ret->SetNull(0);
 
             return NO_ERROR;
         },
         ARG(VTYPE_STRING, "path")
-        ARG(VTYPE_DICTIONARY, "options")
-    ));
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        // binary data arrives as a string with one character per byte; turn it into an ArrayBuffer
+        TEXT("return readFile(path, options || {}, function(data, fileSize, encoding) { if (typeof data === 'string' && options && options.encoding === 'binary') { var buf = new Uint8Array(data.length); for (var i = 0; i < data.length; i++) buf[i] = data.charCodeAt(i); data = buf.buffer; } if (callback) callback(data, fileSize, encoding); });")
+    );
     
 
+    // void writeFile(string path, string|ArrayBuffer data, json<writeFileOptions> options, function(bool success))
+    // writeFileOptions = {
+    //     encoding: {String, opt}, "utf-8" (default) or "binary" (set automatically if data is an ArrayBuffer or a typed array)
+    //     atomic: {Boolean, opt}, write to a temporary file and replace the file with it; default: false
+    //     sync: {Boolean, opt}, invoke the callback only once the data is on disk; default: false
+    // }
+    e->AddNativeJavaScriptFunction(
+        TEXT("writeFile"),
+        FUNC({
+            JavaScript::Object options = args->GetDictionary(2);
+            std::vector<uint8_t> data;
+            if (!GetDataToWrite(args, 1, options, data))
+            {
+                ret->SetBool(0, false);
+                return NO_ERROR;
+            }
+
+            FileUtil::WriteFile(args->GetString(0), data, options->GetBool(TEXT("atomic")), options->GetBool(TEXT("sync")), CreateWriteCallback(CreateDelayedCallback(callback)));
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "path")
+        ARG(VTYPE_STRING, "data")
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        // array buffers are passed as binary strings (one character per byte)
+        TEXT("return writeFile(path, typeof data === 'string' ? data : (function(b) { var s = ''; for (var i = 0; i < b.length; i += 8192) s += String.fromCharCode.apply(null, b.subarray(i, i + 8192)); return s; })(new Uint8Array(data.buffer || data, data.byteOffset || 0, data.byteLength)), typeof data === 'string' ? (options || {}) : { encoding: 'binary', atomic: !!(options && options.atomic), sync: !!(options && options.sync) }, callback);")
+    );
+
+    // void appendFile(string path, string|ArrayBuffer data, json<appendFileOptions> options, function(bool success))
+    // appendFileOptions = {
+    //     encoding: {String, opt}, see writeFile
+    //     sync: {Boolean, opt}, see writeFile
+    // }
+    e->AddNativeJavaScriptFunction(
+        TEXT("appendFile"),
+        FUNC({
+            JavaScript::Object options = args->GetDictionary(2);
+            std::vector<uint8_t> data;
+            if (!GetDataToWrite(args, 1, options, data))
+            {
+                ret->SetBool(0, false);
+                return NO_ERROR;
+            }
+
+            FileUtil::AppendFile(args->GetString(0), data, options->GetBool(TEXT("sync")), CreateWriteCallback(CreateDelayedCallback(callback)));
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "path")
+        ARG(VTYPE_STRING, "data")
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        TEXT("return appendFile(path, typeof data === 'string' ? data : (function(b) { var s = ''; for (var i = 0; i < b.length; i += 8192) s += String.fromCharCode.apply(null, b.subarray(i, i + 8192)); return s; })(new Uint8Array(data.buffer || data, data.byteOffset || 0, data.byteLength)), typeof data === 'string' ? (options || {}) : { encoding: 'binary', sync: !!(options && options.sync) }, callback);")
+    );
+
+    // void copyFile(string from, string to, function(json<copyProgress> progress))
+    // copyProgress = {
+    //     id: {Number}, pass to cancelCopy to cancel the copy
+    //     status: {String}, "copying", "done", "failed" or "cancelled"
+    //     bytesCopied: {Number}, bytesTotal: {Number}, filesCopied: {Number}, filesTotal: {Number}
+    // }
+    // The callback is invoked when the copy has started, at most every FILE_COPY_PROGRESS_INTERVAL ms while it is in progress,
+    // and once it has ended.
+    e->AddNativeJavaScriptFunction(
+        TEXT("copyFile"),
+        FUNC({
+            FileUtil::Copy(args->GetString(0), args->GetString(1), CreateCopyCallback(CreateDelayedCallback(callback)));
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "from")
+        ARG(VTYPE_STRING, "to"))
+    );
+
+    // void moveFile(string from, string to, function(json<copyProgress> progress))
+    // Moves a file or a directory; if it can't be renamed (e.g., because "to" is on another volume), it is copied and deleted.
+    e->AddNativeJavaScriptFunction(
+        TEXT("moveFile"),
+        FUNC({
+            FileUtil::Move(args->GetString(0), args->GetString(1), CreateCopyCallback(CreateDelayedCallback(callback)));
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "from")
+        ARG(VTYPE_STRING, "to"))
+    );
+
+    // void copyTree(string from, string to, function(json<copyProgress> progress))
+    // Copies a directory with all its contents; several files are copied concurrently.
+    e->AddNativeJavaScriptFunction(
+        TEXT("copyTree"),
+        FUNC({
+            FileUtil::CopyTree(args->GetString(0), args->GetString(1), CreateCopyCallback(CreateDelayedCallback(callback)));
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "from")
+        ARG(VTYPE_STRING, "to"))
+    );
+
+    // void cancelCopy(int id)
+    e->AddNativeJavaScriptProcedure(
+        TEXT("cancelCopy"),
+        FUNC({
+            FileUtil::CancelCopy(args->GetInt(0));
+            return NO_ERROR;
+        },
+        ARG(VTYPE_INT, "id"))
+    );
+
+    // void listDirectory(string path, json<listDirectoryOptions> options, function(array entries, bool isDone))
+    // listDirectoryOptions = {
+    //     recursive: {Boolean, opt}, also list the subdirectories; default: false
+    //     includeStats: {Boolean, opt}, retrieve the size and the modification time of the entries; default: false
+    //     filter: {String, opt}, a glob pattern the names of the entries must match, e.g. "*.js"
+    // }
+    // entry = { path: {String}, isDirectory: {Boolean}, isSymbolicLink: {Boolean}, size: {Number}, modified: {Number} }
+    // The callback is invoked multiple times with batches of entries until isDone is true.
+    // If the path isn't a directory, entries is null.
+    e->AddNativeJavaScriptFunction(
+        TEXT("listDirectory"),
+        FUNC({
+            JavaScript::Object options = args->GetDictionary(1);
+            bool includeStats = options->GetBool(TEXT("includeStats"));
+            DelayedCallbackPtr delayedCallback = CreateDelayedCallback(callback);
+
+            bool isListing = DirectoryLister::List(
+                args->GetString(0), options->GetBool(TEXT("recursive")), includeStats, options->GetString(TEXT("filter")),
+                [delayedCallback, includeStats](std::vector<FileUtil::FileInfo>& entries, bool isDone) {
+                    std::shared_ptr<std::vector<FileUtil::FileInfo> > batch(new std::vector<FileUtil::FileInfo>());
+                    batch->swap(entries);
+                    delayedCallback->Invoke([batch, includeStats, isDone](JavaScript::Array ret) {
+                        ret->SetList(0, CreateFileInfoList(*batch, includeStats));
+                        ret->SetBool(1, isDone);
+                    }, isDone);
+                }
+            );
+
+            if (isListing)
+                return RET_DELAYED_CALLBACK;
+
+            ret->SetNull(0);
+            ret->SetBool(1, true);
+            return NO_ERROR;
+        },
+        ARG(VTYPE_STRING, "path")
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        TEXT("return listDirectory(path, options || {}, callback);")
+    );
+
+    // void statMany(array paths, function(json<stats> result))
+    // stats = { sizes: {Array}, modified: {Array}, modes: {Array}, errors: {Array} }
+    // Each array contains one number per path, in the order of the paths.
+    // error = 0 (ok), 1 (not found), 2 (access denied), 3 (other error)
+    e->AddNativeJavaScriptFunction(
+        TEXT("statMany"),
+        FUNC({
+            std::vector<String> paths;
+            JavaScript::Array list = args->GetList(0);
+            for (int i = 0; i < (int) list->GetSize(); ++i)
+                paths.push_back(list->GetString(i));
+
+            DelayedCallbackPtr delayedCallback = CreateDelayedCallback(callback);
+            DirectoryLister::StatMany(paths, [delayedCallback](std::vector<FileUtil::FileStatus>& stats) {
+                std::shared_ptr<std::vector<FileUtil::FileStatus> > result(new std::vector<FileUtil::FileStatus>());
+                result->swap(stats);
+                delayedCallback->Invoke([result](JavaScript::Array ret) {
+                    JavaScript::Array sizes = JavaScript::CreateArray();
+                    JavaScript::Array modified = JavaScript::CreateArray();
+                    JavaScript::Array modes = JavaScript::CreateArray();
+                    JavaScript::Array errors = JavaScript::CreateArray();
+
+                    for (int i = 0; i < (int) result->size(); ++i)
+                    {
+                        const FileUtil::FileStatus& status = (*result)[i];
+                        sizes->SetDouble(i, (double) status.size);
+                        modified->SetDouble(i, status.modified);
+                        modes->SetInt(i, (int) status.mode);
+                        errors->SetInt(i, (int) status.error);
+                    }
+
+                    JavaScript::Object obj = JavaScript::CreateObject();
+                    obj->SetList(TEXT("sizes"), sizes);
+                    obj->SetList(TEXT("modified"), modified);
+                    obj->SetList(TEXT("modes"), modes);
+                    obj->SetList(TEXT("errors"), errors);
+                    ret->SetDictionary(0, obj);
+                });
+            });
+
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_LIST, "paths"))
+    );
+
+    // void searchFiles(string root, string pattern, json<searchOptions> options, function(array matches, bool isDone))
+    // searchOptions = {
+    //     regex: {Boolean, opt}, the pattern is a regular expression; default: false
+    //     caseInsensitive: {Boolean, opt}, ignore the case of ASCII letters; default: false
+    //     globs: {Array, opt}, glob patterns of which the file names must match one, e.g. ["*.js", "*.css"]
+    //     maxResults: {Number, opt}, the search ends after this many matches; default: SEARCH_FILES_DEFAULT_MAX_RESULTS
+    // }
+    // match = { path: {String}, line: {Number}, column: {Number}, preview: {String} }
+    // The callback is invoked multiple times with batches of matches until isDone is true.
+    // Regular expressions match UTF-8 text: "." and character classes match whole characters (see SearchPattern).
+    // If root isn't a directory or the pattern is invalid, matches is null.
+    e->AddNativeJavaScriptFunction(
+        TEXT("searchFiles"),
+        FUNC({
+            JavaScript::Object options = args->GetDictionary(2);
+
+            FileSearch::Options searchOptions;
+            searchOptions.isRegex = options->GetBool(TEXT("regex"));
+            searchOptions.caseInsensitive = options->GetBool(TEXT("caseInsensitive"));
+            searchOptions.maxResults = (int) GetNumberOption(options, TEXT("maxResults"), SEARCH_FILES_DEFAULT_MAX_RESULTS);
+            if (options->GetType(TEXT("globs")) == VTYPE_LIST)
+            {
+                JavaScript::Array globs = options->GetList(TEXT("globs"));
+                for (int i = 0; i < (int) globs->GetSize(); ++i)
+                    searchOptions.globs.push_back(globs->GetString(i));
+            }
+
+            DelayedCallbackPtr delayedCallback = CreateDelayedCallback(callback);
+
+            bool isSearching = FileSearch::Search(
+                args->GetString(0), JavaScript::GetUTF8String(args, 1), searchOptions,
+                [delayedCallback](std::vector<FileSearch::Match>& matches, bool isDone) {
+                    std::shared_ptr<std::vector<FileSearch::Match> > batch(new std::vector<FileSearch::Match>());
+                    batch->swap(matches);
+                    delayedCallback->Invoke([batch, isDone](JavaScript::Array ret) {
+                        ret->SetList(0, CreateMatchList(*batch));
+                        ret->SetBool(1, isDone);
+                    }, isDone);
+                }
+            );
+
+            if (isSearching)
+                return RET_DELAYED_CALLBACK;
+
+            ret->SetNull(0);
+            ret->SetBool(1, true);
+            return NO_ERROR;
+        },
+        ARG(VTYPE_STRING, "root")
+        ARG(VTYPE_STRING, "pattern")
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        TEXT("return searchFiles(root, pattern, options || {}, callback);")
+    );
+
+    // void readLines(string path, int start, int count, function(array lines, int numLines, bool isComplete))
+    // Reads at most LINE_INDEX_MAX_LINES_PER_READ lines starting at the (zero-based) line "start".
+    // The file is indexed in the background; until isComplete is true, numLines is the number of lines indexed so far.
+    // Pass a count of 0 to query the progress of the indexing. If the file can't be read, lines is null.
+    e->AddNativeJavaScriptFunction(
+        TEXT("readLines"),
+        FUNC({
+            int start = args->GetInt(1);
+            int count = args->GetInt(2);
+            DelayedCallbackPtr delayedCallback = CreateDelayedCallback(callback);
+
+            LineIndex::ReadLines(
+                args->GetString(0), start > 0 ? (uint64_t) start : 0, count > 0 ? (uint64_t) count : 0,
+                [delayedCallback](bool isOK, std::vector<std::string>& lines, uint64_t numLines, bool isComplete) {
+                    std::shared_ptr<std::vector<std::string> > result(new std::vector<std::string>());
+                    result->swap(lines);
+                    delayedCallback->Invoke([isOK, result, numLines, isComplete](JavaScript::Array ret) {
+                        if (isOK)
+                        {
+                            JavaScript::Array list = JavaScript::CreateArray();
+                            for (int i = 0; i < (int) result->size(); ++i)
+                                list->SetString(i, (*result)[i]);
+                            ret->SetList(0, list);
+                        }
+                        else
+                            ret->SetNull(0);
+
+                        ret->SetDouble(1, (double) numLines);
+                        ret->SetBool(2, isComplete);
+                    });
+                }
+            );
+
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "path")
+        ARG(VTYPE_INT, "start")
+        ARG(VTYPE_INT, "count"))
+    );
+
+    // void hashFiles(array paths, string algorithm, function(array digests))
+    // algorithm = "xxh64" or "sha256"
+    // The digests are lower-case hexadecimal strings in the order of the paths; the digest of a file which can't be read is null.
+    // If the algorithm isn't supported, digests is null.
+    e->AddNativeJavaScriptFunction(
+        TEXT("hashFiles"),
+        FUNC({
+            FileHasher::Algorithm algorithm;
+            if (!FileHasher::GetAlgorithm(args->GetString(1), algorithm))
+            {
+                ret->SetNull(0);
+                return NO_ERROR;
+            }
+
+            std::vector<String> paths;
+            JavaScript::Array list = args->GetList(0);
+            for (int i = 0; i < (int) list->GetSize(); ++i)
+                paths.push_back(list->GetString(i));
+
+            DelayedCallbackPtr delayedCallback = CreateDelayedCallback(callback);
+            FileHasher::HashFiles(paths, algorithm, [delayedCallback](std::vector<String>& digests) {
+                std::shared_ptr<std::vector<String> > result(new std::vector<String>());
+                result->swap(digests);
+                delayedCallback->Invoke([result](JavaScript::Array ret) {
+                    JavaScript::Array list = JavaScript::CreateArray();
+                    for (int i = 0; i < (int) result->size(); ++i)
+                    {
+                        if ((*result)[i].length() > 0)
+                            list->SetString(i, (*result)[i]);
+                        else
+                            list->SetNull(i);
+                    }
+
+                    ret->SetList(0, list);
+                });
+            });
+
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_LIST, "paths")
+        ARG(VTYPE_STRING, "algorithm"))
+    );
+
+    // void hashBuffer(string|ArrayBuffer buffer, string algorithm, function(string digest))
+    // Strings are hashed as UTF-8. If the algorithm isn't supported, digest is null.
+    e->AddNativeJavaScriptFunction(
+        TEXT("hashBuffer"),
+        FUNC({
+            FileHasher::Algorithm algorithm;
+            std::vector<uint8_t> data;
+            if (!FileHasher::GetAlgorithm(args->GetString(1), algorithm) || !JavaScript::GetBinary(args, 0, data))
+            {
+                ret->SetNull(0);
+                return NO_ERROR;
+            }
+
+            ret->SetString(0, FileHasher::HashBuffer(data.size() > 0 ? &data[0] : NULL, data.size(), algorithm));
+            return NO_ERROR;
+        },
+        ARG(VTYPE_STRING, "buffer")
+        ARG(VTYPE_STRING, "algorithm")),
+        true, false,
+        // the data is passed as a binary string (one character per byte)
+        TEXT("return hashBuffer(typeof buffer === 'string' ? unescape(encodeURIComponent(buffer)) : (function(b) { var s = ''; for (var i = 0; i < b.length; i += 8192) s += String.fromCharCode.apply(null, b.subarray(i, i + 8192)); return s; })(new Uint8Array(buffer.buffer || buffer, buffer.byteOffset || 0, buffer.byteLength)), algorithm, callback);")
+    );
+
+    // void watch(string path, json<watchOptions> options, function(array events))
+    // watchOptions = {
+    //     recursive: {Boolean, opt}, also watch the subdirectories; default: false
+    //     latency: {Number, opt}, the time in milliseconds changes are collected before the callback is invoked; default: FILE_WATCHER_DEFAULT_LATENCY
+    // }
+    // event = { path: {String}, type: {String}, "created", "modified" or "deleted", isDirectory: {Boolean} }
+    // The paths are relative to the watched directory; there is at most one event per path and invocation.
+    // The callback is invoked whenever changes are detected. events is null once the watch has ended,
+    // i.e., if the directory can't be watched, unwatch has been called or the directory is watched again.
+    e->AddNativeJavaScriptFunction(
+        TEXT("watch"),
+        FUNC({
+            String path = args->GetString(0);
+            JavaScript::Object options = args->GetDictionary(1);
+
+            // the events are passed to the callback registered last for the path
+            g_watchCallbacks.Register(path, CreateDelayedCallback(callback));
+            bool isWatching = FileWatcher::Watch(
+                path, options->GetBool(TEXT("recursive")), (int) GetNumberOption(options, TEXT("latency"), FILE_WATCHER_DEFAULT_LATENCY),
+                [path](std::vector<FileWatcher::Event>& events) {
+                    std::shared_ptr<std::vector<FileWatcher::Event> > batch(new std::vector<FileWatcher::Event>());
+                    batch->swap(events);
+                    g_watchCallbacks.Invoke(path, [batch](JavaScript::Array args) {
+                        args->SetList(0, CreateFileEventList(*batch));
+                    });
+                }
+            );
+
+            if (!isWatching)
+                g_watchCallbacks.End(path);
+
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "path")
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        TEXT("return watch(path, options || {}, function(events) { if (events !== null && !(options && options.recursive)) events = events.filter(function(e) { return e.path.indexOf('/') < 0 && e.path.indexOf('\\\\') < 0; }); if (callback && (events === null || events.length > 0)) callback(events); });")
+    );
+
+    // void unwatch(string path)
+    e->AddNativeJavaScriptProcedure(
+        TEXT("unwatch"),
+        FUNC({
+            String path = args->GetString(0);
+            FileWatcher::Unwatch(path);
+            g_watchCallbacks.End(path);
+            return NO_ERROR;
+        },
+        ARG(VTYPE_STRING, "path"))
+    );
+
+    // void followFile(string path, int fromOffset, function(string data, int offset, string type))
+    // Passes on the data appended to the file, starting at the byte offset fromOffset (at the current end of the file if omitted or negative).
+    // offset is the position in the file following the data; type is "appended", or "truncated" or "rotated" if the file has been
+    // truncated or replaced, in which case data starts at the beginning of the file.
+    // The callback is invoked at most once per frame (FILE_FOLLOWER_LATENCY). data is null once following the file has ended,
+    // i.e., if the file's directory doesn't exist, unfollowFile has been called or the file is followed again.
+    e->AddNativeJavaScriptFunction(
+        TEXT("followFile"),
+        FUNC({
+            String path = args->GetString(0);
+
+            g_followCallbacks.Register(path, CreateDelayedCallback(callback));
+            bool isFollowing = FileFollower::Follow(
+                path, (int64_t) GetNumberArg(args, 1, -1),
+                [path](FileFollower::UpdateType type, std::string& data, uint64_t offset) {
+                    std::shared_ptr<std::string> update(new std::string());
+                    update->swap(data);
+                    g_followCallbacks.Invoke(path, [update, offset, type](JavaScript::Array args) {
+                        args->SetString(0, *update);
+                        args->SetDouble(1, (double) offset);
+                        args->SetString(2, type == FileFollower::UPDATE_TRUNCATED ? TEXT("truncated") : type == FileFollower::UPDATE_ROTATED ? TEXT("rotated") : TEXT("appended"));
+                    });
+                }
+            );
+
+            if (!isFollowing)
+                g_followCallbacks.End(path);
+
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "path")
+        ARG(VTYPE_DOUBLE, "fromOffset")),
+        true, false,
+        TEXT("return followFile(path, typeof fromOffset === 'number' ? fromOffset : -1, callback);")
+    );
+
+    // void unfollowFile(string path)
+    e->AddNativeJavaScriptProcedure(
+        TEXT("unfollowFile"),
+        FUNC({
+            String path = args->GetString(0);
+            FileFollower::Unfollow(path);
+            g_followCallbacks.End(path);
+            return NO_ERROR;
+        },
+        ARG(VTYPE_STRING, "path"))
+    );
+
+    // void openReadStream(string path, json<readStreamOptions> options, function(json<stream> stream))
+    // readStreamOptions = {
+    //     chunkSize: {Number, opt}, the size of the chunks in bytes; default: READ_STREAM_DEFAULT_CHUNK_SIZE
+    //     offset: {Number, opt}, the position of the first byte to read; default: 0
+    //     length: {Number, opt}, the number of bytes to read; default: up to the end of the file
+    // }
+    // stream = {
+    //     id: {Number}, fileSize: {Number},
+    //     read: {Function(function(ArrayBuffer chunk, Number offset))}, chunk is null at the end of the stream
+    //     close: {Function()}
+    // }
+    e->AddNativeJavaScriptFunction(
+        TEXT("openReadStream"),
+        FUNC({
+            JavaScript::Object options = args->GetDictionary(1);
+            double offset = GetNumberOption(options, TEXT("offset"), 0);
+            double length = GetNumberOption(options, TEXT("length"), -1);
+            double chunkSize = GetNumberOption(options, TEXT("chunkSize"), READ_STREAM_DEFAULT_CHUNK_SIZE);
+
+            uint64_t fileSize = 0;
+            int streamId = offset < 0 || chunkSize < 0 ? -1 :
+                ReadStream::Open(args->GetString(0), (uint64_t) offset, (int64_t) length, (size_t) chunkSize, fileSize);
+
+            if (streamId < 0)
+                ret->SetNull(0);
+            else
+            {
+                ret->SetInt(0, streamId);
+                ret->SetDouble(1, (double) fileSize);
+            }
+
+            return NO_ERROR;
+        },
+        ARG(VTYPE_STRING, "path")
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        TEXT("return openReadStream(path, options || {}, function(id, fileSize) { if (!callback) return; if (id === null) { callback(null); return; } callback({ id: id, fileSize: fileSize, read: function(cb) { app.readStreamChunk(id, function(chunk, offset) { if (chunk === null) app.closeReadStream(id); if (cb) cb(chunk, offset); }); }, close: function() { app.closeReadStream(id); } }); });")
+    );
+
+    // void readStreamChunk(int streamId, function(ArrayBuffer chunk, number offset))
+    // The next chunk is read ahead in the background; if it isn't available yet, the callback is invoked once it is.
+    e->AddNativeJavaScriptFunction(
+        TEXT("readStreamChunk"),
+        FUNC({
+            if (ReadStream::Read(args->GetInt(0), ret, CreateDelayedCallback(callback)))
+                return NO_ERROR;
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_INT, "streamId")),
+        true, false,
+        TEXT("return readStreamChunk(streamId, function(data, offset) { if (typeof data === 'string') { var buf = new Uint8Array(data.length); for (var i = 0; i < data.length; i++) buf[i] = data.charCodeAt(i); data = buf.buffer; } if (callback) callback(data, offset); });")
+    );
+
+    // void closeReadStream(int streamId)
+    e->AddNativeJavaScriptProcedure(
+        TEXT("closeReadStream"),
+        FUNC({
+            ReadStream::Close(args->GetInt(0));
+            return NO_ERROR;
+        },
+        ARG(VTYPE_INT, "streamId")
+    ));
+
+
+    //////////////////////////////////////////////////////////////////////
+    // Diagnostics
+
+#ifndef USE_WEBVIEW
+    // void getResourceStats(function(array records))
+    e->AddNativeJavaScriptFunction(
+        TEXT("getResourceStats"),
+        FUNC({
+            ret->SetList(0, ResourceStats::GetRecords());
+            return NO_ERROR;
+        }
+    ));
+#endif
+
+
     //////////////////////////////////////////////////////////////////////
     // Networking
     
-#ifdef USE_WEBVIEW
     // mimicks the Zepto ajax function
     // Syntax:
     // app.ajax(options),
@@ -197,39 +1157,237 @@ void AddNativeExtensions(NativeJavaScriptFunctionAdder* e)
     //     url: {String}
     //     data: {String, opt}, POST data
     //     contentType: {String, opt}, the content type of "data"; default: "application/x-www-form-urlencoded" if "data" is set
-    //     dataType: {String, opt}, response type to expect from the server ("json", "xml", "html", "text", "base64")
+    //     dataType: {String, opt}, response type to expect from the server ("json", "xml", "html", "text", "base64", "arraybuffer")
+    //     cache: {Boolean, opt}, if false, GET requests bypass the response cache; default: true
+    //     priority: {String, opt}, "interactive", "normal" or "background"; default: "normal"
+    //     group: {String, opt}, a name for cancelling requests together with cancelAjax
     //     success: {Function(data, contentType)}, callback called when request succeeds
-    //     error: {Function()}, callback called if there is an error (timeout, parse error, or status code not in HTTP 2xx)
+    //     error: {Function(status)}, callback called if there is an error (timeout, parse error, or status code not in HTTP 2xx)
     // }
+    // "http://" URLs are loaded with the native HTTP client through the response cache and the request scheduler
+    // (see NetworkUtil::SendCachedRequest and NetworkUtil::ScheduleRequest). The native client doesn't support HTTPS:
+    // "https://" URLs and redirects to them are loaded with NSURLConnection on Mac and with CefURLRequest on Windows,
+    // bypassing the response cache and the scheduler.
     e->AddNativeJavaScriptFunction(
         TEXT("ajax"),
         FUNC({
             JavaScript::Object options = args->GetDictionary(0);
-        
+
+            String responseDataType = options->GetString(TEXT("dataType"));
+            if (responseDataType == TEXT(""))
+                responseDataType = TEXT("text");
+
+#ifdef USE_WEBVIEW
+            // NSURLConnection handles HTTPS
             String httpMethod = options->GetString(TEXT("type"));
+            std::transform(httpMethod.begin(), httpMethod.end(), httpMethod.begin(), toupper);
             if (httpMethod == "")
                 httpMethod = TEXT("GET");
-        
-            String url = options->GetString(TEXT("url"));
-        
+
             String postData = options->GetString(TEXT("data"));
             String postDataContentType = options->GetString(TEXT("contentType"));
             if (postData != "" && postDataContentType == "")
                 postDataContentType = TEXT("application/x-www-form-urlencoded");
-        
-            String responseDataType = options->GetString(TEXT("dataType"));
-            if (responseDataType == "")
-                responseDataType = TEXT("text");
-        
-            NetworkUtil::MakeRequest(callback, httpMethod, url, postData, postDataContentType, responseDataType);
-        
+
+            String url = options->GetString(TEXT("url"));
+            if (NetworkUtil::GetUrlScheme(url) == "https")
+            {
+                NetworkUtil::MakeRequest(callback, httpMethod, url, postData, postDataContentType, responseDataType);
+                return RET_DELAYED_CALLBACK;
+            }
+#endif
+
+            NetworkUtil::HttpRequest request;
+            request.method = JavaScript::GetUTF8String(options, TEXT("type"));
+            request.url = JavaScript::GetUTF8String(options, TEXT("url"));
+            request.body = JavaScript::GetUTF8String(options, TEXT("data"));
+
+            std::string contentType = JavaScript::GetUTF8String(options, TEXT("contentType"));
+            if (!request.body.empty() || !contentType.empty())
+                request.headers.push_back(std::make_pair(std::string("Content-Type"), contentType.empty() ? std::string("application/x-www-form-urlencoded") : contentType));
+
+            DelayedCallbackPtr delayedCallback = CreateDelayedCallback(callback);
+
+            bool useCache = options->GetType(TEXT("cache")) != VTYPE_BOOL || options->GetBool(TEXT("cache"));
+            std::string group = JavaScript::GetUTF8String(options, TEXT("group"));
+
+            String priorityName = options->GetString(TEXT("priority"));
+            NetworkUtil::RequestPriority priority =
+                priorityName == TEXT("interactive") ? NetworkUtil::PRIORITY_INTERACTIVE :
+                priorityName == TEXT("background") ? NetworkUtil::PRIORITY_BACKGROUND : NetworkUtil::PRIORITY_NORMAL;
+
+            NetworkUtil::HttpCallback onCompleted = CreateAjaxCallback(delayedCallback, responseDataType);
+#ifdef USE_WEBVIEW
+            onCompleted = CreateHttpsRedirectHandler(onCompleted, callback, httpMethod, postData, postDataContentType, responseDataType);
+#else
+            // CefURLRequest handles HTTPS
+            if (NetworkUtil::GetUrlScheme(request.url) == "https")
+            {
+                NetworkUtil::SendCefRequest(request, onCompleted);
+                return RET_DELAYED_CALLBACK;
+            }
+
+            onCompleted = CreateHttpsRedirectHandler(onCompleted, request);
+#endif
+            if (useCache)
+                NetworkUtil::SendCachedRequest(request, priority, group, onCompleted);
+            else
+                NetworkUtil::ScheduleRequest(request, priority, group, onCompleted);
+
             return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_DICTIONARY, "options")),
+        true, false,
+        // binary data arrives in chunks of binary strings, which are copied into one ArrayBuffer
+        TEXT("return ajax(options, (function() { var buf = null; return function(data, contentType, status, statusCode, offset, length) { if (status && options.dataType === 'arraybuffer') { if (typeof offset !== 'number') { offset = 0; length = data.length; } if (buf === null) buf = new Uint8Array(length); for (var i = 0; i < data.length; i++) buf[offset + i] = data.charCodeAt(i); if (offset + data.length < length) return; data = buf.buffer; } if (status) { if (options.success) options.success(options.dataType === 'json' ? JSON.parse(data) : data, contentType); } else if (options.error) options.error(statusCode); }; })());")
+    );
+
+    // void cancelAjax(string group)
+    // Cancels the pending requests of the group; their error callbacks are called with status 0.
+    e->AddNativeJavaScriptProcedure(
+        TEXT("cancelAjax"),
+        FUNC({
+            NetworkUtil::CancelRequestGroup(JavaScript::GetUTF8String(args, 0));
+            return NO_ERROR;
+        },
+        ARG(VTYPE_STRING, "group"))
+    );
+
+    // void getRequestQueueStats(function(array<json<queueStats>> stats))
+    // queueStats = {
+    //     priority: {String}, "interactive", "normal" or "background"
+    //     queued: {Number}, active: {Number}, started: {Number}
+    //     averageWait: {Number}, maxWait: {Number}, the times (in ms) the started requests have been queued
+    //     oldestWait: {Number}, the time (in ms) the longest-waiting queued request has been queued
+    // }
+    e->AddNativeJavaScriptFunction(
+        TEXT("getRequestQueueStats"),
+        FUNC({
+            std::vector<NetworkUtil::SchedulerStats> stats;
+            NetworkUtil::GetSchedulerStats(stats);
+
+            JavaScript::Array list = JavaScript::CreateArray();
+            for (int i = 0; i < (int) stats.size(); ++i)
+            {
+                JavaScript::Object obj = JavaScript::CreateObject();
+                obj->SetString(TEXT("priority"),
+                    i == NetworkUtil::PRIORITY_INTERACTIVE ? TEXT("interactive") :
+                    i == NetworkUtil::PRIORITY_NORMAL ? TEXT("normal") : TEXT("background"));
+                obj->SetInt(TEXT("queued"), stats[i].numQueued);
+                obj->SetInt(TEXT("active"), stats[i].numActive);
+                obj->SetDouble(TEXT("started"), (double) stats[i].numStarted);
+                obj->SetDouble(TEXT("averageWait"), stats[i].averageWaitTime);
+                obj->SetDouble(TEXT("maxWait"), stats[i].maxWaitTime);
+                obj->SetDouble(TEXT("oldestWait"), stats[i].oldestWaitTime);
+                list->SetDictionary(i, obj);
+            }
+
+            ret->SetList(0, list);
+            return NO_ERROR;
         }
+    ));
+
+    // void download(string url, string path, json<downloadOptions> options, function(json<downloadProgress> progress))
+    // downloadOptions = {
+    //     resume: {Boolean, opt}, continue a previous download from "<path>.part" and keep it if the download fails; default: false
+    //     size: {Number, opt}, the expected size of the file
+    //     digest: {String, opt}, the expected hexadecimal digest of the file
+    //     algorithm: {String, opt}, the algorithm of "digest", "xxh64" or "sha256"; default: "sha256"
+    // }
+    // downloadProgress = {
+    //     id: {Number}, pass to cancelDownload to cancel the download
+    //     status: {String}, "downloading", "done", "failed" or "cancelled"
+    //     error: {String, opt}, if the download failed: "request", "http", "file", "size", "digest" or "unsupported"
+    //     httpStatus: {Number}, bytesReceived: {Number}, bytesTotal: {Number}, null if unknown
+    // }
+    // The file is streamed to "<path>.part", which is renamed to "path" once the download is complete and verified.
+    // Only "http://" URLs are supported (the native HTTP client doesn't support HTTPS); other URLs and redirects to
+    // them fail with "unsupported".
+    // The callback is invoked when the response has arrived, at most every HTTP_DOWNLOAD_PROGRESS_INTERVAL ms while
+    // the download is in progress, and once it has ended.
+    e->AddNativeJavaScriptFunction(
+        TEXT("download"),
+        FUNC({
+            JavaScript::Object options = args->GetDictionary(2);
+
+            NetworkUtil::DownloadOptions downloadOptions;
+            downloadOptions.resume = options->GetBool(TEXT("resume"));
+            downloadOptions.size = (int64_t) GetNumberOption(options, TEXT("size"), -1);
+            downloadOptions.digest = options->GetString(TEXT("digest"));
+
+            String algorithm = options->GetString(TEXT("algorithm"));
+            if (!FileHasher::GetAlgorithm(algorithm == TEXT("") ? TEXT("sha256") : algorithm, downloadOptions.algorithm))
+            {
+                JavaScript::Object obj = JavaScript::CreateObject();
+                obj->SetInt(TEXT("id"), 0);
+                obj->SetString(TEXT("status"), TEXT("failed"));
+                obj->SetString(TEXT("error"), TEXT("digest"));
+                obj->SetInt(TEXT("httpStatus"), 0);
+                obj->SetDouble(TEXT("bytesReceived"), 0);
+                obj->SetNull(TEXT("bytesTotal"));
+                ret->SetDictionary(0, obj);
+                return NO_ERROR;
+            }
+
+            NetworkUtil::Download(JavaScript::GetUTF8String(args, 0), args->GetString(1), downloadOptions, CreateDownloadCallback(CreateDelayedCallback(callback)));
+            return RET_DELAYED_CALLBACK;
+        },
+        ARG(VTYPE_STRING, "url")
+        ARG(VTYPE_STRING, "path")
         ARG(VTYPE_DICTIONARY, "options")),
         true, false,
-        TEXT("return ajax(options, function(data, contentType, status) { if (status) { if (options.success) options.success(options.dataType === 'json' ? JSON.parse(data) : data, contentType); } else if (options.error) options.error(); });")
+        TEXT("return download(url, path, options || {}, callback);")
     );
-#endif
+
+    // void cancelDownload(int id)
+    e->AddNativeJavaScriptProcedure(
+        TEXT("cancelDownload"),
+        FUNC({
+            NetworkUtil::CancelDownload(args->GetInt(0));
+            return NO_ERROR;
+        },
+        ARG(VTYPE_INT, "id"))
+    );
+
+    // void getHttpCacheStats(function(json<httpCacheStats> stats))
+    // httpCacheStats = {
+    //     hits: {Number}, staleHits: {Number}, revalidations: {Number}, misses: {Number}, evictions: {Number},
+    //     entries: {Number}, size: {Number}
+    // }
+    e->AddNativeJavaScriptFunction(
+        TEXT("getHttpCacheStats"),
+        FUNC({
+            NetworkUtil::HttpCacheStats stats;
+            NetworkUtil::GetHttpCacheStats(stats);
+
+            JavaScript::Object obj = JavaScript::CreateObject();
+            obj->SetDouble(TEXT("hits"), (double) stats.numHits);
+            obj->SetDouble(TEXT("staleHits"), (double) stats.numStaleHits);
+            obj->SetDouble(TEXT("revalidations"), (double) stats.numRevalidations);
+            obj->SetDouble(TEXT("misses"), (double) stats.numMisses);
+            obj->SetDouble(TEXT("evictions"), (double) stats.numEvictions);
+            obj->SetDouble(TEXT("entries"), (double) stats.numEntries);
+            obj->SetDouble(TEXT("size"), (double) stats.size);
+            ret->SetDictionary(0, obj);
+            return NO_ERROR;
+        }
+    ));
+
+    // void clearHttpCache()
+    e->AddNativeJavaScriptProcedure(
+        TEXT("clearHttpCache"),
+        FUNC({
+            NetworkUtil::ClearHttpCache();
+            return NO_ERROR;
+        }
+    ));
+}
+
+
+void ReleaseNativeExtensionCallbacks()
+{
+    g_watchCallbacks.Clear();
+    g_followCallbacks.Clear();
 }
 
 
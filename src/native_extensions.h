@@ -31,7 +31,7 @@
 #ifndef USE_WEBVIEW
 
 #define FUNC(code, ...) new NativeFunction( \
-    [](CefRefPtr<ClientHandler> handler, CefRefPtr<CefBrowser> browser, CefRefPtr<ExtensionState> state, CefRefPtr<CefListValue> args, CefRefPtr<CefListValue> ret) -> int \
+    [](CefRefPtr<ClientHandler> handler, CefRefPtr<CefBrowser> browser, CefRefPtr<ExtensionState> state, CefRefPtr<CefListValue> args, CefRefPtr<CefListValue> ret, DelayedCallbackPtr callback) -> int \
     code __VA_ARGS__, END_MARKER)
 
 #define PROC(code) [](CefRefPtr<ClientHandler> handler, CefRefPtr<CefBrowser> browser, CefRefPtr<ExtensionState> state) code
@@ -57,6 +57,12 @@ class Path;
 
 void AddNativeExtensions(NativeJavaScriptFunctionAdder* extensionHandler);
 
+//
+// Releases the JavaScript callbacks of the directory watches and followed
+// files. Called once the watchers have been stopped.
+//
+void ReleaseNativeExtensionCallbacks();
+
 
 class ExtensionState
 #ifndef USE_WEBVIEW
@@ -68,6 +74,11 @@ public:
     ~ExtensionState();
     void SetClientExtensionHandler(ClientExtensionHandlerPtr e);
     
+    inline ClientExtensionHandlerPtr GetClientExtensionHandler()
+    {
+        return m_e;
+    }
+    
 private:
     ClientExtensionHandlerPtr m_e;
 
@@ -20,16 +20,341 @@
 // IN THE SOFTWARE.
 //
 
+#ifndef __network_util_h
+#define __network_util_h
+
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "types.h"
+#include "file_hasher.h"
+
+
+// The maximum number of connections to a host
+#define HTTP_MAX_CONNECTIONS_PER_HOST 6
+
+// The maximum number of requests sent on a connection before their responses
+// have arrived (only GET, HEAD and OPTIONS requests are pipelined)
+#define HTTP_MAX_PIPELINE_DEPTH 4
+
+// The time (in milliseconds) a connection may take to be established
+#define HTTP_CONNECT_TIMEOUT 10000
+
+// The time (in milliseconds) without any data from the server after which a
+// request fails
+#define HTTP_RESPONSE_TIMEOUT 60000
+
+// The time (in milliseconds) after which idle connections are closed
+#define HTTP_KEEP_ALIVE_TIMEOUT 30000
+
+// The maximum number of redirects which are followed
+#define HTTP_MAX_REDIRECTS 5
+
+// The maximum size of the status line and the headers of a response
+#define HTTP_MAX_HEADER_SIZE (64 * 1024)
+
+// The maximum size of the chunks in which binary responses are passed to
+// JavaScript
+#define HTTP_BINARY_CHUNK_SIZE (1024 * 1024)
+
+// The minimum time (in milliseconds) between progress reports of downloads
+#define HTTP_DOWNLOAD_PROGRESS_INTERVAL 100
+
+// The maximum size (in bytes) of the response cache on disk; responses larger
+// than an eighth of it aren't cached
+#define HTTP_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+// The maximum freshness lifetime (in seconds) derived from the Last-Modified
+// header of responses without an explicit expiration time
+#define HTTP_CACHE_MAX_HEURISTIC_LIFETIME (24 * 60 * 60)
+
+// The number of threads reading and writing cached responses
+#define HTTP_CACHE_NUM_THREADS 2
+
+// The maximum number of scheduled requests in progress at the same time, in
+// total, to a host, and of background priority
+#define HTTP_SCHEDULER_MAX_ACTIVE 24
+#define HTTP_SCHEDULER_MAX_ACTIVE_PER_HOST 8
+#define HTTP_SCHEDULER_MAX_ACTIVE_BACKGROUND 8
 
 
 namespace NetworkUtil {
 
+typedef std::vector<std::pair<std::string, std::string> > HttpHeaders;
+
+enum RequestError
+{
+    REQUEST_OK,
+    REQUEST_INVALID_URL,
+    REQUEST_RESOLVE_FAILED,
+    REQUEST_CONNECT_FAILED,
+    REQUEST_TIMED_OUT,
+    REQUEST_CONNECTION_CLOSED,
+    REQUEST_PROTOCOL_ERROR,
+    REQUEST_CANCELLED
+};
+
+//
+// The response to a request. If error isn't REQUEST_OK, status is 0. url is
+// the URL of the response after following redirects.
+//
+struct HttpResponse
+{
+    RequestError error;
+    int status;
+    std::string url;
+    HttpHeaders headers;
+    std::string body;
+};
+
+typedef std::function<void(HttpResponse& response)> HttpCallback;
+typedef std::function<bool(const HttpResponse& response)> HttpHeadersCallback;
+typedef std::function<bool(const char* data, size_t length)> HttpDataCallback;
+
+//
+// A HTTP request. Only "http://" URLs are supported; redirects to other
+// schemes (e.g., "https://") aren't followed, but passed on as the response.
+// Host and Content-Length are added automatically.
+// If onHeaders is set, it's called when the status and the headers of the
+// final response (i.e., not of a redirect which is followed) have arrived. If
+// onData is set, the body is passed to it as it arrives instead of being
+// collected in the response; such requests aren't sent again once data has
+// been passed on. The request is cancelled if either returns false. Both are
+// called on the network thread.
+//
+struct HttpRequest
+{
+    std::string method;
+    std::string url;
+    HttpHeaders headers;
+    std::string body;
+
+    HttpHeadersCallback onHeaders;
+    HttpDataCallback onData;
+};
+
+//
+// Sends a request with the native HTTP/1.1 client and returns its ID. All
+// connections are handled by one thread with non-blocking sockets; up to
+// HTTP_MAX_CONNECTIONS_PER_HOST connections per host are kept alive and
+// reused, and idempotent requests are pipelined on them if all connections
+// are busy. Redirects are followed. onCompleted is called on the network
+// thread.
+//
+int SendRequest(const HttpRequest& request, HttpCallback onCompleted);
+
+//
+// Cancels a request; its callback is called with REQUEST_CANCELLED unless it
+// has completed already.
+//
+void CancelRequest(int id);
+
+//
+// Closes all connections and stops the network thread. Pending requests are
+// dropped without calling their callbacks.
+//
+void StopHttpClient();
+
+enum DownloadStatus
+{
+    DOWNLOAD_IN_PROGRESS,
+    DOWNLOAD_DONE,
+    DOWNLOAD_FAILED,
+    DOWNLOAD_CANCELLED
+};
+
+enum DownloadError
+{
+    DOWNLOAD_OK,
+    DOWNLOAD_REQUEST_FAILED,
+    DOWNLOAD_HTTP_ERROR,
+    DOWNLOAD_FILE_ERROR,
+    DOWNLOAD_SIZE_MISMATCH,
+    DOWNLOAD_DIGEST_MISMATCH,
+    DOWNLOAD_UNSUPPORTED_URL
+};
+
+//
+// If "resume" is set, the data of an interrupted download is kept and
+// requested from where it stopped, provided the response had an ETag or a
+// Last-Modified header, which is sent in If-Range. The downloaded file is verified against
+// the size (unless it's negative) and the lower-case hexadecimal digest
+// (unless it's empty).
+//
+struct DownloadOptions
+{
+    bool resume;
+    int64_t size;
+    String digest;
+    FileHasher::Algorithm algorithm;
+};
+
+//
+// numBytesReceived includes the data of a resumed download; numBytesTotal is
+// -1 while the size is unknown. httpStatus is the status of the response.
+//
+struct DownloadProgress
+{
+    int id;
+    DownloadStatus status;
+    DownloadError error;
+    int httpStatus;
+    uint64_t numBytesReceived;
+    int64_t numBytesTotal;
+};
+
+typedef std::function<void(const DownloadProgress& progress)> DownloadCallback;
+
+//
+// Downloads the URL to "path" and returns the ID of the download. The data is
+// written to "<path>.part" as it arrives, which is renamed to "path" once the
+// download is complete and verified. If the download fails or is cancelled,
+// the partial file is kept if "resume" is set (unless the digest doesn't
+// match), along with the validator of the response in
+// "<path>.part.validator", and deleted otherwise. onProgress is called once the response has
+// started, at most every HTTP_DOWNLOAD_PROGRESS_INTERVAL ms while the download
+// is in progress, and once it has ended.
+// Only "http://" URLs are supported, as the native HTTP client doesn't
+// support HTTPS; other URLs and redirects to them fail with
+// DOWNLOAD_UNSUPPORTED_URL (for other URLs, onProgress is called before
+// Download returns).
+//
+int Download(const std::string& url, const String& path, const DownloadOptions& options, DownloadCallback onProgress);
+
+void CancelDownload(int id);
+
+enum RequestPriority
+{
+    PRIORITY_INTERACTIVE,
+    PRIORITY_NORMAL,
+    PRIORITY_BACKGROUND,
+
+    NUM_REQUEST_PRIORITIES
+};
+
+//
+// Queues a request and returns its ID. Queued requests are started in the
+// order of their priorities as long as fewer than HTTP_SCHEDULER_MAX_ACTIVE
+// requests (HTTP_SCHEDULER_MAX_ACTIVE_PER_HOST to a host,
+// HTTP_SCHEDULER_MAX_ACTIVE_BACKGROUND of background priority) are in
+// progress; within a priority, the hosts take turns. "group" is an arbitrary
+// name (possibly empty) for cancelling requests together. onCompleted is
+// called on the network thread, or on the cancelling thread if the request is
+// cancelled while it's queued.
+//
+int ScheduleRequest(const HttpRequest& request, RequestPriority priority, const std::string& group, HttpCallback onCompleted);
+
+//
+// Cancels a scheduled request, or all scheduled requests of the (non-empty)
+// group; their callbacks are called with REQUEST_CANCELLED.
+//
+void CancelScheduledRequest(int id);
+void CancelRequestGroup(const std::string& group);
+
+//
+// The state of the queue of a priority. The wait times (in milliseconds) are
+// the times requests have spent in the queue: the average and the maximum of
+// the requests started so far, and the time the longest-waiting request has
+// been queued.
+//
+struct SchedulerStats
+{
+    int numQueued;
+    int numActive;
+    uint64_t numStarted;
+    double averageWaitTime;
+    double maxWaitTime;
+    double oldestWaitTime;
+};
+
+//
+// Returns the stats of the queues, indexed by RequestPriority.
+//
+void GetSchedulerStats(std::vector<SchedulerStats>& stats);
+
+//
+// Drops the queued requests without calling their callbacks.
+//
+void StopScheduler();
+
+//
+// numHits counts fresh responses served from the cache, numStaleHits stale
+// responses served while they are revalidated in the background, and
+// numRevalidations cached responses the server has confirmed to be current
+// ("304 Not Modified"). numMisses counts responses loaded from the network.
+// size is the total size of the cache files.
+//
+struct HttpCacheStats
+{
+    uint64_t numHits;
+    uint64_t numStaleHits;
+    uint64_t numRevalidations;
+    uint64_t numMisses;
+    uint64_t numEvictions;
+    uint64_t numEntries;
+    uint64_t size;
+};
+
+//
+// Sends a request like ScheduleRequest, but serves GET requests from the
+// response cache if possible and stores cacheable responses in it. The cache honors
+// Cache-Control (of the response and the request) and Expires; stale
+// responses are revalidated with If-None-Match/If-Modified-Since, or served
+// while they're revalidated within their "stale-while-revalidate" period.
+// The responses are kept on disk, and the least recently used ones are
+// evicted if the cache exceeds HTTP_CACHE_MAX_SIZE. Background revalidations
+// are scheduled with PRIORITY_BACKGROUND. onCompleted is called on the
+// network thread or on one of the cache's threads.
+//
+void SendCachedRequest(const HttpRequest& request, RequestPriority priority, const std::string& group, HttpCallback onCompleted);
+
+void GetHttpCacheStats(HttpCacheStats& stats);
+
+//
+// Removes all responses from the cache.
+//
+void ClearHttpCache();
+
+//
+// Waits for pending cache operations and stops the cache's threads.
+//
+void StopHttpCache();
+
+//
+// Returns the value of the first header with the name (which is compared
+// case-insensitively), or an empty string.
+//
+std::string GetHeader(const HttpHeaders& headers, const std::string& name);
+
+//
+// Returns the scheme of the URL in lower case (e.g., "https"), or an empty
+// string if the URL is relative.
+//
+std::string GetUrlScheme(const std::string& url);
+
+
 #ifdef USE_WEBVIEW
 
-// For Mac/WebView: Make a HTTP request
+// For Mac/WebView: Make a HTTP request with NSURLConnection (which supports
+// HTTPS); can be called on any thread
 void MakeRequest(JSObjectRef callback, String httpMethod, String url, String postData, String postDataContentType, String responseDataType);
 
+#elif !defined(NATIVE_ONLY)
+
+//
+// For Windows/CEF: Sends a request with CefURLRequest, which supports HTTPS
+// and follows redirects itself. onHeaders and onData aren't supported; the
+// body is collected in the response. Can be called on any thread; onCompleted
+// is called on the UI thread.
+//
+void SendCefRequest(const HttpRequest& request, HttpCallback onCompleted);
+
 #endif
 
 } // namespace NetworkUtil
+
+
+#endif
@@ -20,6 +20,8 @@
 // IN THE SOFTWARE.
 //
 
+#include <vector>
+
 #import "network_util.h"
 #include "NSData+Base64.h"
 
@@ -31,6 +33,7 @@
 @property JSObjectRef callback;
 @property NSString *responseDataType;
 @property NSString *responseMimeType;
+@property NSInteger statusCode;
 
 @end
 
@@ -52,6 +55,7 @@
 {
     _data.length = 0;
     _responseMimeType = response.MIMEType;
+    _statusCode = [response isKindOfClass: [NSHTTPURLResponse class]] ? ((NSHTTPURLResponse*) response).statusCode : 200;
 }
 
 - (void) connection: (NSURLConnection*) connection didReceiveData: (NSData*) data
@@ -61,7 +65,37 @@
 
 - (void) connectionDidFinishLoading: (NSURLConnection*) connection
 {
-    if (JSObjectIsFunction(g_ctx, _callback))
+    if (JSObjectIsFunction(g_ctx, _callback) && [_responseDataType isEqualToString: @"arraybuffer"])
+    {
+        // pass the data as binary strings (one character per byte) in chunks
+        const unsigned char *bytes = (const unsigned char*) _data.bytes;
+        size_t length = _data.length;
+        size_t offset = 0;
+        JSStringRef retContentType = JSStringCreateWithCFString((__bridge CFStringRef) _responseMimeType);
+
+        do
+        {
+            size_t chunkLength = MIN((size_t) HTTP_BINARY_CHUNK_SIZE, length - offset);
+            std::vector<JSChar> chars(bytes + offset, bytes + offset + chunkLength);
+            JSStringRef retData = JSStringCreateWithCharacters(chunkLength > 0 ? &chars[0] : NULL, chunkLength);
+
+            JSValueRef args[6];
+            args[0] = JSValueMakeString(g_ctx, retData);
+            args[1] = JSValueMakeString(g_ctx, retContentType);
+            args[2] = JSValueMakeBoolean(g_ctx, true);
+            args[3] = JSValueMakeNumber(g_ctx, _statusCode);
+            args[4] = JSValueMakeNumber(g_ctx, offset);
+            args[5] = JSValueMakeNumber(g_ctx, length);
+
+            JSObjectCallAsFunction(g_ctx, _callback, NULL, 6, args, NULL);
+            JSStringRelease(retData);
+
+            offset += chunkLength;
+        } while (offset < length);
+
+        JSStringRelease(retContentType);
+    }
+    else if (JSObjectIsFunction(g_ctx, _callback))
     {
         NSString *strRetData = nil;
         if ([_responseDataType isEqualToString: @"base64"])
@@ -117,6 +151,18 @@ namespace NetworkUtil {
     
 void MakeRequest(JSObjectRef callback, String httpMethod, String url, String postData, String postDataContentType, String responseDataType)
 {
+    // the connection is scheduled on the run loop of the main thread, where
+    // its delegate calls into JavaScript
+    if (![NSThread isMainThread])
+    {
+        JSValueProtect(g_ctx, callback);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            MakeRequest(callback, httpMethod, url, postData, postDataContentType, responseDataType);
+            JSValueUnprotect(g_ctx, callback);
+        });
+        return;
+    }
+
     JSValueProtect(g_ctx, callback);
     
     NSMutableURLRequest *urlRequest = [NSMutableURLRequest requestWithURL: [NSURL URLWithString: [NSString stringWithUTF8String: url.c_str()]]];
@@ -20,10 +20,148 @@
 // IN THE SOFTWARE.
 //
 
+#include "lib/Libcef/Include/cef_request.h"
+#include "lib/Libcef/Include/cef_task.h"
+#include "lib/Libcef/Include/cef_urlrequest.h"
+
 #include "network_util.h"
 #include "app.h"
 
 
 namespace NetworkUtil {
 
+//
+// Collects the body of a CefURLRequest and passes the response to the
+// callback once the request has completed.
+//
+class CefRequestClient : public CefURLRequestClient
+{
+public:
+    CefRequestClient(const std::string& url, HttpCallback onCompleted)
+        : m_url(url), m_onCompleted(onCompleted)
+    {
+    }
+
+    virtual void OnRequestComplete(CefRefPtr<CefURLRequest> request)
+    {
+        HttpResponse response;
+        response.error = REQUEST_OK;
+        response.status = 0;
+        response.url = m_url;
+
+        CefRefPtr<CefResponse> cefResponse = request->GetResponse();
+        if (request->GetRequestStatus() == UR_SUCCESS && cefResponse.get())
+        {
+            response.status = cefResponse->GetStatus();
+
+            CefResponse::HeaderMap headerMap;
+            cefResponse->GetHeaderMap(headerMap);
+            for (CefResponse::HeaderMap::iterator it = headerMap.begin(); it != headerMap.end(); ++it)
+                response.headers.push_back(std::make_pair(it->first.ToString(), it->second.ToString()));
+
+            response.body.swap(m_body);
+        }
+        else if (request->GetRequestStatus() == UR_CANCELED)
+            response.error = REQUEST_CANCELLED;
+        else
+        {
+            switch (request->GetRequestError())
+            {
+            case ERR_NAME_NOT_RESOLVED:
+                response.error = REQUEST_RESOLVE_FAILED;
+                break;
+            case ERR_CONNECTION_REFUSED:
+                response.error = REQUEST_CONNECT_FAILED;
+                break;
+            case ERR_TIMED_OUT:
+                response.error = REQUEST_TIMED_OUT;
+                break;
+            case ERR_CONNECTION_CLOSED:
+            case ERR_CONNECTION_RESET:
+                response.error = REQUEST_CONNECTION_CLOSED;
+                break;
+            default:
+                response.error = REQUEST_PROTOCOL_ERROR;
+                break;
+            }
+        }
+
+        m_onCompleted(response);
+    }
+
+    virtual void OnUploadProgress(CefRefPtr<CefURLRequest> request, uint64 current, uint64 total)
+    {
+    }
+
+    virtual void OnDownloadProgress(CefRefPtr<CefURLRequest> request, uint64 current, uint64 total)
+    {
+    }
+
+    virtual void OnDownloadData(CefRefPtr<CefURLRequest> request, const void* data, size_t dataLength)
+    {
+        m_body.append((const char*) data, dataLength);
+    }
+
+    virtual bool GetAuthCredentials(bool isProxy, const CefString& host, int port, const CefString& realm,
+        const CefString& scheme, CefRefPtr<CefAuthCallback> callback)
+    {
+        return false;
+    }
+
+private:
+    std::string m_url;
+    HttpCallback m_onCompleted;
+    std::string m_body;
+
+    IMPLEMENT_REFCOUNTING(CefRequestClient);
+};
+
+//
+// Creates and starts a CefURLRequest (on the UI thread, on which its client
+// is called).
+//
+class StartCefRequestTask : public CefTask
+{
+public:
+    StartCefRequestTask(const HttpRequest& request, HttpCallback onCompleted)
+        : m_request(request), m_onCompleted(onCompleted)
+    {
+    }
+
+    virtual void Execute()
+    {
+        CefRefPtr<CefRequest> cefRequest = CefRequest::Create();
+        cefRequest->SetURL(m_request.url);
+        cefRequest->SetMethod(m_request.method.empty() ? std::string("GET") : m_request.method);
+
+        CefRequest::HeaderMap headerMap;
+        for (HttpHeaders::iterator it = m_request.headers.begin(); it != m_request.headers.end(); ++it)
+            headerMap.insert(std::make_pair(CefString(it->first), CefString(it->second)));
+        cefRequest->SetHeaderMap(headerMap);
+
+        if (!m_request.body.empty())
+        {
+            CefRefPtr<CefPostDataElement> element = CefPostDataElement::Create();
+            element->SetToBytes(m_request.body.length(), m_request.body.data());
+            CefRefPtr<CefPostData> postData = CefPostData::Create();
+            postData->AddElement(element);
+            cefRequest->SetPostData(postData);
+        }
+
+        CefURLRequest::Create(cefRequest, new CefRequestClient(m_request.url, m_onCompleted));
+    }
+
+private:
+    HttpRequest m_request;
+    HttpCallback m_onCompleted;
+
+    IMPLEMENT_REFCOUNTING(StartCefRequestTask);
+};
+
+
+void SendCefRequest(const HttpRequest& request, HttpCallback onCompleted)
+{
+    CefPostTask(TID_UI, new StartCefRequestTask(request, onCompleted));
+}
+
 } // namespace NetworkUtil
\ No newline at end of file
@@ -0,0 +1,322 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "read_stream.h"
+#include "file_util.h"
+#include "app.h"
+
+
+namespace ReadStream {
+
+//
+// A chunk of the file. An empty chunk marks the end of the stream.
+//
+struct Chunk
+{
+    std::vector<uint8_t> data;
+    uint64_t offset;
+};
+
+typedef std::shared_ptr<Chunk> ChunkPtr;
+
+
+static void SetChunk(JavaScript::Array ret, ChunkPtr chunk)
+{
+    if (chunk->data.empty())
+        ret->SetNull(0);
+    else
+        JavaScript::SetBinary(ret, 0, &chunk->data[0], chunk->data.size());
+
+    ret->SetDouble(1, (double) chunk->offset);
+}
+
+static void Deliver(DelayedCallbackPtr callback, ChunkPtr chunk)
+{
+    callback->Invoke([chunk](JavaScript::Array ret) { SetChunk(ret, chunk); });
+}
+
+
+class Stream
+{
+public:
+    Stream()
+        : m_fileSize(0), m_offset(0), m_end(0), m_chunkSize(0), m_isClosed(false), m_isEndQueued(false)
+    {
+    }
+
+    ~Stream()
+    {
+        Stop();
+    }
+
+    bool Open(const String& path, uint64_t offset, int64_t length, size_t chunkSize)
+    {
+        if (!m_file.Open(path))
+            return false;
+
+        m_fileSize = m_file.GetSize();
+        m_offset = offset < m_fileSize ? offset : m_fileSize;
+        m_end = length < 0 || (uint64_t) length > m_fileSize - m_offset ? m_fileSize : m_offset + (uint64_t) length;
+        m_chunkSize = chunkSize;
+
+        m_thread = std::thread(&Stream::Run, this);
+        return true;
+    }
+
+    uint64_t GetFileSize() const
+    {
+        return m_fileSize;
+    }
+
+    bool Read(JavaScript::Array ret, DelayedCallbackPtr callback)
+    {
+        ChunkPtr chunk;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (m_chunks.empty())
+            {
+                if (m_isEndQueued && m_pendingReads.empty())
+                {
+                    // the end has been delivered already
+                    ret->SetNull(0);
+                    ret->SetDouble(1, (double) m_end);
+                    return true;
+                }
+
+                m_pendingReads.push_back(callback);
+                return false;
+            }
+
+            chunk = m_chunks.front();
+            m_chunks.pop_front();
+        }
+
+        // there is room for another chunk
+        m_cvSpace.notify_one();
+
+        SetChunk(ret, chunk);
+        return true;
+    }
+
+    void Stop()
+    {
+        std::deque<DelayedCallbackPtr> pendingReads;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_isClosed = true;
+            m_chunks.clear();
+            pendingReads.swap(m_pendingReads);
+        }
+
+        m_cvSpace.notify_one();
+        if (m_thread.joinable())
+            m_thread.join();
+
+        // don't leave any reads unanswered
+        ChunkPtr end(new Chunk);
+        end->offset = m_end;
+        for (DelayedCallbackPtr callback : pendingReads)
+            Deliver(callback, end);
+    }
+
+private:
+    //
+    // The reader thread.
+    //
+    void Run()
+    {
+        uint64_t offset = m_offset;
+        bool isOK = true;
+
+        while (offset < m_end)
+        {
+            // wait until the app has consumed a chunk if enough chunks are in flight
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (!m_isClosed && m_chunks.size() >= READ_STREAM_MAX_CHUNKS_IN_FLIGHT)
+                    m_cvSpace.wait(lock);
+
+                if (m_isClosed)
+                    return;
+            }
+
+            size_t size = m_end - offset > (uint64_t) m_chunkSize ? m_chunkSize : (size_t) (m_end - offset);
+            const uint8_t* data = m_file.Map(offset, size);
+            if (data == NULL)
+            {
+                App::Log(TEXT("ReadStream: Failed to read from the file"));
+                isOK = false;
+                break;
+            }
+
+            // touch the pages on this thread rather than in the app
+            ChunkPtr chunk(new Chunk);
+            chunk->data.assign(data, data + size);
+            chunk->offset = offset;
+            Push(chunk);
+
+            offset += size;
+        }
+
+        // release the file while the app is still consuming chunks
+        m_file.Close();
+
+        ChunkPtr end(new Chunk);
+        end->offset = isOK ? m_end : offset;
+        Push(end);
+    }
+
+    //
+    // Hands the chunk directly to a waiting read or queues it.
+    //
+    void Push(ChunkPtr chunk)
+    {
+        DelayedCallbackPtr callback;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (chunk->data.empty())
+                m_isEndQueued = true;
+
+            if (m_pendingReads.empty())
+            {
+                m_chunks.push_back(chunk);
+                return;
+            }
+
+            callback = m_pendingReads.front();
+            m_pendingReads.pop_front();
+        }
+
+        Deliver(callback, chunk);
+    }
+
+private:
+    FileUtil::MappedFile m_file;
+    uint64_t m_fileSize;
+    uint64_t m_offset;
+    uint64_t m_end;
+    size_t m_chunkSize;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cvSpace;
+
+    std::deque<ChunkPtr> m_chunks;
+    std::deque<DelayedCallbackPtr> m_pendingReads;
+    bool m_isClosed;
+    bool m_isEndQueued;
+};
+
+
+static std::mutex g_mutex;
+static std::map<int, std::shared_ptr<Stream> > g_streams;
+static int g_nextStreamId = 1;
+
+
+int Open(const String& path, uint64_t offset, int64_t length, size_t chunkSize, uint64_t& fileSize)
+{
+    if (chunkSize < READ_STREAM_MIN_CHUNK_SIZE)
+        chunkSize = READ_STREAM_MIN_CHUNK_SIZE;
+    if (chunkSize > FILE_MAX_SLICE_SIZE)
+        chunkSize = FILE_MAX_SLICE_SIZE;
+
+    std::shared_ptr<Stream> stream(new Stream());
+    if (!stream->Open(path, offset, length, chunkSize))
+        return -1;
+
+    fileSize = stream->GetFileSize();
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    int streamId = g_nextStreamId++;
+    g_streams[streamId] = stream;
+    return streamId;
+}
+
+bool Read(int streamId, JavaScript::Array ret, DelayedCallbackPtr callback)
+{
+    std::shared_ptr<Stream> stream;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        std::map<int, std::shared_ptr<Stream> >::iterator it = g_streams.find(streamId);
+        if (it != g_streams.end())
+            stream = it->second;
+    }
+
+    if (!stream)
+    {
+        // closed or unknown stream
+        ret->SetNull(0);
+        ret->SetNull(1);
+        return true;
+    }
+
+    return stream->Read(ret, callback);
+}
+
+void Close(int streamId)
+{
+    std::shared_ptr<Stream> stream;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        std::map<int, std::shared_ptr<Stream> >::iterator it = g_streams.find(streamId);
+        if (it == g_streams.end())
+            return;
+
+        stream = it->second;
+        g_streams.erase(it);
+    }
+
+    stream->Stop();
+}
+
+void CloseAll()
+{
+    std::map<int, std::shared_ptr<Stream> > streams;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        streams.swap(g_streams);
+    }
+
+    for (std::map<int, std::shared_ptr<Stream> >::iterator it = streams.begin(); it != streams.end(); ++it)
+        it->second->Stop();
+}
+
+} // namespace ReadStream
@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef __read_stream_h
+#define __read_stream_h
+
+
+#include <stdint.h>
+
+#include "types.h"
+
+#ifndef USE_WEBVIEW
+#include "extension_handler.h"
+#else
+#include "webview_extension.h"
+#endif
+
+
+// Chunk sizes used if the app doesn't specify one, and the bounds for it
+#define READ_STREAM_DEFAULT_CHUNK_SIZE (1024 * 1024)
+#define READ_STREAM_MIN_CHUNK_SIZE (4 * 1024)
+
+// The number of chunks read ahead before the reader thread waits for the app
+#define READ_STREAM_MAX_CHUNKS_IN_FLIGHT 4
+
+
+//
+// Streams read files chunk by chunk: a background thread reads ahead until
+// READ_STREAM_MAX_CHUNKS_IN_FLIGHT chunks are waiting to be pulled by the app,
+// so the memory used is bounded by the chunk size regardless of the file size.
+//
+namespace ReadStream {
+
+//
+// Opens a stream reading "length" bytes (up to the end of the file if negative),
+// starting at "offset". Returns the ID of the stream or -1 if the file can't be
+// opened.
+//
+int Open(const String& path, uint64_t offset, int64_t length, size_t chunkSize, uint64_t& fileSize);
+
+//
+// Pulls the next chunk. Returns true if a chunk was available and has been set
+// to ret; otherwise it is passed to the callback once it has been read.
+// A chunk consists of the data and its offset in the file; the data is null
+// after the end of the stream has been reached or if the file can't be read.
+//
+bool Read(int streamId, JavaScript::Array ret, DelayedCallbackPtr callback);
+
+//
+// Stops the reader thread and releases the stream.
+//
+void Close(int streamId);
+
+//
+// Closes all the streams still open; called when the app shuts down.
+//
+void CloseAll();
+
+} // namespace ReadStream
+
+
+#endif
@@ -0,0 +1,111 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <map>
+#include <mutex>
+
+#include "lib/Libcef/Include/wrapper/cef_byte_read_handler.h"
+
+#include "resource_cache.h"
+
+
+namespace ResourceCache {
+
+//
+// Holds the contents of a cached resource. Stream readers keep a reference
+// to it, so an entry can be replaced or cleared while it is still being read.
+//
+class CachedResource : public CefBase
+{
+public:
+    ResourceIdentity m_identity;
+    std::string m_data;
+
+    IMPLEMENT_REFCOUNTING(CachedResource);
+};
+
+
+static std::map<String, CefRefPtr<CachedResource> > g_mapResources;
+static std::mutex g_mutex;
+
+
+//
+// Returns the cached resource if the file it has been read from hasn't
+// changed; otherwise, the entry is removed.
+//
+static CefRefPtr<CachedResource> GetResource(const String& resourceName)
+{
+    CefRefPtr<CachedResource> resource;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        std::map<String, CefRefPtr<CachedResource> >::iterator it = g_mapResources.find(resourceName);
+        if (it == g_mapResources.end())
+            return NULL;
+        resource = it->second;
+    }
+
+    ResourceIdentity identity;
+    if (GetResourceIdentity(resourceName.c_str(), identity) && IsSameResourceIdentity(identity, resource->m_identity))
+        return resource;
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    std::map<String, CefRefPtr<CachedResource> >::iterator it = g_mapResources.find(resourceName);
+    if (it != g_mapResources.end() && it->second.get() == resource.get())
+        g_mapResources.erase(it);
+
+    return NULL;
+}
+
+CefRefPtr<CefStreamReader> GetReader(const String& resourceName)
+{
+    CefRefPtr<CachedResource> resource = GetResource(resourceName);
+    if (!resource.get())
+        return NULL;
+
+    return CefStreamReader::CreateForHandler(new CefByteReadHandler(
+        (const unsigned char*) resource->m_data.data(), resource->m_data.size(), resource.get()));
+}
+
+bool Contains(const String& resourceName)
+{
+    return GetResource(resourceName).get() != NULL;
+}
+
+void Put(const String& resourceName, const ResourceIdentity& identity, std::string& data)
+{
+    CefRefPtr<CachedResource> resource = new CachedResource();
+    resource->m_identity = identity;
+    resource->m_data.swap(data);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_mapResources[resourceName] = resource;
+}
+
+void Clear()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_mapResources.clear();
+}
+
+} // namespace ResourceCache
@@ -0,0 +1,69 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef __resource_cache_h
+#define __resource_cache_h
+
+
+#include <string>
+
+#include "lib/Libcef/Include/cef_stream.h"
+#include "types.h"
+#include "resource_util.h"
+
+
+//
+// In-memory cache of the (possibly transformed) contents of app resources,
+// keyed by resource name. Each entry remembers the identity of the file the
+// resource has been read from and is dropped once that file has changed.
+// Safe to use from any thread.
+//
+namespace ResourceCache {
+
+//
+// Returns a stream reader over the cached contents of the resource, or NULL
+// if the resource isn't cached or its file has changed.
+//
+CefRefPtr<CefStreamReader> GetReader(const String& resourceName);
+
+//
+// Tests whether the resource is cached (and its file hasn't changed).
+//
+bool Contains(const String& resourceName);
+
+//
+// Adds the contents of a resource to the cache. identity is the identity of
+// the file the contents have been read from, taken before it was opened. The
+// data is moved into the cache; data will be empty after the call.
+//
+void Put(const String& resourceName, const ResourceIdentity& identity, std::string& data);
+
+//
+// Removes all entries from the cache.
+//
+void Clear();
+
+} // namespace ResourceCache
+
+
+#endif
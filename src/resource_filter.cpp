@@ -0,0 +1,387 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "resource_filter.h"
+#include "resource_cache.h"
+#include "hash_util.h"
+
+
+// Patched resources up to this size are kept in the resource cache
+#define MAX_CACHED_RESOURCE_SIZE (1024 * 1024)
+
+// Number of bytes read from the source stream at a time
+#define READ_CHUNK_SIZE 4096
+
+
+namespace ResourceFilter {
+
+//
+// Aho-Corasick automaton over all declared placeholders.
+// The goto and failure functions are combined into a full transition table,
+// so matching is a single table lookup per input byte.
+//
+class PlaceholderMatcher
+{
+public:
+    PlaceholderMatcher(const std::map<std::string, std::string>& placeholders)
+    {
+        // state 0 is the root of the trie
+        AddState(0);
+
+        for (std::map<std::string, std::string>::const_iterator it = placeholders.begin(); it != placeholders.end(); ++it)
+        {
+            if (it->first.empty())
+                continue;
+
+            int state = 0;
+            for (size_t i = 0; i < it->first.length(); ++i)
+            {
+                unsigned char c = (unsigned char) it->first.at(i);
+                if (m_delta[state * 256 + c] <= 0)
+                {
+                    int next = AddState((int) i + 1);
+                    m_delta[state * 256 + c] = next;
+                }
+
+                state = m_delta[state * 256 + c];
+            }
+
+            m_match[state] = (int) m_values.size();
+            m_lengths.push_back(it->first.length());
+            m_values.push_back(it->second);
+        }
+
+        // compute the failure links breadth first and complete the transition table
+        std::vector<int> fail(m_depth.size(), 0);
+        std::queue<int> queue;
+
+        for (int c = 0; c < 256; ++c)
+        {
+            int next = m_delta[c];
+            if (next > 0)
+            {
+                fail[next] = 0;
+                queue.push(next);
+            }
+            else
+                m_delta[c] = 0;
+        }
+
+        while (!queue.empty())
+        {
+            int state = queue.front();
+            queue.pop();
+
+            // a state matches if its longest proper suffix state matches
+            if (m_match[state] < 0)
+                m_match[state] = m_match[fail[state]];
+
+            for (int c = 0; c < 256; ++c)
+            {
+                int next = m_delta[state * 256 + c];
+                if (next > 0)
+                {
+                    fail[next] = m_delta[fail[state] * 256 + c];
+                    queue.push(next);
+                }
+                else
+                    m_delta[state * 256 + c] = m_delta[fail[state] * 256 + c];
+            }
+        }
+    }
+
+    inline int Next(int state, unsigned char c) const
+    {
+        return m_delta[state * 256 + c];
+    }
+
+    inline size_t GetDepth(int state) const
+    {
+        return m_depth[state];
+    }
+
+    // Returns the index of the placeholder ending in this state or -1
+    inline int GetMatch(int state) const
+    {
+        return m_match[state];
+    }
+
+    inline size_t GetLength(int placeholder) const
+    {
+        return m_lengths[placeholder];
+    }
+
+    inline const std::string& GetValue(int placeholder) const
+    {
+        return m_values[placeholder];
+    }
+
+    inline bool IsEmpty() const
+    {
+        return m_values.empty();
+    }
+
+private:
+    int AddState(int depth)
+    {
+        int state = (int) m_depth.size();
+        m_depth.push_back(depth);
+        m_match.push_back(-1);
+        m_delta.resize(m_delta.size() + 256, -1);
+        return state;
+    }
+
+private:
+    std::vector<int> m_delta;
+    std::vector<size_t> m_depth;
+    std::vector<int> m_match;
+    std::vector<size_t> m_lengths;
+    std::vector<std::string> m_values;
+};
+
+
+//
+// Read handler replacing the placeholders in the source stream on the fly.
+// Bytes which might be the beginning of a placeholder are held back until
+// it is clear whether they match; at most as many bytes as the longest
+// placeholder is long are buffered.
+//
+class SubstitutionReadHandler : public CefReadHandler
+{
+public:
+    SubstitutionReadHandler(const String& resourceName, CefRefPtr<CefStreamReader> source, const ResourceIdentity* identity,
+        std::shared_ptr<const PlaceholderMatcher> matcher)
+        : m_resourceName(resourceName), m_source(source), m_matcher(matcher),
+          m_state(0), m_outPos(0), m_offset(0), m_isEOF(false), m_isCaching(identity != NULL)
+    {
+        if (identity != NULL)
+            m_identity = *identity;
+    }
+
+    virtual size_t Read(void* ptr, size_t size, size_t n) OVERRIDE
+    {
+        size_t numBytes = size * n;
+        size_t numWritten = 0;
+        char* out = (char*) ptr;
+
+        while (numWritten < numBytes)
+        {
+            if (m_outPos < m_out.length())
+            {
+                size_t len = m_out.length() - m_outPos;
+                if (len > numBytes - numWritten)
+                    len = numBytes - numWritten;
+                memcpy(out + numWritten, m_out.data() + m_outPos, len);
+                m_outPos += len;
+                numWritten += len;
+                continue;
+            }
+
+            if (m_isEOF)
+                break;
+
+            m_out.clear();
+            m_outPos = 0;
+            Fill();
+        }
+
+        m_offset += numWritten;
+        return size == 0 ? 0 : numWritten / size;
+    }
+
+    virtual int Seek(int64 offset, int whence) OVERRIDE
+    {
+        // the stream can't be repositioned
+        return offset == 0 && whence == SEEK_CUR ? 0 : -1;
+    }
+
+    virtual int64 Tell() OVERRIDE
+    {
+        return m_offset;
+    }
+
+    virtual int Eof() OVERRIDE
+    {
+        return m_isEOF && m_outPos >= m_out.length();
+    }
+
+private:
+    //
+    // Reads the next chunk from the source and appends the output to m_out.
+    //
+    void Fill()
+    {
+        char buf[READ_CHUNK_SIZE];
+        size_t len = m_source->Read(buf, 1, sizeof(buf));
+
+        if (len == 0)
+        {
+            // flush the bytes held back
+            m_out.append(m_pending);
+            m_pending.clear();
+            m_isEOF = true;
+        }
+        else
+        {
+            for (size_t i = 0; i < len; ++i)
+            {
+                m_state = m_matcher->Next(m_state, (unsigned char) buf[i]);
+                m_pending.push_back(buf[i]);
+
+                int match = m_matcher->GetMatch(m_state);
+                if (match >= 0)
+                {
+                    // the placeholder is a suffix of the pending bytes
+                    m_out.append(m_pending, 0, m_pending.length() - m_matcher->GetLength(match));
+                    m_out.append(m_matcher->GetValue(match));
+                    m_pending.clear();
+                    m_state = 0;
+                }
+                else if (m_pending.length() > m_matcher->GetDepth(m_state))
+                {
+                    // only the last GetDepth(m_state) bytes can still be part of a placeholder
+                    size_t numReleased = m_pending.length() - m_matcher->GetDepth(m_state);
+                    m_out.append(m_pending, 0, numReleased);
+                    m_pending.erase(0, numReleased);
+                }
+            }
+        }
+
+        // memorize the output and add it to the resource cache once complete
+        if (m_isCaching)
+        {
+            if (m_cache.length() + m_out.length() > MAX_CACHED_RESOURCE_SIZE)
+            {
+                m_isCaching = false;
+                std::string().swap(m_cache);
+            }
+            else
+            {
+                m_cache.append(m_out);
+                if (m_isEOF)
+                    ResourceCache::Put(m_resourceName, m_identity, m_cache);
+            }
+        }
+    }
+
+private:
+    String m_resourceName;
+    CefRefPtr<CefStreamReader> m_source;
+    ResourceIdentity m_identity;
+    std::shared_ptr<const PlaceholderMatcher> m_matcher;
+
+    // the current state of the automaton
+    int m_state;
+
+    // bytes which might be part of a placeholder
+    std::string m_pending;
+
+    // output which hasn't been returned from Read yet
+    std::string m_out;
+    size_t m_outPos;
+
+    // number of bytes returned from Read
+    int64 m_offset;
+
+    bool m_isEOF;
+
+    // the complete output so far, if the resource is to be cached
+    bool m_isCaching;
+    std::string m_cache;
+
+    IMPLEMENT_REFCOUNTING(SubstitutionReadHandler);
+};
+
+
+static std::map<std::string, std::string> g_mapPlaceholders;
+static std::shared_ptr<const PlaceholderMatcher> g_matcher;
+static uint64_t g_hashPlaceholders = HashUtil::FNV1A64_OFFSET_BASIS;
+static std::mutex g_mutex;
+
+
+void SetPlaceholder(const std::string& placeholder, const std::string& value)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    g_mapPlaceholders[placeholder] = value;
+
+    // rebuild the automaton; readers which have already been created keep the old one
+    g_matcher = std::make_shared<const PlaceholderMatcher>(g_mapPlaceholders);
+
+    g_hashPlaceholders = HashUtil::FNV1A64_OFFSET_BASIS;
+    for (std::map<std::string, std::string>::iterator it = g_mapPlaceholders.begin(); it != g_mapPlaceholders.end(); ++it)
+    {
+        g_hashPlaceholders = HashUtil::Fnv1a64(it->first.c_str(), it->first.length() + 1, g_hashPlaceholders);
+        g_hashPlaceholders = HashUtil::Fnv1a64(it->second.c_str(), it->second.length() + 1, g_hashPlaceholders);
+    }
+
+    // previously patched resources are outdated
+    ResourceCache::Clear();
+}
+
+bool IsFilteredMimeType(const String& mimeType)
+{
+    // placeholders are only substituted in markup and style sheets
+    return mimeType == TEXT("text/html") || mimeType == TEXT("text/css");
+}
+
+CefRefPtr<CefStreamReader> CreateReader(const String& resourceName, CefRefPtr<CefStreamReader> source, const ResourceIdentity* identity)
+{
+    std::shared_ptr<const PlaceholderMatcher> matcher;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        matcher = g_matcher;
+    }
+
+    if (!matcher || matcher->IsEmpty())
+        return source;
+
+    return CefStreamReader::CreateForHandler(new SubstitutionReadHandler(resourceName, source, identity, matcher));
+}
+
+String GetETag(const String& etag)
+{
+    uint64_t hash;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        hash = g_hashPlaceholders;
+    }
+
+    // etag is a quoted string: insert the hash before the closing quote
+    if (etag.length() < 2)
+        return etag;
+    return etag.substr(0, etag.length() - 1) + TEXT("-") + HashUtil::ToHex(hash) + TEXT("\"");
+}
+
+} // namespace ResourceFilter
@@ -0,0 +1,88 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef __resource_filter_h
+#define __resource_filter_h
+
+
+#include <string>
+
+#include "lib/Libcef/Include/cef_stream.h"
+#include "types.h"
+#include "resource_util.h"
+
+
+// Placeholders the native layer provides values for. Apps can declare more
+// using ResourceFilter::SetPlaceholder. The braces keep placeholders from
+// matching parts of identifiers in scripts and style sheets.
+#define PLACEHOLDER_SYSTEM_FONT "{{zephyros:system-font}}"
+#define PLACEHOLDER_LOCALE      "{{zephyros:locale}}"
+#define PLACEHOLDER_VERSION     "{{zephyros:app-version}}"
+#define PLACEHOLDER_THEME       "{{zephyros:theme}}"
+
+// Deprecated: the system font placeholder of earlier versions, which was only
+// replaced in style/base.css on Windows. It's still replaced there (now in all
+// filtered resources) until apps have moved to PLACEHOLDER_SYSTEM_FONT.
+#define PLACEHOLDER_SYSTEM_FONT_LEGACY "_system-font_"
+
+
+//
+// Streaming substitution of placeholders in served resources.
+//
+// All declared placeholders are replaced in a single pass over the resource
+// stream (using an Aho-Corasick automaton), so resources never have to be
+// loaded as a whole. The patched output of a resource is put into the
+// ResourceCache once it has been read completely.
+//
+namespace ResourceFilter {
+
+//
+// Declares a placeholder and the value it is replaced with. Placeholders are
+// matched byte-wise in every filtered resource, so they should be delimited
+// like the built-in ones (e.g., "{{myapp:name}}"); the value is inserted as
+// is (i.e., UTF-8 encoded).
+//
+void SetPlaceholder(const std::string& placeholder, const std::string& value);
+
+//
+// Tests whether resources of the given MIME type are filtered.
+//
+bool IsFilteredMimeType(const String& mimeType);
+
+//
+// Returns a stream reader which reads the contents of source with all
+// placeholders replaced. identity is the identity of the file source reads
+// from, taken before it was opened; the output is only cached if it is set.
+//
+CefRefPtr<CefStreamReader> CreateReader(const String& resourceName, CefRefPtr<CefStreamReader> source, const ResourceIdentity* identity);
+
+//
+// Returns the entity tag of a filtered resource given the entity tag of the
+// unfiltered resource, i.e., mixes the placeholder values into etag.
+//
+String GetETag(const String& etag);
+
+} // namespace ResourceFilter
+
+
+#endif
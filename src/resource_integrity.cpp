@@ -0,0 +1,324 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef OS_WIN
+#include <tchar.h>
+#endif
+
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "resource_integrity.h"
+#include "resource_util.h"
+#include "file_util.h"
+#include "hash_util.h"
+#include "worker_pool.h"
+#include "app.h"
+
+
+namespace ResourceIntegrity {
+
+enum State
+{
+    StateUnverified,
+    StateVerified,
+    StateTampered
+};
+
+struct Entry
+{
+    // hex digest from the manifest
+    String digest;
+
+    State state;
+
+    // identity of the file the resource was verified from
+    bool hasIdentity;
+    ResourceIdentity identity;
+};
+
+
+static std::map<String, Entry> g_mapEntries;
+static std::mutex g_mutex;
+static std::thread g_thread;
+
+
+static bool GetCachePath(String& path)
+{
+    if (!FileUtil::GetApplicationDataDirectory(path))
+        return false;
+
+#ifdef OS_WIN
+    path.append(TEXT("\\"));
+#else
+    path.append(TEXT("/"));
+#endif
+    path.append(INTEGRITY_CACHE_NAME);
+    return true;
+}
+
+static void SplitLines(const std::string& data, std::vector<std::string>& lines)
+{
+    std::istringstream ss(data);
+    std::string line;
+    while (std::getline(ss, line))
+    {
+        if (line.length() > 0 && line.at(line.length() - 1) == '\r')
+            line.erase(line.length() - 1);
+        if (line.length() > 0)
+            lines.push_back(line);
+    }
+}
+
+//
+// Reads the manifest, which is in the format of sha256sum:
+// "<hex digest> <space or '*'><resource name>" per line.
+//
+static void LoadManifest()
+{
+    CefRefPtr<CefStreamReader> stream = GetBinaryResourceReader(INTEGRITY_MANIFEST_NAME);
+    if (!stream.get())
+        return;
+
+    std::string data;
+    char buf[16384];
+    size_t len;
+    while ((len = stream->Read(buf, 1, sizeof(buf))) > 0)
+        data.append(buf, len);
+
+    std::vector<std::string> lines;
+    SplitLines(data, lines);
+
+    for (std::vector<std::string>::iterator it = lines.begin(); it != lines.end(); ++it)
+    {
+        if (it->length() < 2 * SHA256_DIGEST_SIZE + 2 || it->at(2 * SHA256_DIGEST_SIZE) != ' ')
+            continue;
+
+        std::string digest = it->substr(0, 2 * SHA256_DIGEST_SIZE);
+        std::string name = it->substr(2 * SHA256_DIGEST_SIZE + 2);
+
+        Entry entry;
+        entry.digest = String(digest.begin(), digest.end());
+        entry.state = StateUnverified;
+        entry.hasIdentity = false;
+        g_mapEntries[String(CefString(name))] = entry;
+    }
+}
+
+//
+// Reads the cached markers, one per line:
+// "<file id> <size> <mtime> <hex digest> <resource name>".
+//
+static void LoadMarkers()
+{
+    String path;
+    if (!GetCachePath(path))
+        return;
+
+    FILE* file = _tfopen(path.c_str(), TEXT("rb"));
+    if (!file)
+        return;
+
+    std::string data;
+    char buf[16384];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+        data.append(buf, len);
+    fclose(file);
+
+    std::vector<std::string> lines;
+    SplitLines(data, lines);
+
+    for (std::vector<std::string>::iterator it = lines.begin(); it != lines.end(); ++it)
+    {
+        std::istringstream ss(*it);
+        unsigned long long fileId, size;
+        long long mtime;
+        std::string digest, name;
+
+        ss >> fileId >> size >> mtime >> digest;
+        ss.get();
+        std::getline(ss, name);
+        if (ss.fail() || name.empty())
+            continue;
+
+        // the marker is only valid for the digest currently in the manifest
+        std::map<String, Entry>::iterator itEntry = g_mapEntries.find(String(CefString(name)));
+        if (itEntry == g_mapEntries.end() || itEntry->second.digest != String(digest.begin(), digest.end()))
+            continue;
+
+        itEntry->second.hasIdentity = true;
+        itEntry->second.identity.fileId = fileId;
+        itEntry->second.identity.size = size;
+        itEntry->second.identity.mtime = mtime;
+    }
+}
+
+static void SaveMarkers()
+{
+    String path;
+    if (!GetCachePath(path))
+        return;
+
+    std::ostringstream ss;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        for (std::map<String, Entry>::iterator it = g_mapEntries.begin(); it != g_mapEntries.end(); ++it)
+        {
+            const Entry& entry = it->second;
+            if (entry.state != StateVerified || !entry.hasIdentity)
+                continue;
+
+            ss << (unsigned long long) entry.identity.fileId << " " << (unsigned long long) entry.identity.size << " " <<
+                (long long) entry.identity.mtime << " " << CefString(entry.digest).ToString() << " " << CefString(it->first).ToString() << "\n";
+        }
+    }
+
+    FILE* file = _tfopen(path.c_str(), TEXT("wb"));
+    if (!file)
+        return;
+
+    std::string data = ss.str();
+    fwrite(data.data(), 1, data.length(), file);
+    fclose(file);
+}
+
+static bool HashResource(const String& resourceName, String& digest)
+{
+    CefRefPtr<CefStreamReader> stream = GetBinaryResourceReader(resourceName.c_str());
+    if (!stream.get())
+        return false;
+
+    HashUtil::Sha256 sha;
+    char buf[65536];
+    size_t len;
+    while ((len = stream->Read(buf, 1, sizeof(buf))) > 0)
+        sha.Update(buf, len);
+
+    uint8_t result[SHA256_DIGEST_SIZE];
+    sha.Final(result);
+    digest = HashUtil::ToHex(result, SHA256_DIGEST_SIZE);
+
+    return true;
+}
+
+static void VerifyAll()
+{
+    std::vector<String> names;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        for (std::map<String, Entry>::iterator it = g_mapEntries.begin(); it != g_mapEntries.end(); ++it)
+            if (it->second.state == StateUnverified)
+                names.push_back(it->first);
+    }
+
+    if (names.empty())
+        return;
+
+    {
+        WorkerPool pool;
+        for (std::vector<String>::iterator it = names.begin(); it != names.end(); ++it)
+            pool.Post(std::bind(VerifyResource, *it));
+        pool.Wait();
+    }
+
+    SaveMarkers();
+}
+
+
+void Start()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        LoadManifest();
+        if (g_mapEntries.empty())
+            return;
+        LoadMarkers();
+    }
+
+    g_thread = std::thread(VerifyAll);
+}
+
+void Stop()
+{
+    if (g_thread.joinable())
+        g_thread.join();
+}
+
+bool VerifyResource(const String& resourceName)
+{
+    String expectedDigest;
+    bool hasMarker;
+    ResourceIdentity marker;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        std::map<String, Entry>::iterator it = g_mapEntries.find(resourceName);
+        if (it == g_mapEntries.end())
+            return true;
+
+        if (it->second.state != StateUnverified)
+            return it->second.state == StateVerified;
+
+        expectedDigest = it->second.digest;
+        hasMarker = it->second.hasIdentity;
+        marker = it->second.identity;
+    }
+
+    ResourceIdentity identity;
+    bool hasIdentity = GetResourceIdentity(resourceName.c_str(), identity);
+
+    // the file hasn't changed since it has been verified
+    State state = StateUnverified;
+    if (hasMarker && hasIdentity && IsSameResourceIdentity(marker, identity))
+        state = StateVerified;
+    else
+    {
+        String digest;
+        state = HashResource(resourceName, digest) && digest == expectedDigest ? StateVerified : StateTampered;
+    }
+
+    if (state == StateTampered)
+        App::Log(TEXT("Integrity check failed for resource ") + resourceName);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    Entry& entry = g_mapEntries[resourceName];
+    entry.state = state;
+    entry.hasIdentity = hasIdentity;
+    if (hasIdentity)
+        entry.identity = identity;
+
+    return state == StateVerified;
+}
+
+} // namespace ResourceIntegrity
@@ -0,0 +1,73 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __resource_integrity_h
+#define __resource_integrity_h
+
+
+#include "types.h"
+
+
+// Name of the resource containing the digests, generated by scripts/make_integrity_manifest.py
+#define INTEGRITY_MANIFEST_NAME TEXT("integrity.sha256")
+
+// Name of the file in the application data directory the verified markers are cached in
+#define INTEGRITY_CACHE_NAME TEXT("integrity.cache")
+
+
+//
+// Tamper detection for the app resources.
+//
+// The integrity manifest lists the SHA-256 digest of each resource. A
+// resource is verified the first time it is served, and all resources are
+// verified in the background on a worker pool after startup. Once a resource
+// has been verified, a marker with the identity (inode, size, modification
+// time) of the file it is read from is cached on disk, so that on the next
+// start it needn't be hashed again unless the file has changed.
+//
+// If there is no manifest, all resources are considered valid.
+//
+namespace ResourceIntegrity {
+
+//
+// Loads the manifest and the cached markers, and starts verifying all
+// resources on a background thread.
+//
+void Start();
+
+//
+// Waits for the background verification to finish and saves the markers.
+//
+void Stop();
+
+//
+// Returns false if the resource's digest doesn't match the manifest.
+// Hashes the resource if it hasn't been verified yet.
+//
+bool VerifyResource(const String& resourceName);
+
+} // namespace ResourceIntegrity
+
+
+#endif
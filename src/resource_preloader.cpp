@@ -0,0 +1,197 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "resource_preloader.h"
+#include "resource_cache.h"
+#include "resource_filter.h"
+#include "resource_util.h"
+#include "worker_pool.h"
+#include "app.h"
+
+
+// Maximum number of threads loading resources in parallel
+#define MAX_PRELOAD_THREADS 4
+
+
+namespace ResourcePreloader {
+
+// Resources needed for the first page load.
+static const TCHAR* g_preloadManifest[] = {
+    // @PRELOAD_MANIFEST_START
+    TEXT("index.html"),
+    TEXT("js/zepto.js"),
+    TEXT("css/screen.css"),
+    // @PRELOAD_MANIFEST_END
+};
+
+
+typedef std::chrono::steady_clock Clock;
+
+static std::thread g_thread;
+static std::mutex g_mutex;
+
+static Clock::time_point g_timeStart;
+
+// time (in microseconds) it took to load each preloaded resource
+static std::map<String, long long> g_mapLoadTimes;
+
+static long long g_preloadDuration = 0;
+static size_t g_numBytesPreloaded = 0;
+static int g_numThreads = 0;
+
+static int g_numCacheHits = 0;
+static int g_numCacheMisses = 0;
+static long long g_timeSaved = 0;
+static bool g_isReported = false;
+
+
+static long long MicrosecondsSince(Clock::time_point t)
+{
+    return (long long) std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count();
+}
+
+static void LoadResource(const TCHAR* resourceName)
+{
+    Clock::time_point t = Clock::now();
+
+    if (ResourceCache::Contains(resourceName))
+        return;
+
+    // taken before the file is opened so a change while it's read invalidates the cache entry
+    ResourceIdentity identity;
+    if (!GetResourceIdentity(resourceName, identity))
+        return;
+
+    CefRefPtr<CefStreamReader> stream = GetBinaryResourceReader(resourceName);
+    if (!stream.get())
+        return;
+
+    // the output is cached below rather than by the filter
+    if (ResourceFilter::IsFilteredMimeType(GetResourceMimeType(resourceName)))
+        stream = ResourceFilter::CreateReader(resourceName, stream, NULL);
+
+    std::string data;
+    char buf[16384];
+    size_t len;
+    while ((len = stream->Read(buf, 1, sizeof(buf))) > 0)
+        data.append(buf, len);
+
+    size_t size = data.size();
+    ResourceCache::Put(resourceName, identity, data);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_mapLoadTimes[resourceName] = MicrosecondsSince(t);
+    g_numBytesPreloaded += size;
+}
+
+static void Preload()
+{
+    int numResources = (int) (sizeof(g_preloadManifest) / sizeof(g_preloadManifest[0]));
+    if (numResources == 0)
+        return;
+
+    int numThreads = (int) std::thread::hardware_concurrency();
+    if (numThreads <= 0 || numThreads > MAX_PRELOAD_THREADS)
+        numThreads = MAX_PRELOAD_THREADS;
+    if (numThreads > numResources)
+        numThreads = numResources;
+
+    Clock::time_point t = Clock::now();
+
+    {
+        WorkerPool pool(numThreads);
+        for (int i = 0; i < numResources; ++i)
+            pool.Post(std::bind(LoadResource, g_preloadManifest[i]));
+        pool.Wait();
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_preloadDuration = MicrosecondsSince(t);
+    g_numThreads = numThreads;
+}
+
+
+void Start()
+{
+    g_timeStart = Clock::now();
+    g_thread = std::thread(Preload);
+}
+
+void Stop()
+{
+    if (g_thread.joinable())
+        g_thread.join();
+}
+
+void OnResourceServed(const String& resourceName, bool isCacheHit)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    if (g_isReported)
+        return;
+
+    std::map<String, long long>::iterator it = g_mapLoadTimes.find(resourceName);
+    if (it == g_mapLoadTimes.end())
+        return;
+
+    if (isCacheHit)
+    {
+        // the time it took to load the resource in the background didn't have to be spent on the request
+        ++g_numCacheHits;
+        g_timeSaved += it->second;
+    }
+    else
+        ++g_numCacheMisses;
+}
+
+void LogStartupTiming()
+{
+    StringStream ss;
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        if (g_isReported)
+            return;
+        g_isReported = true;
+
+        ss << TEXT("Startup timing: first page loaded after ") << (MicrosecondsSince(g_timeStart) / 1000) << TEXT(" ms");
+        ss << TEXT("; preloaded ") << g_mapLoadTimes.size() << TEXT(" resources (") << g_numBytesPreloaded << TEXT(" bytes)");
+        if (g_numThreads > 0)
+            ss << TEXT(" in ") << (g_preloadDuration / 1000) << TEXT(" ms on ") << g_numThreads << TEXT(" threads");
+        else
+            ss << TEXT(", preloading still in progress");
+        ss << TEXT("; ") << g_numCacheHits << TEXT(" requests served from the preload cache, ") << g_numCacheMisses << TEXT(" missed");
+        ss << TEXT("; estimated time saved: ") << (g_timeSaved / 1000.0) << TEXT(" ms");
+    }
+
+    App::Log(ss.str());
+}
+
+} // namespace ResourcePreloader
@@ -0,0 +1,67 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __resource_preloader_h
+#define __resource_preloader_h
+
+
+#include "types.h"
+
+
+//
+// Warms the critical resources listed in the preload manifest into the
+// ResourceCache while CEF is initializing and the browser is being created,
+// so the first page load doesn't have to wait for each resource to be loaded
+// (and filtered) when it is requested.
+//
+// The manifest is generated at build time by scripts/make_preload_manifest.py.
+//
+namespace ResourcePreloader {
+
+//
+// Starts loading the resources in the manifest on a background thread.
+//
+void Start();
+
+//
+// Waits for the background thread to finish.
+//
+void Stop();
+
+//
+// Records that a resource has been served; isCacheHit is true if it was
+// served from the ResourceCache.
+//
+void OnResourceServed(const String& resourceName, bool isCacheHit);
+
+//
+// Logs the startup timing report. Called when the main frame has finished
+// loading; only the first call has an effect.
+//
+void LogStartupTiming();
+
+} // namespace ResourcePreloader
+
+
+#endif
@@ -0,0 +1,308 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "resource_stats.h"
+#include "jsbridge.h"
+
+
+// URLs and MIME types longer than this are truncated in the records
+#define RECORD_MAX_URL_LENGTH 256
+#define RECORD_MAX_MIME_TYPE_LENGTH 64
+
+
+namespace ResourceStats {
+
+//
+// A request record. Plain data, so it can be copied in and out of the ring
+// buffer without synchronization other than the slot's sequence number.
+//
+struct Record
+{
+    TCHAR url[RECORD_MAX_URL_LENGTH];
+    TCHAR mimeType[RECORD_MAX_MIME_TYPE_LENGTH];
+    int source;
+    int status;
+    bool isCacheHit;
+    long long numBytes;
+
+    // all times are in microseconds
+    long long startTime;
+    long long timeToHeaders;
+    long long timeToLastByte;
+};
+
+//
+// A slot in the ring buffer. The sequence number is odd while the record is
+// being written and 2 * (index + 1) once the record with the given index has
+// been written completely.
+//
+struct Slot
+{
+    std::atomic<unsigned long long> seq;
+    Record record;
+};
+
+
+static Slot g_slots[RESOURCE_STATS_CAPACITY];
+
+// index of the next record to write
+static std::atomic<unsigned long long> g_head(0);
+
+static const std::chrono::steady_clock::time_point g_timeStart = std::chrono::steady_clock::now();
+
+
+static void CopyString(TCHAR* dest, size_t destSize, const String& src)
+{
+    size_t len = src.length() < destSize - 1 ? src.length() : destSize - 1;
+    memcpy(dest, src.c_str(), len * sizeof(TCHAR));
+    dest[len] = 0;
+}
+
+static void InitRecord(Record& record, const String& url, const String& mimeType, Source source, int status, bool isCacheHit, long long startTime)
+{
+    CopyString(record.url, RECORD_MAX_URL_LENGTH, url);
+    CopyString(record.mimeType, RECORD_MAX_MIME_TYPE_LENGTH, mimeType);
+    record.source = source;
+    record.status = status;
+    record.isCacheHit = isCacheHit;
+    record.numBytes = 0;
+    record.startTime = startTime;
+    record.timeToHeaders = -1;
+    record.timeToLastByte = -1;
+}
+
+//
+// Appends a record to the ring buffer, overwriting the oldest record.
+//
+static void Write(const Record& record)
+{
+    unsigned long long index = g_head.fetch_add(1);
+    Slot& slot = g_slots[index % RESOURCE_STATS_CAPACITY];
+
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+}
+
+//
+// Calls fnx for each complete record in the ring buffer, oldest first.
+// Records which are being overwritten while they are read are skipped.
+//
+template<typename F> static void ForEachRecord(F fnx)
+{
+    unsigned long long head = g_head.load(std::memory_order_acquire);
+    unsigned long long first = head > RESOURCE_STATS_CAPACITY ? head - RESOURCE_STATS_CAPACITY : 0;
+
+    for (unsigned long long index = first; index < head; ++index)
+    {
+        Slot& slot = g_slots[index % RESOURCE_STATS_CAPACITY];
+
+        unsigned long long seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * index + 2)
+            continue;
+
+        Record record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq)
+            continue;
+
+        fnx(record);
+    }
+}
+
+static const TCHAR* GetSourceName(int source)
+{
+    switch (source)
+    {
+    case SourceBlocked:
+        return TEXT("blocked");
+    case SourceNotModified:
+        return TEXT("not-modified");
+    case SourceMemoryCache:
+        return TEXT("memory-cache");
+    case SourceZipBundle:
+        return TEXT("zip-bundle");
+    case SourceResources:
+        return TEXT("resources");
+    default:
+        return TEXT("not-found");
+    }
+}
+
+
+//
+// Forwards all calls to the wrapped handler and measures the response.
+// Resource handlers are only called on the IO thread.
+//
+class InstrumentedResourceHandler : public CefResourceHandler
+{
+public:
+    InstrumentedResourceHandler(CefRefPtr<CefResourceHandler> handler, const Record& record)
+        : m_handler(handler), m_record(record), m_isRecorded(false)
+    {
+    }
+
+    virtual ~InstrumentedResourceHandler()
+    {
+        Commit();
+    }
+
+    virtual bool ProcessRequest(CefRefPtr<CefRequest> request, CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        return m_handler->ProcessRequest(request, callback);
+    }
+
+    virtual void GetResponseHeaders(CefRefPtr<CefResponse> response, int64& response_length, CefString& redirectUrl) OVERRIDE
+    {
+        m_handler->GetResponseHeaders(response, response_length, redirectUrl);
+        m_record.status = response->GetStatus();
+        m_record.timeToHeaders = GetTime() - m_record.startTime;
+    }
+
+    virtual bool ReadResponse(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefCallback> callback) OVERRIDE
+    {
+        bool ret = m_handler->ReadResponse(data_out, bytes_to_read, bytes_read, callback);
+        if (ret)
+            m_record.numBytes += bytes_read;
+        else
+            Commit();
+
+        return ret;
+    }
+
+    virtual bool CanGetCookie(const CefCookie& cookie) OVERRIDE
+    {
+        return m_handler->CanGetCookie(cookie);
+    }
+
+    virtual bool CanSetCookie(const CefCookie& cookie) OVERRIDE
+    {
+        return m_handler->CanSetCookie(cookie);
+    }
+
+    virtual void Cancel() OVERRIDE
+    {
+        m_handler->Cancel();
+        Commit();
+    }
+
+private:
+    void Commit()
+    {
+        if (m_isRecorded)
+            return;
+
+        m_record.timeToLastByte = GetTime() - m_record.startTime;
+        Write(m_record);
+        m_isRecorded = true;
+    }
+
+private:
+    CefRefPtr<CefResourceHandler> m_handler;
+    Record m_record;
+    bool m_isRecorded;
+
+    IMPLEMENT_REFCOUNTING(InstrumentedResourceHandler);
+};
+
+
+CefRefPtr<CefResourceHandler> Instrument(CefRefPtr<CefResourceHandler> handler,
+    const String& url, const String& mimeType, Source source, bool isCacheHit, long long startTime)
+{
+    Record record;
+    InitRecord(record, url, mimeType, source, 0, isCacheHit, startTime);
+    return new InstrumentedResourceHandler(handler, record);
+}
+
+void AddRecord(const String& url, const String& mimeType, Source source, int status, long long startTime)
+{
+    Record record;
+    InitRecord(record, url, mimeType, source, status, false, startTime);
+    record.timeToHeaders = record.timeToLastByte = GetTime() - startTime;
+    Write(record);
+}
+
+long long GetTime()
+{
+    return (long long) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_timeStart).count();
+}
+
+JavaScript::Array GetRecords()
+{
+    JavaScript::Array records = JavaScript::CreateArray();
+
+    ForEachRecord([&records](const Record& record)
+    {
+        JavaScript::Object obj = JavaScript::CreateObject();
+        obj->SetString(TEXT("url"), record.url);
+        obj->SetString(TEXT("source"), GetSourceName(record.source));
+        obj->SetString(TEXT("mimeType"), record.mimeType);
+        obj->SetDouble(TEXT("bytes"), (double) record.numBytes);
+        obj->SetBool(TEXT("cacheHit"), record.isCacheHit);
+        obj->SetInt(TEXT("status"), record.status);
+        obj->SetDouble(TEXT("startTime"), record.startTime / 1000.0);
+        obj->SetDouble(TEXT("timeToHeaders"), record.timeToHeaders / 1000.0);
+        obj->SetDouble(TEXT("timeToLastByte"), record.timeToLastByte / 1000.0);
+
+        records->SetDictionary(records->GetSize(), obj);
+    });
+
+    return records;
+}
+
+String ToJSON()
+{
+    StringStream ss;
+    bool isFirst = true;
+
+    ss << TEXT("[");
+    ForEachRecord([&ss, &isFirst](const Record& record)
+    {
+        if (!isFirst)
+            ss << TEXT(",");
+        isFirst = false;
+
+        ss << TEXT("{\"url\":\"") << JavaScript::JSONEscape(record.url) << TEXT("\"");
+        ss << TEXT(",\"source\":\"") << GetSourceName(record.source) << TEXT("\"");
+        ss << TEXT(",\"mimeType\":\"") << JavaScript::JSONEscape(record.mimeType) << TEXT("\"");
+        ss << TEXT(",\"bytes\":") << record.numBytes;
+        ss << TEXT(",\"cacheHit\":") << (record.isCacheHit ? TEXT("true") : TEXT("false"));
+        ss << TEXT(",\"status\":") << record.status;
+        ss << TEXT(",\"startTime\":") << (record.startTime / 1000.0);
+        ss << TEXT(",\"timeToHeaders\":") << (record.timeToHeaders / 1000.0);
+        ss << TEXT(",\"timeToLastByte\":") << (record.timeToLastByte / 1000.0);
+        ss << TEXT("}");
+    });
+    ss << TEXT("]");
+
+    return ss.str();
+}
+
+} // namespace ResourceStats
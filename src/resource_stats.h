@@ -0,0 +1,91 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __resource_stats_h
+#define __resource_stats_h
+
+
+#include "lib/Libcef/Include/cef_resource_handler.h"
+#include "types.h"
+
+
+// Number of request records kept; older records are overwritten
+#define RESOURCE_STATS_CAPACITY 1024
+
+
+//
+// Per-request instrumentation of the resources served by
+// ClientHandler::GetResourceHandler.
+//
+// Records are written into a fixed-size ring buffer without taking locks, so
+// the resource handlers on the IO thread never wait for a reader.
+//
+namespace ResourceStats {
+
+//
+// Where a response came from.
+//
+enum Source
+{
+    SourceNotFound,
+    SourceBlocked,
+    SourceNotModified,
+    SourceMemoryCache,
+    SourceZipBundle,
+    SourceResources
+};
+
+//
+// Wraps handler so that the time to headers, the time to the last byte
+// and the number of bytes served are recorded. startTime is the time the
+// request arrived (see GetTime).
+//
+CefRefPtr<CefResourceHandler> Instrument(CefRefPtr<CefResourceHandler> handler,
+    const String& url, const String& mimeType, Source source, bool isCacheHit, long long startTime);
+
+//
+// Records a request for which no response body is served (e.g., if the
+// resource doesn't exist).
+//
+void AddRecord(const String& url, const String& mimeType, Source source, int status, long long startTime);
+
+//
+// Returns the current time in microseconds on the clock used for the records.
+//
+long long GetTime();
+
+//
+// Returns the records as a list of dictionaries, oldest first.
+//
+JavaScript::Array GetRecords();
+
+//
+// Returns the records as a JSON array, oldest first.
+//
+String ToJSON();
+
+} // namespace ResourceStats
+
+
+#endif
@@ -0,0 +1,28 @@
+// Copyright (c) 2013 The Chromium Embedded Framework Authors. All rights
+// reserved. Use of this source code is governed by a BSD-style license that
+// can be found in the LICENSE file.
+
+#include "resource_util.h"
+
+
+String GetResourceMimeType(const String& resource_name)
+{
+    if (resource_name.find(TEXT(".html")) != String::npos)
+        return TEXT("text/html");
+    if (resource_name.find(TEXT(".css")) != String::npos)
+        return TEXT("text/css");
+    if (resource_name.find(TEXT(".js")) != String::npos)
+        return TEXT("text/javascript");
+    if (resource_name.find(TEXT(".png")) != String::npos)
+        return TEXT("image/png");
+    if (resource_name.find(TEXT(".jpg")) != String::npos || resource_name.find(TEXT(".jpeg")) != String::npos)
+        return TEXT("image/jpeg");
+    if (resource_name.find(TEXT(".woff")) != String::npos)
+        return TEXT("application/font-woff");
+    if (resource_name.find(TEXT(".ttf")) != String::npos)
+        return TEXT("application/x-font-ttf");
+    if (resource_name.find(TEXT(".svg")) != String::npos)
+        return TEXT("image/svg+xml");
+
+    return TEXT("");
+}
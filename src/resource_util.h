@@ -6,6 +6,7 @@
 #define CEF_TESTS_CEFCLIENT_RESOURCE_UTIL_H_
 #pragma once
 
+#include <stdint.h>
 #include <string>
 #include "include/cef_stream.h"
 #include "types.h"
@@ -22,6 +23,39 @@ bool LoadBinaryResource(const TCHAR* resource_name, String& resource_data);
 // Retrieve a resource as a steam reader.
 CefRefPtr<CefStreamReader> GetBinaryResourceReader(const TCHAR* resource_name);
 
+// Returns the MIME type of a resource derived from its name.
+String GetResourceMimeType(const String& resource_name);
+
+// Returns the path at which the app's zip bundle is expected (the bundle needn't exist).
+bool GetAppBundlePath(String& path);
+
+// Tests whether the resource is served from the app's zip bundle.
+bool IsBundledResource(const TCHAR* resource_name);
+
+// Identifies the file a resource is read from (the resource file itself, the
+// zip bundle or the executable) so changes can be detected without reading it.
+struct ResourceIdentity
+{
+    uint64_t fileId;    // inode or NTFS file index
+    uint64_t size;
+    int64_t mtime;
+};
+
+// Retrieve the identity of the file a resource is read from.
+bool GetResourceIdentity(const TCHAR* resource_name, ResourceIdentity& identity);
+
+inline bool IsSameResourceIdentity(const ResourceIdentity& a, const ResourceIdentity& b)
+{
+    return a.fileId == b.fileId && a.size == b.size && a.mtime == b.mtime;
+}
+
+// Retrieve the entity tag (a quoted hash of the contents) of a resource.
+bool GetResourceETag(const TCHAR* resource_name, String& etag);
+
+// Declare the values substituted for the placeholders in HTML and CSS resources
+// (system font, locale, application version, theme).
+void RegisterResourcePlaceholders();
+
 void FreeResources();
 
 
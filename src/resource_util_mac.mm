@@ -4,10 +4,12 @@
 // found in the LICENSE file.
 
 #import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
 #include <mach-o/dyld.h>
 #include <stdio.h>
 
 #include "resource_util.h"
+#include "resource_filter.h"
 #include "util.h"
 
 
@@ -67,3 +69,18 @@ bool GetResourceDir(std::string& dir)
         return false;
     }
 }
+
+void RegisterResourcePlaceholders()
+{
+    NSFont* font = [NSFont systemFontOfSize: [NSFont systemFontSize]];
+    if (font != nil)
+        ResourceFilter::SetPlaceholder(PLACEHOLDER_SYSTEM_FONT, [[font familyName] UTF8String]);
+
+    ResourceFilter::SetPlaceholder(PLACEHOLDER_LOCALE, [[[NSLocale currentLocale] localeIdentifier] UTF8String]);
+
+    NSString* version = [[[NSBundle mainBundle] infoDictionary] objectForKey: @"CFBundleShortVersionString"];
+    ResourceFilter::SetPlaceholder(PLACEHOLDER_VERSION, version != nil ? [version UTF8String] : "");
+
+    NSString* style = [[NSUserDefaults standardUserDefaults] stringForKey: @"AppleInterfaceStyle"];
+    ResourceFilter::SetPlaceholder(PLACEHOLDER_THEME, [style isEqualToString: @"Dark"] ? "dark" : "default");
+}
@@ -4,9 +4,29 @@
 
 #include "resource_util.h"
 #include <stdio.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <mutex>
+
+#include "hash_util.h"
+#include "zip_bundle.h"
 
 namespace {
 
+struct ETagEntry
+{
+    off_t size;
+    time_t mtime;
+    std::string etag;
+};
+
+// Entity tags computed so far, keyed by resource path. An entry is only valid
+// as long as the size and modification time of the file haven't changed.
+std::map<std::string, ETagEntry> g_mapETags;
+std::mutex g_mutexETags;
+
+
 bool FileExists(const char* path)
 {
     FILE* f = fopen(path, "rb");
@@ -19,6 +39,51 @@ bool FileExists(const char* path)
     return false;
 }
 
+bool GetResourcePath(const char* resource_name, std::string& path)
+{
+    if (!GetResourceDir(path))
+        return false;
+
+    path.append("/");
+    path.append(resource_name);
+    return true;
+}
+
+//
+// Returns the zip archive containing the app resources if the app is
+// shipped as a bundle in the resource directory, or NULL otherwise.
+//
+CefRefPtr<ZipBundle> GetAppBundle()
+{
+    static CefRefPtr<ZipBundle> bundle;
+    static std::once_flag flag;
+
+    std::call_once(flag, []()
+    {
+        std::string path;
+        if (GetAppBundlePath(path) && FileExists(path.c_str()))
+            bundle = ZipBundle::Open(path);
+    });
+
+    return bundle;
+}
+
+bool HashFile(const char* path, uint64_t& hash)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    char buf[1 << 16];
+    size_t len;
+    hash = HashUtil::FNV1A64_OFFSET_BASIS;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+        hash = HashUtil::Fnv1a64(buf, len, hash);
+    fclose(file);
+
+    return true;
+}
+
 bool ReadFileToString(const char* path, std::string& data)
 {
     // Implementation adapted from base/file_util.cc
@@ -52,6 +117,10 @@ bool LoadBinaryResource(const char* resource_name, std::string& resource_data)
 
 CefRefPtr<CefStreamReader> GetBinaryResourceReader(const char* resource_name)
 {
+    CefRefPtr<ZipBundle> bundle = GetAppBundle();
+    if (bundle.get() && bundle->HasFile(resource_name))
+        return bundle->GetStreamReader(resource_name);
+
     std::string path;
     if  (!GetResourceDir(path))
         return NULL;
@@ -64,3 +133,69 @@ CefRefPtr<CefStreamReader> GetBinaryResourceReader(const char* resource_name)
 
     return CefStreamReader::CreateForFile(path);
 }
+
+bool GetAppBundlePath(std::string& path)
+{
+    return GetResourcePath(APP_BUNDLE_NAME, path);
+}
+
+bool IsBundledResource(const char* resource_name)
+{
+    CefRefPtr<ZipBundle> bundle = GetAppBundle();
+    return bundle.get() && bundle->HasFile(resource_name);
+}
+
+bool GetResourceIdentity(const char* resource_name, ResourceIdentity& identity)
+{
+    std::string path;
+    if (IsBundledResource(resource_name))
+        GetAppBundlePath(path);
+    else if (!GetResourcePath(resource_name, path))
+        return false;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+    identity.fileId = (uint64_t) st.st_ino;
+    identity.size = (uint64_t) st.st_size;
+    identity.mtime = (int64_t) st.st_mtime;
+
+    return true;
+}
+
+bool GetResourceETag(const char* resource_name, std::string& etag)
+{
+    CefRefPtr<ZipBundle> bundle = GetAppBundle();
+    if (bundle.get() && bundle->HasFile(resource_name))
+        return bundle->GetETag(resource_name, etag);
+
+    std::string path;
+    if (!GetResourcePath(resource_name, path))
+        return false;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(g_mutexETags);
+
+    // hash the file lazily on first access and whenever it changes
+    ETagEntry& entry = g_mapETags[path];
+    if (entry.etag.empty() || entry.size != st.st_size || entry.mtime != st.st_mtime)
+    {
+        uint64_t hash;
+        if (!HashFile(path.c_str(), hash))
+        {
+            g_mapETags.erase(path);
+            return false;
+        }
+
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+        entry.etag = "\"" + HashUtil::ToHex(hash) + "\"";
+    }
+
+    etag = entry.etag;
+    return true;
+}
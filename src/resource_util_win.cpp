@@ -2,20 +2,31 @@
 // reserved. Use of this source code is governed by a BSD-style license that
 // can be found in the LICENSE file.
 
+#include <stdio.h>
 #include <string.h>
 #include <tchar.h>
 
+#include <map>
+#include <mutex>
+
 #include "lib/Libcef/Include/cef_stream.h"
 #include "lib/Libcef/Include/wrapper/cef_byte_read_handler.h"
 
 #include "resource_util.h"
 #include "resource.h"
+#include "resource_cache.h"
+#include "resource_filter.h"
+#include "hash_util.h"
+#include "zip_bundle.h"
 #include "util.h"
 
 
 namespace {
 
-LPBYTE g_szMainCSS = NULL;
+// Entity tags of the resources, computed lazily; keyed by resource ID.
+// The resources are compiled into the executable and can't change while running.
+std::map<int, String> g_mapETags;
+std::mutex g_mutexETags;
 
 
 bool LoadBinaryResource(int binaryId, DWORD &dwSize, LPBYTE &pBytes)
@@ -59,6 +70,65 @@ int GetResourceId(const TCHAR* resource_name)
 	return 0;
 }
 
+//
+// Returns the zip archive containing the app resources if the app is
+// shipped as a bundle next to the executable, or NULL otherwise.
+//
+CefRefPtr<ZipBundle> GetAppBundle()
+{
+	static CefRefPtr<ZipBundle> bundle;
+	static std::once_flag flag;
+
+	std::call_once(flag, []()
+	{
+		String path;
+		if (GetAppBundlePath(path) && GetFileAttributes(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+			bundle = ZipBundle::Open(path);
+	});
+
+	return bundle;
+}
+
+std::string ToUTF8(const TCHAR* str)
+{
+	int len = WideCharToMultiByte(CP_UTF8, 0, str, -1, NULL, 0, NULL, NULL);
+	if (len <= 1)
+		return "";
+
+	std::string ret(len, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, str, -1, &ret[0], len, NULL, NULL);
+	ret.resize(len - 1);
+
+	return ret;
+}
+
+std::string GetAppVersion()
+{
+	TCHAR szPath[MAX_PATH];
+	GetModuleFileName(NULL, szPath, MAX_PATH);
+
+	DWORD dwHandle;
+	DWORD dwSize = GetFileVersionInfoSize(szPath, &dwHandle);
+	if (dwSize == 0)
+		return "";
+
+	std::string version;
+	LPBYTE pData = new BYTE[dwSize];
+	VS_FIXEDFILEINFO* pInfo = NULL;
+	UINT len = 0;
+
+	if (GetFileVersionInfo(szPath, 0, dwSize, pData) && VerQueryValue(pData, TEXT("\\"), (LPVOID*) &pInfo, &len) && pInfo != NULL)
+	{
+		char szVersion[64];
+		sprintf_s(szVersion, "%d.%d.%d",
+			HIWORD(pInfo->dwProductVersionMS), LOWORD(pInfo->dwProductVersionMS), HIWORD(pInfo->dwProductVersionLS));
+		version = szVersion;
+	}
+
+	delete[] pData;
+	return version;
+}
+
 }  // namespace
 
 
@@ -83,6 +153,10 @@ bool LoadBinaryResource(const TCHAR* resource_name, String& resource_data)
 
 CefRefPtr<CefStreamReader> GetBinaryResourceReader(const TCHAR* resource_name)
 {
+	CefRefPtr<ZipBundle> bundle = GetAppBundle();
+	if (bundle.get() && bundle->HasFile(resource_name))
+		return bundle->GetStreamReader(resource_name);
+
 	int resource_id = GetResourceId(resource_name);
 	if (resource_id == 0)
 		return NULL;
@@ -92,31 +166,6 @@ CefRefPtr<CefStreamReader> GetBinaryResourceReader(const TCHAR* resource_name)
 
 	if (LoadBinaryResource(resource_id, dwSize, pBytes))
 	{
-		// patch "_system-font_"
-		if (_tcscmp(resource_name, TEXT("style/base.css")) == 0)
-		{
-			if (g_szMainCSS != NULL)
-				pBytes = g_szMainCSS;
-			else
-			{
-				char* ptr = strstr((char*) pBytes, "_system-font_");
-				if (ptr != NULL)
-				{
-					g_szMainCSS = new BYTE[dwSize];
-					memcpy(g_szMainCSS, pBytes, dwSize);
-					ptr = (char*) (g_szMainCSS + ((LPBYTE) ptr - pBytes));
-					pBytes = g_szMainCSS;
-
-					LOGFONT logfont;
-					SystemParametersInfo(SPI_GETICONTITLELOGFONT, sizeof(LOGFONT), &logfont, 0);
-					char szFont[] = "             "; // strlen("_system-font_") + 1
-					WideCharToMultiByte(CP_UTF8, 0, logfont.lfFaceName, (int) _tcslen(logfont.lfFaceName), (LPSTR) szFont, 13, NULL, NULL);
-					for (int j = 0; j < 13; j++)
-						ptr[j] = szFont[j];
-				}
-			}
-		}
-
 		return CefStreamReader::CreateForHandler(new CefByteReadHandler(pBytes, dwSize, NULL));
 	}
 
@@ -124,8 +173,110 @@ CefRefPtr<CefStreamReader> GetBinaryResourceReader(const TCHAR* resource_name)
 	return NULL;
 }
 
+bool GetAppBundlePath(String& path)
+{
+	TCHAR szPath[MAX_PATH];
+	DWORD len = GetModuleFileName(NULL, szPath, MAX_PATH);
+	if (len == 0 || len >= MAX_PATH)
+		return false;
+
+	path = String(szPath, len);
+	path = path.substr(0, path.find_last_of(TEXT('\\')) + 1) + APP_BUNDLE_NAME;
+	return true;
+}
+
+bool IsBundledResource(const TCHAR* resource_name)
+{
+	CefRefPtr<ZipBundle> bundle = GetAppBundle();
+	return bundle.get() && bundle->HasFile(resource_name);
+}
+
+bool GetResourceIdentity(const TCHAR* resource_name, ResourceIdentity& identity)
+{
+	String path;
+	if (IsBundledResource(resource_name))
+		GetAppBundlePath(path);
+	else if (GetResourceId(resource_name) != 0)
+	{
+		// the resource is compiled into the executable
+		TCHAR szPath[MAX_PATH];
+		DWORD len = GetModuleFileName(NULL, szPath, MAX_PATH);
+		if (len == 0 || len >= MAX_PATH)
+			return false;
+		path = String(szPath, len);
+	}
+	else
+		return false;
+
+	HANDLE hFile = CreateFile(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	BY_HANDLE_FILE_INFORMATION info;
+	BOOL success = GetFileInformationByHandle(hFile, &info);
+	CloseHandle(hFile);
+	if (!success)
+		return false;
+
+	identity.fileId = ((uint64_t) info.nFileIndexHigh << 32) | info.nFileIndexLow;
+	identity.size = ((uint64_t) info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	identity.mtime = (int64_t) (((uint64_t) info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+
+	return true;
+}
+
+bool GetResourceETag(const TCHAR* resource_name, String& etag)
+{
+	CefRefPtr<ZipBundle> bundle = GetAppBundle();
+	if (bundle.get() && bundle->HasFile(resource_name))
+		return bundle->GetETag(resource_name, etag);
+
+	int resource_id = GetResourceId(resource_name);
+	if (resource_id == 0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(g_mutexETags);
+
+	std::map<int, String>::iterator it = g_mapETags.find(resource_id);
+	if (it != g_mapETags.end())
+	{
+		etag = it->second;
+		return true;
+	}
+
+	DWORD dwSize;
+	LPBYTE pBytes;
+	if (!LoadBinaryResource(resource_id, dwSize, pBytes))
+		return false;
+
+	etag = TEXT("\"") + HashUtil::ToHex(HashUtil::Fnv1a64(pBytes, dwSize)) + TEXT("\"");
+	g_mapETags[resource_id] = etag;
+
+	return true;
+}
+
+void RegisterResourcePlaceholders()
+{
+	LOGFONT logfont;
+	if (SystemParametersInfo(SPI_GETICONTITLELOGFONT, sizeof(LOGFONT), &logfont, 0))
+	{
+		ResourceFilter::SetPlaceholder(PLACEHOLDER_SYSTEM_FONT, ToUTF8(logfont.lfFaceName));
+		ResourceFilter::SetPlaceholder(PLACEHOLDER_SYSTEM_FONT_LEGACY, ToUTF8(logfont.lfFaceName));
+	}
+
+	TCHAR szLocale[LOCALE_NAME_MAX_LENGTH];
+	if (GetUserDefaultLocaleName(szLocale, LOCALE_NAME_MAX_LENGTH) > 0)
+		ResourceFilter::SetPlaceholder(PLACEHOLDER_LOCALE, ToUTF8(szLocale));
+
+	ResourceFilter::SetPlaceholder(PLACEHOLDER_VERSION, GetAppVersion());
+
+	HIGHCONTRAST hc;
+	hc.cbSize = sizeof(HIGHCONTRAST);
+	bool isHighContrast = SystemParametersInfo(SPI_GETHIGHCONTRAST, sizeof(HIGHCONTRAST), &hc, 0) && (hc.dwFlags & HCF_HIGHCONTRASTON);
+	ResourceFilter::SetPlaceholder(PLACEHOLDER_THEME, isHighContrast ? "high-contrast" : "default");
+}
+
 void FreeResources()
 {
-	if (g_szMainCSS != NULL)
-		delete[] g_szMainCSS;
+	ResourceCache::Clear();
 }
@@ -0,0 +1,1078 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <string.h>
+
+#include "search_pattern.h"
+#include "simd_util.h"
+
+
+// the maximum nesting depth of groups
+#define MAX_DEPTH 100
+
+// the maximum count in a "{m,n}" quantifier
+#define MAX_REPEAT 1000
+
+// the code points standing for bytes which aren't part of a valid UTF-8
+// sequence (the byte is added)
+#define INVALID_BYTE_BASE 0x110000
+
+
+enum NodeType
+{
+    NODE_CHAR,
+    NODE_ANY,
+    NODE_CLASS,
+    NODE_BEGIN_LINE,
+    NODE_END_LINE,
+    NODE_WORD_BOUNDARY,
+    NODE_NOT_WORD_BOUNDARY,
+    NODE_EMPTY,
+    NODE_CONCAT,
+    NODE_ALTERNATE,
+    NODE_REPEAT
+};
+
+enum Opcode
+{
+    OP_CHAR,
+    OP_ANY,
+    OP_CLASS,
+    OP_BEGIN_LINE,
+    OP_END_LINE,
+    OP_WORD_BOUNDARY,
+    OP_NOT_WORD_BOUNDARY,
+    OP_SPLIT,
+    OP_JMP,
+    OP_MATCH
+};
+
+
+static inline bool IsAlpha(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool IsDigit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool IsWordChar(int c)
+{
+    return IsAlpha(c) || IsDigit(c) || c == '_';
+}
+
+static inline bool IsSpace(int c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+static inline uint8_t ToLower(uint8_t c)
+{
+    return c >= 'A' && c <= 'Z' ? (uint8_t) (c + ('a' - 'A')) : c;
+}
+
+static inline int HexValue(int c)
+{
+    if (IsDigit(c))
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+//
+// Decodes the UTF-8 character at p, of which "length" bytes are available,
+// and sets n to the length of its sequence. If p doesn't start a valid
+// sequence, returns INVALID_BYTE_BASE plus the byte and sets n to 1.
+//
+static inline uint32_t DecodeChar(const uint8_t* p, size_t length, size_t& n)
+{
+    uint32_t c = p[0];
+    n = 1;
+    if (c < 0x80)
+        return c;
+
+    size_t seqLength = c >= 0xc2 && c <= 0xdf ? 2 : c >= 0xe0 && c <= 0xef ? 3 : c >= 0xf0 && c <= 0xf4 ? 4 : 0;
+    if (seqLength == 0 || seqLength > length)
+        return INVALID_BYTE_BASE + c;
+
+    uint32_t value = c & (0x7f >> seqLength);
+    for (size_t i = 1; i < seqLength; ++i)
+    {
+        if ((p[i] & 0xc0) != 0x80)
+            return INVALID_BYTE_BASE + c;
+        value = (value << 6) | (p[i] & 0x3f);
+    }
+
+    n = seqLength;
+    return value;
+}
+
+
+void SearchPattern::CharClass::AddRange(uint32_t first, uint32_t last)
+{
+    for (uint32_t c = first; c <= last && c < 256; ++c)
+        Set((int) c);
+
+    if (last >= 256)
+        ranges.push_back(std::make_pair(first < 256 ? 256 : first, last));
+}
+
+bool SearchPattern::CharClass::Contains(uint32_t c) const
+{
+    if (c < 256)
+        return Test((int) c);
+
+    bool isInRange = false;
+    for (size_t i = 0; i < ranges.size() && !isInRange; ++i)
+        isInRange = c >= ranges[i].first && c <= ranges[i].second;
+
+    return isInRange != isNegated;
+}
+
+
+SearchPattern::SearchPattern()
+    : m_caseInsensitive(false), m_isLiteral(false)
+{
+}
+
+int SearchPattern::AddNode(int type, int value)
+{
+    Node node;
+    node.type = type;
+    node.value = value;
+    node.min = 0;
+    node.max = 0;
+    node.isGreedy = true;
+    m_nodes.push_back(node);
+
+    return (int) m_nodes.size() - 1;
+}
+
+int SearchPattern::AddClass(const CharClass& cls)
+{
+    m_classes.push_back(cls);
+    return AddNode(NODE_CLASS, (int) m_classes.size() - 1);
+}
+
+//
+// Adds the characters of the escape sequences "\d", "\w" and "\s" (or their
+// negations, which include all non-ASCII characters) to the class. Returns
+// false if c isn't one of these.
+//
+bool SearchPattern::AddClassEscape(int c, CharClass& cls)
+{
+    bool (*fnxTest)(int) = NULL;
+    switch (c)
+    {
+    case 'd': case 'D':
+        fnxTest = IsDigit;
+        break;
+    case 'w': case 'W':
+        fnxTest = IsWordChar;
+        break;
+    case 's': case 'S':
+        fnxTest = IsSpace;
+        break;
+    default:
+        return false;
+    }
+
+    bool isNegated = c == 'D' || c == 'W' || c == 'S';
+    for (int ch = 0; ch < 256; ++ch)
+        if (fnxTest(ch) != isNegated)
+            cls.Set(ch);
+
+    if (isNegated)
+        cls.AddRange(256, 0xffffffffu);
+
+    return true;
+}
+
+//
+// Returns the character of a single-character escape sequence, or -1.
+//
+static int GetEscapedChar(const std::string& pattern, size_t& pos)
+{
+    int c = (uint8_t) pattern[pos];
+    switch (c)
+    {
+    case 't': ++pos; return '\t';
+    case 'n': ++pos; return '\n';
+    case 'r': ++pos; return '\r';
+    case 'f': ++pos; return '\f';
+    case 'v': ++pos; return '\v';
+    case 'x':
+        if (pos + 2 < pattern.length() && HexValue(pattern[pos + 1]) >= 0 && HexValue(pattern[pos + 2]) >= 0)
+        {
+            int value = HexValue(pattern[pos + 1]) * 16 + HexValue(pattern[pos + 2]);
+            pos += 3;
+            return value;
+        }
+        return -1;
+    }
+
+    // escaped punctuation stands for itself
+    if (!IsWordChar(c) && c < 0x80)
+    {
+        ++pos;
+        return c;
+    }
+
+    return -1;
+}
+
+//
+// Returns the code point of the (unescaped) UTF-8 character at pos, or -1 if
+// the pattern isn't valid UTF-8.
+//
+static int GetPatternChar(const std::string& pattern, size_t& pos)
+{
+    size_t n = 0;
+    uint32_t c = DecodeChar((const uint8_t*) pattern.data() + pos, pattern.length() - pos, n);
+    pos += n;
+    return c < INVALID_BYTE_BASE ? (int) c : -1;
+}
+
+bool SearchPattern::ParseClass(const std::string& pattern, size_t& pos, CharClass& cls)
+{
+    bool isNegated = false;
+    if (pos < pattern.length() && pattern[pos] == '^')
+    {
+        isNegated = true;
+        ++pos;
+    }
+
+    bool isFirst = true;
+    for ( ; ; )
+    {
+        if (pos >= pattern.length())
+            return false;
+
+        int c = (uint8_t) pattern[pos];
+        if (c == ']' && !isFirst)
+        {
+            ++pos;
+            break;
+        }
+
+        isFirst = false;
+
+        if (c == '\\')
+        {
+            if (++pos >= pattern.length())
+                return false;
+
+            if (AddClassEscape((uint8_t) pattern[pos], cls))
+            {
+                ++pos;
+                continue;
+            }
+
+            c = GetEscapedChar(pattern, pos);
+        }
+        else
+            c = GetPatternChar(pattern, pos);
+
+        if (c < 0)
+            return false;
+
+        // a range
+        int last = c;
+        if (pos + 1 < pattern.length() && pattern[pos] == '-' && pattern[pos + 1] != ']')
+        {
+            ++pos;
+            if (pattern[pos] == '\\')
+            {
+                if (++pos >= pattern.length())
+                    return false;
+                last = GetEscapedChar(pattern, pos);
+            }
+            else
+                last = GetPatternChar(pattern, pos);
+
+            if (last < c)
+                return false;
+        }
+
+        cls.AddRange((uint32_t) c, (uint32_t) last);
+    }
+
+    // fold the case before negating, so "[^a]" excludes "A" as well
+    if (m_caseInsensitive)
+    {
+        for (int ch = 'a'; ch <= 'z'; ++ch)
+        {
+            if (cls.Test(ch) || cls.Test(ch - 'a' + 'A'))
+            {
+                cls.Set(ch);
+                cls.Set(ch - 'a' + 'A');
+            }
+        }
+    }
+
+    if (isNegated)
+    {
+        for (int i = 0; i < 8; ++i)
+            cls.bits[i] = ~cls.bits[i];
+        cls.isNegated = true;
+    }
+
+    return true;
+}
+
+bool SearchPattern::ParseQuantifier(const std::string& pattern, size_t& pos, int& min, int& max)
+{
+    char c = pattern[pos];
+    if (c == '*' || c == '+' || c == '?')
+    {
+        min = c == '+' ? 1 : 0;
+        max = c == '?' ? 1 : -1;
+        ++pos;
+        return true;
+    }
+
+    if (c != '{')
+        return false;
+
+    // "{m}", "{m,}" or "{m,n}"; otherwise the brace is a literal
+    size_t p = pos + 1;
+    int values[2] = { 0, -1 };
+    int numValues = 0;
+    bool hasComma = false;
+
+    for ( ; numValues < 2; )
+    {
+        if (p >= pattern.length() || !IsDigit(pattern[p]))
+        {
+            if (numValues == 1 && hasComma)
+                break;
+            return false;
+        }
+
+        int value = 0;
+        for ( ; p < pattern.length() && IsDigit(pattern[p]); ++p)
+        {
+            value = value * 10 + (pattern[p] - '0');
+            if (value > MAX_REPEAT)
+                return false;
+        }
+
+        values[numValues++] = value;
+
+        if (p < pattern.length() && pattern[p] == ',' && !hasComma)
+        {
+            hasComma = true;
+            ++p;
+        }
+        else
+            break;
+    }
+
+    if (p >= pattern.length() || pattern[p] != '}')
+        return false;
+
+    min = values[0];
+    max = hasComma ? values[1] : values[0];
+    if (max >= 0 && max < min)
+        return false;
+
+    pos = p + 1;
+    return true;
+}
+
+int SearchPattern::ParseAtom(const std::string& pattern, size_t& pos, int depth)
+{
+    int c = (uint8_t) pattern[pos];
+
+    switch (c)
+    {
+    case '(':
+        {
+            if (depth >= MAX_DEPTH)
+                return -1;
+
+            ++pos;
+            if (pattern.compare(pos, 2, "?:") == 0)
+                pos += 2;
+
+            int node = ParseAlternatives(pattern, pos, depth + 1);
+            if (node < 0 || pos >= pattern.length() || pattern[pos] != ')')
+                return -1;
+
+            ++pos;
+            return node;
+        }
+
+    case '[':
+        {
+            ++pos;
+            CharClass cls;
+            if (!ParseClass(pattern, pos, cls))
+                return -1;
+            return AddClass(cls);
+        }
+
+    case '.':
+        ++pos;
+        return AddNode(NODE_ANY, 0);
+
+    case '^':
+        ++pos;
+        return AddNode(NODE_BEGIN_LINE, 0);
+
+    case '$':
+        ++pos;
+        return AddNode(NODE_END_LINE, 0);
+
+    case '*':
+    case '+':
+    case '?':
+        // nothing to repeat
+        return -1;
+
+    case '\\':
+        {
+            if (++pos >= pattern.length())
+                return -1;
+
+            c = (uint8_t) pattern[pos];
+            if (c == 'b' || c == 'B')
+            {
+                ++pos;
+                return AddNode(c == 'b' ? NODE_WORD_BOUNDARY : NODE_NOT_WORD_BOUNDARY, 0);
+            }
+
+            CharClass cls;
+            if (AddClassEscape(c, cls))
+            {
+                ++pos;
+                return AddClass(cls);
+            }
+
+            c = GetEscapedChar(pattern, pos);
+            if (c < 0x80)
+                return c < 0 ? -1 : AddNode(NODE_CHAR, c);
+
+            // "\xhh" stands for the code point, i.e., its UTF-8 sequence
+            int node = AddNode(NODE_CONCAT, 0);
+            int lead = AddNode(NODE_CHAR, 0xc0 | (c >> 6));
+            int trail = AddNode(NODE_CHAR, 0x80 | (c & 0x3f));
+            m_nodes[node].children.push_back(lead);
+            m_nodes[node].children.push_back(trail);
+            return node;
+        }
+    }
+
+    // a UTF-8 sequence is a single atom, so a quantifier applies to the
+    // whole character
+    size_t length = 1;
+    if (c >= 0xc0)
+        for ( ; pos + length < pattern.length() && ((uint8_t) pattern[pos + length] & 0xc0) == 0x80; ++length)
+            ;
+
+    if (length == 1)
+    {
+        ++pos;
+        return AddNode(NODE_CHAR, c);
+    }
+
+    int node = AddNode(NODE_CONCAT, 0);
+    for (size_t i = 0; i < length; ++i)
+    {
+        int child = AddNode(NODE_CHAR, (uint8_t) pattern[pos++]);
+        m_nodes[node].children.push_back(child);
+    }
+
+    return node;
+}
+
+int SearchPattern::ParseSequence(const std::string& pattern, size_t& pos, int depth)
+{
+    int node = AddNode(NODE_CONCAT, 0);
+
+    while (pos < pattern.length() && pattern[pos] != '|' && pattern[pos] != ')')
+    {
+        int atom = -1;
+        int min = 0;
+        int max = 0;
+
+        // a brace which doesn't start a quantifier is a literal
+        if (pattern[pos] == '{')
+        {
+            size_t p = pos;
+            if (ParseQuantifier(pattern, p, min, max))
+                return -1;
+            atom = AddNode(NODE_CHAR, '{');
+            ++pos;
+        }
+        else
+            atom = ParseAtom(pattern, pos, depth);
+
+        if (atom < 0)
+            return -1;
+
+        while (pos < pattern.length() && ParseQuantifier(pattern, pos, min, max))
+        {
+            bool isGreedy = true;
+            if (pos < pattern.length() && pattern[pos] == '?')
+            {
+                isGreedy = false;
+                ++pos;
+            }
+
+            int repeat = AddNode(NODE_REPEAT, 0);
+            m_nodes[repeat].children.push_back(atom);
+            m_nodes[repeat].min = min;
+            m_nodes[repeat].max = max;
+            m_nodes[repeat].isGreedy = isGreedy;
+            atom = repeat;
+        }
+
+        m_nodes[node].children.push_back(atom);
+    }
+
+    return node;
+}
+
+int SearchPattern::ParseAlternatives(const std::string& pattern, size_t& pos, int depth)
+{
+    int first = ParseSequence(pattern, pos, depth);
+    if (first < 0 || pos >= pattern.length() || pattern[pos] != '|')
+        return first;
+
+    int node = AddNode(NODE_ALTERNATE, 0);
+    m_nodes[node].children.push_back(first);
+
+    while (pos < pattern.length() && pattern[pos] == '|')
+    {
+        ++pos;
+        int alternative = ParseSequence(pattern, pos, depth);
+        if (alternative < 0)
+            return -1;
+        m_nodes[node].children.push_back(alternative);
+    }
+
+    return node;
+}
+
+int SearchPattern::EmitInstruction(int op, int arg, int arg2)
+{
+    Instruction instruction;
+    instruction.op = op;
+    instruction.arg = arg;
+    instruction.arg2 = arg2;
+    m_program.push_back(instruction);
+
+    return (int) m_program.size() - 1;
+}
+
+bool SearchPattern::Emit(int node)
+{
+    if (m_program.size() > SEARCH_PATTERN_MAX_PROGRAM_SIZE)
+        return false;
+
+    const Node& n = m_nodes[node];
+
+    switch (n.type)
+    {
+    case NODE_CHAR:
+        if (m_caseInsensitive && IsAlpha(n.value))
+        {
+            CharClass cls;
+            cls.Set(ToLower((uint8_t) n.value));
+            cls.Set(ToLower((uint8_t) n.value) - ('a' - 'A'));
+            m_classes.push_back(cls);
+            EmitInstruction(OP_CLASS, (int) m_classes.size() - 1);
+        }
+        else
+            EmitInstruction(OP_CHAR, n.value);
+        break;
+
+    case NODE_ANY:
+        EmitInstruction(OP_ANY);
+        break;
+
+    case NODE_CLASS:
+        EmitInstruction(OP_CLASS, n.value);
+        break;
+
+    case NODE_BEGIN_LINE:
+        EmitInstruction(OP_BEGIN_LINE);
+        break;
+
+    case NODE_END_LINE:
+        EmitInstruction(OP_END_LINE);
+        break;
+
+    case NODE_WORD_BOUNDARY:
+        EmitInstruction(OP_WORD_BOUNDARY);
+        break;
+
+    case NODE_NOT_WORD_BOUNDARY:
+        EmitInstruction(OP_NOT_WORD_BOUNDARY);
+        break;
+
+    case NODE_EMPTY:
+        break;
+
+    case NODE_CONCAT:
+        for (size_t i = 0; i < n.children.size(); ++i)
+            if (!Emit(n.children[i]))
+                return false;
+        break;
+
+    case NODE_ALTERNATE:
+        {
+            std::vector<int> jumps;
+            for (size_t i = 0; i + 1 < n.children.size(); ++i)
+            {
+                int split = EmitInstruction(OP_SPLIT);
+                m_program[split].arg = (int) m_program.size();
+                if (!Emit(n.children[i]))
+                    return false;
+                jumps.push_back(EmitInstruction(OP_JMP));
+                m_program[split].arg2 = (int) m_program.size();
+            }
+
+            if (!Emit(n.children.back()))
+                return false;
+
+            for (size_t i = 0; i < jumps.size(); ++i)
+                m_program[jumps[i]].arg = (int) m_program.size();
+        }
+        break;
+
+    case NODE_REPEAT:
+        {
+            int child = n.children[0];
+            for (int i = 0; i < n.min; ++i)
+                if (!Emit(child))
+                    return false;
+
+            if (n.max < 0)
+            {
+                // a loop
+                int split = EmitInstruction(OP_SPLIT);
+                int body = (int) m_program.size();
+                if (!Emit(child))
+                    return false;
+                EmitInstruction(OP_JMP, split);
+
+                int out = (int) m_program.size();
+                m_program[split].arg = n.isGreedy ? body : out;
+                m_program[split].arg2 = n.isGreedy ? out : body;
+            }
+            else
+            {
+                // up to (max - min) optional repetitions
+                std::vector<int> splits;
+                for (int i = n.min; i < n.max; ++i)
+                {
+                    splits.push_back(EmitInstruction(OP_SPLIT));
+                    m_program[splits.back()].arg = (int) m_program.size();
+                    if (!Emit(child))
+                        return false;
+                }
+
+                int out = (int) m_program.size();
+                for (size_t i = 0; i < splits.size(); ++i)
+                {
+                    Instruction& instruction = m_program[splits[i]];
+                    int body = instruction.arg;
+                    instruction.arg = n.isGreedy ? body : out;
+                    instruction.arg2 = n.isGreedy ? out : body;
+                }
+            }
+        }
+        break;
+    }
+
+    return m_program.size() <= SEARCH_PATTERN_MAX_PROGRAM_SIZE;
+}
+
+std::string SearchPattern::GetRequiredLiteral(int node) const
+{
+    const Node& n = m_nodes[node];
+
+    switch (n.type)
+    {
+    case NODE_CHAR:
+        return std::string(1, (char) (m_caseInsensitive ? ToLower((uint8_t) n.value) : n.value));
+
+    case NODE_CONCAT:
+        {
+            // the longest run of consecutive characters, or the longest
+            // literal required by a child
+            std::string best;
+            std::string run;
+            for (size_t i = 0; i < n.children.size(); ++i)
+            {
+                const Node& child = m_nodes[n.children[i]];
+                if (child.type == NODE_CHAR)
+                {
+                    run.append(1, (char) (m_caseInsensitive ? ToLower((uint8_t) child.value) : child.value));
+                    continue;
+                }
+
+                // assertions don't consume characters, so they don't break runs
+                if (child.type == NODE_BEGIN_LINE || child.type == NODE_END_LINE ||
+                    child.type == NODE_WORD_BOUNDARY || child.type == NODE_NOT_WORD_BOUNDARY)
+                {
+                    continue;
+                }
+
+                if (run.length() > best.length())
+                    best = run;
+                run.clear();
+
+                std::string literal = GetRequiredLiteral(n.children[i]);
+                if (literal.length() > best.length())
+                    best = literal;
+            }
+
+            return run.length() > best.length() ? run : best;
+        }
+
+    case NODE_REPEAT:
+        if (n.min >= 1)
+            return GetRequiredLiteral(n.children[0]);
+        break;
+    }
+
+    return std::string();
+}
+
+bool SearchPattern::Compile(const std::string& pattern, bool isRegex, bool caseInsensitive)
+{
+    m_caseInsensitive = caseInsensitive;
+    m_isLiteral = false;
+    m_literal.clear();
+    m_nodes.clear();
+    m_program.clear();
+    m_classes.clear();
+
+    if (pattern.length() == 0)
+        return false;
+
+    int root = -1;
+    if (isRegex)
+    {
+        size_t pos = 0;
+        root = ParseAlternatives(pattern, pos, 0);
+        if (root < 0 || pos < pattern.length())
+            return false;
+    }
+    else
+    {
+        root = AddNode(NODE_CONCAT, 0);
+        for (size_t i = 0; i < pattern.length(); ++i)
+        {
+            int child = AddNode(NODE_CHAR, (uint8_t) pattern[i]);
+            m_nodes[root].children.push_back(child);
+        }
+    }
+
+    if (!Emit(root))
+        return false;
+    EmitInstruction(OP_MATCH);
+
+    m_literal = GetRequiredLiteral(root);
+
+    // the occurrences of the literal are the matches if the pattern consists
+    // of characters only
+    const Node& n = m_nodes[root];
+    m_isLiteral = n.type == NODE_CHAR;
+    if (n.type == NODE_CONCAT && n.children.size() > 0)
+    {
+        m_isLiteral = true;
+        for (size_t i = 0; i < n.children.size(); ++i)
+            if (m_nodes[n.children[i]].type != NODE_CHAR)
+                m_isLiteral = false;
+    }
+
+    // the nodes aren't needed anymore
+    m_nodes.clear();
+    return true;
+}
+
+void SearchPattern::AddThread(std::vector<State::Thread>& list, State& state, unsigned int generation, int pc, int start, const uint8_t* line, size_t length, size_t pos) const
+{
+    // follow the instructions which don't consume characters; the alternative
+    // preferred by a split is followed first, so the list is ordered by priority
+    std::vector<int>& stack = state.m_stack;
+    stack.clear();
+    stack.push_back(pc);
+
+    while (!stack.empty())
+    {
+        pc = stack.back();
+        stack.pop_back();
+
+        if (state.m_marks[pc] == generation)
+            continue;
+        state.m_marks[pc] = generation;
+
+        const Instruction& instruction = m_program[pc];
+        switch (instruction.op)
+        {
+        case OP_JMP:
+            stack.push_back(instruction.arg);
+            break;
+
+        case OP_SPLIT:
+            stack.push_back(instruction.arg2);
+            stack.push_back(instruction.arg);
+            break;
+
+        case OP_BEGIN_LINE:
+            if (pos == 0)
+                stack.push_back(pc + 1);
+            break;
+
+        case OP_END_LINE:
+            if (pos == length)
+                stack.push_back(pc + 1);
+            break;
+
+        case OP_WORD_BOUNDARY:
+        case OP_NOT_WORD_BOUNDARY:
+            {
+                bool isWordBefore = pos > 0 && IsWordChar(line[pos - 1]);
+                bool isWordAfter = pos < length && IsWordChar(line[pos]);
+                if ((isWordBefore != isWordAfter) == (instruction.op == OP_WORD_BOUNDARY))
+                    stack.push_back(pc + 1);
+            }
+            break;
+
+        default:
+            {
+                State::Thread thread;
+                thread.pc = pc;
+                thread.start = start;
+                thread.skip = 0;
+                list.push_back(thread);
+            }
+            break;
+        }
+    }
+}
+
+void SearchPattern::AddSkipThread(std::vector<State::Thread>& list, State& state, unsigned int generation, int pc, int start, int skip) const
+{
+    // of the threads in the same state, only the one with the highest
+    // priority is kept
+    unsigned int& mark = state.m_skipMarks[pc * 3 + skip - 1];
+    if (mark == generation)
+        return;
+    mark = generation;
+
+    State::Thread thread;
+    thread.pc = pc;
+    thread.start = start;
+    thread.skip = skip;
+    list.push_back(thread);
+}
+
+bool SearchPattern::Match(const uint8_t* line, size_t length, State& state, size_t& start, size_t& end) const
+{
+    if (state.m_marks.size() < m_program.size() || state.m_generation > 0xfffffff0u - length)
+    {
+        state.m_marks.assign(m_program.size(), 0);
+        state.m_skipMarks.assign(m_program.size() * 3, 0);
+        state.m_generation = 0;
+    }
+
+    std::vector<State::Thread>& current = state.m_current;
+    std::vector<State::Thread>& next = state.m_next;
+    current.clear();
+    next.clear();
+
+    bool isMatched = false;
+    unsigned int generation = ++state.m_generation;
+
+    // the position of the next character
+    size_t boundary = 0;
+
+    for (size_t pos = 0; ; ++pos)
+    {
+        // start a new thread at each character (with the lowest priority)
+        // until a match has been found
+        bool isBoundary = pos == boundary;
+        if (!isMatched && isBoundary)
+            AddThread(current, state, generation, 0, (int) pos, line, length, pos);
+
+        generation = ++state.m_generation;
+
+        uint32_t ch = 0;
+        size_t charLength = 1;
+        if (pos < length && (isBoundary || !current.empty()))
+        {
+            ch = DecodeChar(line + pos, length - pos, charLength);
+            if (isBoundary)
+                boundary += charLength;
+        }
+
+        if (current.empty())
+        {
+            if (isMatched || pos >= length)
+                break;
+            continue;
+        }
+
+        int c = pos < length ? line[pos] : -1;
+
+        for (size_t i = 0; i < current.size(); ++i)
+        {
+            const State::Thread& thread = current[i];
+            const Instruction& instruction = m_program[thread.pc];
+
+            // consume the rest of a multi-byte character
+            if (thread.skip > 0)
+            {
+                if (thread.skip == 1)
+                    AddThread(next, state, generation, thread.pc + 1, thread.start, line, length, pos + 1);
+                else
+                    AddSkipThread(next, state, generation, thread.pc, thread.start, thread.skip - 1);
+                continue;
+            }
+
+            bool isStepping = false;
+            switch (instruction.op)
+            {
+            case OP_MATCH:
+                isMatched = true;
+                start = (size_t) thread.start;
+                end = pos;
+                break;
+            case OP_CHAR:
+                isStepping = c == instruction.arg;
+                break;
+            case OP_ANY:
+                isStepping = c >= 0;
+                break;
+            case OP_CLASS:
+                isStepping = c >= 0 && m_classes[instruction.arg].Contains(ch);
+                break;
+            }
+
+            // threads with lower priority than a match are discarded
+            if (instruction.op == OP_MATCH)
+                break;
+
+            if (!isStepping)
+                continue;
+
+            // "." and classes consume whole characters
+            if (instruction.op == OP_CHAR || charLength == 1)
+                AddThread(next, state, generation, thread.pc + 1, thread.start, line, length, pos + 1);
+            else
+                AddSkipThread(next, state, generation, thread.pc, thread.start, (int) charLength - 1);
+        }
+
+        current.swap(next);
+        next.clear();
+
+        if (pos >= length)
+            break;
+    }
+
+    return isMatched;
+}
+
+static inline bool EqualsLiteral(const uint8_t* p, const std::string& literal, bool caseInsensitive)
+{
+    if (!caseInsensitive)
+        return memcmp(p, literal.data(), literal.length()) == 0;
+
+    for (size_t i = 0; i < literal.length(); ++i)
+        if (ToLower(p[i]) != (uint8_t) literal[i])
+            return false;
+
+    return true;
+}
+
+const uint8_t* SearchPattern::FindLiteral(const uint8_t* p, const uint8_t* end) const
+{
+    size_t n = m_literal.length();
+    if ((size_t) (end - p) < n)
+        return NULL;
+
+    uint8_t first = (uint8_t) m_literal[0];
+    uint8_t last = (uint8_t) m_literal[n - 1];
+
+#ifdef SIMD_USE_SSE2
+    // compare the first and the last byte of the literal at 16 positions at
+    // once; only the candidates where both match are compared entirely. For
+    // case-insensitive searches, letters are folded to lower case by setting
+    // bit 5 (which doesn't create false positives for letters).
+    __m128i vFirst = _mm_set1_epi8((char) first);
+    __m128i vLast = _mm_set1_epi8((char) last);
+    __m128i vFoldFirst = _mm_set1_epi8(m_caseInsensitive && IsAlpha(first) ? 0x20 : 0);
+    __m128i vFoldLast = _mm_set1_epi8(m_caseInsensitive && IsAlpha(last) ? 0x20 : 0);
+
+    for ( ; p + n + 15 <= end; p += 16)
+    {
+        __m128i blockFirst = _mm_or_si128(_mm_loadu_si128((const __m128i*) p), vFoldFirst);
+        __m128i blockLast = _mm_or_si128(_mm_loadu_si128((const __m128i*) (p + n - 1)), vFoldLast);
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, vFirst), _mm_cmpeq_epi8(blockLast, vLast)));
+
+        while (mask != 0)
+        {
+            int i = CountTrailingZeros(mask);
+            if (EqualsLiteral(p + i, m_literal, m_caseInsensitive))
+                return p + i;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    const uint8_t* lastStart = end - n;
+
+    if (!m_caseInsensitive || !IsAlpha(first))
+    {
+        // memchr is vectorized by the C runtime
+        while (p <= lastStart)
+        {
+            p = (const uint8_t*) memchr(p, first, lastStart - p + 1);
+            if (p == NULL)
+                return NULL;
+            if (EqualsLiteral(p, m_literal, m_caseInsensitive))
+                return p;
+            ++p;
+        }
+
+        return NULL;
+    }
+
+    for ( ; p <= lastStart; ++p)
+        if (ToLower(*p) == first && EqualsLiteral(p, m_literal, m_caseInsensitive))
+            return p;
+
+    return NULL;
+}
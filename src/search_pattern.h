@@ -0,0 +1,208 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __search_pattern_h
+#define __search_pattern_h
+
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// The maximum number of instructions a compiled regular expression may have
+#define SEARCH_PATTERN_MAX_PROGRAM_SIZE 10000
+
+
+//
+// A literal string or a regular expression to search lines of UTF-8 text for.
+//
+// The regular expressions support the usual syntax: ".", character classes
+// ("[a-z]", "[^0-9]", "\d", "\w", "\s" and their negations), the anchors "^",
+// "$", "\b" and "\B", groups (also "(?:...)"), alternatives and the greedy and
+// lazy quantifiers "*", "+", "?" and "{m,n}". They are matched by simulating
+// all alternatives in parallel, so the time is linear in the length of the
+// line regardless of the expression. Case-insensitive matching only folds
+// ASCII letters.
+//
+// "." and character classes match whole UTF-8 characters, "\xhh" stands for
+// the code point U+00hh, and matches start at character boundaries. "\d",
+// "\w", "\s" and "\b" only consider ASCII characters. Bytes which aren't part
+// of a valid UTF-8 sequence count as single characters, which are matched by
+// "." and negated classes only.
+//
+// Every match must contain a certain literal (e.g., "foo" in "foo\d+") if the
+// pattern has one; FindLiteral finds it using SIMD instructions, so only the
+// lines containing it have to be matched against the expression.
+//
+class SearchPattern
+{
+public:
+    //
+    // Scratch memory for matching, which can be reused for subsequent calls
+    // to Match on the same thread.
+    //
+    class State
+    {
+    public:
+        State() : m_generation(0) {}
+
+    private:
+        //
+        // A thread which is in the middle of a multi-byte character has
+        // "skip" more bytes of it to consume before continuing at pc + 1.
+        //
+        struct Thread
+        {
+            int pc;
+            int start;
+            int skip;
+        };
+
+        std::vector<Thread> m_current;
+        std::vector<Thread> m_next;
+        std::vector<int> m_stack;
+        std::vector<unsigned int> m_marks;
+        std::vector<unsigned int> m_skipMarks;
+        unsigned int m_generation;
+
+        friend class SearchPattern;
+    };
+
+    SearchPattern();
+
+    //
+    // Compiles the pattern (UTF-8). If isRegex isn't set, the pattern is
+    // searched literally. Returns false if the regular expression is invalid.
+    //
+    bool Compile(const std::string& pattern, bool isRegex, bool caseInsensitive);
+
+    //
+    // Finds the first (leftmost) match in the line, which doesn't include the
+    // line terminator. On success, start and end are the byte offsets of the
+    // match within the line.
+    //
+    bool Match(const uint8_t* line, size_t length, State& state, size_t& start, size_t& end) const;
+
+    //
+    // Returns the first occurrence of the required literal in [p, end), or
+    // NULL if there is none. Must only be called if HasLiteral returns true.
+    //
+    const uint8_t* FindLiteral(const uint8_t* p, const uint8_t* end) const;
+
+    //
+    // Returns true if every match contains a literal which can be searched for
+    // with FindLiteral.
+    //
+    inline bool HasLiteral() const
+    {
+        return !m_literal.empty();
+    }
+
+    //
+    // Returns true if the pattern is a plain literal, i.e., the occurrences
+    // found by FindLiteral are the matches.
+    //
+    inline bool IsLiteral() const
+    {
+        return m_isLiteral;
+    }
+
+    inline size_t GetLiteralLength() const
+    {
+        return m_literal.length();
+    }
+
+private:
+    struct Node
+    {
+        int type;
+        int value;
+        int min;
+        int max;
+        bool isGreedy;
+        std::vector<int> children;
+    };
+
+    //
+    // A set of code points: the bits hold the ones below 256, the ranges the
+    // others (which are excluded instead if isNegated is set).
+    //
+    struct CharClass
+    {
+        uint32_t bits[8];
+        std::vector<std::pair<uint32_t, uint32_t> > ranges;
+        bool isNegated;
+
+        CharClass() : isNegated(false)
+        {
+            for (int i = 0; i < 8; ++i)
+                bits[i] = 0;
+        }
+
+        inline void Set(int c) { bits[c >> 5] |= 1u << (c & 31); }
+        inline bool Test(int c) const { return (bits[c >> 5] & (1u << (c & 31))) != 0; }
+
+        void AddRange(uint32_t first, uint32_t last);
+        bool Contains(uint32_t c) const;
+    };
+
+    struct Instruction
+    {
+        int op;
+        int arg;
+        int arg2;
+    };
+
+    // parser
+    int ParseAlternatives(const std::string& pattern, size_t& pos, int depth);
+    int ParseSequence(const std::string& pattern, size_t& pos, int depth);
+    int ParseAtom(const std::string& pattern, size_t& pos, int depth);
+    bool ParseClass(const std::string& pattern, size_t& pos, CharClass& cls);
+    static bool AddClassEscape(int c, CharClass& cls);
+    bool ParseQuantifier(const std::string& pattern, size_t& pos, int& min, int& max);
+    int AddNode(int type, int value);
+    int AddClass(const CharClass& cls);
+
+    // code generation
+    bool Emit(int node);
+    int EmitInstruction(int op, int arg = 0, int arg2 = 0);
+    std::string GetRequiredLiteral(int node) const;
+
+    // matching
+    void AddThread(std::vector<State::Thread>& list, State& state, unsigned int generation, int pc, int start, const uint8_t* line, size_t length, size_t pos) const;
+    void AddSkipThread(std::vector<State::Thread>& list, State& state, unsigned int generation, int pc, int start, int skip) const;
+
+    bool m_caseInsensitive;
+    bool m_isLiteral;
+    std::string m_literal;
+
+    std::vector<Node> m_nodes;
+    std::vector<Instruction> m_program;
+    std::vector<CharClass> m_classes;
+};
+
+
+#endif
@@ -0,0 +1,191 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __simd_util_h
+#define __simd_util_h
+
+
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// SSE2 is available on all x86-64 CPUs; VS2012 also targets it by default for
+// 32-bit x86
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_USE_SSE2
+#endif
+
+// Newer instruction sets are only used in functions compiled for them (marked
+// with SIMD_TARGET_...), which are called if the CPU supports them. VS2012
+// doesn't know the SHA intrinsics.
+#if defined(SIMD_USE_SSE2) && defined(_MSC_VER)
+#include <tmmintrin.h>
+#include <immintrin.h>
+#define SIMD_USE_SSSE3
+#define SIMD_TARGET_SSSE3
+#define SIMD_USE_AVX2
+#define SIMD_TARGET_AVX2
+#if _MSC_VER >= 1900
+#define SIMD_USE_SHA
+#define SIMD_TARGET_SHA
+#endif
+#elif defined(SIMD_USE_SSE2) && defined(__GNUC__) && defined(__has_attribute)
+#if __has_attribute(target)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SIMD_USE_SSSE3
+#define SIMD_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define SIMD_USE_AVX2
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_USE_SHA
+#define SIMD_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+// NEON is part of the base instruction set of 64-bit ARM
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SIMD_USE_NEON
+#endif
+
+//
+// Returns the index of the lowest set bit; x must not be 0.
+//
+inline int CountTrailingZeros(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (int) index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+inline int CountTrailingZeros64(uint64_t x)
+{
+    uint32_t low = (uint32_t) x;
+    return low != 0 ? CountTrailingZeros(low) : 32 + CountTrailingZeros((uint32_t) (x >> 32));
+}
+
+//
+// Returns the number of set bits (without relying on the POPCNT instruction,
+// which older CPUs don't have).
+//
+inline int PopCount64(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int) ((x * 0x0101010101010101ULL) >> 56);
+}
+
+
+#ifdef SIMD_USE_SSSE3
+//
+// Retrieves the feature flags in ECX of CPUID leaf 1 and in EBX of leaf 7
+// (0 if the leaf isn't supported).
+//
+inline void GetCPUFeatures(uint32_t& ecx1, uint32_t& ebx7)
+{
+    ecx1 = 0;
+    ebx7 = 0;
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    ecx1 = (uint32_t) info[2];
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        ebx7 = (uint32_t) info[1];
+    }
+#else
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int maxLeaf = __get_cpuid_max(0, NULL);
+    __cpuid(1, eax, ebx, ecx, edx);
+    ecx1 = ecx;
+    if (maxLeaf >= 7)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        ebx7 = ebx;
+    }
+#endif
+}
+
+//
+// Tests whether the CPU supports SSSE3 (which has been the case for nearly
+// all x86 CPUs since 2006).
+//
+inline bool HasSSSE3()
+{
+    uint32_t ecx1, ebx7;
+    GetCPUFeatures(ecx1, ebx7);
+    return (ecx1 & (1 << 9)) != 0;
+}
+#endif
+
+#ifdef SIMD_USE_AVX2
+//
+// Tests whether the CPU supports AVX2 and the OS saves the AVX registers.
+//
+inline bool HasAVX2()
+{
+    uint32_t ecx1, ebx7;
+    GetCPUFeatures(ecx1, ebx7);
+    if ((ecx1 & (1 << 27)) == 0 || (ebx7 & (1 << 5)) == 0)
+        return false;
+
+    // XCR0 must have the SSE and the AVX state enabled
+#ifdef _MSC_VER
+    uint64_t xcr0 = _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    uint64_t xcr0 = ((uint64_t) edx << 32) | eax;
+#endif
+    return (xcr0 & 6) == 6;
+}
+#endif
+
+#ifdef SIMD_USE_SHA
+//
+// Tests whether the CPU supports the SHA extensions (and SSSE3 and SSE4.1,
+// which the SHA-256 code needs as well).
+//
+inline bool HasSHAExtensions()
+{
+    uint32_t ecx1, ebx7;
+    GetCPUFeatures(ecx1, ebx7);
+    return (ecx1 & (1 << 9)) != 0 && (ecx1 & (1 << 19)) != 0 && (ebx7 & (1 << 29)) != 0;
+}
+#endif
+
+
+#endif
@@ -23,14 +23,18 @@
 #include <string>
 #include <sstream>
 
-#ifndef USE_WEBVIEW
+// NATIVE_ONLY is defined by the test build (test/CMakeLists.txt), which only
+// builds the native modules that don't depend on the browser (file and network
+// utilities), e.g. on Linux, where there is no application. It's a flag of its
+// own because the CEF headers define OS_LINUX on Linux hosts.
+#if !defined(USE_WEBVIEW) && !defined(NATIVE_ONLY)
 #include "lib/Libcef/Include/cef_base.h"
 #include "lib/Libcef/Include/cef_values.h"
 #else
 #endif
 
 
-#if defined(OS_MACOSX)
+#if defined(OS_MACOSX) || defined(NATIVE_ONLY)
 
 
 #define TEXT(string) string
@@ -39,6 +43,8 @@
 #define _tprintf    printf
 #define _tcscat     strcat
 #define _tcslen     strlen
+#define _tfopen     fopen
+#define _tremove    remove
 
 typedef std::string String;
 typedef std::stringstream StringStream;
@@ -68,7 +74,9 @@ class ExtensionState;
 class ClientExtensionHandler;
 
 
-#ifndef USE_WEBVIEW
+#if defined(NATIVE_ONLY)
+
+#elif !defined(USE_WEBVIEW)
 
 #include "jsbridge_v8.h"
 
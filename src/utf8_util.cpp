@@ -0,0 +1,440 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#include <string.h>
+
+#include "utf8_util.h"
+#include "simd_util.h"
+
+
+//
+// Returns the length of the valid UTF-8 sequence at p, or 0 if the sequence is
+// invalid or incomplete.
+//
+static inline size_t GetSequenceLength(const uint8_t* p, const uint8_t* end)
+{
+    uint8_t c = *p;
+    if (c < 0x80)
+        return 1;
+
+    // the range of the second byte excludes overlong encodings, surrogates
+    // (U+D800 to U+DFFF) and code points above U+10FFFF
+    size_t n;
+    uint8_t lo = 0x80;
+    uint8_t hi = 0xbf;
+    if (c < 0xc2)
+        return 0;
+    else if (c < 0xe0)
+        n = 2;
+    else if (c < 0xf0)
+    {
+        n = 3;
+        if (c == 0xe0)
+            lo = 0xa0;
+        else if (c == 0xed)
+            hi = 0x9f;
+    }
+    else if (c < 0xf5)
+    {
+        n = 4;
+        if (c == 0xf0)
+            lo = 0x90;
+        else if (c == 0xf4)
+            hi = 0x8f;
+    }
+    else
+        return 0;
+
+    if ((size_t) (end - p) < n || p[1] < lo || p[1] > hi)
+        return 0;
+    for (size_t i = 2; i < n; ++i)
+        if ((p[i] & 0xc0) != 0x80)
+            return 0;
+
+    return n;
+}
+
+static bool IsValidUTF8Scalar(const uint8_t* p, size_t length)
+{
+    const uint8_t* end = p + length;
+    while (p < end)
+    {
+        // skip ASCII 8 bytes at a time
+        if (end - p >= 8)
+        {
+            uint64_t block;
+            memcpy(&block, p, 8);
+            if ((block & 0x8080808080808080ULL) == 0)
+            {
+                p += 8;
+                continue;
+            }
+        }
+
+        size_t n = GetSequenceLength(p, end);
+        if (n == 0)
+            return false;
+        p += n;
+    }
+
+    return true;
+}
+
+#ifdef SIMD_USE_SSSE3
+//
+// Validates 16 bytes at a time with the lookup table algorithm by Keiser and
+// Lemire ("Validating UTF-8 In Less Than One Instruction Per Byte"): three
+// table lookups indexed by the nibbles of each byte and its predecessor
+// classify all invalid 2-byte combinations, and the remaining checks make sure
+// that the continuation bytes of 3- and 4-byte sequences are where they are
+// expected.
+//
+SIMD_TARGET_SSSE3 static bool IsValidUTF8SSSE3(const uint8_t* p, size_t length)
+{
+    // the error classes of the tables
+    const char TOO_SHORT = 1 << 0;  // a lead byte or ASCII following a lead byte
+    const char TOO_LONG = 1 << 1;  // ASCII followed by a continuation byte
+    const char OVERLONG_3 = 1 << 2;  // E0 80..9F
+    const char TOO_LARGE = 1 << 3;  // F4 90..BF, F5..FF
+    const char SURROGATE = 1 << 4;  // ED A0..BF
+    const char OVERLONG_2 = 1 << 5;  // C0..C1
+    const char TOO_LARGE_1000 = 1 << 6;  // F5..FF 80..8F
+    const char OVERLONG_4 = 1 << 6;  // F0 80..8F
+    const char TWO_CONTS = (char) (1 << 7);  // two continuation bytes
+    const char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    const __m128i byte1HighTable = _mm_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+
+    const __m128i byte1LowTable = _mm_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+
+    const __m128i byte2HighTable = _mm_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    // the largest values of the last three bytes which don't start a sequence
+    // that continues in the next block
+    const __m128i maxValue = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char) 0xef, (char) 0xdf, (char) 0xbf);
+    const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+
+    __m128i error = _mm_setzero_si128();
+    __m128i prev = _mm_setzero_si128();
+    __m128i prevIncomplete = _mm_setzero_si128();
+
+    uint8_t tail[16];
+    for (size_t i = 0; i < length; i += 16)
+    {
+        __m128i input;
+        if (length - i >= 16)
+            input = _mm_loadu_si128((const __m128i*) (p + i));
+        else
+        {
+            // pad the last block with zeros, which terminate cut-off sequences
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p + i, length - i);
+            input = _mm_loadu_si128((const __m128i*) tail);
+        }
+
+        if (_mm_movemask_epi8(input) == 0)
+        {
+            // ASCII only; only a sequence cut off at the end of the previous
+            // block can be invalid
+            error = _mm_or_si128(error, prevIncomplete);
+            prevIncomplete = _mm_setzero_si128();
+        }
+        else
+        {
+            __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+            __m128i byte1High = _mm_shuffle_epi8(byte1HighTable, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibbleMask));
+            __m128i byte1Low = _mm_shuffle_epi8(byte1LowTable, _mm_and_si128(prev1, nibbleMask));
+            __m128i byte2High = _mm_shuffle_epi8(byte2HighTable, _mm_and_si128(_mm_srli_epi16(input, 4), nibbleMask));
+            __m128i specialCases = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+            // the third and fourth bytes of 3- and 4-byte sequences must be
+            // continuation bytes (which the tables classify as TWO_CONTS)
+            __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+            __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+            __m128i isThirdByte = _mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xe0 - 0x80)));
+            __m128i isFourthByte = _mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xf0 - 0x80)));
+            __m128i mustBeContinuation = _mm_and_si128(_mm_or_si128(isThirdByte, isFourthByte), _mm_set1_epi8((char) 0x80));
+
+            error = _mm_or_si128(error, _mm_xor_si128(mustBeContinuation, specialCases));
+            prevIncomplete = _mm_subs_epu8(input, maxValue);
+        }
+
+        prev = input;
+    }
+
+    error = _mm_or_si128(error, prevIncomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+static const bool g_hasSSSE3 = HasSSSE3();
+#endif
+
+bool IsValidUTF8(const uint8_t* p, size_t length)
+{
+#ifdef SIMD_USE_SSSE3
+    if (g_hasSSSE3)
+        return IsValidUTF8SSSE3(p, length);
+#endif
+
+    return IsValidUTF8Scalar(p, length);
+}
+
+void AppendValidUTF8(std::string& out, const uint8_t* p, size_t length)
+{
+    const uint8_t* end = p + length;
+    while (p < end)
+    {
+        size_t n = GetSequenceLength(p, end);
+        if (n > 0)
+        {
+            out.append((const char*) p, n);
+            p += n;
+        }
+        else
+        {
+            out.append("\xef\xbf\xbd");
+            ++p;
+        }
+    }
+}
+
+size_t GetCompleteUTF8Length(const uint8_t* p, size_t length)
+{
+    // look for the lead byte of the last sequence among the last 3 bytes
+    for (size_t i = 1; i <= 3 && i <= length; ++i)
+    {
+        uint8_t c = p[length - i];
+        if ((c & 0xc0) == 0x80)
+            continue;
+
+        size_t n = (c & 0xe0) == 0xc0 ? 2 : (c & 0xf0) == 0xe0 ? 3 : (c & 0xf8) == 0xf0 ? 4 : 1;
+        return n > i ? length - i : length;
+    }
+
+    return length;
+}
+
+TextEncoding DetectTextEncoding(const uint8_t* p, size_t length, size_t& bomLength)
+{
+    bomLength = 0;
+
+    if (length >= 3 && p[0] == 0xef && p[1] == 0xbb && p[2] == 0xbf)
+    {
+        bomLength = 3;
+        return ENCODING_UTF8;
+    }
+
+    if (length >= 2 && p[0] == 0xff && p[1] == 0xfe)
+    {
+        bomLength = 2;
+        return ENCODING_UTF16LE;
+    }
+
+    if (length >= 2 && p[0] == 0xfe && p[1] == 0xff)
+    {
+        bomLength = 2;
+        return ENCODING_UTF16BE;
+    }
+
+    return IsValidUTF8(p, length) ? ENCODING_UTF8 : ENCODING_LATIN1;
+}
+
+//
+// Writes the code point as UTF-8 to dst and returns the position after it.
+//
+static inline char* EncodeUTF8(char* dst, uint32_t c)
+{
+    if (c < 0x80)
+        *dst++ = (char) c;
+    else if (c < 0x800)
+    {
+        *dst++ = (char) (0xc0 | (c >> 6));
+        *dst++ = (char) (0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000)
+    {
+        *dst++ = (char) (0xe0 | (c >> 12));
+        *dst++ = (char) (0x80 | ((c >> 6) & 0x3f));
+        *dst++ = (char) (0x80 | (c & 0x3f));
+    }
+    else
+    {
+        *dst++ = (char) (0xf0 | (c >> 18));
+        *dst++ = (char) (0x80 | ((c >> 12) & 0x3f));
+        *dst++ = (char) (0x80 | ((c >> 6) & 0x3f));
+        *dst++ = (char) (0x80 | (c & 0x3f));
+    }
+
+    return dst;
+}
+
+//
+// Converts UTF-16 to UTF-8; dst must have room for 3 bytes per code unit.
+// Returns the position after the output.
+//
+static char* ConvertUTF16(char* dst, const uint8_t* p, size_t numUnits, bool isBigEndian)
+{
+    int hi = isBigEndian ? 0 : 1;
+    size_t i = 0;
+    while (i < numUnits)
+    {
+#ifdef SIMD_USE_SSE2
+        // convert runs of ASCII 8 code units at a time
+        while (numUnits - i >= 8)
+        {
+            __m128i units = _mm_loadu_si128((const __m128i*) (p + 2 * i));
+            if (isBigEndian)
+                units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+            __m128i nonASCII = _mm_and_si128(units, _mm_set1_epi16((short) 0xff80));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonASCII, _mm_setzero_si128())) != 0xffff)
+                break;
+
+            _mm_storel_epi64((__m128i*) dst, _mm_packus_epi16(units, units));
+            dst += 8;
+            i += 8;
+        }
+
+        if (i == numUnits)
+            break;
+#endif
+
+        uint32_t c = ((uint32_t) p[2 * i + hi] << 8) | p[2 * i + 1 - hi];
+        ++i;
+
+        if (c >= 0xd800 && c < 0xe000)
+        {
+            // a high surrogate must be followed by a low surrogate
+            uint32_t c2 = i < numUnits ? ((uint32_t) p[2 * i + hi] << 8) | p[2 * i + 1 - hi] : 0;
+            if (c < 0xdc00 && c2 >= 0xdc00 && c2 < 0xe000)
+            {
+                c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+                ++i;
+            }
+            else
+                c = 0xfffd;
+        }
+
+        dst = EncodeUTF8(dst, c);
+    }
+
+    return dst;
+}
+
+//
+// Converts Latin-1 to UTF-8; dst must have room for 2 bytes per byte. Returns
+// the position after the output.
+//
+static char* ConvertLatin1(char* dst, const uint8_t* p, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+#ifdef SIMD_USE_SSE2
+        // copy runs of ASCII 16 bytes at a time
+        while (length - i >= 16)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*) (p + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+                break;
+
+            _mm_storeu_si128((__m128i*) dst, bytes);
+            dst += 16;
+            i += 16;
+        }
+
+        if (i == length)
+            break;
+#endif
+
+        uint8_t c = p[i++];
+        if (c < 0x80)
+            *dst++ = (char) c;
+        else
+        {
+            *dst++ = (char) (0xc0 | (c >> 6));
+            *dst++ = (char) (0x80 | (c & 0x3f));
+        }
+    }
+
+    return dst;
+}
+
+void AppendAsUTF8(std::string& out, const uint8_t* p, size_t length, TextEncoding encoding)
+{
+    if (encoding == ENCODING_UTF8)
+    {
+        if (IsValidUTF8(p, length))
+            out.append((const char*) p, length);
+        else
+            AppendValidUTF8(out, p, length);
+        return;
+    }
+
+    // convert into the reserved space and cut off the rest
+    size_t start = out.size();
+    size_t maxLength = encoding == ENCODING_LATIN1 ? 2 * length : 3 * (length / 2) + 3;
+    out.resize(start + maxLength);
+
+    char* dst = &out[0] + start;
+    char* end;
+    if (encoding == ENCODING_LATIN1)
+        end = ConvertLatin1(dst, p, length);
+    else
+    {
+        end = ConvertUTF16(dst, p, length / 2, encoding == ENCODING_UTF16BE);
+        if (length % 2 != 0)
+            end = EncodeUTF8(end, 0xfffd);
+    }
+
+    out.resize(start + (end - dst));
+}
@@ -0,0 +1,75 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __utf8_util_h
+#define __utf8_util_h
+
+
+#include <stdint.h>
+#include <string>
+
+
+enum TextEncoding
+{
+    ENCODING_UTF8,
+    ENCODING_UTF16LE,
+    ENCODING_UTF16BE,
+    ENCODING_LATIN1
+};
+
+//
+// Tests whether the bytes are valid UTF-8, rejecting overlong encodings,
+// surrogates and code points above U+10FFFF.
+//
+bool IsValidUTF8(const uint8_t* p, size_t length);
+
+//
+// Appends the bytes to "out", replacing invalid UTF-8 sequences with U+FFFD
+// (the bridges can't pass invalid UTF-8 to JavaScript).
+//
+void AppendValidUTF8(std::string& out, const uint8_t* p, size_t length);
+
+//
+// Determines the encoding of a text from its byte order mark; sets bomLength
+// to its length. Texts without a BOM are UTF-8 if they are valid UTF-8, and
+// Latin-1 otherwise.
+//
+TextEncoding DetectTextEncoding(const uint8_t* p, size_t length, size_t& bomLength);
+
+//
+// Appends the text, converted from the encoding to UTF-8, to "out". Invalid
+// sequences (including unpaired surrogates and a trailing odd byte of UTF-16)
+// are replaced with U+FFFD.
+//
+void AppendAsUTF8(std::string& out, const uint8_t* p, size_t length, TextEncoding encoding);
+
+//
+// Returns the length of the data without a multi-byte sequence which is cut
+// off at its end, i.e., the part of a stream which can be decoded before the
+// following bytes have arrived.
+//
+size_t GetCompleteUTF8Length(const uint8_t* p, size_t length);
+
+
+#endif
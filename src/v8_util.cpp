@@ -165,6 +165,28 @@ void SetDictionary(CefRefPtr<CefDictionaryValue> source, CefRefPtr<CefV8Value> t
         SetDictionaryValue(target, key, source);
 }
 
+//
+// Converts binary data to a "binary string" (a string with one character per byte);
+// there is no way to create typed arrays through the CEF V8 API.
+//
+CefRefPtr<CefV8Value> BinaryValueToV8Value(CefRefPtr<CefBinaryValue> value)
+{
+    size_t size = value.get() ? value->GetSize() : 0;
+    if (size == 0)
+        return CefV8Value::CreateString(CefString());
+
+    // CefV8Value only creates strings from UTF-16, so the bytes are copied
+    // into the upper half of the character buffer and widened in place (each
+    // byte is read before its position is overwritten)
+    std::vector<char16> chars(size);
+    unsigned char* data = (unsigned char*) &chars[0] + size;
+    value->GetData(data, size, 0);
+    for (size_t i = 0; i < size; ++i)
+        chars[i] = data[i];
+
+    return CefV8Value::CreateString(CefString(&chars[0], size, false));
+}
+
 CefRefPtr<CefV8Value> ListValueToV8Value(CefRefPtr<CefListValue> value, int index)
 {
     CefRefPtr<CefV8Value> new_value;
@@ -198,6 +220,9 @@ CefRefPtr<CefV8Value> ListValueToV8Value(CefRefPtr<CefListValue> value, int inde
     case VTYPE_STRING:
         new_value = CefV8Value::CreateString(value->GetString(index));
         break;
+    case VTYPE_BINARY:
+        new_value = BinaryValueToV8Value(value->GetBinary(index));
+        break;
     default:
         new_value = CefV8Value::CreateNull();
         break;
@@ -239,6 +264,9 @@ CefRefPtr<CefV8Value> DictionaryValueToV8Value(CefRefPtr<CefDictionaryValue> val
     case VTYPE_STRING:
         new_value = CefV8Value::CreateString(value->GetString(key));
         break;
+    case VTYPE_BINARY:
+        new_value = BinaryValueToV8Value(value->GetBinary(key));
+        break;
     default:
         new_value = CefV8Value::CreateNull();
         break;
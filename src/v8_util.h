@@ -37,6 +37,7 @@ void SetList(CefRefPtr<CefListValue> source, CefRefPtr<CefV8Value> target);
 void SetDictionaryValue(CefRefPtr<CefV8Value> obj, CefString key, CefRefPtr<CefDictionaryValue> value);
 void SetDictionary(CefRefPtr<CefDictionaryValue>, CefRefPtr<CefV8Value> target);
 
+CefRefPtr<CefV8Value> BinaryValueToV8Value(CefRefPtr<CefBinaryValue> value);
 CefRefPtr<CefV8Value> ListValueToV8Value(CefRefPtr<CefListValue> value, int index);
 CefRefPtr<CefV8Value> DictionaryValueToV8Value(CefRefPtr<CefDictionaryValue> value, CefString key);
 
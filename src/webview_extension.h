@@ -24,7 +24,9 @@
 #define __Zephyros__webview_extension__
 
 
+#include <functional>
 #include <map>
+#include <memory>
 
 #include "types.h"
 #include "native_extensions.h"
@@ -44,6 +46,40 @@ typedef int (*Function)(ExtensionState* ext, JavaScript::Array args, JavaScript:
 typedef void (*CallbacksCompleteHandler)(ExtensionState* ext);
 
 
+//
+// The callback of a native function which returned RET_DELAYED_CALLBACK.
+// Invoke can be called from any thread and any number of times; the function
+// setting the callback arguments is run on the main thread. The JavaScript
+// callback is released after the invocation with isLast set.
+//
+class DelayedCallback : public std::enable_shared_from_this<DelayedCallback>
+{
+public:
+    typedef std::function<void(JavaScript::Array ret)> ArgsSetter;
+    
+    DelayedCallback(JSObjectRef callback);
+    ~DelayedCallback();
+    
+    void Invoke(ArgsSetter fnxSetArgs, bool isLast = true);
+    
+private:
+    void DoInvoke(ArgsSetter fnxSetArgs, bool isLast);
+    
+    JSObjectRef m_callback;
+};
+
+typedef std::shared_ptr<DelayedCallback> DelayedCallbackPtr;
+
+//
+// Returns a handle to the callback passed to the native function which can
+// be invoked once the function has returned RET_DELAYED_CALLBACK.
+//
+inline DelayedCallbackPtr CreateDelayedCallback(JSObjectRef callback)
+{
+    return DelayedCallbackPtr(new DelayedCallback(callback));
+}
+
+
 class NativeFunction
 {
 public:
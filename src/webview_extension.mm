@@ -31,6 +31,57 @@
 extern JSContextRef g_ctx;
 
 
+///////////////////////////////////////////////////////////////
+// DelayedCallback Implementation
+
+DelayedCallback::DelayedCallback(JSObjectRef callback)
+    : m_callback(callback)
+{
+    if (m_callback != NULL)
+        JSValueProtect(g_ctx, m_callback);
+}
+
+DelayedCallback::~DelayedCallback()
+{
+    // the last reference might be dropped on a background thread
+    if (m_callback != NULL)
+    {
+        JSObjectRef callback = m_callback;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            JSValueUnprotect(g_ctx, callback);
+        });
+    }
+}
+
+void DelayedCallback::Invoke(ArgsSetter fnxSetArgs, bool isLast)
+{
+    DelayedCallbackPtr self = shared_from_this();
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self->DoInvoke(fnxSetArgs, isLast);
+    });
+}
+
+void DelayedCallback::DoInvoke(ArgsSetter fnxSetArgs, bool isLast)
+{
+    if (m_callback == NULL)
+        return;
+    
+    JavaScript::Array returnValues = JavaScript::CreateArray();
+    if (fnxSetArgs)
+        fnxSetArgs(returnValues);
+    
+    JSValueRef* retArgs = returnValues->AsArray();
+    JSObjectCallAsFunction(g_ctx, m_callback, NULL, returnValues->GetSize(), retArgs, NULL);
+    returnValues->FreeArray(retArgs);
+    
+    if (isLast)
+    {
+        JSValueUnprotect(g_ctx, m_callback);
+        m_callback = NULL;
+    }
+}
+
+
 ///////////////////////////////////////////////////////////////
 // NativeFunction Implementation
 
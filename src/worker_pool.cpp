@@ -0,0 +1,161 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include "worker_pool.h"
+
+
+WorkerPool::WorkerPool(int numThreads)
+    : m_nextQueue(0), m_numQueued(0), m_numPending(0), m_isStopping(false)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = (int) std::thread::hardware_concurrency();
+        if (numThreads <= 0)
+            numThreads = 2;
+    }
+
+    // create all the queues before the threads start stealing
+    for (int i = 0; i < numThreads; ++i)
+        m_queues.push_back(new Queue());
+
+    for (int i = 0; i < numThreads; ++i)
+        m_threads.push_back(std::thread(&WorkerPool::Run, this, i));
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopping = true;
+    }
+
+    m_condTask.notify_all();
+
+    for (std::vector<std::thread>::iterator it = m_threads.begin(); it != m_threads.end(); ++it)
+        it->join();
+
+    for (std::vector<Queue*>::iterator it = m_queues.begin(); it != m_queues.end(); ++it)
+        delete *it;
+}
+
+void WorkerPool::Post(Task task)
+{
+    int index = GetCurrentThreadIndex();
+    if (index < 0)
+        index = (int) (m_nextQueue++ % m_queues.size());
+
+    {
+        // holding m_mutex while queuing the task ensures that the notification
+        // can't get lost between an idle thread's check of m_numQueued and its wait
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_numPending;
+
+        Queue* queue = m_queues[index];
+        std::lock_guard<std::mutex> lockQueue(queue->mutex);
+        queue->tasks.push_back(task);
+        ++m_numQueued;
+    }
+
+    m_condTask.notify_one();
+}
+
+void WorkerPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_numPending > 0)
+        m_condDone.wait(lock);
+}
+
+int WorkerPool::GetCurrentThreadIndex()
+{
+    // m_threads isn't modified after the constructor has returned
+    std::thread::id id = std::this_thread::get_id();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        if (m_threads[i].get_id() == id)
+            return (int) i;
+
+    return -1;
+}
+
+bool WorkerPool::Pop(int index, Task& task)
+{
+    // the thread's own queue: newest task first
+    {
+        Queue* queue = m_queues[index];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->tasks.empty())
+        {
+            task = queue->tasks.back();
+            queue->tasks.pop_back();
+            --m_numQueued;
+            return true;
+        }
+    }
+
+    // steal the oldest task from another thread
+    int numQueues = (int) m_queues.size();
+    for (int i = 1; i < numQueues; ++i)
+    {
+        Queue* queue = m_queues[(index + i) % numQueues];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->tasks.empty())
+        {
+            task = queue->tasks.front();
+            queue->tasks.pop_front();
+            --m_numQueued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkerPool::Run(int index)
+{
+    for ( ; ; )
+    {
+        Task task;
+
+        if (!Pop(index, task))
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_numQueued == 0 && !m_isStopping)
+                m_condTask.wait(lock);
+
+            // the remaining tasks are still executed when the pool is stopped
+            if (m_numQueued == 0)
+                return;
+
+            continue;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_numPending == 0)
+                m_condDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,109 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __worker_pool_h
+#define __worker_pool_h
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+//
+// A fixed set of threads executing posted tasks. Each thread has its own task
+// queue: tasks posted from a worker thread are put into the thread's queue and
+// executed by it in LIFO order (so recursive work stays local), tasks posted
+// from other threads are distributed round-robin. A thread whose queue is empty
+// steals the oldest task from another thread's queue.
+//
+class WorkerPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    //
+    // Creates the pool and starts the threads. If numThreads is 0, one
+    // thread per hardware thread is started.
+    //
+    WorkerPool(int numThreads = 0);
+
+    //
+    // Waits for all posted tasks to complete and stops the threads.
+    //
+    ~WorkerPool();
+
+    //
+    // Schedules a task for execution on one of the threads.
+    //
+    void Post(Task task);
+
+    //
+    // Blocks until all tasks posted so far have completed.
+    //
+    void Wait();
+
+    inline int GetNumThreads() const
+    {
+        return (int) m_threads.size();
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void Run(int index);
+    bool Pop(int index, Task& task);
+    int GetCurrentThreadIndex();
+
+    // not copyable
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+private:
+    std::vector<std::thread> m_threads;
+    std::vector<Queue*> m_queues;
+    std::atomic<unsigned int> m_nextQueue;
+
+    // number of tasks in the queues
+    std::atomic<int> m_numQueued;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condTask;
+    std::condition_variable m_condDone;
+
+    // number of posted tasks which haven't completed yet
+    int m_numPending;
+    bool m_isStopping;
+};
+
+
+#endif
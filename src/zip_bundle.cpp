@@ -0,0 +1,349 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lib/Libcef/Include/cef_zip_reader.h"
+#include "lib/Libcef/Include/wrapper/cef_byte_read_handler.h"
+
+#include "zip_bundle.h"
+#include "hash_util.h"
+
+
+#define ZIP_LOCAL_FILE_HEADER_SIGNATURE     0x04034b50
+#define ZIP_CENTRAL_FILE_HEADER_SIGNATURE   0x02014b50
+#define ZIP_END_OF_CENTRAL_DIR_SIGNATURE    0x06054b50
+
+#define ZIP_LOCAL_FILE_HEADER_SIZE          30
+#define ZIP_CENTRAL_FILE_HEADER_SIZE        46
+#define ZIP_END_OF_CENTRAL_DIR_SIZE         22
+#define ZIP_MAX_COMMENT_SIZE                0xffff
+
+#define ZIP_METHOD_STORED                   0
+#define ZIP_METHOD_DEFLATED                 8
+
+
+static inline uint16_t ReadUInt16(const unsigned char* p)
+{
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t ReadUInt32(const unsigned char* p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void WriteUInt16(std::string& s, uint16_t value)
+{
+    s.push_back((char) (value & 0xff));
+    s.push_back((char) (value >> 8));
+}
+
+static inline void WriteUInt32(std::string& s, uint32_t value)
+{
+    WriteUInt16(s, (uint16_t) (value & 0xffff));
+    WriteUInt16(s, (uint16_t) (value >> 16));
+}
+
+//
+// Reads len bytes at offset from the stream into buf.
+//
+static bool ReadAt(CefRefPtr<CefStreamReader> stream, int64 offset, size_t len, std::string& buf)
+{
+    if (stream->Seek(offset, SEEK_SET) != 0)
+        return false;
+
+    buf.resize(len);
+    size_t numRead = 0;
+    while (numRead < len)
+    {
+        size_t n = stream->Read(&buf[numRead], 1, len - numRead);
+        if (n == 0)
+            return false;
+        numRead += n;
+    }
+
+    return true;
+}
+
+
+//
+// The decompressed contents of an entry. Stream readers keep a reference,
+// so entries can be evicted while they are being read.
+//
+class ZipBundle::DecodedEntry : public CefBase
+{
+public:
+    std::string m_data;
+
+    IMPLEMENT_REFCOUNTING(DecodedEntry);
+};
+
+
+CefRefPtr<ZipBundle> ZipBundle::Open(const String& path, size_t maxDecodedSize)
+{
+    CefRefPtr<ZipBundle> bundle = new ZipBundle(path, maxDecodedSize);
+    if (!bundle->ReadCentralDirectory())
+        return NULL;
+    return bundle;
+}
+
+ZipBundle::ZipBundle(const String& path, size_t maxDecodedSize)
+    : m_path(path), m_decodedSize(0), m_maxDecodedSize(maxDecodedSize)
+{
+}
+
+ZipBundle::~ZipBundle()
+{
+}
+
+size_t ZipBundle::GetFileCount()
+{
+    return m_entries.size();
+}
+
+bool ZipBundle::HasFile(const String& fileName)
+{
+    return m_entries.find(fileName) != m_entries.end();
+}
+
+bool ZipBundle::GetETag(const String& fileName, String& etag)
+{
+    std::map<String, Entry>::iterator it = m_entries.find(fileName);
+    if (it == m_entries.end())
+        return false;
+
+    uint64_t hash = HashUtil::Fnv1a64(&it->second.crc32, sizeof(uint32_t));
+    hash = HashUtil::Fnv1a64(&it->second.uncompressedSize, sizeof(uint32_t), hash);
+    etag = TEXT("\"") + HashUtil::ToHex(hash) + TEXT("\"");
+
+    return true;
+}
+
+CefRefPtr<CefStreamReader> ZipBundle::GetStreamReader(const String& fileName)
+{
+    std::map<String, Entry>::iterator itEntry = m_entries.find(fileName);
+    if (itEntry == m_entries.end())
+        return NULL;
+
+    CefRefPtr<DecodedEntry> decoded;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::map<String, std::pair<CefRefPtr<DecodedEntry>, LRUList::iterator> >::iterator it = m_decoded.find(fileName);
+        if (it != m_decoded.end())
+        {
+            // move the entry to the front of the LRU list
+            m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+            decoded = it->second.first;
+        }
+    }
+
+    if (!decoded.get())
+    {
+        // decompress outside of the lock; if another thread decodes the same
+        // entry concurrently, the result which is inserted first wins
+        decoded = Decode(itEntry->second);
+        if (!decoded.get())
+            return NULL;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_decoded.find(fileName) == m_decoded.end() && decoded->m_data.size() <= m_maxDecodedSize)
+        {
+            m_lru.push_front(fileName);
+            m_decoded[fileName] = std::make_pair(decoded, m_lru.begin());
+            m_decodedSize += decoded->m_data.size();
+
+            // evict the least recently used entries
+            while (m_decodedSize > m_maxDecodedSize && !m_lru.empty())
+            {
+                std::map<String, std::pair<CefRefPtr<DecodedEntry>, LRUList::iterator> >::iterator itLast = m_decoded.find(m_lru.back());
+                m_decodedSize -= itLast->second.first->m_data.size();
+                m_decoded.erase(itLast);
+                m_lru.pop_back();
+            }
+        }
+    }
+
+    return CefStreamReader::CreateForHandler(new CefByteReadHandler(
+        (const unsigned char*) decoded->m_data.data(), decoded->m_data.size(), decoded.get()));
+}
+
+bool ZipBundle::ReadCentralDirectory()
+{
+    CefRefPtr<CefStreamReader> stream = CefStreamReader::CreateForFile(m_path);
+    if (!stream.get())
+        return false;
+
+    if (stream->Seek(0, SEEK_END) != 0)
+        return false;
+    int64 fileSize = stream->Tell();
+    if (fileSize < ZIP_END_OF_CENTRAL_DIR_SIZE)
+        return false;
+
+    // the end of central directory record is followed by a comment of up to 64 KB
+    size_t tailSize = (size_t) (fileSize < ZIP_END_OF_CENTRAL_DIR_SIZE + ZIP_MAX_COMMENT_SIZE ?
+        fileSize : ZIP_END_OF_CENTRAL_DIR_SIZE + ZIP_MAX_COMMENT_SIZE);
+    std::string tail;
+    if (!ReadAt(stream, fileSize - tailSize, tailSize, tail))
+        return false;
+
+    const unsigned char* eocd = NULL;
+    for (size_t i = tailSize - ZIP_END_OF_CENTRAL_DIR_SIZE + 1; i > 0; --i)
+    {
+        const unsigned char* p = (const unsigned char*) tail.data() + i - 1;
+        if (ReadUInt32(p) == ZIP_END_OF_CENTRAL_DIR_SIGNATURE)
+        {
+            eocd = p;
+            break;
+        }
+    }
+
+    if (eocd == NULL)
+        return false;
+
+    uint16_t numEntries = ReadUInt16(eocd + 10);
+    uint32_t centralDirSize = ReadUInt32(eocd + 12);
+    uint32_t centralDirOffset = ReadUInt32(eocd + 16);
+
+    std::string centralDir;
+    if (!ReadAt(stream, centralDirOffset, centralDirSize, centralDir))
+        return false;
+
+    const unsigned char* p = (const unsigned char*) centralDir.data();
+    const unsigned char* end = p + centralDir.size();
+
+    for (uint16_t i = 0; i < numEntries; ++i)
+    {
+        if (p + ZIP_CENTRAL_FILE_HEADER_SIZE > end || ReadUInt32(p) != ZIP_CENTRAL_FILE_HEADER_SIGNATURE)
+            return false;
+
+        uint16_t nameLen = ReadUInt16(p + 28);
+        uint16_t extraLen = ReadUInt16(p + 30);
+        uint16_t commentLen = ReadUInt16(p + 32);
+        size_t headerSize = ZIP_CENTRAL_FILE_HEADER_SIZE + nameLen + extraLen + commentLen;
+        if (p + headerSize > end)
+            return false;
+
+        Entry entry;
+        entry.header.assign((const char*) p, headerSize);
+        entry.method = ReadUInt16(p + 10);
+        entry.crc32 = ReadUInt32(p + 16);
+        entry.compressedSize = ReadUInt32(p + 20);
+        entry.uncompressedSize = ReadUInt32(p + 24);
+        entry.localHeaderOffset = ReadUInt32(p + 42);
+
+        std::string name((const char*) p + ZIP_CENTRAL_FILE_HEADER_SIZE, nameLen);
+
+        // skip directories and entries which can't be decoded
+        bool isDirectory = name.length() > 0 && name.at(name.length() - 1) == '/';
+        bool isZip64 = entry.compressedSize == 0xffffffff || entry.uncompressedSize == 0xffffffff || entry.localHeaderOffset == 0xffffffff;
+        bool isSupported = entry.method == ZIP_METHOD_STORED || entry.method == ZIP_METHOD_DEFLATED;
+        if (!isDirectory && !isZip64 && isSupported)
+            m_entries[String(CefString(name))] = entry;
+
+        p += headerSize;
+    }
+
+    return true;
+}
+
+CefRefPtr<ZipBundle::DecodedEntry> ZipBundle::Decode(const Entry& entry)
+{
+    CefRefPtr<CefStreamReader> stream = CefStreamReader::CreateForFile(m_path);
+    if (!stream.get())
+        return NULL;
+
+    std::string localHeader;
+    if (!ReadAt(stream, entry.localHeaderOffset, ZIP_LOCAL_FILE_HEADER_SIZE, localHeader))
+        return NULL;
+
+    const unsigned char* p = (const unsigned char*) localHeader.data();
+    if (ReadUInt32(p) != ZIP_LOCAL_FILE_HEADER_SIGNATURE)
+        return NULL;
+
+    size_t localHeaderSize = ZIP_LOCAL_FILE_HEADER_SIZE + ReadUInt16(p + 26) + ReadUInt16(p + 28);
+
+    CefRefPtr<DecodedEntry> decoded = new DecodedEntry();
+
+    if (entry.method == ZIP_METHOD_STORED)
+    {
+        if (!ReadAt(stream, entry.localHeaderOffset + localHeaderSize, entry.uncompressedSize, decoded->m_data))
+            return NULL;
+        return decoded;
+    }
+
+    // Inflate using CEF's zip reader. To avoid having it scan the entire
+    // archive, it is presented with an archive consisting only of this entry:
+    // the local file header and the compressed data followed by the entry's
+    // central directory header and an end of central directory record.
+    std::string archive;
+    if (!ReadAt(stream, entry.localHeaderOffset, localHeaderSize + entry.compressedSize, archive))
+        return NULL;
+
+    size_t centralDirOffset = archive.size();
+    archive.append(entry.header);
+    for (int i = 0; i < 4; ++i)
+        archive[centralDirOffset + 42 + i] = 0;   // the local header is now at offset 0
+
+    WriteUInt32(archive, ZIP_END_OF_CENTRAL_DIR_SIGNATURE);
+    WriteUInt16(archive, 0);    // number of this disk
+    WriteUInt16(archive, 0);    // disk where the central directory starts
+    WriteUInt16(archive, 1);    // number of central directory records on this disk
+    WriteUInt16(archive, 1);    // total number of central directory records
+    WriteUInt32(archive, (uint32_t) entry.header.size());
+    WriteUInt32(archive, (uint32_t) centralDirOffset);
+    WriteUInt16(archive, 0);    // comment length
+
+    CefRefPtr<CefZipReader> reader = CefZipReader::Create(CefStreamReader::CreateForData(&archive[0], archive.size()));
+    if (!reader.get())
+        return NULL;
+
+    bool success = false;
+    if (reader->MoveToFirstFile() && reader->OpenFile(""))
+    {
+        decoded->m_data.resize(entry.uncompressedSize);
+
+        size_t numRead = 0;
+        while (numRead < entry.uncompressedSize)
+        {
+            int n = reader->ReadFile(&decoded->m_data[numRead], entry.uncompressedSize - numRead);
+            if (n <= 0)
+                break;
+            numRead += n;
+        }
+
+        success = numRead == entry.uncompressedSize;
+        reader->CloseFile();
+    }
+
+    reader->Close();
+
+    if (!success)
+        return NULL;
+    return decoded;
+}
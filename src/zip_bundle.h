@@ -0,0 +1,131 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __zip_bundle_h
+#define __zip_bundle_h
+
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "lib/Libcef/Include/cef_stream.h"
+#include "types.h"
+
+
+// Name of the zip archive the app resources can be shipped in
+#define APP_BUNDLE_NAME TEXT("app.zip")
+
+// Maximum total size of the decompressed entries kept in memory
+#define ZIP_BUNDLE_MAX_DECODED_SIZE (8 * 1024 * 1024)
+
+
+//
+// Read-only access to the files in a zip archive.
+//
+// Unlike CefZipArchive, which inflates all entries up front, only the
+// central directory is read when the archive is opened. Entries are
+// decompressed when they are accessed for the first time; the most recently
+// used decompressed entries are kept in memory, up to a total size of
+// maxDecodedSize bytes.
+//
+// Supported are stored and deflated entries of archives without zip64
+// extensions. Entry names are compared case-sensitively. Safe to use from
+// any thread.
+//
+class ZipBundle : public CefBase
+{
+public:
+    //
+    // Opens the archive at path and reads its central directory.
+    // Returns NULL if the file doesn't exist or isn't a zip archive.
+    //
+    static CefRefPtr<ZipBundle> Open(const String& path, size_t maxDecodedSize = ZIP_BUNDLE_MAX_DECODED_SIZE);
+
+    virtual ~ZipBundle();
+
+    //
+    // Returns the number of files in the archive.
+    //
+    size_t GetFileCount();
+
+    //
+    // Tests whether the archive contains the file.
+    //
+    bool HasFile(const String& fileName);
+
+    //
+    // Retrieves the entity tag of a file, which is derived from the CRC-32
+    // and size recorded in the central directory.
+    //
+    bool GetETag(const String& fileName, String& etag);
+
+    //
+    // Returns a stream reader over the decompressed contents of the file,
+    // or NULL if the archive doesn't contain the file or it can't be
+    // decompressed.
+    //
+    CefRefPtr<CefStreamReader> GetStreamReader(const String& fileName);
+
+private:
+    struct Entry
+    {
+        // the central directory file header, including name, extra field and comment
+        std::string header;
+
+        uint16_t method;
+        uint32_t crc32;
+        uint32_t compressedSize;
+        uint32_t uncompressedSize;
+        uint32_t localHeaderOffset;
+    };
+
+    class DecodedEntry;
+    typedef std::list<String> LRUList;
+
+    ZipBundle(const String& path, size_t maxDecodedSize);
+
+    bool ReadCentralDirectory();
+    CefRefPtr<DecodedEntry> Decode(const Entry& entry);
+
+private:
+    String m_path;
+    std::map<String, Entry> m_entries;
+
+    std::mutex m_mutex;
+
+    // decompressed entries; the most recently used entry is at the front of m_lru
+    std::map<String, std::pair<CefRefPtr<DecodedEntry>, LRUList::iterator> > m_decoded;
+    LRUList m_lru;
+    size_t m_decodedSize;
+    size_t m_maxDecodedSize;
+
+    IMPLEMENT_REFCOUNTING(ZipBundle);
+};
+
+
+#endif
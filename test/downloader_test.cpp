@@ -0,0 +1,248 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#include <algorithm>
+#include <mutex>
+
+#include "file_util.h"
+#include "network_util.h"
+#include "loopback_server.h"
+#include "test_util.h"
+
+
+DEFINE_TEST_GLOBALS();
+
+static LoopbackServer* g_server = NULL;
+static std::string g_dir;
+
+static const std::string g_contents = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+// the state of "/resumable", which has the ETag "v<version>" and is cut off
+// after 10 bytes if isCutOff is set
+static std::mutex g_mutex;
+static int g_version = 1;
+static bool g_isCutOff = false;
+static LoopbackServer::Request g_lastRequest;
+
+
+static std::string GetContents(int version)
+{
+    std::string contents = g_contents;
+    if (version != 1)
+        std::reverse(contents.begin(), contents.end());
+    return contents;
+}
+
+static std::string RespondResumable(const LoopbackServer::Request& request)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_lastRequest = request;
+
+    std::string etag = "\"v" + std::to_string(g_version) + "\"";
+    std::string contents = GetContents(g_version);
+
+    if (g_isCutOff)
+    {
+        g_isCutOff = false;
+        return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(contents.length()) + "\r\nETag: " + etag +
+            "\r\nConnection: close\r\n\r\n" + contents.substr(0, 10);
+    }
+
+    std::map<std::string, std::string>::const_iterator range = request.headers.find("range");
+    std::map<std::string, std::string>::const_iterator ifRange = request.headers.find("if-range");
+    if (range != request.headers.end() && (ifRange == request.headers.end() || ifRange->second == etag))
+    {
+        size_t first = (size_t) atol(range->second.c_str() + 6);
+        std::string contentRange = "bytes " + std::to_string(first) + "-" + std::to_string(contents.length() - 1) + "/" + std::to_string(contents.length());
+        return MakeResponse(206, contents.substr(first), "ETag: " + etag + "\r\nContent-Range: " + contentRange + "\r\n");
+    }
+
+    return MakeResponse(200, contents, "ETag: " + etag + "\r\n");
+}
+
+
+static std::string Respond(const LoopbackServer::Request& request)
+{
+    const std::string& path = request.path;
+
+    if (path == "/file")
+        return MakeResponse(200, g_contents);
+    if (path == "/resumable")
+        return RespondResumable(request);
+    if (path == "/secure")
+        return MakeResponse(302, "", "Location: https://127.0.0.1/file\r\n");
+
+    return MakeResponse(404, "not found");
+}
+
+//
+// Downloads the URL and returns the final progress.
+//
+static NetworkUtil::DownloadProgress Download(const std::string& url, const std::string& path, bool resume)
+{
+    NetworkUtil::DownloadOptions options;
+    options.resume = resume;
+    options.size = -1;
+    options.algorithm = FileHasher::ALGORITHM_SHA256;
+
+    Completion completion;
+    NetworkUtil::DownloadProgress result;
+    result.status = NetworkUtil::DOWNLOAD_IN_PROGRESS;
+    result.error = NetworkUtil::DOWNLOAD_OK;
+
+    NetworkUtil::Download(url, path, options, [&completion, &result](const NetworkUtil::DownloadProgress& progress) {
+        if (progress.status != NetworkUtil::DOWNLOAD_IN_PROGRESS)
+        {
+            result = progress;
+            completion.Complete(true);
+        }
+    });
+
+    completion.Wait(1);
+    return result;
+}
+
+
+static void TestDownload()
+{
+    std::string path = g_dir + "/download.txt";
+    NetworkUtil::DownloadProgress progress = Download(g_server->GetUrl("/file"), path, false);
+    CHECK(progress.status == NetworkUtil::DOWNLOAD_DONE);
+    CHECK(progress.numBytesReceived == g_contents.length());
+    CHECK(ReadContents(path) == g_contents);
+    CHECK(!Exists(path + ".part"));
+}
+
+//
+// Leaves a partial download of version 1 of "/resumable" behind.
+//
+static void Interrupt(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_version = 1;
+        g_isCutOff = true;
+    }
+
+    NetworkUtil::DownloadProgress progress = Download(g_server->GetUrl("/resumable"), path, true);
+    CHECK(progress.status == NetworkUtil::DOWNLOAD_FAILED);
+    CHECK(ReadContents(path + ".part") == g_contents.substr(0, 10));
+}
+
+static std::string GetLastRequestHeader(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    std::map<std::string, std::string>::const_iterator it = g_lastRequest.headers.find(name);
+    return it == g_lastRequest.headers.end() ? "" : it->second;
+}
+
+static void TestResume()
+{
+    std::string path = g_dir + "/resume.txt";
+    Interrupt(path);
+
+    NetworkUtil::DownloadProgress progress = Download(g_server->GetUrl("/resumable"), path, true);
+    CHECK(progress.status == NetworkUtil::DOWNLOAD_DONE);
+    CHECK(progress.httpStatus == 206);
+    CHECK(GetLastRequestHeader("range") == "bytes=10-");
+    CHECK(GetLastRequestHeader("if-range") == "\"v1\"");
+    CHECK(ReadContents(path) == g_contents);
+    CHECK(!Exists(path + ".part") && !Exists(path + ".part.validator"));
+}
+
+static void TestResumeChangedFile()
+{
+    std::string path = g_dir + "/changed.txt";
+    Interrupt(path);
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_version = 2;
+    }
+
+    // the server sends the entire new version
+    NetworkUtil::DownloadProgress progress = Download(g_server->GetUrl("/resumable"), path, true);
+    CHECK(progress.status == NetworkUtil::DOWNLOAD_DONE);
+    CHECK(progress.httpStatus == 200);
+    CHECK(ReadContents(path) == GetContents(2));
+}
+
+static void TestResumeWithoutValidator()
+{
+    // a partial file whose origin is unknown isn't continued
+    std::string path = g_dir + "/unknown.txt";
+    WriteContents(path + ".part", "stale data");
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_version = 1;
+    }
+
+    NetworkUtil::DownloadProgress progress = Download(g_server->GetUrl("/resumable"), path, true);
+    CHECK(progress.status == NetworkUtil::DOWNLOAD_DONE);
+    CHECK(GetLastRequestHeader("range").empty());
+    CHECK(ReadContents(path) == g_contents);
+}
+
+static void TestUnsupportedUrl()
+{
+    std::string path = g_dir + "/unsupported.txt";
+
+    NetworkUtil::DownloadProgress progress = Download("https://127.0.0.1/file", path, false);
+    CHECK(progress.status == NetworkUtil::DOWNLOAD_FAILED);
+    CHECK(progress.error == NetworkUtil::DOWNLOAD_UNSUPPORTED_URL);
+
+    progress = Download(g_server->GetUrl("/secure"), path, false);
+    CHECK(progress.status == NetworkUtil::DOWNLOAD_FAILED);
+    CHECK(progress.error == NetworkUtil::DOWNLOAD_UNSUPPORTED_URL);
+    CHECK(progress.httpStatus == 302);
+    CHECK(!Exists(path) && !Exists(path + ".part"));
+}
+
+
+int main()
+{
+    g_dir = MakeTempDirectory();
+    if (g_dir.empty())
+        return 1;
+
+    LoopbackServer server(Respond);
+    if (!server.Start())
+        return 1;
+    g_server = &server;
+
+    RUN_TEST(TestDownload);
+    RUN_TEST(TestResume);
+    RUN_TEST(TestResumeChangedFile);
+    RUN_TEST(TestResumeWithoutValidator);
+    RUN_TEST(TestUnsupportedUrl);
+
+    NetworkUtil::StopHttpClient();
+    server.Stop();
+    FileHasher::Stop();
+    RemoveDirectoryTree(g_dir);
+
+    return TEST_RESULT;
+}
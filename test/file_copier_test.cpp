@@ -0,0 +1,147 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+
+#include <unistd.h>
+
+#include <string>
+
+#include "file_util.h"
+#include "test_util.h"
+
+
+DEFINE_TEST_GLOBALS();
+
+static std::string g_dir;
+
+
+typedef int (*CopyFunction)(const String& from, const String& to, FileUtil::CopyCallback onProgress);
+
+//
+// Runs a copy or move and returns its final status.
+//
+static FileUtil::CopyStatus Run(CopyFunction fnx, const std::string& from, const std::string& to)
+{
+    Completion completion;
+    FileUtil::CopyStatus status = FileUtil::COPY_IN_PROGRESS;
+    fnx(from, to, [&completion, &status](const FileUtil::CopyProgress& progress) {
+        if (progress.status != FileUtil::COPY_IN_PROGRESS)
+        {
+            status = progress.status;
+            completion.Complete(true);
+        }
+    });
+    completion.Wait(1);
+    return status;
+}
+
+
+static void TestCopy()
+{
+    std::string from = g_dir + "/copy-from.txt";
+    std::string to = g_dir + "/copy-to.txt";
+    WriteContents(from, "hello");
+    WriteContents(to, "previous contents");
+
+    CHECK(Run(FileUtil::Copy, from, to) == FileUtil::COPY_DONE);
+    CHECK(ReadContents(from) == "hello");
+    CHECK(ReadContents(to) == "hello");
+}
+
+static void TestCopyOntoItself()
+{
+    std::string path = g_dir + "/self.txt";
+    WriteContents(path, "hello");
+
+    CHECK(Run(FileUtil::Copy, path, path) == FileUtil::COPY_FAILED);
+    CHECK(Run(FileUtil::Copy, path, g_dir + "/./self.txt") == FileUtil::COPY_FAILED);
+    CHECK(Run(FileUtil::Move, path, path) == FileUtil::COPY_FAILED);
+    CHECK(ReadContents(path) == "hello");
+}
+
+static void TestCopyOntoLink()
+{
+    std::string path = g_dir + "/linked.txt";
+    std::string hardLink = g_dir + "/hard-link.txt";
+    std::string symbolicLink = g_dir + "/symbolic-link.txt";
+    WriteContents(path, "hello");
+    CHECK(link(path.c_str(), hardLink.c_str()) == 0);
+    CHECK(symlink(path.c_str(), symbolicLink.c_str()) == 0);
+
+    CHECK(Run(FileUtil::Copy, path, hardLink) == FileUtil::COPY_FAILED);
+    CHECK(Run(FileUtil::Copy, path, symbolicLink) == FileUtil::COPY_FAILED);
+    CHECK(ReadContents(path) == "hello");
+
+    // the copy itself refuses to truncate its source
+    CHECK(!FileUtil::CopyFileContents(path, hardLink, [](uint64_t) { return true; }));
+    CHECK(ReadContents(path) == "hello");
+}
+
+static void TestCopyTreeOntoItself()
+{
+    std::string dir = g_dir + "/tree";
+    CHECK(mkdir(dir.c_str(), 0755) == 0);
+    WriteContents(dir + "/a.txt", "a");
+
+    CHECK(Run(FileUtil::CopyTree, dir, dir) == FileUtil::COPY_FAILED);
+    CHECK(Run(FileUtil::CopyTree, dir, dir + "/.") == FileUtil::COPY_FAILED);
+    CHECK(ReadContents(dir + "/a.txt") == "a");
+}
+
+static void TestCancelledCopyKeepsExistingFile()
+{
+    std::string from = g_dir + "/cancel-from.txt";
+    std::string to = g_dir + "/cancel-to.txt";
+    std::string created = g_dir + "/cancel-created.txt";
+    WriteContents(from, "hello");
+    WriteContents(to, "previous contents");
+
+    // an existing destination has been replaced, but isn't deleted
+    CHECK(!FileUtil::CopyFileContents(from, to, [](uint64_t) { return false; }));
+    CHECK(Exists(to));
+
+    // a destination created by the copy is deleted
+    CHECK(!FileUtil::CopyFileContents(from, created, [](uint64_t) { return false; }));
+    CHECK(!Exists(created));
+    CHECK(ReadContents(from) == "hello");
+}
+
+
+int main()
+{
+    g_dir = MakeTempDirectory();
+    if (g_dir.empty())
+        return 1;
+
+    RUN_TEST(TestCopy);
+    RUN_TEST(TestCopyOntoItself);
+    RUN_TEST(TestCopyOntoLink);
+    RUN_TEST(TestCopyTreeOntoItself);
+    RUN_TEST(TestCancelledCopyKeepsExistingFile);
+
+    FileUtil::StopCopier();
+    RemoveDirectoryTree(g_dir);
+
+    return TEST_RESULT;
+}
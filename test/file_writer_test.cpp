@@ -0,0 +1,227 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <dirent.h>
+
+#include <thread>
+#include <vector>
+
+#include "file_util.h"
+#include "test_util.h"
+
+
+DEFINE_TEST_GLOBALS();
+
+static std::string g_dir;
+
+
+static std::vector<uint8_t> ToData(const std::string& s)
+{
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+static bool Write(const std::string& path, const std::string& contents, bool atomic, bool sync)
+{
+    Completion completion;
+    std::vector<uint8_t> data = ToData(contents);
+    FileUtil::WriteFile(path, data, atomic, sync, [&completion](bool success) { completion.Complete(success); });
+    return completion.Wait(1) == 1;
+}
+
+static bool Append(const std::string& path, const std::string& contents, bool sync)
+{
+    Completion completion;
+    std::vector<uint8_t> data = ToData(contents);
+    FileUtil::AppendFile(path, data, sync, [&completion](bool success) { completion.Complete(success); });
+    return completion.Wait(1) == 1;
+}
+
+static int CountEntries(const std::string& path)
+{
+    int count = 0;
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL)
+        return -1;
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+            ++count;
+    }
+    closedir(dir);
+    return count;
+}
+
+
+static void TestWrite()
+{
+    std::string path = g_dir + "/write.txt";
+    CHECK(Write(path, "hello", false, false));
+    CHECK(ReadContents(path) == "hello");
+
+    // an existing file is truncated
+    CHECK(Write(path, "hi", false, true));
+    CHECK(ReadContents(path) == "hi");
+
+    // empty data creates an empty file
+    CHECK(Write(g_dir + "/empty.txt", "", false, false));
+    CHECK(Exists(g_dir + "/empty.txt") && ReadContents(g_dir + "/empty.txt").empty());
+}
+
+static void TestAppend()
+{
+    std::string path = g_dir + "/append.txt";
+    CHECK(Append(path, "one,", false));
+    CHECK(Append(path, "two,", true));
+    CHECK(Append(path, "three", false));
+    CHECK(ReadContents(path) == "one,two,three");
+}
+
+static void TestAtomicReplace()
+{
+    std::string dir = g_dir + "/atomic";
+    mkdir(dir.c_str(), 0755);
+    std::string path = dir + "/file.txt";
+
+    WriteContents(path, "old contents");
+    CHECK(Write(path, "new", true, false));
+    CHECK(ReadContents(path) == "new");
+    CHECK(Write(path, "newer", true, true));
+    CHECK(ReadContents(path) == "newer");
+
+    // no temporary files are left behind
+    CHECK(CountEntries(dir) == 1);
+}
+
+static void TestAtomicReplaceKeepsMode()
+{
+    static const mode_t modes[] = { 0600, 0640, 0750, 0755 };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+    {
+        std::string path = g_dir + "/mode.txt";
+        WriteContents(path, "x");
+        chmod(path.c_str(), modes[i]);
+
+        CHECK(Write(path, "replaced", true, i % 2 == 0));
+
+        struct stat st;
+        CHECK(stat(path.c_str(), &st) == 0 && (st.st_mode & 07777) == modes[i]);
+        CHECK(ReadContents(path) == "replaced");
+    }
+}
+
+static void TestOrdering()
+{
+    // writes to the same file are executed in the order in which they are issued,
+    // even if atomic replacements and appends are synced in the same group
+    std::string path = g_dir + "/ordered.txt";
+    Completion completion;
+    std::vector<std::string> parts;
+    parts.push_back("a");
+    parts.push_back("b");
+    parts.push_back("c");
+
+    std::vector<uint8_t> data = ToData("start:");
+    FileUtil::WriteFile(path, data, true, true, [&completion](bool success) { completion.Complete(success); });
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        data = ToData(parts[i]);
+        FileUtil::AppendFile(path, data, true, [&completion](bool success) { completion.Complete(success); });
+    }
+    data = ToData("replaced:");
+    FileUtil::WriteFile(path, data, true, true, [&completion](bool success) { completion.Complete(success); });
+    data = ToData("end");
+    FileUtil::AppendFile(path, data, false, [&completion](bool success) { completion.Complete(success); });
+
+    CHECK(completion.Wait(6) == 6);
+    CHECK(ReadContents(path) == "replaced:end");
+}
+
+static void TestConcurrentSyncedWrites()
+{
+    // durable writes from several threads, which the writer syncs in groups
+    const int numThreads = 8;
+    const int numWritesPerThread = 25;
+    std::string dir = g_dir + "/concurrent";
+    mkdir(dir.c_str(), 0755);
+
+    Completion completion;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([t, &dir, &completion]() {
+            for (int i = 0; i < numWritesPerThread; ++i)
+            {
+                std::string name = dir + "/" + std::to_string(t) + "-" + std::to_string(i);
+                std::vector<uint8_t> data = ToData(name);
+                FileUtil::WriteFile(name, data, i % 2 == 0, true, [&completion](bool success) { completion.Complete(success); });
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    CHECK(completion.Wait(numThreads * numWritesPerThread) == numThreads * numWritesPerThread);
+    CHECK(CountEntries(dir) == numThreads * numWritesPerThread);
+
+    bool isContentsOK = true;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        for (int i = 0; i < numWritesPerThread; ++i)
+        {
+            std::string name = dir + "/" + std::to_string(t) + "-" + std::to_string(i);
+            isContentsOK = isContentsOK && ReadContents(name) == name;
+        }
+    }
+    CHECK(isContentsOK);
+}
+
+static void TestFailure()
+{
+    std::string path = g_dir + "/missing/file.txt";
+    CHECK(!Write(path, "x", false, false));
+    CHECK(!Write(path, "x", true, true));
+    CHECK(!Append(path, "x", true));
+    CHECK(!Exists(g_dir + "/missing"));
+}
+
+
+int main()
+{
+    g_dir = MakeTempDirectory();
+    if (g_dir.empty())
+        return 1;
+
+    RUN_TEST(TestWrite);
+    RUN_TEST(TestAppend);
+    RUN_TEST(TestAtomicReplace);
+    RUN_TEST(TestAtomicReplaceKeepsMode);
+    RUN_TEST(TestOrdering);
+    RUN_TEST(TestConcurrentSyncedWrites);
+    RUN_TEST(TestFailure);
+
+    FileUtil::StopWriter();
+    RemoveDirectoryTree(g_dir);
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,278 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#include <chrono>
+#include <thread>
+
+#include "network_util.h"
+#include "loopback_server.h"
+#include "test_util.h"
+
+
+DEFINE_TEST_GLOBALS();
+
+static LoopbackServer* g_server = NULL;
+
+
+static std::string Respond(const LoopbackServer::Request& request)
+{
+    const std::string& path = request.path;
+
+    if (path.compare(0, 6, "/hello") == 0)
+        return MakeResponse(200, "hello");
+    if (path == "/echo")
+        return MakeResponse(200, request.method + ":" + request.body, "Content-Type: text/plain\r\n");
+    if (path == "/chunked")
+        return "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nchunk\r\n7\r\ned body\r\n0\r\n\r\n";
+    if (path == "/redirect")
+        return MakeResponse(302, "", "Location: /hello\r\n");
+    if (path == "/see-other")
+        return MakeResponse(303, "", "Location: /echo\r\n");
+    if (path == "/secure")
+        return MakeResponse(301, "", "Location: HTTPS://example.com/\r\n");
+    if (path == "/close")
+        return MakeResponse(200, "closed", "Connection: close\r\n");
+    if (path == "/large")
+        return MakeResponse(200, std::string(1024 * 1024, 'x'));
+    if (path == "/slow")
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        return MakeResponse(200, "slow");
+    }
+
+    return MakeResponse(404, "not found");
+}
+
+//
+// Sends a request and waits for its response.
+//
+static NetworkUtil::HttpResponse Send(const NetworkUtil::HttpRequest& request)
+{
+    Completion completion;
+    NetworkUtil::HttpResponse result;
+    result.error = NetworkUtil::REQUEST_TIMED_OUT;
+    result.status = 0;
+
+    NetworkUtil::SendRequest(request, [&completion, &result](NetworkUtil::HttpResponse& response) {
+        result = response;
+        completion.Complete(true);
+    });
+
+    completion.Wait(1);
+    return result;
+}
+
+static NetworkUtil::HttpResponse Get(const std::string& url)
+{
+    NetworkUtil::HttpRequest request;
+    request.method = "GET";
+    request.url = url;
+    return Send(request);
+}
+
+
+static void TestGet()
+{
+    NetworkUtil::HttpResponse response = Get(g_server->GetUrl("/hello"));
+    CHECK(response.error == NetworkUtil::REQUEST_OK);
+    CHECK(response.status == 200);
+    CHECK(response.body == "hello");
+    CHECK(NetworkUtil::GetHeader(response.headers, "content-length") == "5");
+
+    response = Get(g_server->GetUrl("/missing"));
+    CHECK(response.error == NetworkUtil::REQUEST_OK && response.status == 404);
+}
+
+static void TestPost()
+{
+    NetworkUtil::HttpRequest request;
+    request.method = "post";
+    request.url = g_server->GetUrl("/echo");
+    request.body = "a=1&b=2";
+    request.headers.push_back(std::make_pair(std::string("Content-Type"), std::string("application/x-www-form-urlencoded")));
+
+    NetworkUtil::HttpResponse response = Send(request);
+    CHECK(response.status == 200);
+    CHECK(response.body == "POST:a=1&b=2");
+    CHECK(NetworkUtil::GetHeader(response.headers, "Content-Type") == "text/plain");
+}
+
+static void TestChunked()
+{
+    NetworkUtil::HttpResponse response = Get(g_server->GetUrl("/chunked"));
+    CHECK(response.status == 200);
+    CHECK(response.body == "chunked body");
+}
+
+static void TestRedirect()
+{
+    NetworkUtil::HttpResponse response = Get(g_server->GetUrl("/redirect"));
+    CHECK(response.status == 200);
+    CHECK(response.body == "hello");
+    CHECK(response.url == g_server->GetUrl("/hello"));
+
+    // a POST redirected with 303 becomes a GET
+    NetworkUtil::HttpRequest request;
+    request.method = "POST";
+    request.url = g_server->GetUrl("/see-other");
+    request.body = "data";
+    response = Send(request);
+    CHECK(response.status == 200 && response.body == "GET:");
+}
+
+static void TestRedirectToHttps()
+{
+    // isn't followed, but passed on
+    NetworkUtil::HttpResponse response = Get(g_server->GetUrl("/secure"));
+    CHECK(response.error == NetworkUtil::REQUEST_OK);
+    CHECK(response.status == 301);
+    CHECK(NetworkUtil::GetUrlScheme(NetworkUtil::GetHeader(response.headers, "Location")) == "https");
+
+    CHECK(NetworkUtil::GetUrlScheme("Http://example.com/") == "http");
+    CHECK(NetworkUtil::GetUrlScheme("/path:with-colon") == "");
+    CHECK(NetworkUtil::GetUrlScheme("//example.com/") == "");
+}
+
+static void TestKeepAlive()
+{
+    // sequential requests reuse the idle connection
+    int numConnections = g_server->GetNumConnections();
+    for (int i = 0; i < 10; ++i)
+        CHECK(Get(g_server->GetUrl("/hello")).body == "hello");
+    CHECK(g_server->GetNumConnections() - numConnections <= 1);
+
+    // a closed connection is replaced
+    CHECK(Get(g_server->GetUrl("/close")).body == "closed");
+    CHECK(Get(g_server->GetUrl("/hello")).body == "hello");
+}
+
+static void TestConcurrent()
+{
+    // concurrent requests share at most HTTP_MAX_CONNECTIONS_PER_HOST
+    // connections; the others are queued or pipelined
+    const int numRequests = 40;
+    int numConnections = g_server->GetNumConnections();
+
+    Completion completion;
+    for (int i = 0; i < numRequests; ++i)
+    {
+        NetworkUtil::HttpRequest request;
+        request.method = "GET";
+        request.url = g_server->GetUrl("/hello?" + std::to_string(i));
+        NetworkUtil::SendRequest(request, [&completion](NetworkUtil::HttpResponse& response) {
+            completion.Complete(response.error == NetworkUtil::REQUEST_OK && response.body == "hello");
+        });
+    }
+
+    CHECK(completion.Wait(numRequests) == numRequests);
+    CHECK(g_server->GetNumConnections() - numConnections <= HTTP_MAX_CONNECTIONS_PER_HOST);
+}
+
+static void TestStreaming()
+{
+    size_t numBytes = 0;
+    bool isBodyIntact = true;
+    bool hasHeaders = false;
+
+    NetworkUtil::HttpRequest request;
+    request.method = "GET";
+    request.url = g_server->GetUrl("/large");
+    request.onHeaders = [&hasHeaders](const NetworkUtil::HttpResponse& response) {
+        hasHeaders = response.status == 200;
+        return true;
+    };
+    request.onData = [&numBytes, &isBodyIntact](const char* data, size_t length) {
+        for (size_t i = 0; i < length; ++i)
+            if (data[i] != 'x')
+                isBodyIntact = false;
+        numBytes += length;
+        return true;
+    };
+
+    NetworkUtil::HttpResponse response = Send(request);
+    CHECK(response.status == 200);
+    CHECK(hasHeaders);
+    CHECK(numBytes == 1024 * 1024);
+    CHECK(isBodyIntact);
+    CHECK(response.body.empty());
+}
+
+static void TestCancel()
+{
+    Completion completion;
+    NetworkUtil::RequestError error = NetworkUtil::REQUEST_OK;
+
+    NetworkUtil::HttpRequest request;
+    request.method = "GET";
+    request.url = g_server->GetUrl("/slow");
+    int id = NetworkUtil::SendRequest(request, [&completion, &error](NetworkUtil::HttpResponse& response) {
+        error = response.error;
+        completion.Complete(true);
+    });
+    NetworkUtil::CancelRequest(id);
+
+    CHECK(completion.Wait(1) == 1);
+    CHECK(error == NetworkUtil::REQUEST_CANCELLED);
+
+    // the client is still usable
+    CHECK(Get(g_server->GetUrl("/hello")).body == "hello");
+}
+
+static void TestErrors()
+{
+    CHECK(Get("ftp://127.0.0.1/").error == NetworkUtil::REQUEST_INVALID_URL);
+    CHECK(Get("http://:80/").error == NetworkUtil::REQUEST_INVALID_URL);
+
+    // a port nobody listens on
+    LoopbackServer server(Respond);
+    server.Start();
+    std::string url = server.GetUrl("/hello");
+    server.Stop();
+    CHECK(Get(url).error == NetworkUtil::REQUEST_CONNECT_FAILED);
+}
+
+
+int main()
+{
+    LoopbackServer server(Respond);
+    if (!server.Start())
+        return 1;
+    g_server = &server;
+
+    RUN_TEST(TestGet);
+    RUN_TEST(TestPost);
+    RUN_TEST(TestChunked);
+    RUN_TEST(TestRedirect);
+    RUN_TEST(TestRedirectToHttps);
+    RUN_TEST(TestKeepAlive);
+    RUN_TEST(TestConcurrent);
+    RUN_TEST(TestStreaming);
+    RUN_TEST(TestCancel);
+    RUN_TEST(TestErrors);
+
+    NetworkUtil::StopHttpClient();
+    server.Stop();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,281 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __loopback_server_h
+#define __loopback_server_h
+
+
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//
+// A minimal HTTP/1.1 server on 127.0.0.1 for testing the HTTP client. Each
+// connection is served by a thread; pipelined requests are answered in order,
+// and connections are kept alive unless the response says otherwise.
+//
+class LoopbackServer
+{
+public:
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> headers;
+        std::string body;
+    };
+
+    //
+    // Returns the raw response (status line, headers and body) to a request.
+    // The connection is closed after the response if it contains
+    // "Connection: close".
+    //
+    typedef std::function<std::string(const Request& request)> Handler;
+
+    LoopbackServer(Handler handler)
+        : m_handler(handler), m_listener(-1), m_port(0), m_numConnections(0), m_numRequests(0)
+    {
+    }
+
+    ~LoopbackServer()
+    {
+        Stop();
+    }
+
+    bool Start()
+    {
+        m_listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listener < 0)
+            return false;
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (bind(m_listener, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(m_listener, 64) != 0 ||
+            getsockname(m_listener, (sockaddr*) &addr, &len) != 0)
+        {
+            return false;
+        }
+
+        m_port = ntohs(addr.sin_port);
+        int listener = m_listener;
+        m_acceptThread = std::thread([this, listener]() { Accept(listener); });
+        return true;
+    }
+
+    void Stop()
+    {
+        if (m_listener < 0)
+            return;
+
+        shutdown(m_listener, SHUT_RDWR);
+        m_acceptThread.join();
+        close(m_listener);
+        m_listener = -1;
+
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < m_sockets.size(); ++i)
+                shutdown(m_sockets[i], SHUT_RDWR);
+            threads.swap(m_threads);
+        }
+
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+    }
+
+    int GetPort() const
+    {
+        return m_port;
+    }
+
+    std::string GetUrl(const std::string& path) const
+    {
+        return "http://127.0.0.1:" + std::to_string(m_port) + path;
+    }
+
+    //
+    // The number of connections accepted and of requests received so far.
+    //
+    int GetNumConnections() const
+    {
+        return m_numConnections;
+    }
+
+    int GetNumRequests() const
+    {
+        return m_numRequests;
+    }
+
+private:
+    void Accept(int listener)
+    {
+        for ( ; ; )
+        {
+            int s = accept(listener, NULL, NULL);
+            if (s < 0)
+                return;
+
+            ++m_numConnections;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_sockets.push_back(s);
+            m_threads.push_back(std::thread([this, s]() { Serve(s); }));
+        }
+    }
+
+    void Serve(int s)
+    {
+        std::string input;
+        char buf[4096];
+        bool isOpen = true;
+
+        while (isOpen)
+        {
+            // wait for a complete request
+            size_t headerEnd = input.find("\r\n\r\n");
+            Request request;
+            size_t requestLength = 0;
+            if (headerEnd != std::string::npos)
+            {
+                ParseHeaders(input.substr(0, headerEnd), request);
+                size_t contentLength = (size_t) atol(request.headers["content-length"].c_str());
+                if (input.length() >= headerEnd + 4 + contentLength)
+                {
+                    request.body = input.substr(headerEnd + 4, contentLength);
+                    requestLength = headerEnd + 4 + contentLength;
+                }
+            }
+
+            if (requestLength == 0)
+            {
+                ssize_t n = recv(s, buf, sizeof(buf), 0);
+                if (n <= 0)
+                    break;
+                input.append(buf, (size_t) n);
+                continue;
+            }
+
+            input.erase(0, requestLength);
+            ++m_numRequests;
+
+            std::string response = m_handler(request);
+            isOpen = response.find("\r\nConnection: close\r\n") == std::string::npos;
+            if (!SendAll(s, response))
+                break;
+        }
+
+        shutdown(s, SHUT_RDWR);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_sockets.size(); ++i)
+        {
+            if (m_sockets[i] == s)
+            {
+                m_sockets.erase(m_sockets.begin() + i);
+                break;
+            }
+        }
+        close(s);
+    }
+
+    static void ParseHeaders(const std::string& data, Request& request)
+    {
+        size_t lineEnd = data.find("\r\n");
+        std::string requestLine = data.substr(0, lineEnd);
+        size_t space1 = requestLine.find(' ');
+        size_t space2 = requestLine.find(' ', space1 + 1);
+        request.method = requestLine.substr(0, space1);
+        request.path = requestLine.substr(space1 + 1, space2 - space1 - 1);
+
+        while (lineEnd != std::string::npos)
+        {
+            size_t start = lineEnd + 2;
+            lineEnd = data.find("\r\n", start);
+            std::string line = data.substr(start, lineEnd == std::string::npos ? std::string::npos : lineEnd - start);
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+                continue;
+
+            std::string name = line.substr(0, colon);
+            for (size_t i = 0; i < name.length(); ++i)
+                name[i] = (char) tolower(name[i]);
+            size_t valueStart = line.find_first_not_of(' ', colon + 1);
+            request.headers[name] = valueStart == std::string::npos ? "" : line.substr(valueStart);
+        }
+    }
+
+    static bool SendAll(int s, const std::string& data)
+    {
+        size_t pos = 0;
+        while (pos < data.length())
+        {
+            ssize_t n = send(s, data.data() + pos, data.length() - pos, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            pos += (size_t) n;
+        }
+        return true;
+    }
+
+private:
+    Handler m_handler;
+    int m_listener;
+    int m_port;
+    std::thread m_acceptThread;
+
+    std::mutex m_mutex;
+    std::vector<int> m_sockets;
+    std::vector<std::thread> m_threads;
+
+    std::atomic<int> m_numConnections;
+    std::atomic<int> m_numRequests;
+};
+
+
+//
+// Returns a complete response with a Content-Length.
+//
+inline std::string MakeResponse(int status, const std::string& body, const std::string& headers = "")
+{
+    return "HTTP/1.1 " + std::to_string(status) + " Status\r\nContent-Length: " + std::to_string(body.length()) + "\r\n" +
+        headers + "\r\n" + body;
+}
+
+
+#endif
@@ -0,0 +1,142 @@
+//
+// Copyright (C) 2013-2014 Vanamco AG
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+
+#ifndef __test_util_h
+#define __test_util_h
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+
+
+//
+// Minimal test harness: a test is a function using CHECK; main runs the tests
+// with RUN_TEST and returns TEST_RESULT (non-zero if a check failed).
+//
+extern int g_numFailures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++g_numFailures; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do { \
+        int numFailures = g_numFailures; \
+        test(); \
+        printf("%s %s\n", g_numFailures == numFailures ? "[ OK ]  " : "[FAIL]  ", #test); \
+    } while (0)
+
+#define TEST_RESULT (g_numFailures == 0 ? 0 : 1)
+
+#define DEFINE_TEST_GLOBALS() int g_numFailures = 0
+
+
+//
+// Counts completions reported from other threads and waits for them.
+//
+class Completion
+{
+public:
+    Completion()
+        : m_numCompleted(0), m_numSucceeded(0)
+    {
+    }
+
+    void Complete(bool success)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_numCompleted;
+        if (success)
+            ++m_numSucceeded;
+        m_cv.notify_all();
+    }
+
+    //
+    // Waits until "count" completions have been reported (or 10 seconds have
+    // passed) and returns the number of successful ones.
+    //
+    int Wait(int count)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait_for(lock, std::chrono::seconds(10), [this, count]() { return m_numCompleted >= count; });
+        return m_numCompleted >= count ? m_numSucceeded : -1;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    int m_numCompleted;
+    int m_numSucceeded;
+};
+
+//
+// Creates a new empty directory for the files of a test.
+//
+inline std::string MakeTempDirectory()
+{
+    char path[] = "/tmp/zephyros-test-XXXXXX";
+    return mkdtemp(path) != NULL ? path : "";
+}
+
+inline void RemoveDirectoryTree(const std::string& path)
+{
+    std::string command = "rm -rf '" + path + "'";
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "couldn't remove %s\n", path.c_str());
+}
+
+inline std::string ReadContents(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+inline void WriteContents(const std::string& path, const std::string& contents)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file << contents;
+}
+
+inline bool Exists(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+
+#endif